@@ -0,0 +1,85 @@
+/*!
+ * @file alloc_guard.h
+ *
+ * @copyright
+ * Copyright &copy; 2026, Scott K Logan
+ *
+ * @copyright
+ * All rights reserved.
+ *
+ * @copyright
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * @copyright
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * @copyright
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * @copyright
+ * EchoLink&reg; is a registered trademark of Synergenics, LLC
+ *
+ * @author Scott K Logan &lt;logans@cottsay.net&gt;
+ *
+ * @brief Internal API for detecting memory allocation on steady state paths
+ */
+
+#ifndef ALLOC_GUARD_H_
+#define ALLOC_GUARD_H_
+
+#ifdef HAVE_ALLOC_GUARD
+/*!
+ * @brief Enables the checks made by ::alloc_guard_enter
+ *
+ * This should be called once the proxy has allocated everything it needs to
+ * serve clients.
+ */
+void alloc_guard_arm(void);
+
+/*!
+ * @brief Disables the checks made by ::alloc_guard_enter
+ */
+void alloc_guard_disarm(void);
+
+/*!
+ * @brief Marks the start of a region in which the calling thread must not
+ *        allocate memory
+ *
+ * While the guard is armed, any call to malloc, calloc or realloc made by the
+ * thread before the matching call to ::alloc_guard_leave aborts the process.
+ * Regions may be nested.
+ */
+void alloc_guard_enter(void);
+
+/*!
+ * @brief Marks the end of a region started by ::alloc_guard_enter
+ */
+void alloc_guard_leave(void);
+#else
+#  define alloc_guard_arm() ((void)0)
+#  define alloc_guard_disarm() ((void)0)
+#  define alloc_guard_enter() ((void)0)
+#  define alloc_guard_leave() ((void)0)
+#endif
+
+#endif /* ALLOC_GUARD_H_ */
@@ -0,0 +1,105 @@
+/*!
+ * @file atomic.h
+ *
+ * @copyright
+ * Copyright &copy; 2026, Scott K Logan
+ *
+ * @copyright
+ * All rights reserved.
+ *
+ * @copyright
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * @copyright
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * @copyright
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * @copyright
+ * EchoLink&reg; is a registered trademark of Synergenics, LLC
+ *
+ * @author Scott K Logan &lt;logans@cottsay.net&gt;
+ *
+ * @brief Internal API for atomic operations on shared counters
+ */
+
+#ifndef ATOMIC_H_
+#define ATOMIC_H_
+
+#include <stdint.h>
+
+/*
+ * Each operation acts on a 32-bit unsigned integer and is sequentially
+ * consistent with respect to the others.
+ */
+#ifdef _MSC_VER
+#  include <intrin.h>
+
+/*! Atomically adds V to the value at P, evaluating to the new value */
+#  define atomic_add_u32(P, V) \
+	((uint32_t)_InterlockedExchangeAdd((volatile long *)(P), (long)(V)) + \
+	 (uint32_t)(V))
+
+/*! Atomically replaces the value at P with D if it is equal to E */
+#  define atomic_cas_u32(P, E, D) \
+	((uint32_t)_InterlockedCompareExchange((volatile long *)(P), (long)(D), \
+					       (long)(E)) == (uint32_t)(E))
+
+/*! Atomically replaces the value at P with V, evaluating to the old value */
+#  define atomic_exchange_u32(P, V) \
+	((uint32_t)_InterlockedExchange((volatile long *)(P), (long)(V)))
+
+/*! Atomically reads the value at P */
+#  define atomic_load_u32(P) \
+	((uint32_t)_InterlockedOr((volatile long *)(P), 0))
+
+/*! Atomically replaces the value at P with V */
+#  define atomic_store_u32(P, V) \
+	((void)_InterlockedExchange((volatile long *)(P), (long)(V)))
+#else
+/*! Atomically adds V to the value at P, evaluating to the new value */
+#  define atomic_add_u32(P, V) \
+	__atomic_add_fetch((P), (uint32_t)(V), __ATOMIC_SEQ_CST)
+
+/*! Atomically replaces the value at P with D if it is equal to E */
+#  define atomic_cas_u32(P, E, D) \
+	__sync_bool_compare_and_swap((P), (uint32_t)(E), (uint32_t)(D))
+
+/*! Atomically replaces the value at P with V, evaluating to the old value */
+#  define atomic_exchange_u32(P, V) \
+	__atomic_exchange_n((P), (uint32_t)(V), __ATOMIC_SEQ_CST)
+
+/*! Atomically reads the value at P */
+#  define atomic_load_u32(P) \
+	__atomic_load_n((P), __ATOMIC_SEQ_CST)
+
+/*! Atomically replaces the value at P with V */
+#  define atomic_store_u32(P, V) \
+	__atomic_store_n((P), (uint32_t)(V), __ATOMIC_SEQ_CST)
+#endif
+
+/*! Atomically subtracts V from the value at P, evaluating to the new value */
+#define atomic_sub_u32(P, V) atomic_add_u32((P), (uint32_t)0 - (uint32_t)(V))
+
+#endif /* ATOMIC_H_ */
@@ -0,0 +1,150 @@
+/*!
+ * @file buff_pool.h
+ *
+ * @copyright
+ * Copyright &copy; 2026, Scott K Logan
+ *
+ * @copyright
+ * All rights reserved.
+ *
+ * @copyright
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * @copyright
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * @copyright
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * @copyright
+ * EchoLink&reg; is a registered trademark of Synergenics, LLC
+ *
+ * @author Scott K Logan &lt;logans@cottsay.net&gt;
+ *
+ * @brief Internal API for a shared pool of reference counted packet buffers
+ */
+
+#ifndef BUFF_POOL_H_
+#define BUFF_POOL_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*!
+ * @brief Represents an instance of a packet buffer pool
+ *
+ * This struct should be initialized to zero before being used. The private data
+ * should be initialized using the ::buff_pool_init function, and subsequently
+ * freed by ::buff_pool_free when the pool is no longer needed.
+ *
+ * Buffers may be borrowed and released by any number of threads concurrently.
+ * Each buffer starts on a cache line boundary and carries a reference count,
+ * so a buffer filled by one thread may be handed to others without copying it.
+ * The pool grows on demand until it reaches buff_pool_handle::max_buffs.
+ */
+struct buff_pool_handle {
+	/*! Private data - used internally by buff_pool functions */
+	void *priv;
+
+	/*! Size of each buffer in bytes */
+	size_t buff_len;
+
+	/*! Number of buffers to allocate when the pool is initialized */
+	uint32_t init_buffs;
+
+	/*! Maximum number of buffers in the pool, or zero for the largest
+	 *  supported number */
+	uint32_t max_buffs;
+};
+
+/*!
+ * @brief Statistics about the buffers in a pool
+ */
+struct buff_pool_stats {
+	/*! Number of buffers which have been allocated */
+	uint32_t size;
+
+	/*! Number of buffers currently borrowed */
+	uint32_t in_use;
+
+	/*! Highest number of buffers which have been borrowed at once */
+	uint32_t in_use_max;
+};
+
+/*!
+ * @brief Takes an unused buffer from the pool
+ *
+ * @param[in,out] bp Target buffer pool instance
+ *
+ * @returns Buffer of buff_pool_handle::buff_len bytes with a single reference,
+ *          or NULL if the pool is exhausted and can't grow
+ */
+uint8_t *buff_pool_borrow(struct buff_pool_handle *bp);
+
+/*!
+ * @brief Frees data allocated by ::buff_pool_init
+ *
+ * @param[in,out] bp Target buffer pool instance
+ *
+ * All buffers borrowed from the pool become invalid.
+ */
+void buff_pool_free(struct buff_pool_handle *bp);
+
+/*!
+ * @brief Gets statistics about the buffers in the pool
+ *
+ * @param[in] bp Target buffer pool instance
+ * @param[out] stats Statistics about the pool
+ */
+void buff_pool_get_stats(struct buff_pool_handle *bp,
+			 struct buff_pool_stats *stats);
+
+/*!
+ * @brief Initializes the private data in a ::buff_pool_handle
+ *
+ * @param[in,out] bp Target buffer pool instance
+ *
+ * @returns 0 on success, negative ERRNO value on failure
+ */
+int buff_pool_init(struct buff_pool_handle *bp);
+
+/*!
+ * @brief Adds a reference to a borrowed buffer
+ *
+ * @param[in,out] buff Buffer returned by ::buff_pool_borrow
+ *
+ * Each reference must be dropped with a call to ::buff_pool_release.
+ */
+void buff_pool_ref(uint8_t *buff);
+
+/*!
+ * @brief Drops a reference to a borrowed buffer
+ *
+ * @param[in,out] bp Buffer pool instance which the buffer was borrowed from
+ * @param[in,out] buff Buffer returned by ::buff_pool_borrow
+ *
+ * When the last reference is dropped, the buffer is returned to the pool.
+ */
+void buff_pool_release(struct buff_pool_handle *bp, uint8_t *buff);
+
+#endif /* BUFF_POOL_H_ */
@@ -64,6 +64,44 @@ enum CONN_TYPE {
 	CONN_TYPE_UDP
 };
 
+/*!
+ * @brief Cache of resolved names which may be shared by several connections
+ *
+ * The private data should be initialized using the ::conn_resolver_init
+ * function, and subsequently freed by ::conn_resolver_free when the cache is
+ * no longer needed. Numeric addresses are never cached, as they are parsed
+ * without calling the system resolver.
+ */
+struct conn_resolver {
+	/*! Private data - used internally by conn functions */
+	void *priv;
+
+	/*! Seconds after which a name is resolved again before it is used, or 0
+	 *  to resolve each name only once */
+	uint32_t ttl;
+};
+
+/*!
+ * @brief Local address resolved ahead of time by ::conn_addr_resolve
+ *
+ * This holds a socket address without depending on the platform's socket
+ * headers, so that it can be stored by callers which don't include them.
+ */
+struct conn_addr {
+	/*! Storage for the socket address - used internally by conn functions */
+	union {
+		/*! Bytes of the socket address */
+		uint8_t bytes[128];
+
+		/*! Aligns the storage for any socket address structure */
+		uint64_t align;
+	} storage;
+
+	/*! Number of bytes of conn_addr::storage in use, or 0 if the address
+	 *  has not been resolved */
+	uint32_t len;
+};
+
 /*!
  * @brief Represents an instance of a network connection
  *
@@ -81,8 +119,91 @@ struct conn_handle {
 	/*! Local socket port to bind to, or NULL for any */
 	const char *source_port;
 
+	/*! Local address to bind to, resolved ahead of time, which is used
+	 *  instead of conn_handle::source_addr if set and resolved. The port is
+	 *  still taken from conn_handle::source_port, which must be numeric. */
+	const struct conn_addr *source;
+
+	/*! Cache used to resolve names, or NULL to resolve them every time */
+	struct conn_resolver *resolver;
+
 	/*! Protocol to use for this connection */
 	enum CONN_TYPE type;
+
+	/*! Non-zero to perform all socket operations without blocking */
+	uint8_t nonblocking;
+#ifdef HAVE_IO_URING
+
+	/*! State of the attached ring, if any - used internally by conn_uring */
+	void *uring;
+#endif
+};
+
+/*!
+ * @brief Describes a datagram for ::conn_recv_many or ::conn_send_many
+ */
+struct conn_datagram {
+	/*! Buffer to copy the received datagram into, or containing the datagram
+	 *  to send */
+	uint8_t *buff;
+
+	/*! Maximum number of bytes to copy into conn_datagram::buff */
+	size_t buff_len;
+
+	/*! Number of bytes in conn_datagram::buff */
+	size_t len;
+
+	/*! Remote address of the sending or listening client */
+	uint32_t addr;
+
+	/*! Remote port on the sending or listening client */
+	uint16_t port;
+};
+
+/*!
+ * @brief Describes a block of data for ::conn_sendv
+ */
+struct conn_iovec {
+	/*! Buffer containing data to be sent */
+	const uint8_t *buff;
+
+	/*! Number of bytes in conn_iovec::buff to send */
+	size_t len;
+};
+
+/*!
+ * @brief Statistics about data sent without copying it, see ::conn_set_zerocopy
+ */
+struct conn_zerocopy_stats {
+	/*! Number of system calls which sent data without copying it */
+	uint32_t sends;
+
+	/*! Number of bytes sent without copying them */
+	uint32_t bytes;
+
+	/*! Number of conn_zerocopy_stats::sends which the kernel has finished
+	 *  with */
+	uint32_t completed;
+
+	/*! Number of conn_zerocopy_stats::completed sends which the kernel
+	 *  copied anyway, such as those to a local address */
+	uint32_t copied;
+};
+
+/*!
+ * @brief Kernel buffer for moving data between connections without copying it
+ *        through user space
+ *
+ * The descriptors should be initialized using the ::conn_pipe_init function,
+ * and subsequently freed by ::conn_pipe_free when the buffer is no longer
+ * needed.
+ */
+struct conn_pipe {
+	/*! Descriptor for reading from the buffer, or -1 if not initialized */
+	int fd_read;
+
+	/*! Descriptor for writing to the buffer, or -1 if not initialized */
+	int fd_write;
 };
 
 /*!
@@ -95,6 +216,20 @@ struct conn_handle {
  */
 int conn_accept(struct conn_handle *conn, struct conn_handle *accepted);
 
+/*!
+ * @brief Resolves a local address once, so that connections which bind to it
+ *        need not parse or resolve it again
+ *
+ * IPv4 addresses are preferred, as ::conn_connect only binds to those.
+ *
+ * @param[out] ca Resolved address, for use as conn_handle::source
+ * @param[in] host Host name or numeric address, or NULL for the wildcard
+ *                 address
+ *
+ * @returns 0 on success, negative ERRNO value on failure
+ */
+int conn_addr_resolve(struct conn_addr *ca, const char *host);
+
 /*!
  * @brief Closes the target connection with the client
  *
@@ -113,6 +248,30 @@ void conn_close(struct conn_handle *conn);
  */
 int conn_connect(struct conn_handle *conn, const char *addr, const char *port);
 
+/*!
+ * @brief Determines the outcome of a non-blocking call to ::conn_connect
+ *
+ * @param[in,out] conn Target network connection instance
+ *
+ * @returns 0 on success, negative ERRNO value on failure
+ *
+ * When conn_handle::nonblocking is set, ::conn_connect may return -EINPROGRESS.
+ * This function should be called once the connection becomes writable to
+ * determine if the connection was successfully established.
+ */
+int conn_connect_finish(struct conn_handle *conn);
+
+/*!
+ * @brief Discards the datagrams already queued on a UDP connection without
+ *        blocking
+ *
+ * @param[in,out] conn Target network connection instance
+ *
+ * @returns Number of datagrams discarded on success, negative ERRNO value on
+ *          failure
+ */
+int conn_drain(struct conn_handle *conn);
+
 /*!
  * @brief Drops any active connections but doesn't close the connection
  *
@@ -127,6 +286,26 @@ void conn_drop(struct conn_handle *conn);
  */
 void conn_free(struct conn_handle *conn);
 
+#ifndef _WIN32
+/*!
+ * @brief Gets the underlying socket descriptor used for TX/RX
+ *
+ * @param[in] conn Target network connection instance
+ *
+ * @returns Socket descriptor, or -1 if the connection is not open
+ */
+int conn_get_fd(struct conn_handle *conn);
+#endif
+
+/*!
+ * @brief Gets statistics about data sent without copying it
+ *
+ * @param[in] conn Target network connection instance
+ * @param[out] stats Statistics about the connection
+ */
+void conn_get_zerocopy_stats(struct conn_handle *conn,
+			     struct conn_zerocopy_stats *stats);
+
 /*!
  * @brief Initializes the private data in a ::conn_handle
  *
@@ -145,6 +324,20 @@ int conn_init(struct conn_handle *conn);
  */
 int conn_in_use(struct conn_handle *conn);
 
+/*!
+ * @brief Ends a blocking receive on a UDP connection without closing it
+ *
+ * An empty datagram is sent to the connection's own address, which ends the
+ * receive with -EPIPE as though the connection was shut down. If nothing is
+ * receiving, the datagram stays queued until it is received or discarded by
+ * ::conn_drain.
+ *
+ * @param[in,out] conn Target network connection instance
+ *
+ * @returns 0 on success, negative ERRNO value on failure
+ */
+int conn_interrupt(struct conn_handle *conn);
+
 /*!
  * @brief Blocking call to listen for incoming connections from clients
  *
@@ -154,6 +347,35 @@ int conn_in_use(struct conn_handle *conn);
  */
 int conn_listen(struct conn_handle *conn);
 
+/*!
+ * @brief Discards data held in a kernel buffer
+ *
+ * @param[in,out] cp Target kernel buffer instance
+ * @param[in] len Number of bytes to discard
+ *
+ * @returns 0 on success, negative ERRNO value on failure
+ */
+int conn_pipe_discard(struct conn_pipe *cp, size_t len);
+
+/*!
+ * @brief Frees the descriptors of a kernel buffer
+ *
+ * @param[in,out] cp Target kernel buffer instance
+ */
+void conn_pipe_free(struct conn_pipe *cp);
+
+/*!
+ * @brief Initializes a kernel buffer for use with ::conn_splice_recv and
+ *        ::conn_splice_send
+ *
+ * @param[out] cp Target kernel buffer instance
+ *
+ * @returns 0 on success, -ENOSYS if the platform does not support moving data
+ *          between connections without copying it, other negative ERRNO value
+ *          on failure
+ */
+int conn_pipe_init(struct conn_pipe *cp);
+
 /*!
  * @brief Convert a port number to an ASCII string
  *
@@ -170,6 +392,11 @@ void conn_port_to_str(uint16_t port, char result[6]);
  * @param[in] buff_len Number of bytes of data to expect
  *
  * @returns 0 on success, negative ERRNO value on failure
+ *
+ * Except on Windows, an interrupted receive is restarted rather than failing
+ * with -EINTR, so a signal does not end the receive. Tearing down an io_uring
+ * instance interrupts every thread which ever submitted to it, and bytes
+ * already read would otherwise be lost.
  */
 int conn_recv(struct conn_handle *conn, uint8_t *buff, size_t buff_len);
 
@@ -187,6 +414,78 @@ int conn_recv(struct conn_handle *conn, uint8_t *buff, size_t buff_len);
 int conn_recv_any(struct conn_handle *conn, uint8_t *buff, size_t buff_len,
 		  uint32_t *addr, uint16_t *port);
 
+/*!
+ * @brief Like ::conn_recv_any, but receives every datagram which is queued
+ *
+ * @param[in] conn Target network connection instance
+ * @param[in,out] dgrams Array of datagram descriptors to populate
+ * @param[in] count Number of entries in dgrams
+ *
+ * @returns Number of datagrams received on success, negative ERRNO value on
+ *          failure
+ *
+ * Blocks until at least one datagram is available, unless the connection is
+ * non-blocking. Any other datagrams which are already queued are received by
+ * the same call, up to count.
+ */
+int conn_recv_many(struct conn_handle *conn, struct conn_datagram *dgrams,
+		   unsigned int count);
+
+/*!
+ * @brief Gets the number of bytes which can be received without blocking
+ *
+ * @param[in] conn Target network connection instance
+ *
+ * @returns Number of bytes queued on success, negative ERRNO value on failure
+ */
+int conn_recv_pending(struct conn_handle *conn);
+
+/*!
+ * @brief Frees data allocated by ::conn_resolver_init
+ *
+ * @param[in,out] cr Target resolved name cache instance
+ */
+void conn_resolver_free(struct conn_resolver *cr);
+
+/*!
+ * @brief Initializes the private data in a ::conn_resolver
+ *
+ * @param[in,out] cr Target resolved name cache instance
+ *
+ * @returns 0 on success, negative ERRNO value on failure
+ */
+int conn_resolver_init(struct conn_resolver *cr);
+
+/*!
+ * @brief Resolves a name ahead of its first use by a connection
+ *
+ * @param[in,out] cr Target resolved name cache instance
+ * @param[in] host Host name or numeric address, or NULL for the wildcard
+ *                 address
+ * @param[in] local Non-zero if the name is a local address to bind to, as
+ *                  with conn_handle::source_addr
+ *
+ * @returns 0 on success, negative ERRNO value on failure
+ */
+int conn_resolver_prefetch(struct conn_resolver *cr, const char *host,
+			   uint8_t local);
+
+/*!
+ * @brief Resolves every cached name which is at least half way to its
+ *        conn_resolver::ttl again
+ *
+ * The cache can be used by connections while this is in progress, and a name
+ * which fails to resolve keeps its last addresses. Calling this function
+ * periodically from a background thread keeps names from expiring, so that
+ * connections don't wait for the system resolver.
+ *
+ * @param[in,out] cr Target resolved name cache instance
+ *
+ * @returns Number of names resolved again on success, negative ERRNO value on
+ *          failure
+ */
+int conn_resolver_refresh(struct conn_resolver *cr);
+
 /*!
  * @brief Send data to the connected client
  *
@@ -198,6 +497,35 @@ int conn_recv_any(struct conn_handle *conn, uint8_t *buff, size_t buff_len,
  */
 int conn_send(struct conn_handle *conn, const uint8_t *buff, size_t buff_len);
 
+/*!
+ * @brief Like ::conn_send, but sends only as much data as possible at once
+ *
+ * @param[in] conn Target network connection instance
+ * @param[in] buff Buffer containing data to be sent
+ * @param[in] buff_len Maximum number of bytes in buff to send
+ *
+ * @returns Number of bytes sent on success, negative ERRNO value on failure
+ */
+int conn_send_any(struct conn_handle *conn, const uint8_t *buff,
+		  size_t buff_len);
+
+/*!
+ * @brief Like ::conn_send_to, but sends several datagrams at once
+ *
+ * @param[in] conn Target network connection instance
+ * @param[in] dgrams Array of datagrams to send, using conn_datagram::len bytes
+ *                   of each conn_datagram::buff
+ * @param[in] count Number of entries in dgrams
+ *
+ * @returns Number of datagrams sent on success, negative ERRNO value if the
+ *          first datagram could not be sent
+ *
+ * If a datagram other than the first cannot be sent, the datagrams before it
+ * are reported as sent and the error is returned when sending it again.
+ */
+int conn_send_many(struct conn_handle *conn,
+		   const struct conn_datagram *dgrams, unsigned int count);
+
 /*!
  * @brief Like ::conn_send, but to a specified, unconnected client
  *
@@ -212,6 +540,22 @@ int conn_send(struct conn_handle *conn, const uint8_t *buff, size_t buff_len);
 int conn_send_to(struct conn_handle *conn, const uint8_t *buff,
 		 size_t buff_len, uint32_t addr, uint16_t port);
 
+/*!
+ * @brief Like ::conn_send, but gathers the data from several buffers
+ *
+ * @param[in] conn Target network connection instance
+ * @param[in] iov Array of buffers containing data to be sent, in order
+ * @param[in] count Number of entries in iov
+ *
+ * @returns 0 on success, negative ERRNO value on failure
+ *
+ * If the buffers are sent without copying them (see ::conn_set_zerocopy), they
+ * must not be modified or freed until ::conn_zerocopy_reap reports that no
+ * sends are pending.
+ */
+int conn_sendv(struct conn_handle *conn, const struct conn_iovec *iov,
+	       unsigned int count);
+
 /*!
  * @brief Set the receive timeout for a connection
  *
@@ -226,6 +570,23 @@ int conn_send_to(struct conn_handle *conn, const uint8_t *buff,
  */
 int conn_set_timeout(struct conn_handle *conn, uint32_t msec);
 
+/*!
+ * @brief Sends large blocks of data for a connected client without copying them
+ *
+ * @param[in,out] conn Target network connection instance
+ * @param[in] min_len Minimum number of bytes in a single call to ::conn_sendv
+ *                    for it to be sent without copying, or 0 to always copy
+ *
+ * @returns 0 on success, -ENOSYS if the platform does not support sending data
+ *          without copying it, other negative ERRNO value on failure
+ *
+ * This setting is cleared when a new connection is accepted. Only a single
+ * thread should send data on the connection while it is enabled, and that
+ * thread must call ::conn_zerocopy_reap to learn when the buffers it sent may
+ * be reused.
+ */
+int conn_set_zerocopy(struct conn_handle *conn, size_t min_len);
+
 /*!
  * @brief Stops socket operations but does not close the socket
  *
@@ -233,6 +594,52 @@ int conn_set_timeout(struct conn_handle *conn, uint32_t msec);
  */
 void conn_shutdown(struct conn_handle *conn);
 
+/*!
+ * @brief Like ::conn_recv_any, but receives the data into a kernel buffer
+ *
+ * @param[in] conn Target network connection instance
+ * @param[in,out] cp Kernel buffer to append the received data to
+ * @param[in] len Maximum number of bytes to receive
+ *
+ * @returns Number of bytes received on success, negative ERRNO value on failure
+ */
+int conn_splice_recv(struct conn_handle *conn, struct conn_pipe *cp,
+		     size_t len);
+
+/*!
+ * @brief Like ::conn_sendv, but follows the buffers with data from a kernel
+ *        buffer
+ *
+ * @param[in] conn Target network connection instance
+ * @param[in] iov Array of buffers containing data to be sent first, in order
+ * @param[in] count Number of entries in iov
+ * @param[in,out] cp Kernel buffer to take the remaining data from
+ * @param[in] len Number of bytes to send from cp
+ *
+ * @returns 0 on success, negative ERRNO value on failure
+ *
+ * The len bytes are removed from cp even if they could not be sent, so that
+ * data received after them remains in order.
+ */
+int conn_splice_send(struct conn_handle *conn, const struct conn_iovec *iov,
+		     unsigned int count, struct conn_pipe *cp, size_t len);
+
+/*!
+ * @brief Collects notifications that the kernel has finished with data sent
+ *        without copying it
+ *
+ * @param[in,out] conn Target network connection instance
+ * @param[in] msec Maximum duration to wait for a notification if any sends are
+ *                 pending, or 0 to return immediately
+ *
+ * @returns Number of sends which are still pending on success, negative ERRNO
+ *          value on failure
+ *
+ * Once this function fails, the connection is no longer usable, so the pending
+ * buffers may be reused.
+ */
+int conn_zerocopy_reap(struct conn_handle *conn, uint32_t msec);
+
 /*!
  * @brief Prints the remote address for the connection to the given ASCII string
  *
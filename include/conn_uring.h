@@ -0,0 +1,208 @@
+/*!
+ * @file conn_uring.h
+ *
+ * @copyright
+ * Copyright &copy; 2026, Scott K Logan
+ *
+ * @copyright
+ * All rights reserved.
+ *
+ * @copyright
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * @copyright
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * @copyright
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * @copyright
+ * EchoLink&reg; is a registered trademark of Synergenics, LLC
+ *
+ * @author Scott K Logan &lt;logans@cottsay.net&gt;
+ *
+ * @brief Completion-based network connection I/O using io_uring
+ */
+
+#ifndef CONN_URING_H_
+#define CONN_URING_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "conn.h"
+
+/*!
+ * @brief Represents an io_uring instance shared by several connections
+ *
+ * This struct should be initialized to zero before being used. The private data
+ * should be initialized using the ::conn_uring_init function, and subsequently
+ * freed by ::conn_uring_free when the ring is no longer needed.
+ *
+ * Once a connection is attached to a ring, ::conn_recv_any (for UDP
+ * connections) and ::conn_send_any (for TCP connections) no longer perform a
+ * system call. Datagrams are received into buffers registered with the ring by
+ * a multishot receive operation, and data sent on a stream is staged and
+ * submitted as linked send operations. All functions which operate on a ring or
+ * on an attached connection must be called from the same thread.
+ */
+struct conn_uring_handle {
+	/*! Private data - used internally by conn_uring functions */
+	void *priv;
+};
+
+/*!
+ * @brief Begins performing I/O on a connection using the given ring
+ *
+ * @param[in,out] cu Target ring instance
+ * @param[in,out] conn Open network connection instance to attach
+ *
+ * @returns 0 on success, negative ERRNO value on failure
+ *
+ * No operations are submitted to the kernel until the next call to
+ * ::conn_uring_submit.
+ */
+int conn_uring_attach(struct conn_uring_handle *cu, struct conn_handle *conn);
+
+/*!
+ * @brief Stops performing I/O on a connection using a ring
+ *
+ * @param[in,out] conn Network connection instance previously attached by
+ *                     ::conn_uring_attach
+ *
+ * Any data which was received but not yet retrieved, or staged but not yet
+ * sent, is discarded. This function must be called before the connection is
+ * closed.
+ */
+void conn_uring_detach(struct conn_handle *conn);
+
+/*!
+ * @brief Frees data allocated by ::conn_uring_init
+ *
+ * @param[in,out] cu Target ring instance
+ */
+void conn_uring_free(struct conn_uring_handle *cu);
+
+/*!
+ * @brief Gets a file descriptor which is readable when completions are pending
+ *
+ * @param[in] cu Target ring instance
+ *
+ * @returns File descriptor of the ring
+ */
+int conn_uring_get_fd(const struct conn_uring_handle *cu);
+
+/*!
+ * @brief Initializes the private data in a ::conn_uring_handle
+ *
+ * @param[in,out] cu Target ring instance
+ *
+ * @returns 0 on success, negative ERRNO value on failure
+ *
+ * This function fails with -ENOSYS or -EINVAL if the running kernel lacks the
+ * necessary io_uring features.
+ */
+int conn_uring_init(struct conn_uring_handle *cu);
+
+/*!
+ * @brief Determines if data or an error can be retrieved from a connection
+ *
+ * @param[in] conn Network connection instance attached to a ring
+ *
+ * @returns Non-zero if ::conn_recv_any would not return -EAGAIN, zero otherwise
+ */
+int conn_uring_readable(const struct conn_handle *conn);
+
+/*!
+ * @brief Processes the completed operations without blocking
+ *
+ * @param[in,out] cu Target ring instance
+ */
+void conn_uring_reap(struct conn_uring_handle *cu);
+
+/*!
+ * @brief Retrieves a datagram received by an attached UDP connection
+ *
+ * @param[in,out] conn Network connection instance attached to a ring
+ * @param[out] buff Buffer to store the received datagram in
+ * @param[in] buff_len Maximum number of bytes to store in buff
+ * @param[out] addr Remote IPv4 address which sent the datagram, or NULL
+ * @param[out] port Remote port which sent the datagram, or NULL
+ *
+ * @returns Number of bytes stored in buff, -EAGAIN if no datagrams are pending,
+ *          or other negative ERRNO value on failure
+ */
+int conn_uring_recv(struct conn_handle *conn, uint8_t *buff, size_t buff_len,
+		    uint32_t *addr, uint16_t *port);
+
+/*!
+ * @brief Allocates state for connections which are attached later
+ *
+ * Once anything has been reserved, ::conn_uring_attach no longer allocates.
+ * It reuses the reserved state instead, and fails with -ENOMEM once all of it
+ * is in use.
+ *
+ * @param[in,out] cu Target ring instance
+ * @param[in] type Protocol of the connections
+ * @param[in] count Number of connections to reserve state for
+ *
+ * @returns 0 on success, negative ERRNO value on failure
+ */
+int conn_uring_reserve(struct conn_uring_handle *cu, enum CONN_TYPE type,
+		       unsigned int count);
+
+/*!
+ * @brief Stages data to be sent by an attached TCP connection
+ *
+ * @param[in,out] conn Network connection instance attached to a ring
+ * @param[in] buff Data to send
+ * @param[in] buff_len Number of bytes in buff
+ *
+ * @returns Number of bytes staged, -EAGAIN if no space is available, or other
+ *          negative ERRNO value if a previous send failed
+ */
+int conn_uring_send(struct conn_handle *conn, const uint8_t *buff,
+		    size_t buff_len);
+
+/*!
+ * @brief Submits operations queued since the last call to the kernel
+ *
+ * @param[in,out] cu Target ring instance
+ *
+ * @returns 0 on success, negative ERRNO value on failure
+ *
+ * At most one system call is made, regardless of the number of attached
+ * connections with pending operations.
+ */
+int conn_uring_submit(struct conn_uring_handle *cu);
+
+/*!
+ * @brief Determines if data can be staged on a connection
+ *
+ * @param[in] conn Network connection instance attached to a ring
+ *
+ * @returns Non-zero if ::conn_send_any would not return -EAGAIN, zero otherwise
+ */
+int conn_uring_writable(const struct conn_handle *conn);
+
+#endif /* CONN_URING_H_ */
@@ -0,0 +1,216 @@
+/*!
+ * @file event.h
+ *
+ * @copyright
+ * Copyright &copy; 2026, Scott K Logan
+ *
+ * @copyright
+ * All rights reserved.
+ *
+ * @copyright
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * @copyright
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * @copyright
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * @copyright
+ * EchoLink&reg; is a registered trademark of Synergenics, LLC
+ *
+ * @author Scott K Logan &lt;logans@cottsay.net&gt;
+ *
+ * @brief Internal API for network event notification
+ */
+
+#ifndef EVENT_H_
+#define EVENT_H_
+
+#include <stdint.h>
+
+#include "conn.h"
+
+/*!
+ * @brief Readiness conditions which can be monitored on a connection
+ */
+enum EVENT_FLAG {
+	/*! Data is available to be received */
+	EVENT_FLAG_IN = 0x1,
+
+	/*! Data can be sent without blocking */
+	EVENT_FLAG_OUT = 0x2,
+
+	/*! The connection has encountered an error or has been shut down */
+	EVENT_FLAG_ERR = 0x4
+};
+
+/*!
+ * @brief Represents an instance of an event loop
+ *
+ * This struct should be initialized to zero before being used. The private data
+ * should be initialized using the ::event_init function, and subsequently
+ * freed by ::event_free when the event loop is no longer needed.
+ */
+struct event_handle {
+	/*! Private data - used internally by event functions */
+	void *priv;
+};
+
+/*!
+ * @brief Represents a connection which is monitored by an event loop
+ *
+ * The memory backing this struct must remain valid for as long as the event
+ * loop which it was added to is processing events, even after it has been
+ * removed using ::event_remove.
+ */
+struct event_source {
+	/*! Pointer to the function called when the connection is ready */
+	void (*func_ptr)(struct event_source *es, uint32_t flags);
+
+	/*! Context to pass to event_source::func_ptr */
+	void *func_ctx;
+
+	/*! Connection to monitor */
+	struct conn_handle *conn;
+
+	/*! Non-zero to receive datagrams (UDP) or send data (TCP) on
+	 *  event_source::conn through the event loop's io_uring instance, where
+	 *  supported */
+	uint8_t offload;
+
+	/*! Currently monitored ::EVENT_FLAG values - used internally */
+	uint32_t flags;
+#ifdef HAVE_IO_URING
+
+	/*! Non-zero if I/O is being offloaded - used internally */
+	uint8_t offloaded;
+
+	/*! Next source in the list of offloaded sources - used internally */
+	struct event_source *next;
+#endif
+};
+
+/*!
+ * @brief Begins monitoring a connection for the given conditions
+ *
+ * @param[in,out] eh Target event loop instance
+ * @param[in,out] es Source connection to monitor
+ * @param[in] flags Bitwise combination of ::EVENT_FLAG values to monitor
+ *
+ * @returns 0 on success, negative ERRNO value on failure
+ *
+ * Note that ::EVENT_FLAG_ERR is always monitored, and the connection must
+ * already be open when this function is called.
+ *
+ * When event_source::offload is set and the event loop supports it, the
+ * readiness of the offloaded direction is reported from the completion ring
+ * rather than the socket. An offloaded connection may only be used from the
+ * thread which calls ::event_process until it is removed.
+ */
+int event_add(struct event_handle *eh, struct event_source *es,
+	      uint32_t flags);
+
+/*!
+ * @brief Frees data allocated by ::event_init
+ *
+ * @param[in,out] eh Target event loop instance
+ */
+void event_free(struct event_handle *eh);
+
+/*!
+ * @brief Initializes the private data in an ::event_handle
+ *
+ * @param[in,out] eh Target event loop instance
+ *
+ * @returns 0 on success, negative ERRNO value on failure
+ */
+int event_init(struct event_handle *eh);
+
+/*!
+ * @brief Changes the conditions monitored on a connection
+ *
+ * @param[in,out] eh Target event loop instance
+ * @param[in,out] es Source connection previously added by ::event_add
+ * @param[in] flags Bitwise combination of ::EVENT_FLAG values to monitor
+ *
+ * @returns 0 on success, negative ERRNO value on failure
+ */
+int event_modify(struct event_handle *eh, struct event_source *es,
+		 uint32_t flags);
+
+/*!
+ * @brief Blocks until events are available and dispatches them
+ *
+ * @param[in,out] eh Target event loop instance
+ * @param[in] msec Maximum number of milliseconds to wait, or 0 to wait forever
+ *
+ * @returns 0 on success, -EINTR if interrupted by ::event_wake, negative ERRNO
+ *          value on failure
+ *
+ * Each ready ::event_source has its event_source::func_ptr called from the
+ * calling thread before this function returns. Sources which are removed while
+ * events are being dispatched will not be called.
+ */
+int event_process(struct event_handle *eh, uint32_t msec);
+
+/*!
+ * @brief Stops monitoring a connection
+ *
+ * @param[in,out] eh Target event loop instance
+ * @param[in,out] es Source connection previously added by ::event_add
+ *
+ * This function must be called before the connection is closed.
+ */
+void event_remove(struct event_handle *eh, struct event_source *es);
+
+/*!
+ * @brief Allocates offload state for connections which are added later
+ *
+ * @param[in,out] eh Target event loop instance
+ * @param[in] type Protocol of the connections
+ * @param[in] count Number of connections to reserve state for
+ *
+ * @returns 0 on success, negative ERRNO value on failure
+ *
+ * Once anything has been reserved, offloading a connection no longer
+ * allocates. Connections which can't be offloaded because the reserved state
+ * is in use are monitored without being offloaded instead. This function must
+ * not be called while ::event_process is running.
+ */
+int event_reserve(struct event_handle *eh, enum CONN_TYPE type,
+		  unsigned int count);
+
+/*!
+ * @brief Interrupts a call to ::event_process
+ *
+ * @param[in,out] eh Target event loop instance
+ *
+ * @returns 0 on success, negative ERRNO value on failure
+ *
+ * If no call to ::event_process is currently blocked, the next call will
+ * return immediately. This function is safe to call from any thread.
+ */
+int event_wake(struct event_handle *eh);
+
+#endif /* EVENT_H_ */
@@ -0,0 +1,216 @@
+/*!
+ * @file msg_queue.h
+ *
+ * @copyright
+ * Copyright &copy; 2026, Scott K Logan
+ *
+ * @copyright
+ * All rights reserved.
+ *
+ * @copyright
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * @copyright
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * @copyright
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * @copyright
+ * EchoLink&reg; is a registered trademark of Synergenics, LLC
+ *
+ * @author Scott K Logan &lt;logans@cottsay.net&gt;
+ *
+ * @brief Internal API for bounded multi-producer message queues
+ */
+
+#ifndef MSG_QUEUE_H_
+#define MSG_QUEUE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "buff_pool.h"
+#include "conn.h"
+
+/*!
+ * @brief Represents an instance of a message queue
+ *
+ * This struct should be initialized to zero before being used. The private data
+ * should be initialized using the ::msg_queue_init function, and subsequently
+ * freed by ::msg_queue_free when the queue is no longer needed.
+ *
+ * Any number of threads may add messages to the queue concurrently without
+ * locking, but only a single thread may consume them.
+ *
+ * Each queued message occupies a buffer borrowed from msg_queue_handle::pool,
+ * so the memory used by the queue is proportional to the number of messages in
+ * it rather than to its capacity.
+ */
+struct msg_queue_handle {
+	/*! Private data - used internally by msg_queue functions */
+	void *priv;
+
+	/*! Maximum number of messages which can be queued, a power of two */
+	uint32_t capacity;
+
+	/*! Maximum size of a single message in bytes, which must not exceed
+	 *  buff_pool_handle::buff_len */
+	size_t msg_len;
+
+	/*! Pool which message buffers are borrowed from */
+	struct buff_pool_handle *pool;
+};
+
+/*!
+ * @brief Statistics about the contents of a message queue
+ */
+struct msg_queue_stats {
+	/*! Number of messages currently queued */
+	uint32_t depth;
+
+	/*! Highest number of messages which have been queued at once */
+	uint32_t depth_max;
+
+	/*! Number of bytes currently queued */
+	uint32_t bytes;
+
+	/*! Highest number of bytes which have been queued at once */
+	uint32_t bytes_max;
+};
+
+/*!
+ * @brief Frees data allocated by ::msg_queue_init
+ *
+ * @param[in,out] mq Target message queue instance
+ */
+void msg_queue_free(struct msg_queue_handle *mq);
+
+/*!
+ * @brief Gets statistics about the contents of the queue
+ *
+ * @param[in] mq Target message queue instance
+ * @param[out] stats Statistics about the queue
+ */
+void msg_queue_get_stats(struct msg_queue_handle *mq,
+			 struct msg_queue_stats *stats);
+
+/*!
+ * @brief Initializes the private data in a ::msg_queue_handle
+ *
+ * @param[in,out] mq Target message queue instance
+ *
+ * @returns 0 on success, negative ERRNO value on failure
+ */
+int msg_queue_init(struct msg_queue_handle *mq);
+
+/*!
+ * @brief Gets the oldest messages in the queue without removing them
+ *
+ * @param[in] mq Target message queue instance
+ * @param[in] skip Number of the oldest messages to pass over
+ * @param[out] iov Array to store the location of each message in
+ * @param[in] count Maximum number of messages to get
+ *
+ * @returns Number of messages stored in iov
+ *
+ * The messages remain valid until they are removed using ::msg_queue_pop. This
+ * function may only be called by the consuming thread.
+ */
+unsigned int msg_queue_peek(struct msg_queue_handle *mq, unsigned int skip,
+			    struct conn_iovec *iov, unsigned int count);
+
+/*!
+ * @brief Removes the oldest messages from the queue
+ *
+ * @param[in,out] mq Target message queue instance
+ * @param[in] count Number of messages to remove, as returned by
+ *                  ::msg_queue_peek
+ *
+ * This function may only be called by the consuming thread.
+ */
+void msg_queue_pop(struct msg_queue_handle *mq, unsigned int count);
+
+/*!
+ * @brief Adds a message to the queue, gathering it from several buffers
+ *
+ * @param[in,out] mq Target message queue instance
+ * @param[in] iov Array of buffers containing the message, in order
+ * @param[in] count Number of entries in iov
+ *
+ * @returns 0 on success, -ENOSPC if the queue is full, -EMSGSIZE if the message
+ *          is larger than msg_queue_handle::msg_len, -ENOMEM if no buffer
+ *          could be borrowed from msg_queue_handle::pool
+ */
+int msg_queue_push(struct msg_queue_handle *mq, const struct conn_iovec *iov,
+		   unsigned int count);
+
+/*!
+ * @brief Adds a message to the queue without copying it
+ *
+ * @param[in,out] mq Target message queue instance
+ * @param[in,out] buff Buffer borrowed from msg_queue_handle::pool which holds
+ *                     the message at its start
+ * @param[in] len Number of bytes in the message
+ *
+ * @returns 0 on success, -ENOSPC if the queue is full, -EMSGSIZE if the message
+ *          is larger than msg_queue_handle::msg_len
+ *
+ * The queue adds its own reference to the buffer, so the caller must still
+ * release its reference.
+ */
+int msg_queue_push_buff(struct msg_queue_handle *mq, uint8_t *buff,
+			size_t len);
+
+/*!
+ * @brief Replaces the oldest message in the queue with a new message
+ *
+ * @param[in,out] mq Target message queue instance
+ * @param[in] skip Number of the oldest messages which must be kept
+ * @param[in,out] buff Buffer borrowed from msg_queue_handle::pool which holds
+ *                     the new message at its start
+ * @param[in] len Number of bytes in the new message
+ *
+ * @returns Number of bytes in the discarded message on success, -ENOSPC if
+ *          there is no message to discard, -EMSGSIZE if the message is larger
+ *          than msg_queue_handle::msg_len
+ *
+ * The oldest message after the first skip is discarded, the messages after it
+ * move up by one, and the new message takes the last place, so it is added
+ * even when the queue is full. As with ::msg_queue_push_buff, the queue adds
+ * its own reference to the buffer.
+ *
+ * Only one thread may replace messages at a time, and the consuming thread
+ * must not peek at or remove the messages after the first skip meanwhile.
+ */
+int msg_queue_replace(struct msg_queue_handle *mq, unsigned int skip,
+		      uint8_t *buff, size_t len);
+
+/*!
+ * @brief Resets the high-water marks to the current contents of the queue
+ *
+ * @param[in,out] mq Target message queue instance
+ */
+void msg_queue_reset_stats(struct msg_queue_handle *mq);
+
+#endif /* MSG_QUEUE_H_ */
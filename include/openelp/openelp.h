@@ -110,6 +110,34 @@ enum LOG_MEDIUM {
 	LOG_MEDIUM_EVENTLOG
 };
 
+/*!
+ * @brief Policies for UDP data which arrives faster than a client receives it
+ */
+enum PROXY_DATA_OVERFLOW {
+	/*! Stop receiving UDP data until there is room for it */
+	PROXY_DATA_OVERFLOW_BLOCK = 0,
+
+	/*! Discard UDP data as it arrives until there is room for it */
+	PROXY_DATA_OVERFLOW_DROP_NEWEST,
+
+	/*! Discard the UDP data which has been waiting the longest */
+	PROXY_DATA_OVERFLOW_DROP_OLDEST
+};
+
+/*!
+ * @brief Models used to process client connections
+ */
+enum PROXY_EVENT_LOOP {
+	/*! Process each client using a set of dedicated threads */
+	PROXY_EVENT_LOOP_OFF = 0,
+
+	/*! Process all clients using a single event loop */
+	PROXY_EVENT_LOOP_SINGLE,
+
+	/*! Process clients using one event loop thread per CPU */
+	PROXY_EVENT_LOOP_SHARDED
+};
+
 /*!
  * @brief Configuration instance for a ::proxy_handle
  *
@@ -153,6 +181,39 @@ struct proxy_conf {
 
 	/*! Port on which to listen for client connections */
 	uint16_t port;
+
+	/*! Model used to process client connections */
+	enum PROXY_EVENT_LOOP event_loop;
+
+	/*! Number of threads used by ::PROXY_EVENT_LOOP_SHARDED, or 0 to use one
+	 *  per online CPU */
+	uint32_t event_loop_threads;
+
+	/*! Handling of UDP data which would exceed proxy_conf::data_queue_budget */
+	enum PROXY_DATA_OVERFLOW data_overflow;
+
+	/*! Number of bytes which may be waiting to be sent to a client when UDP
+	 *  data is queued for it, or 0 for no limit */
+	uint32_t data_queue_budget;
+
+	/*! Minimum number of bytes written to a client at once for them to be
+	 *  sent without copying, or 0 to always copy */
+	uint32_t zerocopy_threshold;
+
+	/*! Stack size of each thread in KiB, or 0 to use the system default */
+	uint32_t thread_stack_size;
+
+	/*! Seconds a thread serving a slot may stay idle before it exits, or 0
+	 *  to keep it until the proxy is closed */
+	uint32_t thread_idle_timeout;
+
+	/*! Seconds to hold back a registration update after the last one, so
+	 *  that changes made in the meantime are sent together */
+	uint32_t reg_interval;
+
+	/*! Non-zero to bind each slot's UDP ports once when the proxy is opened
+	 *  instead of each time a client connects */
+	uint8_t persistent_udp;
 };
 
 /*!
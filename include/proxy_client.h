@@ -133,4 +133,17 @@ int proxy_client_recv(struct proxy_client_handle *ch, struct proxy_msg *msg,
 int proxy_client_send(struct proxy_client_handle *ch,
 		      const struct proxy_msg *msg, const uint8_t *buff);
 
+/*!
+ * @brief Set the receive timeout for the connection to the proxy server
+ *
+ * @param[in] ch Target client connection instance
+ * @param[in] msec Duration to wait before returning from ::proxy_client_recv,
+ *                 or 0 to wait indefinitely
+ *
+ * @returns 0 on success, negative ERRNO value on failure
+ *
+ * This must be called after ::proxy_client_connect.
+ */
+int proxy_client_set_timeout(struct proxy_client_handle *ch, uint32_t msec);
+
 #endif /* PROXY_CLIENT_H_ */
@@ -47,7 +47,26 @@
 #ifndef PROXY_CONN_H_
 #define PROXY_CONN_H_
 
+#include "buff_pool.h"
 #include "conn.h"
+#include "event.h"
+
+/*!
+ * @brief Size of the buffers in proxy_conn_handle::pool
+ *
+ * This is the largest message which is exchanged with a client, including its
+ * header.
+ */
+#define PROXY_CONN_BUFF_LEN 4096
+
+/*!
+ * @brief Number of buffers in proxy_conn_handle::pool to allocate per slot
+ *
+ * The pool never grows once the proxy is running. This covers a slot with both
+ * of its message queues full while datagrams are also being received and
+ * batched. Datagrams which arrive while every buffer is in use are discarded.
+ */
+#define PROXY_CONN_POOL_BUFFS 160
 
 /*!
  * @brief Represents an instance of a proxy client connection
@@ -72,10 +91,27 @@ struct proxy_conn_handle {
 	/*! Null-terminated struing containing the port number for data packets */
 	const char *data_port;
 
+	/*! Event loop which services this connection, or NULL to use threads */
+	struct event_handle *event;
+
+	/*! Pool of packet buffers shared with the other connections */
+	struct buff_pool_handle *pool;
+
+	/*! proxy_conn_handle::source_addr, resolved once when the proxy is
+	 *  opened */
+	struct conn_addr source;
+
+	/*! Function called by the event loop once the client has disconnected */
+	void (*finish_func)(struct proxy_conn_handle *pc);
+
+	/*! Context for use by proxy_conn_handle::finish_func */
+	void *finish_ctx;
+
 	/*! The next ::proxy_conn_handle in the linked list */
 	struct proxy_conn_handle *next;
 
-	/*! The pointer to this ::proxy_conn_handle in the linked list */
+	/*! The pointer to this ::proxy_conn_handle in the linked list, or NULL
+	 *  while it isn't in the list */
 	struct proxy_conn_handle **prev_ptr;
 
 	/*! The next ::proxy_conn_handle in the linked list by callsign*/
@@ -83,6 +119,58 @@ struct proxy_conn_handle {
 
 	/*! The pointer to this ::proxy_conn_handle in the linked list by callsign */
 	struct proxy_conn_handle **prev_by_call_ptr;
+
+	/*! Callsign of the last client to use this ::proxy_conn_handle, which
+	 *  keys the linked list by callsign */
+	char callsign[12];
+};
+
+/*!
+ * @brief Statistics about the messages waiting to be sent to a client
+ *
+ * UDP data messages are queued separately from, and sent after, all other
+ * messages.
+ */
+struct proxy_conn_stats {
+	/*! Number of other messages currently queued, or zero when using an event
+	 *  loop */
+	uint32_t queue_depth;
+
+	/*! Highest value of proxy_conn_stats::queue_depth during this session */
+	uint32_t queue_depth_max;
+
+	/*! Number of bytes of other messages currently queued */
+	uint32_t queue_bytes;
+
+	/*! Highest value of proxy_conn_stats::queue_bytes during this session */
+	uint32_t queue_bytes_max;
+
+	/*! Number of UDP data messages currently queued */
+	uint32_t data_depth;
+
+	/*! Highest value of proxy_conn_stats::data_depth during this session */
+	uint32_t data_depth_max;
+
+	/*! Number of bytes of UDP data messages currently queued */
+	uint32_t data_bytes;
+
+	/*! Highest value of proxy_conn_stats::data_bytes during this session */
+	uint32_t data_bytes_max;
+
+	/*! Number of UDP data messages discarded during this session */
+	uint32_t data_dropped;
+
+	/*! Number of writes to the client during this session which were sent
+	 *  without copying */
+	uint32_t zerocopy_sends;
+
+	/*! Number of bytes sent to the client during this session without
+	 *  copying */
+	uint32_t zerocopy_bytes;
+
+	/*! Number of proxy_conn_stats::zerocopy_sends which the kernel copied
+	 *  anyway */
+	uint32_t zerocopy_copied;
 };
 
 /*!
@@ -125,6 +213,18 @@ void proxy_conn_finish(struct proxy_conn_handle *pc);
  */
 void proxy_conn_free(struct proxy_conn_handle *pc);
 
+/*!
+ * @brief Gets statistics about the messages waiting to be sent to the client
+ *
+ * @param[in] pc Target proxy client connection instance
+ * @param[out] stats Statistics about the outbound queue
+ *
+ * When proxy_conn_handle::event is set, this function must be called from the
+ * event loop.
+ */
+void proxy_conn_get_stats(struct proxy_conn_handle *pc,
+			  struct proxy_conn_stats *stats);
+
 /*!
  * @brief Initializes the private data in a ::proxy_conn_handle
  *
@@ -149,6 +249,10 @@ int proxy_conn_in_use(struct proxy_conn_handle *pc);
  * @param[in,out] pc Target proxy client connection instance
  *
  * @returns 0 on success, negative ERRNO value on failure
+ *
+ * This function is not used when proxy_conn_handle::event is set, in which
+ * case messages are processed by the event loop and
+ * proxy_conn_handle::finish_func is called when the client disconnects.
  */
 int proxy_conn_process(struct proxy_conn_handle *pc);
 
@@ -60,6 +60,32 @@
 struct registration_service_handle {
 	/*! Private data - used internally by registration_service functions */
 	void *priv;
+
+	/*! Host name or address of the registrar, or NULL for the official
+	 *  EchoLink registrar */
+	const char *host;
+
+	/*! Port number of the registrar, or NULL for port 80 */
+	const char *port;
+
+	/*! Milliseconds between reports when nothing has changed, or 0 for
+	 *  every 10 minutes */
+	uint32_t heartbeat;
+};
+
+/*!
+ * @brief Statistics about the reports sent by a registration service
+ */
+struct registration_service_stats {
+	/*! Number of reports delivered to the registrar */
+	uint32_t sent;
+
+	/*! Number of updates which were merged into another report or changed
+	 *  nothing, and so were not reported on their own */
+	uint32_t suppressed;
+
+	/*! Number of reports which could not be delivered */
+	uint32_t failed;
 };
 
 /*!
@@ -69,6 +95,15 @@ struct registration_service_handle {
  */
 void registration_service_free(struct registration_service_handle *rs);
 
+/*!
+ * @brief Gets statistics about the reports sent so far
+ *
+ * @param[in] rs Target registration service instance
+ * @param[out] stats Statistics to populate
+ */
+void registration_service_get_stats(struct registration_service_handle *rs,
+				    struct registration_service_stats *stats);
+
 /*!
  * @brief Initializes the private data in a ::registration_service_handle
  *
@@ -104,6 +139,10 @@ int registration_service_stop(struct registration_service_handle *rs);
  * @param[in,out] rs Target registration service instance
  * @param[in] slots_used Number of proxy slots currently in use
  * @param[in] slots_total Total number of configured proxy slots
+ *
+ * Updates which change nothing are dropped, and an update made soon after
+ * the last report is held back so that any further updates can be sent with
+ * it. The registrar is still sent a report every 10 minutes.
  */
 void registration_service_update(struct registration_service_handle *rs,
 				 size_t slots_used, size_t slots_total);
@@ -72,6 +72,13 @@ struct thread_handle {
 	unsigned int stack_size;
 };
 
+/*!
+ * @brief Determines the number of CPUs which are currently online
+ *
+ * @returns Number of online CPUs, which is always at least 1
+ */
+int thread_cpu_count(void);
+
 /*!
  * @brief Frees data allocated by ::thread_init
  *
@@ -97,6 +104,16 @@ int thread_init(struct thread_handle *th);
  */
 int thread_join(struct thread_handle *th);
 
+/*!
+ * @brief Restricts a running thread to execute only on the given CPU
+ *
+ * @param[in,out] th Target thread instance
+ * @param[in] cpu Zero-based index of the CPU to run on
+ *
+ * @returns 0 on success, negative ERRNO value on failure
+ */
+int thread_set_affinity(struct thread_handle *th, unsigned int cpu);
+
 /*!
  * @brief Starts the target thread instance
  *
@@ -73,6 +73,11 @@ struct worker_handle {
 
 	/*! Optional maximum idle time in milliseconds between work */
 	uint32_t periodic_wake;
+
+	/*! Optional idle time in milliseconds after which the thread exits, to
+	 *  be started again when more work is signaled. Not used when
+	 *  worker_handle::periodic_wake is set. */
+	uint32_t idle_timeout;
 };
 
 /*!
@@ -119,6 +124,9 @@ int worker_join(struct worker_handle *wh);
  * @param[in,out] wh Target worker instance
  *
  * @returns 0 on success, negative ERRNO value on failure
+ *
+ * Unless worker_handle::periodic_wake is set, the backing thread is not
+ * created until work is first signaled by ::worker_wake.
  */
 int worker_start(struct worker_handle *wh);
 
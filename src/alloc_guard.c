@@ -0,0 +1,153 @@
+/*!
+ * @file alloc_guard.c
+ *
+ * @copyright
+ * Copyright &copy; 2026, Scott K Logan
+ *
+ * @copyright
+ * All rights reserved.
+ *
+ * @copyright
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * @copyright
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * @copyright
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * @copyright
+ * EchoLink&reg; is a registered trademark of Synergenics, LLC
+ *
+ * @author Scott K Logan &lt;logans@cottsay.net&gt;
+ *
+ * @brief Detection of memory allocation on steady state paths
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "alloc_guard.h"
+#include "atomic.h"
+
+/*!
+ * @brief Allocates memory using the C library's own allocator
+ *
+ * @param[in] nmemb Number of elements to allocate
+ * @param[in] size Size of each element in bytes
+ *
+ * @returns Zeroed memory, or NULL on failure
+ */
+extern void *__libc_calloc(size_t nmemb, size_t size);
+
+/*!
+ * @brief Allocates memory using the C library's own allocator
+ *
+ * @param[in] size Number of bytes to allocate
+ *
+ * @returns Uninitialized memory, or NULL on failure
+ */
+extern void *__libc_malloc(size_t size);
+
+/*!
+ * @brief Resizes memory using the C library's own allocator
+ *
+ * @param[in] ptr Memory to resize, or NULL
+ * @param[in] size Number of bytes to resize the memory to
+ *
+ * @returns Resized memory, or NULL on failure
+ */
+extern void *__libc_realloc(void *ptr, size_t size);
+
+/*! Non-zero once ::alloc_guard_arm has been called */
+static uint32_t alloc_guard_armed;
+
+/*! Number of regions which the calling thread is currently in */
+static __thread unsigned int alloc_guard_depth;
+
+/*!
+ * @brief Aborts the process if the calling thread must not allocate memory
+ *
+ * @param[in] func Name of the allocation function which was called
+ */
+static void alloc_guard_check(const char *func);
+
+void alloc_guard_arm(void)
+{
+	atomic_store_u32(&alloc_guard_armed, 1);
+}
+
+static void alloc_guard_check(const char *func)
+{
+	static const char msg[] =
+		"() was called on a path which must not allocate memory\n";
+	ssize_t ret;
+
+	if (alloc_guard_depth == 0 || atomic_load_u32(&alloc_guard_armed) == 0)
+		return;
+
+	/* Formatted output may itself allocate */
+	ret = write(STDERR_FILENO, func, strlen(func));
+	if (ret >= 0)
+		ret = write(STDERR_FILENO, msg, sizeof(msg) - 1);
+	(void)ret;
+
+	abort();
+}
+
+void alloc_guard_disarm(void)
+{
+	atomic_store_u32(&alloc_guard_armed, 0);
+}
+
+void alloc_guard_enter(void)
+{
+	alloc_guard_depth++;
+}
+
+void alloc_guard_leave(void)
+{
+	alloc_guard_depth--;
+}
+
+void *calloc(size_t nmemb, size_t size)
+{
+	alloc_guard_check("calloc");
+
+	return __libc_calloc(nmemb, size);
+}
+
+void *malloc(size_t size)
+{
+	alloc_guard_check("malloc");
+
+	return __libc_malloc(size);
+}
+
+void *realloc(void *ptr, size_t size)
+{
+	alloc_guard_check("realloc");
+
+	return __libc_realloc(ptr, size);
+}
@@ -0,0 +1,395 @@
+/*!
+ * @file buff_pool.c
+ *
+ * @copyright
+ * Copyright &copy; 2026, Scott K Logan
+ *
+ * @copyright
+ * All rights reserved.
+ *
+ * @copyright
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * @copyright
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * @copyright
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * @copyright
+ * EchoLink&reg; is a registered trademark of Synergenics, LLC
+ *
+ * @author Scott K Logan &lt;logans@cottsay.net&gt;
+ *
+ * @brief Reference counted packet buffer pool implementation
+ */
+
+#include <errno.h>
+#include <stdlib.h>
+
+#include "atomic.h"
+#include "buff_pool.h"
+#include "mutex.h"
+
+/*! Assumed size of a cache line, which each buffer is aligned to */
+#define BUFF_POOL_CACHE_LINE 64
+
+/*! Number of buffers allocated at once when the pool grows */
+#define BUFF_POOL_CHUNK 16
+
+/*! Largest number of buffers supported, limited by the free list encoding */
+#define BUFF_POOL_MAX 0xFFFF
+
+/*! Mask of the part of the free list head which identifies a buffer */
+#define BUFF_POOL_INDEX_MASK 0xFFFF
+
+/*! Amount added to the free list head each time it changes */
+#define BUFF_POOL_TAG_INC 0x10000
+
+/*!
+ * @brief Bookkeeping which precedes the data in each buffer
+ */
+struct buff_pool_hdr {
+	/*! Number of references to the buffer, zero while it is unused */
+	uint32_t refs;
+
+	/*! Index of the buffer plus one */
+	uint32_t id;
+
+	/*! Identifier of the next unused buffer, or zero */
+	uint32_t next;
+};
+
+/*!
+ * @brief A single allocation holding several buffers
+ */
+struct buff_pool_chunk {
+	/*! Pointer returned by the allocator */
+	void *raw;
+
+	/*! First buffer, aligned to BUFF_POOL_CACHE_LINE */
+	uint8_t *base;
+};
+
+/*!
+ * @brief Private data for an instance of a buffer pool
+ *
+ * Unused buffers form a stack which is linked through their headers. The head
+ * of the stack holds the identifier of the top buffer in the low 16 bits and
+ * a tag which changes with every update in the high 16 bits, so that a buffer
+ * which is taken and returned between two reads of the head is noticed.
+ */
+struct buff_pool_priv {
+	/*! Allocations holding the buffers, indexed by buffer index */
+	struct buff_pool_chunk *chunks;
+
+	/*! Size of the space occupied by each buffer and its header */
+	size_t stride;
+
+	/*! Maximum number of buffers in the pool */
+	uint32_t max;
+
+	/*! Head of the stack of unused buffers */
+	uint32_t free_head;
+
+	/*! Number of buffers which have been allocated */
+	uint32_t size;
+
+	/*! Number of buffers currently borrowed */
+	uint32_t in_use;
+
+	/*! Highest number of buffers which have been borrowed at once */
+	uint32_t in_use_max;
+
+	/*! Serializes growth of the pool */
+	struct mutex_handle mutex_grow;
+};
+
+/*!
+ * @brief Allocates another chunk of buffers
+ *
+ * @param[in,out] priv Private data for the target buffer pool instance
+ *
+ * @returns 0 on success, negative ERRNO value on failure
+ *
+ * The new buffers are added to the stack of unused buffers. The caller must
+ * hold buff_pool_priv::mutex_grow.
+ */
+static int buff_pool_grow(struct buff_pool_priv *priv);
+
+/*!
+ * @brief Gets the header of a buffer
+ *
+ * @param[in] priv Private data for the target buffer pool instance
+ * @param[in] id Identifier of the buffer, as stored in buff_pool_hdr::id
+ *
+ * @returns Header of the buffer
+ */
+static struct buff_pool_hdr *buff_pool_hdr_get(struct buff_pool_priv *priv,
+					       uint32_t id);
+
+/*!
+ * @brief Adds a linked list of buffers to the stack of unused buffers
+ *
+ * @param[in,out] priv Private data for the target buffer pool instance
+ * @param[in] first Header of the first buffer in the list
+ * @param[in,out] last Header of the last buffer in the list
+ */
+static void buff_pool_push(struct buff_pool_priv *priv,
+			   struct buff_pool_hdr *first,
+			   struct buff_pool_hdr *last);
+
+/*!
+ * @brief Takes a buffer from the stack of unused buffers
+ *
+ * @param[in,out] priv Private data for the target buffer pool instance
+ *
+ * @returns Header of the buffer, or NULL if the stack is empty
+ */
+static struct buff_pool_hdr *buff_pool_take(struct buff_pool_priv *priv);
+
+uint8_t *buff_pool_borrow(struct buff_pool_handle *bp)
+{
+	struct buff_pool_priv *priv = bp->priv;
+	struct buff_pool_hdr *hdr;
+	uint32_t in_use;
+	uint32_t curr;
+
+	hdr = buff_pool_take(priv);
+	if (hdr == NULL) {
+		/* A pool which can't grow is simply exhausted */
+		if (atomic_load_u32(&priv->size) >= priv->max)
+			return NULL;
+
+		mutex_lock(&priv->mutex_grow);
+
+		/* Another thread may have grown the pool in the meantime */
+		hdr = buff_pool_take(priv);
+		if (hdr == NULL && buff_pool_grow(priv) == 0)
+			hdr = buff_pool_take(priv);
+
+		mutex_unlock(&priv->mutex_grow);
+
+		if (hdr == NULL)
+			return NULL;
+	}
+
+	atomic_store_u32(&hdr->refs, 1);
+
+	in_use = atomic_add_u32(&priv->in_use, 1);
+	curr = atomic_load_u32(&priv->in_use_max);
+	while (in_use > curr && !atomic_cas_u32(&priv->in_use_max, curr, in_use))
+		curr = atomic_load_u32(&priv->in_use_max);
+
+	return (uint8_t *)hdr + BUFF_POOL_CACHE_LINE;
+}
+
+void buff_pool_free(struct buff_pool_handle *bp)
+{
+	struct buff_pool_priv *priv = bp->priv;
+	uint32_t i;
+
+	if (priv != NULL) {
+		if (priv->chunks != NULL) {
+			for (i = 0; i < priv->size; i += BUFF_POOL_CHUNK)
+				free(priv->chunks[i / BUFF_POOL_CHUNK].raw);
+
+			free(priv->chunks);
+		}
+
+		mutex_free(&priv->mutex_grow);
+
+		free(bp->priv);
+		bp->priv = NULL;
+	}
+}
+
+void buff_pool_get_stats(struct buff_pool_handle *bp,
+			 struct buff_pool_stats *stats)
+{
+	struct buff_pool_priv *priv = bp->priv;
+
+	stats->size = atomic_load_u32(&priv->size);
+	stats->in_use = atomic_load_u32(&priv->in_use);
+	stats->in_use_max = atomic_load_u32(&priv->in_use_max);
+}
+
+static int buff_pool_grow(struct buff_pool_priv *priv)
+{
+	struct buff_pool_chunk *chunk;
+	struct buff_pool_hdr *first;
+	struct buff_pool_hdr *hdr;
+	struct buff_pool_hdr *prev = NULL;
+	uint32_t count;
+	uint32_t i;
+
+	if (priv->size >= priv->max)
+		return -ENOMEM;
+
+	count = priv->max - priv->size;
+	if (count > BUFF_POOL_CHUNK)
+		count = BUFF_POOL_CHUNK;
+
+	chunk = &priv->chunks[priv->size / BUFF_POOL_CHUNK];
+	chunk->raw = malloc(count * priv->stride + BUFF_POOL_CACHE_LINE - 1);
+	if (chunk->raw == NULL)
+		return -ENOMEM;
+
+	chunk->base = (uint8_t *)chunk->raw +
+		      (BUFF_POOL_CACHE_LINE -
+		       (uintptr_t)chunk->raw % BUFF_POOL_CACHE_LINE) %
+		      BUFF_POOL_CACHE_LINE;
+
+	first = (struct buff_pool_hdr *)chunk->base;
+	for (i = 0; i < count; i++) {
+		hdr = (struct buff_pool_hdr *)(chunk->base + i * priv->stride);
+		hdr->refs = 0;
+		hdr->id = priv->size + i + 1;
+		hdr->next = 0;
+
+		if (prev != NULL)
+			prev->next = hdr->id;
+		prev = hdr;
+	}
+
+	atomic_store_u32(&priv->size, priv->size + count);
+
+	buff_pool_push(priv, first, prev);
+
+	return 0;
+}
+
+static struct buff_pool_hdr *buff_pool_hdr_get(struct buff_pool_priv *priv,
+					       uint32_t id)
+{
+	return (struct buff_pool_hdr *)
+		(priv->chunks[(id - 1) / BUFF_POOL_CHUNK].base +
+		 ((id - 1) % BUFF_POOL_CHUNK) * priv->stride);
+}
+
+int buff_pool_init(struct buff_pool_handle *bp)
+{
+	struct buff_pool_priv *priv = bp->priv;
+	int ret;
+
+	if (bp->buff_len == 0 || bp->max_buffs > BUFF_POOL_MAX ||
+	    (bp->max_buffs != 0 && bp->init_buffs > bp->max_buffs))
+		return -EINVAL;
+
+	if (priv == NULL) {
+		priv = calloc(1, sizeof(*priv));
+		if (priv == NULL)
+			return -ENOMEM;
+
+		bp->priv = priv;
+	}
+
+	priv->max = bp->max_buffs != 0 ? bp->max_buffs : BUFF_POOL_MAX;
+	priv->stride = BUFF_POOL_CACHE_LINE +
+		       (bp->buff_len + BUFF_POOL_CACHE_LINE - 1) /
+		       BUFF_POOL_CACHE_LINE * BUFF_POOL_CACHE_LINE;
+
+	/* The table is never resized, so it can be read without locking */
+	priv->chunks = calloc((priv->max + BUFF_POOL_CHUNK - 1) / BUFF_POOL_CHUNK,
+			      sizeof(*priv->chunks));
+	if (priv->chunks == NULL) {
+		ret = -ENOMEM;
+		goto buff_pool_init_exit;
+	}
+
+	ret = mutex_init(&priv->mutex_grow);
+	if (ret < 0)
+		goto buff_pool_init_exit;
+
+	while (priv->size < bp->init_buffs) {
+		ret = buff_pool_grow(priv);
+		if (ret < 0)
+			goto buff_pool_init_exit;
+	}
+
+	return 0;
+
+buff_pool_init_exit:
+	buff_pool_free(bp);
+
+	return ret;
+}
+
+static void buff_pool_push(struct buff_pool_priv *priv,
+			   struct buff_pool_hdr *first,
+			   struct buff_pool_hdr *last)
+{
+	uint32_t head;
+
+	do {
+		head = atomic_load_u32(&priv->free_head);
+		atomic_store_u32(&last->next, head & BUFF_POOL_INDEX_MASK);
+	} while (!atomic_cas_u32(&priv->free_head, head,
+				 ((head + BUFF_POOL_TAG_INC) &
+				  ~(uint32_t)BUFF_POOL_INDEX_MASK) | first->id));
+}
+
+void buff_pool_ref(uint8_t *buff)
+{
+	struct buff_pool_hdr *hdr =
+		(struct buff_pool_hdr *)(buff - BUFF_POOL_CACHE_LINE);
+
+	atomic_add_u32(&hdr->refs, 1);
+}
+
+void buff_pool_release(struct buff_pool_handle *bp, uint8_t *buff)
+{
+	struct buff_pool_priv *priv = bp->priv;
+	struct buff_pool_hdr *hdr =
+		(struct buff_pool_hdr *)(buff - BUFF_POOL_CACHE_LINE);
+
+	if (atomic_sub_u32(&hdr->refs, 1) != 0)
+		return;
+
+	atomic_sub_u32(&priv->in_use, 1);
+
+	buff_pool_push(priv, hdr, hdr);
+}
+
+static struct buff_pool_hdr *buff_pool_take(struct buff_pool_priv *priv)
+{
+	struct buff_pool_hdr *hdr;
+	uint32_t head;
+	uint32_t next;
+
+	do {
+		head = atomic_load_u32(&priv->free_head);
+		if ((head & BUFF_POOL_INDEX_MASK) == 0)
+			return NULL;
+
+		/* The buffer may be taken by another thread before the exchange,
+		 * in which case the tag will have changed and this is retried
+		 */
+		hdr = buff_pool_hdr_get(priv, head & BUFF_POOL_INDEX_MASK);
+		next = atomic_load_u32(&hdr->next);
+	} while (!atomic_cas_u32(&priv->free_head, head,
+				 ((head + BUFF_POOL_TAG_INC) &
+				  ~(uint32_t)BUFF_POOL_INDEX_MASK) | next));
+
+	return hdr;
+}
@@ -236,6 +236,26 @@ static int conf_parse_pair(const char *key, size_t key_len,
 			}
 		}
 
+		break;
+	case 9:
+		if (strncmp(key, "EventLoop", key_len) == 0) {
+			if (val_len == 3 && strncmp(val, "off", val_len) == 0) {
+				conf->event_loop = PROXY_EVENT_LOOP_OFF;
+			} else if (val_len == 6 &&
+				   strncmp(val, "single", val_len) == 0) {
+				conf->event_loop = PROXY_EVENT_LOOP_SINGLE;
+			} else if (val_len == 7 &&
+				   strncmp(val, "sharded", val_len) == 0) {
+				conf->event_loop = PROXY_EVENT_LOOP_SHARDED;
+			} else {
+				log_printf(log, LOG_LEVEL_ERROR,
+					   "Invalid configuration value for 'EventLoop': '%.*s'\n",
+					   (int)val_len, val);
+
+				return -EINVAL;
+			}
+		}
+
 		break;
 	case 11:
 		if (strncmp(key, "BindAddress", key_len) == 0) {
@@ -291,6 +311,27 @@ static int conf_parse_pair(const char *key, size_t key_len,
 
 			memcpy(conf->calls_denied, val, val_len);
 			conf->calls_denied[val_len] = '\0';
+		} else if (strncmp(key, "DataQueueBudget", key_len) == 0) {
+			if (sscanf(val, "%u%1s", &conf->data_queue_budget, dummy) != 1) {
+				log_printf(log, LOG_LEVEL_ERROR,
+					   "Invalid configuration value for 'DataQueueBudget': '%.*s'\n",
+					   (int)val_len, val);
+
+				return -EINVAL;
+			}
+		} else if (strncmp(key, "ThreadStackSize", key_len) == 0) {
+			if (sscanf(val, "%u%1s", &conf->thread_stack_size, dummy) != 1 ||
+			    conf->thread_stack_size > 1024 * 1024) {
+				log_printf(log, LOG_LEVEL_ERROR,
+					   "Invalid configuration value for 'ThreadStackSize': '%.*s'\n",
+					   (int)val_len, val);
+
+				return -EINVAL;
+			}
+
+			if (conf->thread_stack_size > 0 &&
+			    conf->thread_stack_size < 64)
+				conf->thread_stack_size = 64;
 		}
 
 		break;
@@ -310,6 +351,14 @@ static int conf_parse_pair(const char *key, size_t key_len,
 
 			memcpy(conf->calls_allowed, val, val_len);
 			conf->calls_allowed[val_len] = '\0';
+		} else if (strncmp(key, "EventLoopThreads", key_len) == 0) {
+			if (sscanf(val, "%u%1s", &conf->event_loop_threads, dummy) != 1) {
+				log_printf(log, LOG_LEVEL_ERROR,
+					   "Invalid configuration value for 'EventLoopThreads': '%.*s'\n",
+					   (int)val_len, val);
+
+				return -EINVAL;
+			}
 		} else if (strncmp(key, "RegistrationName", key_len) == 0) {
 			if (conf->reg_name != NULL)
 				free(conf->reg_name);
@@ -335,6 +384,56 @@ static int conf_parse_pair(const char *key, size_t key_len,
 					   "Invalid configuration value for 'ConnectionTimeout': '%.*s'\n",
 					   (int)val_len, val);
 
+				return -EINVAL;
+			}
+		} else if (strncmp(key, "ThreadIdleTimeout", key_len) == 0) {
+			if (sscanf(val, "%u%1s", &conf->thread_idle_timeout, dummy) != 1 ||
+			    conf->thread_idle_timeout > 24 * 60 * 60) {
+				log_printf(log, LOG_LEVEL_ERROR,
+					   "Invalid configuration value for 'ThreadIdleTimeout': '%.*s'\n",
+					   (int)val_len, val);
+
+				return -EINVAL;
+			}
+		} else if (strncmp(key, "ZeroCopyThreshold", key_len) == 0) {
+			if (sscanf(val, "%u%1s", &conf->zerocopy_threshold, dummy) != 1) {
+				log_printf(log, LOG_LEVEL_ERROR,
+					   "Invalid configuration value for 'ZeroCopyThreshold': '%.*s'\n",
+					   (int)val_len, val);
+
+				return -EINVAL;
+			}
+		}
+
+		break;
+	case 18:
+		if (strncmp(key, "DataOverflowPolicy", key_len) == 0) {
+			if (val_len == 5 && strncmp(val, "block", val_len) == 0) {
+				conf->data_overflow = PROXY_DATA_OVERFLOW_BLOCK;
+			} else if (val_len == 11 &&
+				   strncmp(val, "drop-newest", val_len) == 0) {
+				conf->data_overflow = PROXY_DATA_OVERFLOW_DROP_NEWEST;
+			} else if (val_len == 11 &&
+				   strncmp(val, "drop-oldest", val_len) == 0) {
+				conf->data_overflow = PROXY_DATA_OVERFLOW_DROP_OLDEST;
+			} else {
+				log_printf(log, LOG_LEVEL_ERROR,
+					   "Invalid configuration value for 'DataOverflowPolicy': '%.*s'\n",
+					   (int)val_len, val);
+
+				return -EINVAL;
+			}
+		} else if (strncmp(key, "PersistentUDPPorts", key_len) == 0) {
+			if (val_len == 2 && strncmp(val, "on", val_len) == 0) {
+				conf->persistent_udp = 1;
+			} else if (val_len == 3 &&
+				   strncmp(val, "off", val_len) == 0) {
+				conf->persistent_udp = 0;
+			} else {
+				log_printf(log, LOG_LEVEL_ERROR,
+					   "Invalid configuration value for 'PersistentUDPPorts': '%.*s'\n",
+					   (int)val_len, val);
+
 				return -EINVAL;
 			}
 		}
@@ -373,6 +472,19 @@ static int conf_parse_pair(const char *key, size_t key_len,
 			conf->reg_comment[val_len] = '\0';
 		}
 
+		break;
+	case 20:
+		if (strncmp(key, "RegistrationInterval", key_len) == 0) {
+			if (sscanf(val, "%u%1s", &conf->reg_interval, dummy) != 1 ||
+			    conf->reg_interval > 10 * 60) {
+				log_printf(log, LOG_LEVEL_ERROR,
+					   "Invalid configuration value for 'RegistrationInterval': '%.*s'\n",
+					   (int)val_len, val);
+
+				return -EINVAL;
+			}
+		}
+
 		break;
 	case 31:
 		if (strncmp(key, "AdditionalExternalBindAddresses", key_len) == 0) {
@@ -457,8 +569,17 @@ static int conf_parse_stream(FILE *stream, struct proxy_conf *conf,
 
 int conf_init(struct proxy_conf *conf)
 {
+	conf->data_overflow = PROXY_DATA_OVERFLOW_BLOCK;
+	conf->data_queue_budget = 0;
+	conf->event_loop = PROXY_EVENT_LOOP_OFF;
+	conf->event_loop_threads = 0;
 	conf->password = NULL;
+	conf->persistent_udp = 0;
 	conf->port = 8100;
+	conf->reg_interval = 5;
+	conf->thread_idle_timeout = 0;
+	conf->thread_stack_size = 1024;
+	conf->zerocopy_threshold = 0;
 
 	return 0;
 }
@@ -44,6 +44,10 @@
  * @brief Network connection implementation
  */
 
+#ifdef __linux__
+#  define _GNU_SOURCE
+#endif
+
 #include <errno.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -53,13 +57,25 @@
 #else
 #  include <unistd.h>
 #endif
+#ifdef __linux__
+#  include <linux/errqueue.h>
+#  include <poll.h>
+#  include <pthread.h>
+#  include <signal.h>
+#endif
+#ifndef _WIN32
+#  include <time.h>
+#endif
 
 #ifdef _WIN32
 #  include <winsock2.h>
 #  include <ws2tcpip.h>
 #  include <mstcpip.h>
 #else
+#  include <fcntl.h>
+#  include <sys/ioctl.h>
 #  include <sys/socket.h>
+#  include <sys/uio.h>
 #  include <netdb.h>
 #  include <netinet/in.h>
 #  include <netinet/tcp.h>
@@ -74,11 +90,59 @@
 #endif
 
 #include "conn.h"
+#ifdef HAVE_IO_URING
+#  include "conn_uring.h"
+#endif
 #ifdef _WIN32
 #  include "conn_wsa_errno.h"
 #endif
+#include "atomic.h"
 #include "mutex.h"
 
+/*! Set in conn_priv::state while conn_priv::fd may be used for I/O */
+#define CONN_STATE_OPEN 0x80000000
+
+/*! Bits of conn_priv::state counting the calls currently using conn_priv::fd */
+#define CONN_STATE_USERS 0x7FFFFFFF
+
+#ifdef __linux__
+/*! Maximum number of datagrams to receive in a single system call */
+#  define CONN_RECV_MANY_MAX 64
+
+/*! Maximum number of datagrams to send in a single system call */
+#  define CONN_SEND_MANY_MAX 64
+#endif
+
+#ifndef _WIN32
+/*! Maximum number of buffers to send in a single system call */
+#  define CONN_SENDV_MAX 64
+#endif
+
+/*! Maximum number of datagrams discarded by a single call to ::conn_drain */
+#define CONN_DRAIN_MAX 1024
+
+/*! Maximum number of addresses kept for each name in a ::conn_resolver */
+#define CONN_RESOLVER_ADDRS_MAX 4
+
+/*! Maximum number of names kept in a ::conn_resolver */
+#define CONN_RESOLVER_ENTRIES_MAX 32
+
+/*! Size of the longest name kept in a ::conn_resolver, plus one */
+#define CONN_RESOLVER_HOST_LEN 256
+
+#ifdef __linux__
+/*! Number of bytes to read at once when discarding data from a kernel buffer */
+#  define CONN_PIPE_DISCARD_LEN 4096
+#endif
+
+#if defined(__linux__) && defined(SO_ZEROCOPY) && defined(MSG_ZEROCOPY)
+/*! Sending data without copying it is supported */
+#  define CONN_ZEROCOPY 1
+
+/*! Number of bytes of ancillary data to receive with each notification */
+#  define CONN_ZEROCOPY_CMSG_LEN 128
+#endif
+
 #ifndef MSG_NOSIGNAL
 /*! Requests not to send SIGPIPE on errors */
 #  define MSG_NOSIGNAL 0
@@ -120,21 +184,669 @@ struct conn_priv {
 	/*! One of conn_priv::sock_fd or conn_priv::conn_fd, used for TX/RX */
 	SOCKET			fd;
 
+	/*! ::CONN_STATE_OPEN and the number of users of conn_priv::fd, which is
+	 *  only changed while the socket isn't open and nobody is using it */
+	uint32_t		state;
+
 	/*! Length of conn_priv::remote_addr_len */
 	socklen_t		remote_addr_len;
 
 	/*! Storage for the remote address of the connection */
 	struct sockaddr_storage remote_addr;
 
-	/*! Mutex for protecting the socket file descriptors */
+	/*! Serializes opening and closing the socket file descriptors */
 	struct mutex_handle	mutex;
 
+	/*! Minimum number of bytes to send without copying them, or 0 */
+	size_t			zerocopy_min;
+
+	/*! Statistics about data sent without copying it */
+	struct conn_zerocopy_stats zerocopy;
+
+	/*! Non-zero if an empty datagram was received behind others, so the
+	 *  next call to ::conn_recv_many returns -EPIPE */
+	uint8_t			recv_shutdown;
+
 #ifdef _WIN32
 	/*! Information about the Windows Sockets implementation */
 	WSADATA			wsadat;
 #endif
 };
 
+/*!
+ * @brief Addresses which a name resolved to
+ */
+struct conn_resolver_addrs {
+	/*! Number of valid entries in conn_resolver_addrs::addrs */
+	size_t num_addrs;
+
+	/*! Resolved addresses with port 0, in the order they should be used */
+	struct sockaddr_storage addrs[CONN_RESOLVER_ADDRS_MAX];
+
+	/*! Length of each address in conn_resolver_addrs::addrs */
+	socklen_t addr_lens[CONN_RESOLVER_ADDRS_MAX];
+};
+
+/*!
+ * @brief A name cached by a ::conn_resolver
+ */
+struct conn_resolver_entry {
+	/*! Name which was resolved */
+	char host[CONN_RESOLVER_HOST_LEN];
+
+	/*! Non-zero if there is no name, which resolves to the wildcard or
+	 *  loopback address */
+	int wildcard;
+
+	/*! Non-zero if the name was resolved as a local address to bind to */
+	int passive;
+
+	/*! Addresses the name resolved to */
+	struct conn_resolver_addrs addrs;
+
+	/*! Time the name was last resolved, from ::conn_resolver_time */
+	uint32_t resolved;
+};
+
+/*!
+ * @brief Private data for an instance of a resolved address cache
+ */
+struct conn_resolver_priv {
+	/*! Protects conn_resolver_priv::entries */
+	struct mutex_handle mutex;
+
+	/*! Cached names, of which the first conn_resolver_priv::num_entries are
+	 *  valid */
+	struct conn_resolver_entry entries[CONN_RESOLVER_ENTRIES_MAX];
+
+	/*! Number of valid entries in conn_resolver_priv::entries */
+	size_t num_entries;
+};
+
+/*!
+ * @brief Starts using the socket for I/O without taking a lock
+ *
+ * Every call must be paired with a call to ::conn_fd_release, even if the
+ * socket isn't open.
+ *
+ * @param[in,out] priv Target connection's private data
+ *
+ * @returns The socket descriptor, or INVALID_SOCKET if it isn't open
+ */
+static SOCKET conn_fd_acquire(struct conn_priv *priv);
+
+/*!
+ * @brief Makes a socket available for I/O
+ *
+ * @param[in,out] priv Target connection's private data
+ * @param[in] fd Socket descriptor to use for I/O
+ */
+static void conn_fd_publish(struct conn_priv *priv, SOCKET fd);
+
+/*!
+ * @brief Stops using the socket acquired by ::conn_fd_acquire
+ *
+ * @param[in,out] priv Target connection's private data
+ */
+static void conn_fd_release(struct conn_priv *priv);
+
+/*!
+ * @brief Stops new I/O on the socket and waits for calls which are still using
+ *        it to return
+ *
+ * Blocking calls must already have been interrupted by shutting the socket
+ * down.
+ *
+ * @param[in,out] priv Target connection's private data
+ */
+static void conn_fd_retire(struct conn_priv *priv);
+
+/*!
+ * @brief Resolves a host and port to a socket address
+ *
+ * Numeric addresses are parsed without calling the system resolver, and names
+ * are looked up in the given cache before they are resolved.
+ *
+ * @param[in,out] cr Cache of resolved names, or NULL to resolve names every
+ *                   time
+ * @param[in] host Host name or numeric address, or NULL for the wildcard or
+ *                 loopback address
+ * @param[in] port Port number or service name, or NULL for port 0
+ * @param[in] family Address family to resolve to, or AF_UNSPEC for any
+ * @param[in] socktype Type of socket the address will be used with
+ * @param[in] passive Non-zero if the address is a local address to bind to
+ * @param[out] addr Resolved socket address
+ * @param[out] addr_len Length of the resolved socket address
+ *
+ * @returns 0 on success, negative ERRNO value on failure
+ */
+static int conn_resolve(struct conn_resolver *cr, const char *host,
+			const char *port, int family, int socktype,
+			int passive, struct sockaddr_storage *addr,
+			socklen_t *addr_len);
+
+/*!
+ * @brief Resolves the local address of a connection, using the address in
+ *        conn_handle::source if it was resolved ahead of time
+ *
+ * @param[in] conn Target network connection instance
+ * @param[in] family Address family to resolve to, or AF_UNSPEC for any
+ * @param[in] socktype Type of socket the address will be used with
+ * @param[out] addr Resolved socket address
+ * @param[out] addr_len Length of the resolved socket address
+ *
+ * @returns 0 on success, negative ERRNO value on failure
+ */
+static int conn_resolve_source(const struct conn_handle *conn, int family,
+			       int socktype, struct sockaddr_storage *addr,
+			       socklen_t *addr_len);
+
+/*!
+ * @brief Resolves a name using the system resolver
+ *
+ * @param[in] host Host name, or NULL for the wildcard or loopback address
+ * @param[in] passive Non-zero if the name is a local address to bind to
+ * @param[out] addrs Addresses the name resolved to
+ *
+ * @returns 0 on success, negative ERRNO value on failure
+ */
+static int conn_resolver_fetch(const char *host, int passive,
+			       struct conn_resolver_addrs *addrs);
+
+/*!
+ * @brief Finds a name in a resolved address cache
+ *
+ * @param[in] priv Target cache's private data, with the mutex held
+ * @param[in] host Host name, or NULL for the wildcard or loopback address
+ * @param[in] passive Non-zero if the name is a local address to bind to
+ *
+ * @returns The cached name, or NULL if it isn't cached
+ */
+static struct conn_resolver_entry *conn_resolver_find(
+	struct conn_resolver_priv *priv, const char *host, int passive);
+
+/*!
+ * @brief Adds a name to a resolved address cache, replacing the one which was
+ *        resolved longest ago if the cache is full
+ *
+ * @param[in,out] priv Target cache's private data, with the mutex held
+ * @param[in] host Host name, or NULL for the wildcard or loopback address
+ * @param[in] passive Non-zero if the name is a local address to bind to
+ *
+ * @returns The new entry, with no addresses
+ */
+static struct conn_resolver_entry *conn_resolver_insert(
+	struct conn_resolver_priv *priv, const char *host, int passive);
+
+/*!
+ * @brief Copies the first resolved address of the given family
+ *
+ * @param[in] addrs Addresses a name resolved to
+ * @param[in] family Address family to copy, or AF_UNSPEC for any
+ * @param[out] addr Copied socket address
+ * @param[out] addr_len Length of the copied socket address
+ *
+ * @returns 0 on success, -EADDRNOTAVAIL if there is no address of the given
+ *          family
+ */
+static int conn_resolver_pick(const struct conn_resolver_addrs *addrs,
+			      int family, struct sockaddr_storage *addr,
+			      socklen_t *addr_len);
+
+/*!
+ * @brief Gets a monotonic time for aging resolved names
+ *
+ * @returns Time in seconds from an arbitrary point
+ */
+static uint32_t conn_resolver_time(void);
+
+/*!
+ * @brief Configures a socket to perform operations without blocking
+ *
+ * @param[in] fd Target socket descriptor
+ *
+ * @returns 0 on success, negative ERRNO value on failure
+ */
+static int conn_set_nonblocking(SOCKET fd);
+
+#ifndef _WIN32
+/*!
+ * @brief Sends every byte of several buffers on a socket
+ *
+ * @param[in] fd Target socket descriptor
+ * @param[in] iov Array of buffers containing data to be sent, in order
+ * @param[in] count Number of entries in iov
+ * @param[in] flags Flags to pass to each call to sendmsg
+ * @param[in,out] sends Incremented for each successful call to sendmsg, or
+ *                      NULL
+ *
+ * @returns 0 on success, negative ERRNO value on failure
+ */
+static int conn_sendmsg_all(SOCKET fd, const struct conn_iovec *iov,
+			    unsigned int count, int flags, uint32_t *sends);
+#endif
+
+static SOCKET conn_fd_acquire(struct conn_priv *priv)
+{
+	/* The descriptor is written before the flag is set */
+	if (atomic_add_u32(&priv->state, 1) & CONN_STATE_OPEN)
+		return priv->fd;
+
+	return INVALID_SOCKET;
+}
+
+static void conn_fd_publish(struct conn_priv *priv, SOCKET fd)
+{
+	uint32_t state;
+
+	priv->fd = fd;
+
+	do {
+		state = atomic_load_u32(&priv->state);
+	} while (!(state & CONN_STATE_OPEN) &&
+		 !atomic_cas_u32(&priv->state, state, state | CONN_STATE_OPEN));
+}
+
+static void conn_fd_release(struct conn_priv *priv)
+{
+	atomic_sub_u32(&priv->state, 1);
+}
+
+static void conn_fd_retire(struct conn_priv *priv)
+{
+	uint32_t state = atomic_load_u32(&priv->state);
+
+	while ((state & CONN_STATE_OPEN) &&
+	       !atomic_cas_u32(&priv->state, state, state & ~CONN_STATE_OPEN))
+		state = atomic_load_u32(&priv->state);
+
+	/* Closing is rare, so polling is cheaper than having every user of the
+	 * socket check for a waiter
+	 */
+	while (atomic_load_u32(&priv->state) & CONN_STATE_USERS) {
+#ifdef _WIN32
+		Sleep(1);
+#else
+		usleep(1000);
+#endif
+	}
+
+	priv->fd = INVALID_SOCKET;
+}
+
+static int conn_resolve(struct conn_resolver *cr, const char *host,
+			const char *port, int family, int socktype,
+			int passive, struct sockaddr_storage *addr,
+			socklen_t *addr_len)
+{
+	struct conn_resolver_priv *priv;
+	struct conn_resolver_entry *entry;
+	struct conn_resolver_addrs fetched;
+	struct addrinfo hints;
+	struct addrinfo *res = NULL;
+	struct sockaddr_in *sin = (struct sockaddr_in *)addr;
+	struct sockaddr_in6 *sin6 = (struct sockaddr_in6 *)addr;
+	unsigned long port_num = 0;
+	char *end;
+	uint32_t now;
+	int ret;
+
+	if (port != NULL) {
+		port_num = strtoul(port, &end, 10);
+		if (end == port || *end != '\0' || port_num > 65535)
+			goto conn_resolve_system;
+	}
+
+	memset(addr, 0x0, sizeof(*addr));
+
+	if (host != NULL) {
+		if (family != AF_INET6 &&
+		    inet_pton(AF_INET, host, &sin->sin_addr) == 1) {
+			sin->sin_family = AF_INET;
+			sin->sin_port = htons((uint16_t)port_num);
+			*addr_len = sizeof(*sin);
+			return 0;
+		}
+
+		if (family != AF_INET &&
+		    inet_pton(AF_INET6, host, &sin6->sin6_addr) == 1) {
+			sin6->sin6_family = AF_INET6;
+			sin6->sin6_port = htons((uint16_t)port_num);
+			*addr_len = sizeof(*sin6);
+			return 0;
+		}
+
+		if (strlen(host) >= CONN_RESOLVER_HOST_LEN)
+			goto conn_resolve_system;
+	}
+
+	if (cr == NULL)
+		goto conn_resolve_system;
+
+	priv = cr->priv;
+	now = conn_resolver_time();
+
+	mutex_lock(&priv->mutex);
+
+	entry = conn_resolver_find(priv, host, passive);
+	if (entry != NULL && (cr->ttl == 0 || now - entry->resolved < cr->ttl)) {
+		ret = conn_resolver_pick(&entry->addrs, family, addr, addr_len);
+		mutex_unlock(&priv->mutex);
+		goto conn_resolve_port;
+	}
+
+	mutex_unlock(&priv->mutex);
+
+	ret = conn_resolver_fetch(host, passive, &fetched);
+
+	mutex_lock(&priv->mutex);
+
+	entry = conn_resolver_find(priv, host, passive);
+	if (ret == 0) {
+		if (entry == NULL)
+			entry = conn_resolver_insert(priv, host, passive);
+
+		entry->addrs = fetched;
+		entry->resolved = now;
+
+		ret = conn_resolver_pick(&fetched, family, addr, addr_len);
+	} else if (entry != NULL) {
+		/* Keep using the last addresses until the name resolves again */
+		ret = conn_resolver_pick(&entry->addrs, family, addr, addr_len);
+	}
+
+	mutex_unlock(&priv->mutex);
+
+conn_resolve_port:
+	if (ret < 0)
+		return ret;
+
+	if (addr->ss_family == AF_INET)
+		sin->sin_port = htons((uint16_t)port_num);
+	else if (addr->ss_family == AF_INET6)
+		sin6->sin6_port = htons((uint16_t)port_num);
+
+	return 0;
+
+conn_resolve_system:
+	memset(&hints, 0x0, sizeof(hints));
+
+	hints.ai_family = family;
+	hints.ai_flags = passive ? AI_PASSIVE : 0;
+	hints.ai_socktype = socktype;
+
+	ret = getaddrinfo(host, port == NULL ? "0" : port, &hints, &res);
+	if (ret != 0)
+		return -EADDRNOTAVAIL;
+
+	if (res->ai_addrlen > sizeof(*addr)) {
+		freeaddrinfo(res);
+		return -EADDRNOTAVAIL;
+	}
+
+	memcpy(addr, res->ai_addr, res->ai_addrlen);
+	*addr_len = (socklen_t)res->ai_addrlen;
+
+	freeaddrinfo(res);
+
+	return 0;
+}
+
+static int conn_resolve_source(const struct conn_handle *conn, int family,
+			       int socktype, struct sockaddr_storage *addr,
+			       socklen_t *addr_len)
+{
+	const struct conn_addr *source = conn->source;
+	unsigned long port_num = 0;
+	char *end;
+
+	if (source == NULL || source->len == 0)
+		return conn_resolve(conn->resolver, conn->source_addr,
+				    conn->source_port, family, socktype, 1,
+				    addr, addr_len);
+
+	if (conn->source_port != NULL) {
+		port_num = strtoul(conn->source_port, &end, 10);
+		if (end == conn->source_port || *end != '\0' ||
+		    port_num > 65535)
+			return -EINVAL;
+	}
+
+	memset(addr, 0x0, sizeof(*addr));
+	memcpy(addr, source->storage.bytes, source->len);
+	*addr_len = (socklen_t)source->len;
+
+	if (family != AF_UNSPEC && addr->ss_family != family)
+		return -EADDRNOTAVAIL;
+
+	if (addr->ss_family == AF_INET)
+		((struct sockaddr_in *)addr)->sin_port =
+			htons((uint16_t)port_num);
+	else if (addr->ss_family == AF_INET6)
+		((struct sockaddr_in6 *)addr)->sin6_port =
+			htons((uint16_t)port_num);
+
+	return 0;
+}
+
+static int conn_resolver_fetch(const char *host, int passive,
+			       struct conn_resolver_addrs *addrs)
+{
+	struct addrinfo hints;
+	struct addrinfo *res = NULL;
+	struct addrinfo *cur;
+	int ret;
+
+	memset(&hints, 0x0, sizeof(hints));
+
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_flags = passive ? AI_PASSIVE : 0;
+	hints.ai_socktype = SOCK_STREAM;
+
+	ret = getaddrinfo(host, "0", &hints, &res);
+	if (ret != 0)
+		return -EADDRNOTAVAIL;
+
+	addrs->num_addrs = 0;
+
+	for (cur = res; cur != NULL; cur = cur->ai_next) {
+		if (addrs->num_addrs >= CONN_RESOLVER_ADDRS_MAX)
+			break;
+
+		if (cur->ai_addrlen > sizeof(addrs->addrs[0]))
+			continue;
+
+		memcpy(&addrs->addrs[addrs->num_addrs], cur->ai_addr,
+		       cur->ai_addrlen);
+		addrs->addr_lens[addrs->num_addrs] = (socklen_t)cur->ai_addrlen;
+		addrs->num_addrs++;
+	}
+
+	freeaddrinfo(res);
+
+	return addrs->num_addrs > 0 ? 0 : -EADDRNOTAVAIL;
+}
+
+static struct conn_resolver_entry *conn_resolver_find(
+	struct conn_resolver_priv *priv, const char *host, int passive)
+{
+	struct conn_resolver_entry *entry;
+	size_t i;
+
+	for (i = 0; i < priv->num_entries; i++) {
+		entry = &priv->entries[i];
+
+		if (entry->passive != passive)
+			continue;
+
+		if (host == NULL ? entry->wildcard :
+		    !entry->wildcard && strcmp(entry->host, host) == 0)
+			return entry;
+	}
+
+	return NULL;
+}
+
+static struct conn_resolver_entry *conn_resolver_insert(
+	struct conn_resolver_priv *priv, const char *host, int passive)
+{
+	struct conn_resolver_entry *entry;
+	size_t i;
+
+	if (priv->num_entries < CONN_RESOLVER_ENTRIES_MAX) {
+		entry = &priv->entries[priv->num_entries++];
+	} else {
+		entry = &priv->entries[0];
+		for (i = 1; i < priv->num_entries; i++) {
+			if ((int32_t)(priv->entries[i].resolved -
+				      entry->resolved) < 0)
+				entry = &priv->entries[i];
+		}
+	}
+
+	memset(entry, 0x0, sizeof(*entry));
+
+	if (host == NULL)
+		entry->wildcard = 1;
+	else
+		strcpy(entry->host, host);
+
+	entry->passive = passive;
+
+	return entry;
+}
+
+static int conn_resolver_pick(const struct conn_resolver_addrs *addrs,
+			      int family, struct sockaddr_storage *addr,
+			      socklen_t *addr_len)
+{
+	size_t i;
+
+	for (i = 0; i < addrs->num_addrs; i++) {
+		if (family != AF_UNSPEC && addrs->addrs[i].ss_family != family)
+			continue;
+
+		memcpy(addr, &addrs->addrs[i], addrs->addr_lens[i]);
+		*addr_len = addrs->addr_lens[i];
+
+		return 0;
+	}
+
+	return -EADDRNOTAVAIL;
+}
+
+static uint32_t conn_resolver_time(void)
+{
+#ifdef _WIN32
+	return (uint32_t)(GetTickCount() / 1000);
+#else
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	return (uint32_t)now.tv_sec;
+#endif
+}
+
+static int conn_set_nonblocking(SOCKET fd)
+{
+#ifdef _WIN32
+	u_long yes = 1;
+
+	if (ioctlsocket(fd, FIONBIO, &yes) == SOCKET_ERROR)
+		return SOCK_ERRNO;
+#else
+	int flags;
+
+	flags = fcntl(fd, F_GETFL, 0);
+	if (flags < 0)
+		return -errno;
+
+	if (fcntl(fd, F_SETFL, flags | O_NONBLOCK) < 0)
+		return -errno;
+#endif
+
+	return 0;
+}
+
+#ifndef _WIN32
+static int conn_sendmsg_all(SOCKET fd, const struct conn_iovec *iov,
+			    unsigned int count, int flags, uint32_t *sends)
+{
+	struct iovec iovs[CONN_SENDV_MAX];
+	struct msghdr msg;
+	unsigned int first;
+	unsigned int num;
+	unsigned int i;
+	size_t sent;
+	int ret;
+
+	while (count > 0) {
+		num = count > CONN_SENDV_MAX ? CONN_SENDV_MAX : count;
+
+		for (i = 0; i < num; i++) {
+			iovs[i].iov_base = (void *)iov[i].buff;
+			iovs[i].iov_len = iov[i].len;
+		}
+
+		first = 0;
+
+		while (first < num) {
+			memset(&msg, 0x0, sizeof(msg));
+			msg.msg_iov = &iovs[first];
+			msg.msg_iovlen = num - first;
+
+			ret = sendmsg(fd, &msg, flags);
+			if (ret == SOCKET_ERROR)
+				return SOCK_ERRNO;
+
+			if (sends != NULL)
+				(*sends)++;
+
+			/* Skip past everything which was sent */
+			for (sent = ret; first < num; first++) {
+				if (sent < iovs[first].iov_len) {
+					iovs[first].iov_base =
+						(uint8_t *)iovs[first].iov_base + sent;
+					iovs[first].iov_len -= sent;
+					break;
+				}
+
+				sent -= iovs[first].iov_len;
+			}
+		}
+
+		iov += num;
+		count -= num;
+	}
+
+	return 0;
+}
+
+#endif
+int conn_addr_resolve(struct conn_addr *ca, const char *host)
+{
+	struct sockaddr_storage addr;
+	socklen_t addr_len;
+	int ret;
+
+	ret = conn_resolve(NULL, host, NULL, AF_INET, SOCK_DGRAM, 1, &addr,
+			   &addr_len);
+	if (ret < 0)
+		ret = conn_resolve(NULL, host, NULL, AF_UNSPEC, SOCK_DGRAM, 1,
+				   &addr, &addr_len);
+	if (ret < 0)
+		return ret;
+
+	if ((size_t)addr_len > sizeof(ca->storage.bytes))
+		return -EADDRNOTAVAIL;
+
+	memcpy(ca->storage.bytes, &addr, addr_len);
+	ca->len = (uint32_t)addr_len;
+
+	return 0;
+}
+
 int conn_init(struct conn_handle *conn)
 {
 	struct conn_priv *priv = conn->priv;
@@ -197,36 +909,31 @@ void conn_free(struct conn_handle *conn)
 
 int conn_listen(struct conn_handle *conn)
 {
-	struct addrinfo hints;
-	struct addrinfo *res = NULL;
+	struct sockaddr_storage addr;
+	socklen_t addr_len;
 	struct conn_priv *priv = conn->priv;
+	int socktype;
 	int ret;
 	static const int yes = 1;
 
-	memset(&hints, 0x0, sizeof(hints));
-
 	switch (conn->type) {
 	case CONN_TYPE_TCP:
-		hints.ai_socktype = SOCK_STREAM;
+		socktype = SOCK_STREAM;
 		break;
 	case  CONN_TYPE_UDP:
-		hints.ai_socktype = SOCK_DGRAM;
+		socktype = SOCK_DGRAM;
 		break;
 	default:
 		return -1;
 	}
 
-	hints.ai_family = AF_UNSPEC;
-	hints.ai_flags = AI_PASSIVE;
+	ret = conn_resolve_source(conn, AF_UNSPEC, socktype, &addr, &addr_len);
+	if (ret < 0)
+		return ret;
 
-	ret = getaddrinfo(conn->source_addr,
-			  conn->source_port == NULL ? "0" : conn->source_port,
-			  &hints, &res);
-	if (ret != 0)
-		return -EADDRNOTAVAIL;
+	priv->recv_shutdown = 0;
 
-	priv->sock_fd = socket(res->ai_family, res->ai_socktype,
-			       res->ai_protocol);
+	priv->sock_fd = socket(addr.ss_family, socktype, 0);
 	if (priv->sock_fd == INVALID_SOCKET) {
 		ret = SOCK_ERRNO;
 		goto conn_listen_free;
@@ -248,9 +955,16 @@ int conn_listen(struct conn_handle *conn)
 		ret = SOCK_ERRNO;
 		goto conn_listen_free;
 	}
-#endif
+#endif
+
+	if (conn->nonblocking) {
+		ret = conn_set_nonblocking(priv->sock_fd);
+		if (ret < 0)
+			/*! @TODO Close priv->sock_fd */
+			goto conn_listen_free;
+	}
 
-	ret = bind(priv->sock_fd, res->ai_addr, (socklen_t)res->ai_addrlen);
+	ret = bind(priv->sock_fd, (struct sockaddr *)&addr, addr_len);
 	if (ret == SOCKET_ERROR) {
 		/*! @TODO Close priv->sock_fd */
 		ret = SOCK_ERRNO;
@@ -268,13 +982,11 @@ int conn_listen(struct conn_handle *conn)
 
 	mutex_lock(&priv->mutex);
 
-	priv->fd = priv->sock_fd;
+	conn_fd_publish(priv, priv->sock_fd);
 
 	mutex_unlock(&priv->mutex);
 
 conn_listen_free:
-	freeaddrinfo(res);
-
 	return ret;
 }
 
@@ -282,6 +994,7 @@ int conn_accept(struct conn_handle *conn, struct conn_handle *accepted)
 {
 	struct conn_priv *priv = conn->priv;
 	struct conn_priv *apriv = accepted->priv;
+	SOCKET fd;
 
 #ifdef _WIN32
 	uint32_t bytes_returned;
@@ -299,13 +1012,16 @@ int conn_accept(struct conn_handle *conn, struct conn_handle *accepted)
 
 	apriv->remote_addr_len = sizeof(apriv->remote_addr);
 
-	mutex_lock_shared(&priv->mutex);
+	fd = conn_fd_acquire(priv);
 
-	apriv->conn_fd = accept(priv->sock_fd,
-				(struct sockaddr *)&apriv->remote_addr,
+	apriv->conn_fd = fd == INVALID_SOCKET ? INVALID_SOCKET :
+			 accept(fd, (struct sockaddr *)&apriv->remote_addr,
 				&apriv->remote_addr_len);
 
-	mutex_unlock_shared(&priv->mutex);
+	conn_fd_release(priv);
+
+	if (fd == INVALID_SOCKET)
+		return -ENOTCONN;
 
 	if (apriv->conn_fd == INVALID_SOCKET)
 		return SOCK_ERRNO;
@@ -341,9 +1057,19 @@ int conn_accept(struct conn_handle *conn, struct conn_handle *accepted)
 
 #endif
 
+	if (accepted->nonblocking) {
+		int ret = conn_set_nonblocking(apriv->conn_fd);
+
+		if (ret < 0)
+			/*! @TODO Close apriv->conn_fd */
+			return ret;
+	}
+
 	mutex_lock(&apriv->mutex);
 
-	apriv->fd = apriv->conn_fd;
+	apriv->zerocopy_min = 0;
+	memset(&apriv->zerocopy, 0x0, sizeof(apriv->zerocopy));
+	conn_fd_publish(apriv, apriv->conn_fd);
 
 	mutex_unlock(&apriv->mutex);
 
@@ -354,41 +1080,27 @@ int conn_connect(struct conn_handle *conn, const char *addr,
 		 const char *port)
 {
 	struct conn_priv *priv = conn->priv;
-	struct addrinfo hints;
-	struct addrinfo *res = NULL;
-	struct addrinfo *res_remote = NULL;
+	struct sockaddr_storage local;
+	struct sockaddr_storage remote;
+	socklen_t local_len;
+	socklen_t remote_len;
 	static const int yes = 1;
 	int ret;
 
 	if (conn->type != CONN_TYPE_TCP)
 		return -EPROTOTYPE;
 
-	memset(&hints, 0x0, sizeof(hints));
-
-	hints.ai_family = AF_INET;
-	hints.ai_flags = AI_PASSIVE;
-	hints.ai_socktype = SOCK_STREAM;
-
-	ret = getaddrinfo(conn->source_addr, conn->source_port == NULL ? "0" :
-			  conn->source_port, &hints, &res);
-	if (ret != 0) {
-		ret = -EADDRNOTAVAIL;
+	ret = conn_resolve_source(conn, AF_INET, SOCK_STREAM, &local,
+				  &local_len);
+	if (ret < 0)
 		goto conn_connect_free_early;
-	}
-
-	memset(&hints, 0x0, sizeof(hints));
 
-	hints.ai_family = AF_UNSPEC;
-	hints.ai_socktype = SOCK_STREAM;
-
-	ret = getaddrinfo(addr, port, &hints, &res_remote);
-	if (ret != 0) {
-		ret = -EADDRNOTAVAIL;
+	ret = conn_resolve(conn->resolver, addr, port, AF_UNSPEC, SOCK_STREAM,
+			   0, &remote, &remote_len);
+	if (ret < 0)
 		goto conn_connect_free_early;
-	}
 
-	priv->sock_fd = socket(res->ai_family, res->ai_socktype,
-			       res->ai_protocol);
+	priv->sock_fd = socket(local.ss_family, SOCK_STREAM, 0);
 	if (priv->sock_fd == INVALID_SOCKET) {
 		ret = SOCK_ERRNO;
 		goto conn_connect_free_early;
@@ -410,29 +1122,36 @@ int conn_connect(struct conn_handle *conn, const char *addr,
 	}
 #endif
 
-	ret = bind(priv->sock_fd, res->ai_addr, (socklen_t)res->ai_addrlen);
+	if (conn->nonblocking) {
+		ret = conn_set_nonblocking(priv->sock_fd);
+		if (ret < 0)
+			goto conn_connect_free;
+	}
+
+	ret = bind(priv->sock_fd, (struct sockaddr *)&local, local_len);
 	if (ret == SOCKET_ERROR) {
 		ret = SOCK_ERRNO;
 		goto conn_connect_free;
 	}
 
-	ret = connect(priv->sock_fd, res_remote->ai_addr,
-		      (socklen_t)res_remote->ai_addrlen);
+	ret = connect(priv->sock_fd, (struct sockaddr *)&remote, remote_len);
 	if (ret == SOCKET_ERROR) {
 		ret = SOCK_ERRNO;
-		goto conn_connect_free;
+#ifdef _WIN32
+		if (ret == -WSAEWOULDBLOCK)
+			ret = -EINPROGRESS;
+#endif
+		if (ret != -EINPROGRESS || !conn->nonblocking)
+			goto conn_connect_free;
 	}
 
-	freeaddrinfo(res_remote);
-	freeaddrinfo(res);
-
 	mutex_lock(&priv->mutex);
 
-	priv->fd = priv->sock_fd;
+	conn_fd_publish(priv, priv->sock_fd);
 
 	mutex_unlock(&priv->mutex);
 
-	return 0;
+	return ret;
 
 conn_connect_free:
 	shutdown(priv->sock_fd, SHUT_RDWR);
@@ -442,11 +1161,29 @@ conn_connect_free:
 	priv->sock_fd = INVALID_SOCKET;
 
 conn_connect_free_early:
-	if (res_remote != NULL)
-		freeaddrinfo(res_remote);
+	return ret;
+}
 
-	if (res != NULL)
-		freeaddrinfo(res);
+int conn_connect_finish(struct conn_handle *conn)
+{
+	struct conn_priv *priv = conn->priv;
+	SOCKET fd;
+	int err = 0;
+	socklen_t err_len = sizeof(err);
+	int ret;
+
+	fd = conn_fd_acquire(priv);
+
+	if (fd == INVALID_SOCKET) {
+		ret = -ENOTCONN;
+	} else if (getsockopt(fd, SOL_SOCKET, SO_ERROR, (void *)&err,
+			      &err_len) == SOCKET_ERROR) {
+		ret = SOCK_ERRNO;
+	} else {
+		ret = -err;
+	}
+
+	conn_fd_release(priv);
 
 	return ret;
 }
@@ -492,25 +1229,90 @@ void conn_port_to_str(uint16_t port, char result[6])
 	*result = '\0';
 }
 
+int conn_pipe_discard(struct conn_pipe *cp, size_t len)
+{
+#ifdef __linux__
+	uint8_t buff[CONN_PIPE_DISCARD_LEN];
+	ssize_t ret;
+
+	while (len > 0) {
+		ret = read(cp->fd_read, buff,
+			   len > sizeof(buff) ? sizeof(buff) : len);
+		if (ret < 0)
+			return -errno;
+		else if (ret == 0)
+			return -EPIPE;
+
+		len -= ret;
+	}
+
+	return 0;
+#else
+	(void)cp;
+	(void)len;
+
+	return -ENOSYS;
+#endif
+}
+
+void conn_pipe_free(struct conn_pipe *cp)
+{
+#ifdef __linux__
+	if (cp->fd_read >= 0)
+		close(cp->fd_read);
+
+	if (cp->fd_write >= 0)
+		close(cp->fd_write);
+
+#endif
+	cp->fd_read = -1;
+	cp->fd_write = -1;
+}
+
+int conn_pipe_init(struct conn_pipe *cp)
+{
+#ifdef __linux__
+	int fds[2];
+
+	if (pipe2(fds, O_CLOEXEC) != 0) {
+		cp->fd_read = -1;
+		cp->fd_write = -1;
+
+		return -errno;
+	}
+
+	cp->fd_read = fds[0];
+	cp->fd_write = fds[1];
+
+	return 0;
+#else
+	cp->fd_read = -1;
+	cp->fd_write = -1;
+
+	return -ENOSYS;
+#endif
+}
+
 int conn_recv(struct conn_handle *conn, uint8_t *buff, size_t buff_len)
 {
 	struct conn_priv *priv = conn->priv;
+	SOCKET fd;
 	int ret = 0;
 	int bytes_read = 0;
 
 	if (conn->type != CONN_TYPE_TCP)
 		return -EPROTOTYPE;
 
-	mutex_lock_shared(&priv->mutex);
+	fd = conn_fd_acquire(priv);
 
-	if (priv->fd == INVALID_SOCKET) {
+	if (fd == INVALID_SOCKET) {
 		ret = -ENOTCONN;
 
 		goto conn_recv_exit;
 	}
 
 	while (buff_len > 0) {
-		ret = recvfrom(priv->fd, (char *)buff, (socklen_t)buff_len, 0,
+		ret = recvfrom(fd, (char *)buff, (socklen_t)buff_len, 0,
 			       NULL, NULL);
 
 		if (ret == 0) {
@@ -524,6 +1326,14 @@ int conn_recv(struct conn_handle *conn, uint8_t *buff, size_t buff_len)
 			if (ret == -WSAESHUTDOWN)
 				ret = -EPIPE;
 
+#else
+			/* Tearing down an io_uring instance interrupts every
+			 * thread which ever submitted to it, even without a
+			 * signal handler, and bytes already read would be lost
+			 */
+			if (ret == -EINTR)
+				continue;
+
 #endif
 
 			goto conn_recv_exit;
@@ -535,7 +1345,7 @@ int conn_recv(struct conn_handle *conn, uint8_t *buff, size_t buff_len)
 	}
 
 conn_recv_exit:
-	mutex_unlock_shared(&priv->mutex);
+	conn_fd_release(priv);
 
 	return ret;
 }
@@ -544,19 +1354,25 @@ int conn_recv_any(struct conn_handle *conn, uint8_t *buff, size_t buff_len,
 		  uint32_t *addr, uint16_t *port)
 {
 	struct conn_priv *priv = conn->priv;
+	SOCKET fd;
 	int ret;
 
+#ifdef HAVE_IO_URING
+	if (conn->uring != NULL && conn->type == CONN_TYPE_UDP)
+		return conn_uring_recv(conn, buff, buff_len, addr, port);
+
+#endif
 	priv->remote_addr_len = sizeof(priv->remote_addr);
 
-	mutex_lock_shared(&priv->mutex);
+	fd = conn_fd_acquire(priv);
 
-	if (priv->fd == INVALID_SOCKET) {
+	if (fd == INVALID_SOCKET) {
 		ret = -ENOTCONN;
 
 		goto conn_recv_any_exit;
 	}
 
-	ret = recvfrom(priv->fd, (char *)buff, (socklen_t)buff_len, 0,
+	ret = recvfrom(fd, (char *)buff, (socklen_t)buff_len, 0,
 		       (struct sockaddr *)&priv->remote_addr,
 		       &priv->remote_addr_len);
 
@@ -573,7 +1389,7 @@ int conn_recv_any(struct conn_handle *conn, uint8_t *buff, size_t buff_len,
 	}
 
 conn_recv_any_exit:
-	mutex_unlock_shared(&priv->mutex);
+	conn_fd_release(priv);
 
 	if (addr != NULL && ret > 0)
 		*addr = ((struct sockaddr_in *)&priv->remote_addr)->sin_addr.s_addr;
@@ -584,56 +1400,396 @@ conn_recv_any_exit:
 	return ret;
 }
 
+int conn_recv_many(struct conn_handle *conn, struct conn_datagram *dgrams,
+		   unsigned int count)
+{
+#ifdef __linux__
+	struct conn_priv *priv = conn->priv;
+	SOCKET fd;
+	struct mmsghdr msgs[CONN_RECV_MANY_MAX];
+	struct iovec iovs[CONN_RECV_MANY_MAX];
+	struct sockaddr_storage addrs[CONN_RECV_MANY_MAX];
+	const struct sockaddr_in *saddr;
+	unsigned int i;
+#endif
+	int ret;
+
+	if (conn->type != CONN_TYPE_UDP)
+		return -EPROTOTYPE;
+
+#ifdef HAVE_IO_URING
+	if (conn->uring != NULL) {
+		for (i = 0; i < count; i++) {
+			ret = conn_uring_recv(conn, dgrams[i].buff,
+					      dgrams[i].buff_len,
+					      &dgrams[i].addr, &dgrams[i].port);
+			if (ret < 0)
+				return i > 0 ? (int)i : ret;
+
+			dgrams[i].len = ret;
+		}
+
+		return (int)count;
+	}
+
+#endif
+#ifdef __linux__
+	if (priv->recv_shutdown) {
+		priv->recv_shutdown = 0;
+		return -EPIPE;
+	}
+
+	if (count > CONN_RECV_MANY_MAX)
+		count = CONN_RECV_MANY_MAX;
+
+	memset(msgs, 0x0, count * sizeof(*msgs));
+
+	for (i = 0; i < count; i++) {
+		iovs[i].iov_base = dgrams[i].buff;
+		iovs[i].iov_len = dgrams[i].buff_len;
+
+		msgs[i].msg_hdr.msg_iov = &iovs[i];
+		msgs[i].msg_hdr.msg_iovlen = 1;
+		msgs[i].msg_hdr.msg_name = &addrs[i];
+		msgs[i].msg_hdr.msg_namelen = sizeof(addrs[i]);
+	}
+
+	fd = conn_fd_acquire(priv);
+
+	if (fd == INVALID_SOCKET) {
+		ret = -ENOTCONN;
+	} else {
+		/* Only the first datagram is waited for */
+		ret = recvmmsg(fd, msgs, count, MSG_WAITFORONE, NULL);
+		if (ret == SOCKET_ERROR)
+			ret = SOCK_ERRNO;
+	}
+
+	conn_fd_release(priv);
+
+	if (ret < 0)
+		return ret;
+
+	for (i = 0; i < (unsigned int)ret; i++) {
+		/* Like conn_recv_any, an empty datagram signals a shutdown */
+		if (msgs[i].msg_len == 0 && i > 0) {
+			priv->recv_shutdown = 1;
+			return (int)i;
+		} else if (msgs[i].msg_len == 0) {
+			return -EPIPE;
+		}
+
+		saddr = (const struct sockaddr_in *)&addrs[i];
+
+		dgrams[i].len = msgs[i].msg_len;
+		dgrams[i].addr = saddr->sin_addr.s_addr;
+		dgrams[i].port = htons(saddr->sin_port);
+	}
+
+	return ret;
+#else
+	if (count == 0)
+		return 0;
+
+	ret = conn_recv_any(conn, dgrams[0].buff, dgrams[0].buff_len,
+			    &dgrams[0].addr, &dgrams[0].port);
+	if (ret < 0)
+		return ret;
+
+	dgrams[0].len = ret;
+
+	return 1;
+#endif
+}
+
+int conn_recv_pending(struct conn_handle *conn)
+{
+	struct conn_priv *priv = conn->priv;
+	SOCKET fd;
+#ifdef _WIN32
+	u_long pending = 0;
+#else
+	int pending = 0;
+#endif
+	int ret;
+
+	fd = conn_fd_acquire(priv);
+
+	if (fd == INVALID_SOCKET) {
+		ret = -ENOTCONN;
+	} else {
+#ifdef _WIN32
+		ret = ioctlsocket(fd, FIONREAD, &pending);
+#else
+		ret = ioctl(fd, FIONREAD, &pending);
+#endif
+		if (ret == SOCKET_ERROR)
+			ret = SOCK_ERRNO;
+		else
+			ret = (int)pending;
+	}
+
+	conn_fd_release(priv);
+
+	return ret;
+}
+
+void conn_resolver_free(struct conn_resolver *cr)
+{
+	if (cr->priv != NULL) {
+		struct conn_resolver_priv *priv = cr->priv;
+
+		mutex_free(&priv->mutex);
+
+		free(cr->priv);
+		cr->priv = NULL;
+	}
+}
+
+int conn_resolver_init(struct conn_resolver *cr)
+{
+	struct conn_resolver_priv *priv = cr->priv;
+	int ret;
+
+	if (priv == NULL) {
+		priv = calloc(1, sizeof(*priv));
+		if (priv == NULL)
+			return -ENOMEM;
+
+		cr->priv = priv;
+	}
+
+	ret = mutex_init(&priv->mutex);
+	if (ret < 0) {
+		free(cr->priv);
+		cr->priv = NULL;
+		return ret;
+	}
+
+	priv->num_entries = 0;
+
+	return 0;
+}
+
+int conn_resolver_prefetch(struct conn_resolver *cr, const char *host,
+			   uint8_t local)
+{
+	struct sockaddr_storage addr;
+	socklen_t addr_len;
+
+	return conn_resolve(cr, host, NULL, AF_UNSPEC, SOCK_STREAM, local != 0,
+			    &addr, &addr_len);
+}
+
+int conn_resolver_refresh(struct conn_resolver *cr)
+{
+	struct conn_resolver_priv *priv = cr->priv;
+	struct conn_resolver_entry *entry;
+	struct conn_resolver_addrs fetched;
+	char host[CONN_RESOLVER_HOST_LEN];
+	int wildcard;
+	int passive;
+	uint32_t now;
+	size_t i;
+	int count = 0;
+	int ret;
+
+	if (cr->ttl == 0)
+		return 0;
+
+	now = conn_resolver_time();
+
+	mutex_lock(&priv->mutex);
+
+	for (i = 0; i < priv->num_entries; i++) {
+		entry = &priv->entries[i];
+		if (now - entry->resolved < cr->ttl / 2)
+			continue;
+
+		strcpy(host, entry->host);
+		wildcard = entry->wildcard;
+		passive = entry->passive;
+
+		/* Other connections may use the cache while this one resolves */
+		mutex_unlock(&priv->mutex);
+
+		ret = conn_resolver_fetch(wildcard ? NULL : host, passive,
+					  &fetched);
+
+		mutex_lock(&priv->mutex);
+
+		if (ret < 0)
+			continue;
+
+		entry = conn_resolver_find(priv, wildcard ? NULL : host,
+					   passive);
+		if (entry != NULL) {
+			entry->addrs = fetched;
+			entry->resolved = now;
+			count++;
+		}
+	}
+
+	mutex_unlock(&priv->mutex);
+
+	return count;
+}
+
 int conn_send(struct conn_handle *conn, const uint8_t *buff, size_t buff_len)
 {
 	struct conn_priv *priv = conn->priv;
+	SOCKET fd;
 	int ret;
 
 	if (conn->type != CONN_TYPE_TCP)
 		return -EPROTOTYPE;
 
-	mutex_lock_shared(&priv->mutex);
+	fd = conn_fd_acquire(priv);
 
-	if (priv->fd != INVALID_SOCKET) {
+	if (fd != INVALID_SOCKET) {
 		while (buff_len > 0) {
 			/*! @TODO Bug? buff isn't changed */
-			ret = send(priv->fd, (const char *)buff, (socklen_t)buff_len,
+			ret = send(fd, (const char *)buff, (socklen_t)buff_len,
 				   MSG_NOSIGNAL);
 
-			if (ret == 0) {
-				ret = -EPIPE;
+			if (ret == 0) {
+				ret = -EPIPE;
+
+				goto conn_send_exit;
+			} else if (ret == SOCKET_ERROR) {
+				ret = SOCK_ERRNO;
+
+#ifdef _WIN32
+				if (ret == -WSAESHUTDOWN)
+					ret = -EPIPE;
+
+#endif
+
+				goto conn_send_exit;
+			}
+
+			buff_len -= ret;
+		}
+
+		ret = 0;
+	} else {
+		ret = -ENOTCONN;
+	}
+
+conn_send_exit:
+	conn_fd_release(priv);
+
+	return ret;
+}
+
+int conn_send_any(struct conn_handle *conn, const uint8_t *buff,
+		  size_t buff_len)
+{
+	struct conn_priv *priv = conn->priv;
+	SOCKET fd;
+	int ret;
+
+	if (conn->type != CONN_TYPE_TCP)
+		return -EPROTOTYPE;
+
+#ifdef HAVE_IO_URING
+	if (conn->uring != NULL)
+		return conn_uring_send(conn, buff, buff_len);
+
+#endif
+	fd = conn_fd_acquire(priv);
+
+	if (fd == INVALID_SOCKET) {
+		ret = -ENOTCONN;
+	} else {
+		ret = send(fd, (const char *)buff, (socklen_t)buff_len,
+			   MSG_NOSIGNAL);
+		if (ret == SOCKET_ERROR) {
+			ret = SOCK_ERRNO;
+
+#ifdef _WIN32
+			if (ret == -WSAESHUTDOWN)
+				ret = -EPIPE;
+			else if (ret == -WSAEWOULDBLOCK)
+				ret = -EAGAIN;
+#endif
+		}
+	}
+
+	conn_fd_release(priv);
+
+	return ret;
+}
+
+int conn_send_many(struct conn_handle *conn,
+		   const struct conn_datagram *dgrams, unsigned int count)
+{
+#ifdef __linux__
+	struct conn_priv *priv = conn->priv;
+	SOCKET fd;
+	struct mmsghdr msgs[CONN_SEND_MANY_MAX];
+	struct iovec iovs[CONN_SEND_MANY_MAX];
+	struct sockaddr_in saddrs[CONN_SEND_MANY_MAX];
+#endif
+	unsigned int i;
+	int ret;
+
+	if (conn->type != CONN_TYPE_UDP)
+		return -EPROTOTYPE;
+
+#ifdef __linux__
+	if (count > CONN_SEND_MANY_MAX)
+		count = CONN_SEND_MANY_MAX;
 
-				goto conn_send_exit;
-			} else if (ret == SOCKET_ERROR) {
-				ret = SOCK_ERRNO;
+	memset(msgs, 0x0, count * sizeof(*msgs));
+	memset(saddrs, 0x0, count * sizeof(*saddrs));
 
-#ifdef _WIN32
-				if (ret == -WSAESHUTDOWN)
-					ret = -EPIPE;
+	for (i = 0; i < count; i++) {
+		saddrs[i].sin_family = AF_INET;
+		saddrs[i].sin_port = htons(dgrams[i].port);
+		saddrs[i].sin_addr.s_addr = dgrams[i].addr;
 
-#endif
+		iovs[i].iov_base = dgrams[i].buff;
+		iovs[i].iov_len = dgrams[i].len;
 
-				goto conn_send_exit;
-			}
+		msgs[i].msg_hdr.msg_iov = &iovs[i];
+		msgs[i].msg_hdr.msg_iovlen = 1;
+		msgs[i].msg_hdr.msg_name = &saddrs[i];
+		msgs[i].msg_hdr.msg_namelen = sizeof(saddrs[i]);
+	}
 
-			buff_len -= ret;
-		}
+	fd = conn_fd_acquire(priv);
 
-		ret = 0;
-	} else {
+	if (fd == INVALID_SOCKET) {
 		ret = -ENOTCONN;
+	} else {
+		ret = sendmmsg(fd, msgs, count, MSG_NOSIGNAL);
+		if (ret == SOCKET_ERROR)
+			ret = SOCK_ERRNO;
+		else if (ret == 0 && count > 0)
+			ret = -EPIPE;
 	}
 
-conn_send_exit:
-	mutex_unlock_shared(&priv->mutex);
+	conn_fd_release(priv);
 
 	return ret;
+#else
+	for (i = 0; i < count; i++) {
+		ret = conn_send_to(conn, dgrams[i].buff, dgrams[i].len,
+				   dgrams[i].addr, dgrams[i].port);
+		if (ret < 0)
+			return i > 0 ? (int)i : ret;
+	}
+
+	return (int)count;
+#endif
 }
 
 int conn_send_to(struct conn_handle *conn, const uint8_t *buff,
 		 size_t buff_len, uint32_t addr, uint16_t port)
 {
 	struct conn_priv *priv = conn->priv;
+	SOCKET fd;
 	struct sockaddr_in saddr;
 	int ret;
 
@@ -646,12 +1802,12 @@ int conn_send_to(struct conn_handle *conn, const uint8_t *buff,
 	saddr.sin_port = htons(port);
 	saddr.sin_addr.s_addr = addr;
 
-	mutex_lock_shared(&priv->mutex);
+	fd = conn_fd_acquire(priv);
 
-	if (priv->fd != INVALID_SOCKET) {
+	if (fd != INVALID_SOCKET) {
 		while (buff_len > 0) {
 			/*! @TODO Bug? buff isn't changed */
-			ret = sendto(priv->fd, (const char *)buff,
+			ret = sendto(fd, (const char *)buff,
 				     (socklen_t)buff_len, MSG_NOSIGNAL,
 				     (struct sockaddr *)&saddr,
 				     sizeof(saddr));
@@ -680,9 +1836,73 @@ int conn_send_to(struct conn_handle *conn, const uint8_t *buff,
 	}
 
 conn_send_to_exit:
-	mutex_unlock_shared(&priv->mutex);
+	conn_fd_release(priv);
+
+	return ret;
+}
+
+int conn_sendv(struct conn_handle *conn, const struct conn_iovec *iov,
+	       unsigned int count)
+{
+#ifndef _WIN32
+	struct conn_priv *priv = conn->priv;
+	SOCKET fd;
+	int flags = MSG_NOSIGNAL;
+#endif
+#ifdef CONN_ZEROCOPY
+	size_t len = 0;
+#endif
+#if defined(_WIN32) || defined(CONN_ZEROCOPY)
+	unsigned int i;
+#endif
+	int ret;
+
+	if (conn->type != CONN_TYPE_TCP)
+		return -EPROTOTYPE;
+
+#ifdef _WIN32
+	for (i = 0; i < count; i++) {
+		ret = conn_send(conn, iov[i].buff, iov[i].len);
+		if (ret < 0)
+			return ret;
+	}
+
+	return 0;
+#else
+	fd = conn_fd_acquire(priv);
+
+	if (fd == INVALID_SOCKET) {
+		ret = -ENOTCONN;
+
+		goto conn_sendv_exit;
+	}
+
+#ifdef CONN_ZEROCOPY
+	if (priv->zerocopy_min > 0) {
+		for (i = 0; i < count; i++)
+			len += iov[i].len;
+
+		if (len >= priv->zerocopy_min)
+			flags |= MSG_ZEROCOPY;
+	}
+
+	if (flags & MSG_ZEROCOPY) {
+		ret = conn_sendmsg_all(fd, iov, count, flags,
+				       &priv->zerocopy.sends);
+		if (ret == 0)
+			priv->zerocopy.bytes += (uint32_t)len;
+
+		goto conn_sendv_exit;
+	}
+
+#endif
+	ret = conn_sendmsg_all(fd, iov, count, flags, NULL);
+
+conn_sendv_exit:
+	conn_fd_release(priv);
 
 	return ret;
+#endif
 }
 
 int conn_set_timeout(struct conn_handle *conn, uint32_t msec)
@@ -710,32 +1930,129 @@ int conn_set_timeout(struct conn_handle *conn, uint32_t msec)
 	return ret;
 }
 
-void conn_drop(struct conn_handle *conn)
+int conn_set_zerocopy(struct conn_handle *conn, size_t min_len)
+{
+#ifdef CONN_ZEROCOPY
+	struct conn_priv *priv = conn->priv;
+	SOCKET fd;
+	const int enable = min_len > 0;
+	int ret;
+
+	if (conn->type != CONN_TYPE_TCP)
+		return -EPROTOTYPE;
+
+	fd = conn_fd_acquire(priv);
+
+	if (fd == INVALID_SOCKET) {
+		ret = -ENOTCONN;
+
+		goto conn_set_zerocopy_exit;
+	}
+
+	/* The option can't be cleared, but it has no effect without the flag */
+	if (enable) {
+		ret = setsockopt(fd, SOL_SOCKET, SO_ZEROCOPY,
+				 (const void *)&enable, sizeof(enable));
+		if (ret == SOCKET_ERROR) {
+			ret = SOCK_ERRNO;
+
+			goto conn_set_zerocopy_exit;
+		}
+	}
+
+	priv->zerocopy_min = min_len;
+
+	ret = 0;
+
+conn_set_zerocopy_exit:
+	conn_fd_release(priv);
+
+	return ret;
+#else
+	(void)conn;
+	(void)min_len;
+
+	return -ENOSYS;
+#endif
+}
+
+int conn_drain(struct conn_handle *conn)
 {
 	struct conn_priv *priv = conn->priv;
+	SOCKET fd;
+	char buff[1];
+	int count = 0;
+	int ret = 0;
+#ifdef _WIN32
+	u_long mode = 1;
+#endif
 
-	/* First, shutdown any active connections */
-	mutex_lock_shared(&priv->mutex);
+	if (conn->type != CONN_TYPE_UDP)
+		return -EPROTOTYPE;
 
-	if (priv->conn_fd == INVALID_SOCKET && priv->fd == INVALID_SOCKET) {
-		/* Nothing to do here */
-		mutex_unlock_shared(&priv->mutex);
+	fd = conn_fd_acquire(priv);
 
-		return;
+	if (fd == INVALID_SOCKET) {
+		ret = -ENOTCONN;
+		goto conn_drain_exit;
 	}
 
-	if (priv->conn_fd != INVALID_SOCKET)
-		shutdown(priv->conn_fd, SHUT_RDWR);
+	priv->recv_shutdown = 0;
 
-	mutex_unlock_shared(&priv->mutex);
+#ifdef _WIN32
+	if (!conn->nonblocking && ioctlsocket(fd, FIONBIO, &mode) != 0) {
+		ret = SOCK_ERRNO;
+		goto conn_drain_exit;
+	}
+
+#endif
+	/* Datagrams keep arriving, so stop at some point */
+	for (; count < CONN_DRAIN_MAX; count++) {
+#ifdef _WIN32
+		ret = recv(fd, buff, sizeof(buff), 0);
+		if (ret == SOCKET_ERROR && WSAGetLastError() == WSAEMSGSIZE)
+			ret = 0;
+#else
+		ret = recv(fd, buff, sizeof(buff), MSG_DONTWAIT);
+#endif
+		if (ret == SOCKET_ERROR) {
+			ret = SOCK_ERRNO;
+			break;
+		}
+	}
+
+#ifdef _WIN32
+	mode = 0;
+	if (!conn->nonblocking)
+		ioctlsocket(fd, FIONBIO, &mode);
+
+	if (ret == -WSAEWOULDBLOCK)
+		ret = -EAGAIN;
+
+#endif
+	if (ret == -EAGAIN || ret == -EWOULDBLOCK || ret >= 0)
+		ret = count;
+
+conn_drain_exit:
+	conn_fd_release(priv);
+
+	return ret;
+}
+
+void conn_drop(struct conn_handle *conn)
+{
+	struct conn_priv *priv = conn->priv;
 
-	/* Now that we know there will be no one blocking while
-	 * holding the shared lock, we can get the exclusive lock
-	 * and close the descriptors
-	 */
 	mutex_lock(&priv->mutex);
 
-	priv->fd = INVALID_SOCKET;
+	/* First, shutdown any active connections */
+	if (priv->conn_fd != INVALID_SOCKET)
+		shutdown(priv->conn_fd, SHUT_RDWR);
+
+	/* Now that no one will be blocking on the socket, wait for them to
+	 * let go of it and close the descriptors
+	 */
+	conn_fd_retire(priv);
 
 	if (priv->conn_fd != INVALID_SOCKET) {
 		closesocket(priv->conn_fd);
@@ -745,6 +2062,50 @@ void conn_drop(struct conn_handle *conn)
 	mutex_unlock(&priv->mutex);
 }
 
+int conn_interrupt(struct conn_handle *conn)
+{
+	struct conn_priv *priv = conn->priv;
+	struct sockaddr_storage addr;
+	socklen_t addr_len = sizeof(addr);
+	struct sockaddr_in *sin = (struct sockaddr_in *)&addr;
+	struct sockaddr_in6 *sin6 = (struct sockaddr_in6 *)&addr;
+	SOCKET fd;
+	int ret = 0;
+
+	if (conn->type != CONN_TYPE_UDP)
+		return -EPROTOTYPE;
+
+	fd = conn_fd_acquire(priv);
+
+	if (fd == INVALID_SOCKET) {
+		ret = -ENOTCONN;
+		goto conn_interrupt_exit;
+	}
+
+	if (getsockname(fd, (struct sockaddr *)&addr,
+			&addr_len) == SOCKET_ERROR) {
+		ret = SOCK_ERRNO;
+		goto conn_interrupt_exit;
+	}
+
+	/* A socket bound to every interface can be reached on loopback */
+	if (addr.ss_family == AF_INET &&
+	    sin->sin_addr.s_addr == htonl(INADDR_ANY))
+		sin->sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	else if (addr.ss_family == AF_INET6 &&
+		 IN6_IS_ADDR_UNSPECIFIED(&sin6->sin6_addr))
+		sin6->sin6_addr = in6addr_loopback;
+
+	if (sendto(fd, "", 0, MSG_NOSIGNAL, (struct sockaddr *)&addr,
+		   addr_len) == SOCKET_ERROR)
+		ret = SOCK_ERRNO;
+
+conn_interrupt_exit:
+	conn_fd_release(priv);
+
+	return ret;
+}
+
 void conn_close(struct conn_handle *conn)
 {
 	struct conn_priv *priv = conn->priv;
@@ -752,13 +2113,12 @@ void conn_close(struct conn_handle *conn)
 	/* First, shutdown any active connections */
 	conn_shutdown(conn);
 
-	/* Now that we know there will be no one blocking while
-	 * holding the shared lock, we can get the exclusive lock
-	 * and close the descriptors
+	/* Now that no one will be blocking on the socket, wait for them to
+	 * let go of it and close the descriptors
 	 */
 	mutex_lock(&priv->mutex);
 
-	priv->fd = INVALID_SOCKET;
+	conn_fd_retire(priv);
 
 	if (priv->conn_fd != INVALID_SOCKET) {
 		closesocket(priv->conn_fd);
@@ -794,6 +2154,214 @@ void conn_shutdown(struct conn_handle *conn)
 	mutex_unlock_shared(&priv->mutex);
 }
 
+int conn_splice_recv(struct conn_handle *conn, struct conn_pipe *cp,
+		     size_t len)
+{
+#ifdef __linux__
+	struct conn_priv *priv = conn->priv;
+	SOCKET fd;
+	unsigned int flags = SPLICE_F_MOVE;
+	int ret;
+
+	if (conn->type != CONN_TYPE_TCP)
+		return -EPROTOTYPE;
+
+	if (conn->nonblocking)
+		flags |= SPLICE_F_NONBLOCK;
+
+	fd = conn_fd_acquire(priv);
+
+	if (fd == INVALID_SOCKET) {
+		ret = -ENOTCONN;
+	} else {
+		ret = (int)splice(fd, NULL, cp->fd_write, NULL, len,
+				  flags);
+		if (ret == 0)
+			ret = -EPIPE;
+		else if (ret < 0)
+			ret = -errno;
+	}
+
+	conn_fd_release(priv);
+
+	return ret;
+#else
+	(void)conn;
+	(void)cp;
+	(void)len;
+
+	return -ENOSYS;
+#endif
+}
+
+int conn_splice_send(struct conn_handle *conn, const struct conn_iovec *iov,
+		     unsigned int count, struct conn_pipe *cp, size_t len)
+{
+#ifdef __linux__
+	struct conn_priv *priv = conn->priv;
+	SOCKET fd;
+	const struct timespec no_wait = { 0, 0 };
+	sigset_t sigpipe_set;
+	sigset_t old_set;
+	ssize_t spliced;
+	int ret;
+
+	if (conn->type != CONN_TYPE_TCP) {
+		ret = -EPROTOTYPE;
+
+		goto conn_splice_send_discard;
+	}
+
+	/* Unlike sendmsg, splice can't be asked not to raise SIGPIPE, so it is
+	 * held back for this thread and consumed if it was raised here
+	 */
+	sigemptyset(&sigpipe_set);
+	sigaddset(&sigpipe_set, SIGPIPE);
+	pthread_sigmask(SIG_BLOCK, &sigpipe_set, &old_set);
+
+	fd = conn_fd_acquire(priv);
+
+	if (fd == INVALID_SOCKET) {
+		ret = -ENOTCONN;
+
+		goto conn_splice_send_exit;
+	}
+
+	ret = conn_sendmsg_all(fd, iov, count, MSG_NOSIGNAL | MSG_MORE,
+			       NULL);
+	if (ret < 0)
+		goto conn_splice_send_exit;
+
+	while (len > 0) {
+		spliced = splice(cp->fd_read, NULL, fd, NULL, len,
+				 SPLICE_F_MOVE);
+		if (spliced < 0) {
+			ret = -errno;
+
+			goto conn_splice_send_exit;
+		} else if (spliced == 0) {
+			ret = -EPIPE;
+
+			goto conn_splice_send_exit;
+		}
+
+		len -= spliced;
+	}
+
+conn_splice_send_exit:
+	conn_fd_release(priv);
+
+	if (ret == -EPIPE && !sigismember(&old_set, SIGPIPE))
+		sigtimedwait(&sigpipe_set, NULL, &no_wait);
+
+	pthread_sigmask(SIG_SETMASK, &old_set, NULL);
+
+conn_splice_send_discard:
+	if (len > 0)
+		conn_pipe_discard(cp, len);
+
+	return ret;
+#else
+	(void)conn;
+	(void)iov;
+	(void)count;
+	(void)cp;
+	(void)len;
+
+	return -ENOSYS;
+#endif
+}
+
+int conn_zerocopy_reap(struct conn_handle *conn, uint32_t msec)
+{
+#ifdef CONN_ZEROCOPY
+	struct conn_priv *priv = conn->priv;
+	SOCKET fd;
+	struct sock_extended_err *serr;
+	char control[CONN_ZEROCOPY_CMSG_LEN];
+	struct cmsghdr *cm;
+	struct msghdr msg;
+	struct pollfd pfd;
+	uint32_t num;
+	int ret = 0;
+
+	fd = conn_fd_acquire(priv);
+
+	if (fd == INVALID_SOCKET) {
+		ret = -ENOTCONN;
+
+		goto conn_zerocopy_reap_exit;
+	}
+
+	while (priv->zerocopy.completed != priv->zerocopy.sends) {
+		memset(&msg, 0x0, sizeof(msg));
+		msg.msg_control = control;
+		msg.msg_controllen = sizeof(control);
+
+		ret = recvmsg(fd, &msg, MSG_ERRQUEUE | MSG_DONTWAIT);
+		if (ret == SOCKET_ERROR) {
+			ret = SOCK_ERRNO;
+			if (ret != -EAGAIN && ret != -EWOULDBLOCK)
+				goto conn_zerocopy_reap_exit;
+
+			ret = 0;
+			if (msec == 0)
+				break;
+
+			/* Notifications are reported as an error condition */
+			pfd.fd = fd;
+			pfd.events = 0;
+			pfd.revents = 0;
+			ret = poll(&pfd, 1, (int)msec);
+			if (ret < 0) {
+				ret = -errno;
+
+				goto conn_zerocopy_reap_exit;
+			}
+
+			/* Only wait once */
+			msec = 0;
+			ret = 0;
+
+			continue;
+		}
+
+		for (cm = CMSG_FIRSTHDR(&msg); cm != NULL;
+		     cm = CMSG_NXTHDR(&msg, cm)) {
+			if (!(cm->cmsg_level == SOL_IP &&
+			      cm->cmsg_type == IP_RECVERR) &&
+			    !(cm->cmsg_level == SOL_IPV6 &&
+			      cm->cmsg_type == IPV6_RECVERR))
+				continue;
+
+			serr = (struct sock_extended_err *)CMSG_DATA(cm);
+			if (serr->ee_errno != 0 ||
+			    serr->ee_origin != SO_EE_ORIGIN_ZEROCOPY)
+				continue;
+
+			/* Each notification covers an inclusive range of sends */
+			num = serr->ee_data - serr->ee_info + 1;
+
+			priv->zerocopy.completed += num;
+			if (serr->ee_code & SO_EE_CODE_ZEROCOPY_COPIED)
+				priv->zerocopy.copied += num;
+		}
+	}
+
+	ret = (int)(priv->zerocopy.sends - priv->zerocopy.completed);
+
+conn_zerocopy_reap_exit:
+	conn_fd_release(priv);
+
+	return ret;
+#else
+	(void)conn;
+	(void)msec;
+
+	return 0;
+#endif
+}
+
 void conn_get_remote_addr(const struct conn_handle *conn, char dest[54])
 {
 	const struct conn_priv *priv = conn->priv;
@@ -822,17 +2390,43 @@ void conn_get_remote_addr(const struct conn_handle *conn, char dest[54])
 	}
 }
 
+#ifndef _WIN32
+int conn_get_fd(struct conn_handle *conn)
+{
+	struct conn_priv *priv = conn->priv;
+	SOCKET fd;
+	int ret;
+
+	fd = conn_fd_acquire(priv);
+
+	ret = fd;
+
+	conn_fd_release(priv);
+
+	return ret;
+}
+#endif
+
+void conn_get_zerocopy_stats(struct conn_handle *conn,
+			     struct conn_zerocopy_stats *stats)
+{
+	struct conn_priv *priv = conn->priv;
+
+	*stats = priv->zerocopy;
+}
+
 int conn_in_use(struct conn_handle *conn)
 {
 	struct conn_priv *priv = conn->priv;
+	SOCKET fd;
 	int ret = 0;
 
-	mutex_lock_shared(&priv->mutex);
+	fd = conn_fd_acquire(priv);
 
-	if (priv->fd != INVALID_SOCKET)
+	if (fd != INVALID_SOCKET)
 		ret = 1;
 
-	mutex_unlock_shared(&priv->mutex);
+	conn_fd_release(priv);
 
 	return ret;
 }
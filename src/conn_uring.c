@@ -0,0 +1,1022 @@
+/*!
+ * @file conn_uring.c
+ *
+ * @copyright
+ * Copyright &copy; 2026, Scott K Logan
+ *
+ * @copyright
+ * All rights reserved.
+ *
+ * @copyright
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * @copyright
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * @copyright
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * @copyright
+ * EchoLink&reg; is a registered trademark of Synergenics, LLC
+ *
+ * @author Scott K Logan &lt;logans@cottsay.net&gt;
+ *
+ * @brief Completion-based network connection I/O using io_uring
+ */
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <linux/io_uring.h>
+#include <netinet/in.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+
+#include "conn.h"
+#include "conn_uring.h"
+
+/*! Number of submission queue entries in each ring */
+#define CONN_URING_SQ_LEN 256
+
+/*! Number of completion queue entries in each ring */
+#define CONN_URING_CQ_LEN 4096
+
+/*! Number of registered receive buffers in each ring, must be a power of 2 */
+#define CONN_URING_BUFS 128
+
+/*! Size of each registered receive buffer */
+#define CONN_URING_BUFF_LEN 4096
+
+/*! Size of the staging buffer for data sent on each TCP connection */
+#define CONN_URING_SEND_LEN 32768
+
+/*! Bit set in the user data of send operations to distinguish them */
+#define CONN_URING_TAG_SEND 0x1
+
+/*!
+ * @brief Datagram which has been received but not yet retrieved
+ */
+struct conn_uring_datagram {
+	/*! ID of the registered buffer which holds the datagram */
+	uint16_t bid;
+
+	/*! Number of bytes in the registered buffer */
+	uint16_t len;
+};
+
+/*!
+ * @brief State of a connection attached to a ring
+ *
+ * The state outlives the attachment until every operation which references it
+ * has completed.
+ */
+struct conn_uring_conn {
+	/*! Ring which the connection is attached to */
+	struct conn_uring_priv *ring;
+
+	/*! Attached connection, or NULL once detached */
+	struct conn_handle *conn;
+
+	/*! Previous entry in conn_uring_priv::conns */
+	struct conn_uring_conn *prev;
+
+	/*! Next entry in conn_uring_priv::conns */
+	struct conn_uring_conn *next;
+
+	/*! Protocol of the attached connection */
+	enum CONN_TYPE type;
+
+	/*! Socket file descriptor of the attached connection */
+	int fd;
+
+	/*! Number of submitted operations which have not completed */
+	int ops;
+
+	/*! First error reported by an operation, or zero */
+	int error;
+
+	/*! Message header describing the layout of received datagrams */
+	struct msghdr msg;
+
+	/*! Non-zero while a multishot receive operation is active */
+	uint8_t recv_armed;
+
+	/*! Received datagrams, in the order they were received */
+	struct conn_uring_datagram queue[CONN_URING_BUFS];
+
+	/*! Index of the oldest entry in conn_uring_conn::queue */
+	unsigned int queue_head;
+
+	/*! Number of entries in conn_uring_conn::queue */
+	unsigned int queue_len;
+
+	/*! Data staged to be sent, for TCP connections */
+	uint8_t *send_buff;
+
+	/*! Offset of the oldest staged byte in conn_uring_conn::send_buff */
+	size_t send_head;
+
+	/*! Number of staged bytes which have not been sent */
+	size_t send_len;
+
+	/*! Number of bytes sent by the send operations in flight */
+	size_t send_done;
+
+	/*! Number of send operations in flight */
+	int send_ops;
+};
+
+/*!
+ * @brief Private data for an instance of a ring
+ */
+struct conn_uring_priv {
+	/*! File descriptor of the ring */
+	int ring_fd;
+
+	/*! Mapping of the submission queue ring */
+	void *sq_ptr;
+
+	/*! Size of conn_uring_priv::sq_ptr */
+	size_t sq_size;
+
+	/*! Mapping of the completion queue ring */
+	void *cq_ptr;
+
+	/*! Size of conn_uring_priv::cq_ptr */
+	size_t cq_size;
+
+	/*! Mapping of the submission queue entries */
+	struct io_uring_sqe *sqes;
+
+	/*! Size of conn_uring_priv::sqes */
+	size_t sqes_size;
+
+	/*! Kernel's position in the submission queue */
+	unsigned int *sq_head;
+
+	/*! Application's published position in the submission queue */
+	unsigned int *sq_tail;
+
+	/*! Mask applied to submission queue positions */
+	unsigned int sq_mask;
+
+	/*! Number of entries in the submission queue */
+	unsigned int sq_entries;
+
+	/*! Submission queue status flags */
+	unsigned int *sq_flags;
+
+	/*! Indirection array of submission queue entries */
+	unsigned int *sq_array;
+
+	/*! Position after the most recently queued submission queue entry */
+	unsigned int sq_local_tail;
+
+	/*! Number of queued entries which have not been submitted */
+	unsigned int sq_unsubmitted;
+
+	/*! Application's position in the completion queue */
+	unsigned int *cq_head;
+
+	/*! Kernel's position in the completion queue */
+	unsigned int *cq_tail;
+
+	/*! Mask applied to completion queue positions */
+	unsigned int cq_mask;
+
+	/*! Completion queue entries */
+	struct io_uring_cqe *cqes;
+
+	/*! Ring which provides receive buffers to the kernel */
+	struct io_uring_buf_ring *buf_ring;
+
+	/*! Size of conn_uring_priv::buf_ring */
+	size_t buf_ring_size;
+
+	/*! Position after the most recently provided buffer */
+	uint16_t buf_tail;
+
+	/*! Number of buffers currently available to the kernel */
+	unsigned int bufs_free;
+
+	/*! Storage for the registered receive buffers */
+	uint8_t *bufs;
+
+	/*! List of attached connections and connections with operations in
+	 *  flight */
+	struct conn_uring_conn *conns;
+
+	/*! Unused state for TCP connections, linked by conn_uring_conn::next */
+	struct conn_uring_conn *spare_tcp;
+
+	/*! Unused state for UDP connections, linked by conn_uring_conn::next */
+	struct conn_uring_conn *spare_udp;
+
+	/*! Non-zero once ::conn_uring_reserve has been called, after which
+	 *  connection state is only ever reused */
+	uint8_t reserved;
+};
+
+/*!
+ * @brief Queues a multishot receive operation on a UDP connection
+ *
+ * @param[in,out] priv Target ring instance private data
+ * @param[in,out] c Target attached connection
+ */
+static void conn_uring_arm_recv(struct conn_uring_priv *priv,
+				struct conn_uring_conn *c);
+
+/*!
+ * @brief Processes a single completion queue entry
+ *
+ * @param[in,out] priv Target ring instance private data
+ * @param[in] cqe Completion queue entry to process
+ */
+static void conn_uring_complete(struct conn_uring_priv *priv,
+				const struct io_uring_cqe *cqe);
+
+/*!
+ * @brief Submits queued entries to the kernel
+ *
+ * @param[in,out] priv Target ring instance private data
+ * @param[in] wait Number of completions to wait for
+ *
+ * @returns 0 on success, negative ERRNO value on failure
+ */
+static int conn_uring_enter(struct conn_uring_priv *priv, unsigned int wait);
+
+/*!
+ * @brief Gets the next free submission queue entry
+ *
+ * @param[in,out] priv Target ring instance private data
+ *
+ * @returns Zeroed submission queue entry, or NULL if the queue is full
+ */
+static struct io_uring_sqe *conn_uring_get_sqe(struct conn_uring_priv *priv);
+
+/*!
+ * @brief Queues send operations for the data staged on a TCP connection
+ *
+ * @param[in,out] priv Target ring instance private data
+ * @param[in,out] c Target attached connection
+ */
+static void conn_uring_queue_send(struct conn_uring_priv *priv,
+				  struct conn_uring_conn *c);
+
+/*!
+ * @brief Returns a registered receive buffer to the kernel
+ *
+ * @param[in,out] priv Target ring instance private data
+ * @param[in] bid ID of the buffer to return
+ */
+static void conn_uring_recycle(struct conn_uring_priv *priv, uint16_t bid);
+
+/*!
+ * @brief Frees connection state which is no longer referenced
+ *
+ * @param[in,out] priv Target ring instance private data
+ * @param[in,out] c Target connection state
+ */
+static void conn_uring_release(struct conn_uring_priv *priv,
+			       struct conn_uring_conn *c);
+
+/*!
+ * @brief Allocates state for a connection
+ *
+ * @param[in] type Protocol of the connection
+ *
+ * @returns Zeroed connection state, or NULL on failure
+ */
+static struct conn_uring_conn *conn_uring_conn_alloc(enum CONN_TYPE type);
+
+/*!
+ * @brief Frees a list of connection state linked by conn_uring_conn::next
+ *
+ * @param[in,out] c First entry in the list, or NULL
+ */
+static void conn_uring_conn_free(struct conn_uring_conn *c);
+
+/*!
+ * @brief Determines the number of free submission queue entries
+ *
+ * @param[in] priv Target ring instance private data
+ *
+ * @returns Number of free submission queue entries
+ */
+static unsigned int conn_uring_sq_space(const struct conn_uring_priv *priv);
+
+static void conn_uring_arm_recv(struct conn_uring_priv *priv,
+				struct conn_uring_conn *c)
+{
+	struct io_uring_sqe *sqe;
+
+	sqe = conn_uring_get_sqe(priv);
+	if (sqe == NULL)
+		return;
+
+	sqe->opcode = IORING_OP_RECVMSG;
+	sqe->fd = c->fd;
+	sqe->addr = (uintptr_t)&c->msg;
+	sqe->len = 1;
+	sqe->ioprio = IORING_RECV_MULTISHOT;
+	sqe->flags = IOSQE_BUFFER_SELECT;
+	sqe->buf_group = 0;
+	sqe->user_data = (uintptr_t)c;
+
+	c->recv_armed = 1;
+	c->ops++;
+}
+
+static void conn_uring_complete(struct conn_uring_priv *priv,
+				const struct io_uring_cqe *cqe)
+{
+	struct conn_uring_conn *c;
+	struct conn_uring_datagram *dgram;
+	size_t overhead;
+	uint16_t bid;
+
+	/* Cancellation requests are not tracked */
+	if (cqe->user_data == 0)
+		return;
+
+	c = (struct conn_uring_conn *)(uintptr_t)
+	    (cqe->user_data & ~(uint64_t)CONN_URING_TAG_SEND);
+
+	if (cqe->user_data & CONN_URING_TAG_SEND) {
+		c->ops--;
+		c->send_ops--;
+
+		if (cqe->res > 0)
+			c->send_done += cqe->res;
+		else if (cqe->res == 0 && c->error == 0)
+			c->error = -EPIPE;
+		else if (cqe->res != -ECANCELED && c->error == 0)
+			c->error = cqe->res;
+
+		/* A short send cancels the rest of the chain, which is
+		 * resubmitted from where it left off
+		 */
+		if (c->send_ops == 0) {
+			c->send_head = (c->send_head + c->send_done) %
+				       CONN_URING_SEND_LEN;
+			c->send_len -= c->send_done;
+			c->send_done = 0;
+
+			if (c->send_len == 0)
+				c->send_head = 0;
+		}
+	} else {
+		if (!(cqe->flags & IORING_CQE_F_MORE)) {
+			c->recv_armed = 0;
+			c->ops--;
+		}
+
+		if (cqe->flags & IORING_CQE_F_BUFFER) {
+			bid = (uint16_t)(cqe->flags >> IORING_CQE_BUFFER_SHIFT);
+			overhead = sizeof(struct io_uring_recvmsg_out) +
+				   c->msg.msg_namelen + c->msg.msg_controllen;
+
+			priv->bufs_free--;
+
+			/* Empty datagrams carry nothing worth forwarding */
+			if (c->conn == NULL || cqe->res <= (int)overhead ||
+			    c->queue_len == CONN_URING_BUFS) {
+				conn_uring_recycle(priv, bid);
+			} else {
+				dgram = &c->queue[(c->queue_head + c->queue_len) %
+						  CONN_URING_BUFS];
+				dgram->bid = bid;
+				dgram->len = (uint16_t)cqe->res;
+				c->queue_len++;
+			}
+		} else if (cqe->res < 0 && cqe->res != -ENOBUFS &&
+			   cqe->res != -ECANCELED && c->error == 0) {
+			c->error = cqe->res;
+		}
+	}
+
+	conn_uring_release(priv, c);
+}
+
+static int conn_uring_enter(struct conn_uring_priv *priv, unsigned int wait)
+{
+	long ret;
+
+	if (priv->sq_unsubmitted == 0 && wait == 0 &&
+	    !(__atomic_load_n(priv->sq_flags, __ATOMIC_RELAXED) &
+	      IORING_SQ_CQ_OVERFLOW))
+		return 0;
+
+	__atomic_store_n(priv->sq_tail, priv->sq_local_tail, __ATOMIC_RELEASE);
+
+	ret = syscall(__NR_io_uring_enter, priv->ring_fd, priv->sq_unsubmitted,
+		      wait, IORING_ENTER_GETEVENTS, NULL, 0);
+	if (ret < 0) {
+		switch (errno) {
+		case EAGAIN:
+		case EBUSY:
+		case EINTR:
+			/* Retried on the next call */
+			return 0;
+		default:
+			return -errno;
+		}
+	}
+
+	priv->sq_unsubmitted -= (unsigned int)ret;
+
+	return 0;
+}
+
+static struct io_uring_sqe *conn_uring_get_sqe(struct conn_uring_priv *priv)
+{
+	struct io_uring_sqe *sqe;
+	unsigned int index;
+
+	if (conn_uring_sq_space(priv) == 0)
+		return NULL;
+
+	index = priv->sq_local_tail & priv->sq_mask;
+
+	sqe = &priv->sqes[index];
+	memset(sqe, 0x0, sizeof(*sqe));
+
+	priv->sq_array[index] = index;
+	priv->sq_local_tail++;
+	priv->sq_unsubmitted++;
+
+	return sqe;
+}
+
+static void conn_uring_queue_send(struct conn_uring_priv *priv,
+				  struct conn_uring_conn *c)
+{
+	struct io_uring_sqe *sqe;
+	size_t offset = c->send_head;
+	size_t remaining = c->send_len;
+	size_t chunk;
+	int count;
+
+	/* The staged data wraps around at most once */
+	count = c->send_head + c->send_len > CONN_URING_SEND_LEN ? 2 : 1;
+
+	/* Both halves must be submitted together to stay linked */
+	if (conn_uring_sq_space(priv) < (unsigned int)count &&
+	    (conn_uring_enter(priv, 0) < 0 ||
+	     conn_uring_sq_space(priv) < (unsigned int)count))
+		return;
+
+	while (remaining > 0) {
+		chunk = CONN_URING_SEND_LEN - offset;
+		if (chunk > remaining)
+			chunk = remaining;
+
+		sqe = conn_uring_get_sqe(priv);
+
+		sqe->opcode = IORING_OP_SEND;
+		sqe->fd = c->fd;
+		sqe->addr = (uintptr_t)&c->send_buff[offset];
+		sqe->len = (uint32_t)chunk;
+		sqe->msg_flags = MSG_NOSIGNAL | MSG_WAITALL;
+		sqe->user_data = (uintptr_t)c | CONN_URING_TAG_SEND;
+
+		remaining -= chunk;
+		offset = 0;
+
+		/* Keep the stream in order if the first half is short */
+		if (remaining > 0)
+			sqe->flags = IOSQE_IO_LINK;
+
+		c->send_ops++;
+		c->ops++;
+	}
+}
+
+static void conn_uring_recycle(struct conn_uring_priv *priv, uint16_t bid)
+{
+	struct io_uring_buf *buf;
+
+	buf = &priv->buf_ring->bufs[priv->buf_tail & (CONN_URING_BUFS - 1)];
+	buf->addr = (uintptr_t)&priv->bufs[(size_t)bid * CONN_URING_BUFF_LEN];
+	buf->len = CONN_URING_BUFF_LEN;
+	buf->bid = bid;
+
+	priv->buf_tail++;
+	priv->bufs_free++;
+
+	__atomic_store_n(&priv->buf_ring->tail, priv->buf_tail,
+			 __ATOMIC_RELEASE);
+}
+
+static void conn_uring_release(struct conn_uring_priv *priv,
+			       struct conn_uring_conn *c)
+{
+	if (c->conn != NULL || c->ops > 0)
+		return;
+
+	if (c->prev != NULL)
+		c->prev->next = c->next;
+	else
+		priv->conns = c->next;
+
+	if (c->next != NULL)
+		c->next->prev = c->prev;
+
+	if (!priv->reserved) {
+		c->next = NULL;
+		conn_uring_conn_free(c);
+		return;
+	}
+
+	/* Keep the state, including the staging buffer, for the next
+	 * connection
+	 */
+	if (c->type == CONN_TYPE_TCP) {
+		c->next = priv->spare_tcp;
+		priv->spare_tcp = c;
+	} else {
+		c->next = priv->spare_udp;
+		priv->spare_udp = c;
+	}
+}
+
+static unsigned int conn_uring_sq_space(const struct conn_uring_priv *priv)
+{
+	return priv->sq_entries -
+	       (priv->sq_local_tail -
+		__atomic_load_n(priv->sq_head, __ATOMIC_ACQUIRE));
+}
+
+int conn_uring_attach(struct conn_uring_handle *cu, struct conn_handle *conn)
+{
+	struct conn_uring_priv *priv = cu->priv;
+	struct conn_uring_conn **spare;
+	struct conn_uring_conn *c;
+	uint8_t *send_buff;
+	int fd;
+
+	if (conn->uring != NULL)
+		return -EBUSY;
+
+	fd = conn_get_fd(conn);
+	if (fd < 0)
+		return -ENOTCONN;
+
+	if (priv->reserved) {
+		spare = conn->type == CONN_TYPE_TCP ?
+			&priv->spare_tcp : &priv->spare_udp;
+
+		c = *spare;
+		if (c == NULL)
+			return -ENOMEM;
+
+		*spare = c->next;
+
+		send_buff = c->send_buff;
+		memset(c, 0x0, sizeof(*c));
+		c->send_buff = send_buff;
+	} else {
+		c = conn_uring_conn_alloc(conn->type);
+		if (c == NULL)
+			return -ENOMEM;
+	}
+
+	c->fd = fd;
+	c->type = conn->type;
+
+	/* Received datagrams are laid out as the header, then the address,
+	 * then the payload
+	 */
+	c->msg.msg_namelen = sizeof(struct sockaddr_storage);
+
+	c->ring = priv;
+	c->conn = conn;
+	c->next = priv->conns;
+	if (c->next != NULL)
+		c->next->prev = c;
+	priv->conns = c;
+
+	conn->uring = c;
+
+	return 0;
+}
+
+static struct conn_uring_conn *conn_uring_conn_alloc(enum CONN_TYPE type)
+{
+	struct conn_uring_conn *c;
+
+	c = calloc(1, sizeof(*c));
+	if (c == NULL)
+		return NULL;
+
+	if (type == CONN_TYPE_TCP) {
+		c->send_buff = malloc(CONN_URING_SEND_LEN);
+		if (c->send_buff == NULL) {
+			free(c);
+			return NULL;
+		}
+	}
+
+	return c;
+}
+
+static void conn_uring_conn_free(struct conn_uring_conn *c)
+{
+	struct conn_uring_conn *next;
+
+	for (; c != NULL; c = next) {
+		next = c->next;
+		free(c->send_buff);
+		free(c);
+	}
+}
+
+void conn_uring_detach(struct conn_handle *conn)
+{
+	struct conn_uring_conn *c = conn->uring;
+	struct conn_uring_priv *priv;
+	struct io_uring_sqe *sqe;
+
+	if (c == NULL)
+		return;
+
+	priv = c->ring;
+
+	conn->uring = NULL;
+	c->conn = NULL;
+
+	for (; c->queue_len > 0; c->queue_len--) {
+		conn_uring_recycle(priv, c->queue[c->queue_head].bid);
+		c->queue_head = (c->queue_head + 1) % CONN_URING_BUFS;
+	}
+
+	/* Operations in flight keep the socket open, so cancel them now */
+	if (c->ops > 0) {
+		sqe = conn_uring_get_sqe(priv);
+		if (sqe == NULL && conn_uring_enter(priv, 0) == 0)
+			sqe = conn_uring_get_sqe(priv);
+
+		if (sqe != NULL) {
+			sqe->opcode = IORING_OP_ASYNC_CANCEL;
+			sqe->fd = c->fd;
+			sqe->cancel_flags = IORING_ASYNC_CANCEL_FD |
+					    IORING_ASYNC_CANCEL_ALL;
+			sqe->user_data = 0;
+
+			conn_uring_enter(priv, 0);
+		}
+	}
+
+	conn_uring_release(priv, c);
+}
+
+void conn_uring_free(struct conn_uring_handle *cu)
+{
+	struct conn_uring_priv *priv = cu->priv;
+	struct conn_uring_conn *next;
+	struct conn_uring_conn *c;
+	struct io_uring_sqe *sqe;
+	int i;
+
+	if (priv == NULL)
+		return;
+
+	for (c = priv->conns; c != NULL; c = next) {
+		next = c->next;
+		if (c->conn != NULL)
+			conn_uring_detach(c->conn);
+	}
+
+	/* The kernel may still reference staged data until every operation
+	 * has been cancelled
+	 */
+	for (i = 0; i < 16 && priv->conns != NULL; i++) {
+		sqe = conn_uring_get_sqe(priv);
+		if (sqe != NULL) {
+			sqe->opcode = IORING_OP_ASYNC_CANCEL;
+			sqe->cancel_flags = IORING_ASYNC_CANCEL_ANY |
+					    IORING_ASYNC_CANCEL_ALL;
+			sqe->user_data = 0;
+		}
+
+		if (conn_uring_enter(priv, 1) < 0)
+			break;
+
+		conn_uring_reap(cu);
+	}
+
+	conn_uring_conn_free(priv->conns);
+	conn_uring_conn_free(priv->spare_tcp);
+	conn_uring_conn_free(priv->spare_udp);
+
+	if (priv->ring_fd >= 0)
+		close(priv->ring_fd);
+
+	if (priv->buf_ring != NULL)
+		munmap(priv->buf_ring, priv->buf_ring_size);
+
+	if (priv->sqes != NULL)
+		munmap(priv->sqes, priv->sqes_size);
+
+	if (priv->cq_ptr != NULL && priv->cq_ptr != priv->sq_ptr)
+		munmap(priv->cq_ptr, priv->cq_size);
+
+	if (priv->sq_ptr != NULL)
+		munmap(priv->sq_ptr, priv->sq_size);
+
+	free(priv->bufs);
+	free(priv);
+	cu->priv = NULL;
+}
+
+int conn_uring_get_fd(const struct conn_uring_handle *cu)
+{
+	const struct conn_uring_priv *priv = cu->priv;
+
+	return priv->ring_fd;
+}
+
+int conn_uring_init(struct conn_uring_handle *cu)
+{
+	struct conn_uring_priv *priv = cu->priv;
+	struct io_uring_params params;
+	struct io_uring_buf_reg reg;
+	uint8_t *sq;
+	uint8_t *cq;
+	uint16_t i;
+	int ret;
+
+	if (priv == NULL) {
+		priv = calloc(1, sizeof(*priv));
+		if (priv == NULL)
+			return -ENOMEM;
+
+		cu->priv = priv;
+	}
+
+	memset(&params, 0x0, sizeof(params));
+	params.flags = IORING_SETUP_CQSIZE;
+	params.cq_entries = CONN_URING_CQ_LEN;
+
+	priv->ring_fd = (int)syscall(__NR_io_uring_setup, CONN_URING_SQ_LEN,
+				     &params);
+	if (priv->ring_fd < 0) {
+		ret = -errno;
+		goto conn_uring_init_exit;
+	}
+
+	/* Multishot completions must never be dropped */
+	if (!(params.features & IORING_FEAT_NODROP) ||
+	    !(params.features & IORING_FEAT_SINGLE_MMAP)) {
+		ret = -ENOSYS;
+		goto conn_uring_init_exit;
+	}
+
+	priv->sq_size = params.sq_off.array +
+			params.sq_entries * sizeof(unsigned int);
+	priv->cq_size = params.cq_off.cqes +
+			params.cq_entries * sizeof(struct io_uring_cqe);
+	if (priv->cq_size > priv->sq_size)
+		priv->sq_size = priv->cq_size;
+	priv->cq_size = priv->sq_size;
+
+	priv->sq_ptr = mmap(NULL, priv->sq_size, PROT_READ | PROT_WRITE,
+			    MAP_SHARED | MAP_POPULATE, priv->ring_fd,
+			    IORING_OFF_SQ_RING);
+	if (priv->sq_ptr == MAP_FAILED) {
+		priv->sq_ptr = NULL;
+		ret = -errno;
+		goto conn_uring_init_exit;
+	}
+
+	priv->cq_ptr = priv->sq_ptr;
+
+	priv->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+	priv->sqes = mmap(NULL, priv->sqes_size, PROT_READ | PROT_WRITE,
+			  MAP_SHARED | MAP_POPULATE, priv->ring_fd,
+			  IORING_OFF_SQES);
+	if (priv->sqes == MAP_FAILED) {
+		priv->sqes = NULL;
+		ret = -errno;
+		goto conn_uring_init_exit;
+	}
+
+	sq = priv->sq_ptr;
+	priv->sq_head = (unsigned int *)(sq + params.sq_off.head);
+	priv->sq_tail = (unsigned int *)(sq + params.sq_off.tail);
+	priv->sq_mask = *(unsigned int *)(sq + params.sq_off.ring_mask);
+	priv->sq_entries = *(unsigned int *)(sq + params.sq_off.ring_entries);
+	priv->sq_flags = (unsigned int *)(sq + params.sq_off.flags);
+	priv->sq_array = (unsigned int *)(sq + params.sq_off.array);
+	priv->sq_local_tail = *priv->sq_tail;
+
+	cq = priv->cq_ptr;
+	priv->cq_head = (unsigned int *)(cq + params.cq_off.head);
+	priv->cq_tail = (unsigned int *)(cq + params.cq_off.tail);
+	priv->cq_mask = *(unsigned int *)(cq + params.cq_off.ring_mask);
+	priv->cqes = (struct io_uring_cqe *)(cq + params.cq_off.cqes);
+
+	/* The buffer ring must be page aligned */
+	priv->buf_ring_size = CONN_URING_BUFS * sizeof(struct io_uring_buf);
+	priv->buf_ring = mmap(NULL, priv->buf_ring_size,
+			      PROT_READ | PROT_WRITE,
+			      MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (priv->buf_ring == MAP_FAILED) {
+		priv->buf_ring = NULL;
+		ret = -errno;
+		goto conn_uring_init_exit;
+	}
+
+	priv->bufs = malloc((size_t)CONN_URING_BUFS * CONN_URING_BUFF_LEN);
+	if (priv->bufs == NULL) {
+		ret = -ENOMEM;
+		goto conn_uring_init_exit;
+	}
+
+	memset(&reg, 0x0, sizeof(reg));
+	reg.ring_addr = (uintptr_t)priv->buf_ring;
+	reg.ring_entries = CONN_URING_BUFS;
+	reg.bgid = 0;
+
+	if (syscall(__NR_io_uring_register, priv->ring_fd,
+		    IORING_REGISTER_PBUF_RING, &reg, 1) < 0) {
+		ret = -errno;
+		goto conn_uring_init_exit;
+	}
+
+	for (i = 0; i < CONN_URING_BUFS; i++)
+		conn_uring_recycle(priv, i);
+
+	return 0;
+
+conn_uring_init_exit:
+	conn_uring_free(cu);
+
+	return ret;
+}
+
+int conn_uring_readable(const struct conn_handle *conn)
+{
+	const struct conn_uring_conn *c = conn->uring;
+
+	return c->queue_len > 0 || c->error != 0;
+}
+
+void conn_uring_reap(struct conn_uring_handle *cu)
+{
+	struct conn_uring_priv *priv = cu->priv;
+	unsigned int head = *priv->cq_head;
+	unsigned int tail;
+
+	tail = __atomic_load_n(priv->cq_tail, __ATOMIC_ACQUIRE);
+
+	for (; head != tail; head++)
+		conn_uring_complete(priv, &priv->cqes[head & priv->cq_mask]);
+
+	__atomic_store_n(priv->cq_head, head, __ATOMIC_RELEASE);
+}
+
+int conn_uring_recv(struct conn_handle *conn, uint8_t *buff, size_t buff_len,
+		    uint32_t *addr, uint16_t *port)
+{
+	struct conn_uring_conn *c = conn->uring;
+	const struct conn_uring_datagram *dgram;
+	const struct io_uring_recvmsg_out *out;
+	const struct sockaddr_in *name;
+	size_t overhead;
+	size_t len;
+
+	if (c->queue_len == 0)
+		return c->error != 0 ? c->error : -EAGAIN;
+
+	dgram = &c->queue[c->queue_head];
+
+	out = (const struct io_uring_recvmsg_out *)
+	      &c->ring->bufs[(size_t)dgram->bid * CONN_URING_BUFF_LEN];
+	name = (const struct sockaddr_in *)(out + 1);
+	overhead = sizeof(*out) + c->msg.msg_namelen + c->msg.msg_controllen;
+
+	/* Like recvfrom, datagrams larger than the buffer are truncated */
+	len = dgram->len - overhead;
+	if (len > buff_len)
+		len = buff_len;
+
+	memcpy(buff, (const uint8_t *)out + overhead, len);
+
+	if (addr != NULL)
+		*addr = name->sin_addr.s_addr;
+
+	if (port != NULL)
+		*port = htons(name->sin_port);
+
+	conn_uring_recycle(c->ring, dgram->bid);
+
+	c->queue_head = (c->queue_head + 1) % CONN_URING_BUFS;
+	c->queue_len--;
+
+	return (int)len;
+}
+
+int conn_uring_reserve(struct conn_uring_handle *cu, enum CONN_TYPE type,
+		       unsigned int count)
+{
+	struct conn_uring_priv *priv = cu->priv;
+	struct conn_uring_conn **spare;
+	struct conn_uring_conn *c;
+
+	spare = type == CONN_TYPE_TCP ? &priv->spare_tcp : &priv->spare_udp;
+
+	for (; count > 0; count--) {
+		c = conn_uring_conn_alloc(type);
+		if (c == NULL)
+			return -ENOMEM;
+
+		c->next = *spare;
+		*spare = c;
+	}
+
+	priv->reserved = 1;
+
+	return 0;
+}
+
+int conn_uring_send(struct conn_handle *conn, const uint8_t *buff,
+		    size_t buff_len)
+{
+	struct conn_uring_conn *c = conn->uring;
+	size_t chunk;
+	size_t tail;
+	size_t sent = 0;
+
+	if (c->error != 0)
+		return c->error;
+
+	if (c->send_len == CONN_URING_SEND_LEN)
+		return -EAGAIN;
+
+	while (sent < buff_len && c->send_len < CONN_URING_SEND_LEN) {
+		tail = (c->send_head + c->send_len) % CONN_URING_SEND_LEN;
+		chunk = CONN_URING_SEND_LEN - tail;
+		if (chunk > CONN_URING_SEND_LEN - c->send_len)
+			chunk = CONN_URING_SEND_LEN - c->send_len;
+		if (chunk > buff_len - sent)
+			chunk = buff_len - sent;
+
+		memcpy(&c->send_buff[tail], buff + sent, chunk);
+
+		c->send_len += chunk;
+		sent += chunk;
+	}
+
+	return (int)sent;
+}
+
+int conn_uring_submit(struct conn_uring_handle *cu)
+{
+	struct conn_uring_priv *priv = cu->priv;
+	struct conn_uring_conn *c;
+
+	for (c = priv->conns; c != NULL; c = c->next) {
+		if (c->conn == NULL || c->error != 0)
+			continue;
+
+		if (c->type == CONN_TYPE_UDP && !c->recv_armed &&
+		    priv->bufs_free > 0)
+			conn_uring_arm_recv(priv, c);
+		else if (c->type == CONN_TYPE_TCP && c->send_ops == 0 &&
+			 c->send_len > 0)
+			conn_uring_queue_send(priv, c);
+	}
+
+	return conn_uring_enter(priv, 0);
+}
+
+int conn_uring_writable(const struct conn_handle *conn)
+{
+	const struct conn_uring_conn *c = conn->uring;
+
+	return c->send_len < CONN_URING_SEND_LEN || c->error != 0;
+}
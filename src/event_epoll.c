@@ -0,0 +1,594 @@
+/*!
+ * @file event_epoll.c
+ *
+ * @copyright
+ * Copyright &copy; 2026, Scott K Logan
+ *
+ * @copyright
+ * All rights reserved.
+ *
+ * @copyright
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * @copyright
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * @copyright
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * @copyright
+ * EchoLink&reg; is a registered trademark of Synergenics, LLC
+ *
+ * @author Scott K Logan &lt;logans@cottsay.net&gt;
+ *
+ * @brief Network event notification implementation using epoll
+ */
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+
+#include "conn.h"
+#ifdef HAVE_IO_URING
+#  include "conn_uring.h"
+#endif
+#include "event.h"
+#ifdef HAVE_IO_URING
+#  include "mutex.h"
+#endif
+
+/*! Maximum number of events to dispatch in a single call to event_process */
+#define EVENT_BATCH_LEN 64
+
+/*!
+ * @brief Private data for an instance of an epoll event loop
+ */
+struct event_priv {
+	/*! File descriptor of the epoll instance */
+	int epoll_fd;
+
+	/*! File descriptor used to interrupt event_process */
+	int wake_fd;
+
+	/*! Non-zero once ::event_wake has been called - accessed atomically */
+	int woken;
+#ifdef HAVE_IO_URING
+
+	/*! Ring used by offloaded sources, if supported by the kernel */
+	struct conn_uring_handle uring;
+
+	/*! Offloaded sources which have not yet been attached to the ring */
+	struct event_source *pending;
+
+	/*! Mutex for protecting event_priv::pending */
+	struct mutex_handle pending_mutex;
+
+	/*! Offloaded sources which are attached to the ring */
+	struct event_source *offloaded;
+#endif
+};
+
+/*!
+ * @brief Performs an epoll_ctl operation on the given source
+ *
+ * @param[in,out] eh Target event loop instance
+ * @param[in,out] es Source connection to operate on
+ * @param[in] op The epoll_ctl operation to perform
+ * @param[in] flags Bitwise combination of ::EVENT_FLAG values to monitor
+ *
+ * @returns 0 on success, negative ERRNO value on failure
+ */
+static int event_ctl(struct event_handle *eh, struct event_source *es,
+		     int op, uint32_t flags);
+
+/*!
+ * @brief Converts ::EVENT_FLAG values to epoll event bits
+ *
+ * @param[in] flags Bitwise combination of ::EVENT_FLAG values
+ *
+ * @returns Equivalent epoll event bits
+ */
+static uint32_t event_flags_to_epoll(uint32_t flags);
+
+#ifdef HAVE_IO_URING
+/*!
+ * @brief Interrupts a call to ::event_process without stopping it
+ *
+ * @param[in,out] priv Target event loop instance private data
+ */
+static void event_kick(struct event_priv *priv);
+
+/*!
+ * @brief Attaches the pending offloaded sources to the ring
+ *
+ * @param[in,out] eh Target event loop instance
+ *
+ * Sources which cannot be attached fall back to being monitored by epoll.
+ */
+static void event_offload_attach(struct event_handle *eh);
+
+/*!
+ * @brief Dispatches the offloaded sources which are ready
+ *
+ * @param[in,out] eh Target event loop instance
+ */
+static void event_offload_dispatch(struct event_handle *eh);
+
+/*!
+ * @brief Determines the readiness of an offloaded source
+ *
+ * @param[in] es Offloaded source which is attached to the ring
+ *
+ * @returns Bitwise combination of monitored ::EVENT_FLAG values which are ready
+ */
+static uint32_t event_offload_ready(const struct event_source *es);
+
+/*!
+ * @brief Detaches an offloaded source and drops it from the source lists
+ *
+ * @param[in,out] priv Target event loop instance private data
+ * @param[in,out] es Offloaded source to remove
+ */
+static void event_offload_remove(struct event_priv *priv,
+				 struct event_source *es);
+#endif
+
+static int event_ctl(struct event_handle *eh, struct event_source *es,
+		     int op, uint32_t flags)
+{
+	struct event_priv *priv = eh->priv;
+	struct epoll_event ev;
+	int fd;
+
+	fd = conn_get_fd(es->conn);
+	if (fd < 0)
+		return -ENOTCONN;
+
+	memset(&ev, 0x0, sizeof(ev));
+	ev.events = event_flags_to_epoll(flags);
+	ev.data.ptr = es;
+
+#ifdef HAVE_IO_URING
+	/* Writability of offloaded streams is reported by the ring */
+	if (es->offloaded)
+		ev.events &= ~EPOLLOUT;
+
+#endif
+	if (epoll_ctl(priv->epoll_fd, op, fd, &ev) != 0)
+		return -errno;
+
+	es->flags = flags | EVENT_FLAG_ERR;
+
+	return 0;
+}
+
+static uint32_t event_flags_to_epoll(uint32_t flags)
+{
+	uint32_t events = 0;
+
+	if (flags & EVENT_FLAG_IN)
+		events |= EPOLLIN;
+
+	if (flags & EVENT_FLAG_OUT)
+		events |= EPOLLOUT;
+
+	return events;
+}
+
+#ifdef HAVE_IO_URING
+static void event_kick(struct event_priv *priv)
+{
+	const uint64_t one = 1;
+
+	if (write(priv->wake_fd, &one, sizeof(one)) < 0) {
+		/* The counter is already non-zero */
+	}
+}
+
+static void event_offload_attach(struct event_handle *eh)
+{
+	struct event_priv *priv = eh->priv;
+	struct event_source *pending;
+	struct event_source *es;
+
+	mutex_lock(&priv->pending_mutex);
+
+	pending = priv->pending;
+	priv->pending = NULL;
+
+	mutex_unlock(&priv->pending_mutex);
+
+	while (pending != NULL) {
+		es = pending;
+		pending = es->next;
+
+		if (conn_uring_attach(&priv->uring, es->conn) == 0) {
+			es->next = priv->offloaded;
+			priv->offloaded = es;
+			continue;
+		}
+
+		es->offloaded = 0;
+		es->next = NULL;
+
+		/* UDP sources were never added to the epoll instance */
+		if (event_ctl(eh, es, es->conn->type == CONN_TYPE_UDP ?
+			      EPOLL_CTL_ADD : EPOLL_CTL_MOD, es->flags) < 0)
+			es->func_ptr(es, EVENT_FLAG_ERR);
+	}
+}
+
+static void event_offload_dispatch(struct event_handle *eh)
+{
+	struct event_priv *priv = eh->priv;
+	struct event_source *ready[EVENT_BATCH_LEN];
+	uint32_t ready_flags[EVENT_BATCH_LEN];
+	struct event_source *es;
+	int count = 0;
+	int i;
+
+	/* Callbacks may remove sources, so collect them first */
+	for (es = priv->offloaded; es != NULL && count < EVENT_BATCH_LEN;
+	     es = es->next) {
+		ready_flags[count] = event_offload_ready(es);
+		if (ready_flags[count] != 0)
+			ready[count++] = es;
+	}
+
+	for (i = 0; i < count; i++) {
+		/* Skip sources which were removed by an earlier callback */
+		if (ready[i]->flags == 0)
+			continue;
+
+		ready[i]->func_ptr(ready[i], ready_flags[i] & ready[i]->flags);
+	}
+}
+
+static uint32_t event_offload_ready(const struct event_source *es)
+{
+	if (es->conn->type == CONN_TYPE_UDP)
+		return (es->flags & EVENT_FLAG_IN) &&
+		       conn_uring_readable(es->conn) ? EVENT_FLAG_IN : 0;
+
+	return (es->flags & EVENT_FLAG_OUT) &&
+	       conn_uring_writable(es->conn) ? EVENT_FLAG_OUT : 0;
+}
+
+static void event_offload_remove(struct event_priv *priv,
+				 struct event_source *es)
+{
+	struct event_source **link;
+
+	mutex_lock(&priv->pending_mutex);
+
+	for (link = &priv->pending; *link != NULL; link = &(*link)->next) {
+		if (*link == es) {
+			*link = es->next;
+			mutex_unlock(&priv->pending_mutex);
+			return;
+		}
+	}
+
+	mutex_unlock(&priv->pending_mutex);
+
+	for (link = &priv->offloaded; *link != NULL; link = &(*link)->next) {
+		if (*link == es) {
+			*link = es->next;
+			conn_uring_detach(es->conn);
+			return;
+		}
+	}
+}
+#endif
+
+int event_add(struct event_handle *eh, struct event_source *es,
+	      uint32_t flags)
+{
+#ifdef HAVE_IO_URING
+	struct event_priv *priv = eh->priv;
+	int ret = 0;
+
+	es->offloaded = es->offload && priv->uring.priv != NULL;
+	if (es->offloaded) {
+		/* Offloaded datagrams are never received through epoll */
+		if (es->conn->type == CONN_TYPE_UDP)
+			es->flags = flags | EVENT_FLAG_ERR;
+		else
+			ret = event_ctl(eh, es, EPOLL_CTL_ADD, flags);
+
+		if (ret < 0) {
+			es->offloaded = 0;
+			return ret;
+		}
+
+		/* Only the thread processing events may touch the ring */
+		mutex_lock(&priv->pending_mutex);
+
+		es->next = priv->pending;
+		priv->pending = es;
+
+		mutex_unlock(&priv->pending_mutex);
+
+		event_kick(priv);
+
+		return 0;
+	}
+
+#endif
+	return event_ctl(eh, es, EPOLL_CTL_ADD, flags);
+}
+
+void event_free(struct event_handle *eh)
+{
+	if (eh->priv != NULL) {
+		struct event_priv *priv = eh->priv;
+
+#ifdef HAVE_IO_URING
+		conn_uring_free(&priv->uring);
+
+		mutex_free(&priv->pending_mutex);
+
+#endif
+		if (priv->wake_fd >= 0)
+			close(priv->wake_fd);
+
+		if (priv->epoll_fd >= 0)
+			close(priv->epoll_fd);
+
+		free(eh->priv);
+		eh->priv = NULL;
+	}
+}
+
+int event_init(struct event_handle *eh)
+{
+	struct event_priv *priv = eh->priv;
+	struct epoll_event ev;
+	int ret;
+
+	if (priv == NULL) {
+		priv = calloc(1, sizeof(*priv));
+		if (priv == NULL)
+			return -ENOMEM;
+
+		eh->priv = priv;
+	}
+
+	priv->wake_fd = -1;
+
+	priv->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+	if (priv->epoll_fd < 0) {
+		ret = -errno;
+		goto event_init_exit;
+	}
+
+	priv->wake_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+	if (priv->wake_fd < 0) {
+		ret = -errno;
+		goto event_init_exit;
+	}
+
+	/* The wake descriptor is identified by a NULL source */
+	memset(&ev, 0x0, sizeof(ev));
+	ev.events = EPOLLIN;
+	ev.data.ptr = NULL;
+
+	if (epoll_ctl(priv->epoll_fd, EPOLL_CTL_ADD, priv->wake_fd, &ev) != 0) {
+		ret = -errno;
+		goto event_init_exit;
+	}
+
+#ifdef HAVE_IO_URING
+	ret = mutex_init(&priv->pending_mutex);
+	if (ret < 0)
+		goto event_init_exit;
+
+	/* Without a ring, offloaded sources are monitored like any other */
+	if (conn_uring_init(&priv->uring) == 0) {
+		ev.data.ptr = &priv->uring;
+
+		if (epoll_ctl(priv->epoll_fd, EPOLL_CTL_ADD,
+			      conn_uring_get_fd(&priv->uring), &ev) != 0)
+			conn_uring_free(&priv->uring);
+	}
+
+#endif
+	return 0;
+
+event_init_exit:
+	event_free(eh);
+
+	return ret;
+}
+
+int event_modify(struct event_handle *eh, struct event_source *es,
+		 uint32_t flags)
+{
+	flags |= EVENT_FLAG_ERR;
+
+	if (flags == es->flags)
+		return 0;
+
+#ifdef HAVE_IO_URING
+	/* Skip the system call if only offloaded conditions have changed */
+	if (es->offloaded && (es->conn->type == CONN_TYPE_UDP ||
+			      ((flags ^ es->flags) & ~EVENT_FLAG_OUT) == 0)) {
+		es->flags = flags;
+		return 0;
+	}
+
+#endif
+	return event_ctl(eh, es, EPOLL_CTL_MOD, flags);
+}
+
+int event_process(struct event_handle *eh, uint32_t msec)
+{
+	struct event_priv *priv = eh->priv;
+	struct epoll_event events[EVENT_BATCH_LEN];
+	struct event_source *es;
+	uint64_t wake_count;
+	uint32_t flags;
+	int timeout = msec == 0 ? -1 : (int)msec;
+	int woken = 0;
+	int ret;
+	int i;
+
+#ifdef HAVE_IO_URING
+	if (priv->uring.priv != NULL) {
+		event_offload_attach(eh);
+
+		/* Everything queued since the last call is submitted at once */
+		ret = conn_uring_submit(&priv->uring);
+		if (ret < 0)
+			return ret;
+
+		conn_uring_reap(&priv->uring);
+
+		/* Offloaded sources are level-triggered, too */
+		for (es = priv->offloaded; es != NULL; es = es->next) {
+			if (event_offload_ready(es) != 0) {
+				timeout = 0;
+				break;
+			}
+		}
+	}
+
+#endif
+	ret = epoll_wait(priv->epoll_fd, events, EVENT_BATCH_LEN, timeout);
+	if (ret < 0) {
+		/* Signals are not reported so that -EINTR is unambiguous */
+		return errno == EINTR ? 0 : -errno;
+	}
+
+	for (i = 0; i < ret; i++) {
+		es = events[i].data.ptr;
+		if (es == NULL) {
+			while (read(priv->wake_fd, &wake_count,
+				    sizeof(wake_count)) > 0)
+				;
+			if (__atomic_exchange_n(&priv->woken, 0,
+						__ATOMIC_ACQ_REL))
+				woken = 1;
+			continue;
+		}
+
+#ifdef HAVE_IO_URING
+		/* Completions are processed once the sockets are handled */
+		if (events[i].data.ptr == &priv->uring)
+			continue;
+
+#endif
+		/* Skip sources which were removed by an earlier callback */
+		if (es->flags == 0)
+			continue;
+
+		flags = 0;
+
+		if (events[i].events & EPOLLIN)
+			flags |= EVENT_FLAG_IN;
+
+		if (events[i].events & EPOLLOUT)
+			flags |= EVENT_FLAG_OUT;
+
+		if (events[i].events & (EPOLLERR | EPOLLHUP))
+			flags |= EVENT_FLAG_ERR;
+
+		es->func_ptr(es, flags & es->flags);
+	}
+
+#ifdef HAVE_IO_URING
+	if (priv->uring.priv != NULL) {
+		conn_uring_reap(&priv->uring);
+
+		event_offload_dispatch(eh);
+	}
+
+#endif
+	return woken ? -EINTR : 0;
+}
+
+void event_remove(struct event_handle *eh, struct event_source *es)
+{
+	struct event_priv *priv = eh->priv;
+	struct epoll_event ev;
+	int fd;
+
+	if (es->flags == 0)
+		return;
+
+	es->flags = 0;
+
+#ifdef HAVE_IO_URING
+	if (es->offloaded) {
+		event_offload_remove(priv, es);
+
+		es->offloaded = 0;
+
+		if (es->conn->type == CONN_TYPE_UDP)
+			return;
+	}
+
+#endif
+	fd = conn_get_fd(es->conn);
+	if (fd < 0)
+		return;
+
+	/* Older kernels require a non-NULL event for EPOLL_CTL_DEL */
+	memset(&ev, 0x0, sizeof(ev));
+	epoll_ctl(priv->epoll_fd, EPOLL_CTL_DEL, fd, &ev);
+}
+
+int event_reserve(struct event_handle *eh, enum CONN_TYPE type,
+		  unsigned int count)
+{
+#ifdef HAVE_IO_URING
+	struct event_priv *priv = eh->priv;
+
+	if (priv->uring.priv != NULL)
+		return conn_uring_reserve(&priv->uring, type, count);
+
+#else
+	(void)eh;
+	(void)type;
+	(void)count;
+
+#endif
+	return 0;
+}
+
+int event_wake(struct event_handle *eh)
+{
+	struct event_priv *priv = eh->priv;
+	const uint64_t one = 1;
+
+	__atomic_store_n(&priv->woken, 1, __ATOMIC_RELEASE);
+
+	if (write(priv->wake_fd, &one, sizeof(one)) < 0 && errno != EAGAIN)
+		return -errno;
+
+	return 0;
+}
@@ -0,0 +1,401 @@
+/*!
+ * @file msg_queue.c
+ *
+ * @copyright
+ * Copyright &copy; 2026, Scott K Logan
+ *
+ * @copyright
+ * All rights reserved.
+ *
+ * @copyright
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * @copyright
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * @copyright
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * @copyright
+ * EchoLink&reg; is a registered trademark of Synergenics, LLC
+ *
+ * @author Scott K Logan &lt;logans@cottsay.net&gt;
+ *
+ * @brief Bounded multi-producer message queue implementation
+ */
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "atomic.h"
+#include "msg_queue.h"
+
+/*! Assumed size of a cache line, used to separate producer and consumer data */
+#define MSG_QUEUE_CACHE_LINE 64
+
+/*!
+ * @brief Private data for an instance of a message queue
+ *
+ * Each slot has a sequence number which tells producers when it is free for
+ * the message at a given position, and tells the consumer when that message
+ * has been completely written.
+ */
+struct msg_queue_priv {
+	/*! Buffer holding the message in each slot */
+	uint8_t **buffs;
+
+	/*! Number of bytes in the message in each slot */
+	uint32_t *len;
+
+	/*! Sequence number of each slot */
+	uint32_t *seq;
+
+	/*! Mask which converts a position into a slot index */
+	uint32_t mask;
+
+	/*! Position of the next message to be added */
+	uint32_t tail;
+
+	/*! Keeps msg_queue_priv::tail and msg_queue_priv::head apart */
+	uint8_t pad[MSG_QUEUE_CACHE_LINE];
+
+	/*! Position of the oldest message */
+	uint32_t head;
+
+	/*! Number of bytes currently queued */
+	uint32_t bytes;
+
+	/*! Highest number of messages which have been queued at once */
+	uint32_t depth_max;
+
+	/*! Highest number of bytes which have been queued at once */
+	uint32_t bytes_max;
+};
+
+/*!
+ * @brief Claims the slot at the tail of the queue
+ *
+ * @param[in,out] mq Target message queue instance
+ * @param[out] pos Position of the claimed slot
+ *
+ * @returns 0 on success, -ENOSPC if the queue is full
+ */
+static int msg_queue_claim(struct msg_queue_handle *mq, uint32_t *pos);
+
+/*!
+ * @brief Makes a message in a claimed slot visible to the consumer
+ *
+ * @param[in,out] mq Target message queue instance
+ * @param[in] pos Position of the slot claimed by ::msg_queue_claim
+ * @param[in] buff Buffer holding the message
+ * @param[in] len Number of bytes in the message
+ */
+static void msg_queue_publish(struct msg_queue_handle *mq, uint32_t pos,
+			      uint8_t *buff, size_t len);
+
+/*!
+ * @brief Atomically raises a high-water mark
+ *
+ * @param[in,out] max High-water mark to raise
+ * @param[in] val Value which the mark must be at least
+ */
+static void msg_queue_update_max(uint32_t *max, uint32_t val);
+
+static int msg_queue_claim(struct msg_queue_handle *mq, uint32_t *pos)
+{
+	struct msg_queue_priv *priv = mq->priv;
+	uint32_t curr = atomic_load_u32(&priv->tail);
+	uint32_t seq;
+
+	for (;;) {
+		seq = atomic_load_u32(&priv->seq[curr & priv->mask]);
+
+		if (seq == curr) {
+			if (atomic_cas_u32(&priv->tail, curr, curr + 1))
+				break;
+		} else if ((int32_t)(seq - curr) < 0) {
+			/* The consumer hasn't released the slot from the last lap */
+			return -ENOSPC;
+		}
+
+		curr = atomic_load_u32(&priv->tail);
+	}
+
+	*pos = curr;
+
+	return 0;
+}
+
+static void msg_queue_update_max(uint32_t *max, uint32_t val)
+{
+	uint32_t curr = atomic_load_u32(max);
+
+	while (val > curr && !atomic_cas_u32(max, curr, val))
+		curr = atomic_load_u32(max);
+}
+
+void msg_queue_free(struct msg_queue_handle *mq)
+{
+	struct msg_queue_priv *priv = mq->priv;
+	uint32_t pos;
+
+	if (priv != NULL) {
+		/* Messages which were never consumed still hold their buffers */
+		if (priv->buffs != NULL && priv->len != NULL &&
+		    priv->seq != NULL) {
+			for (pos = priv->head;
+			     priv->seq[pos & priv->mask] == pos + 1; pos++)
+				buff_pool_release(mq->pool,
+						  priv->buffs[pos & priv->mask]);
+		}
+
+		free(priv->seq);
+		free(priv->len);
+		free(priv->buffs);
+
+		free(mq->priv);
+		mq->priv = NULL;
+	}
+}
+
+void msg_queue_get_stats(struct msg_queue_handle *mq,
+			 struct msg_queue_stats *stats)
+{
+	struct msg_queue_priv *priv = mq->priv;
+	uint32_t head = atomic_load_u32(&priv->head);
+
+	stats->depth = atomic_load_u32(&priv->tail) - head;
+	stats->depth_max = atomic_load_u32(&priv->depth_max);
+	stats->bytes = atomic_load_u32(&priv->bytes);
+	stats->bytes_max = atomic_load_u32(&priv->bytes_max);
+}
+
+int msg_queue_init(struct msg_queue_handle *mq)
+{
+	struct msg_queue_priv *priv = mq->priv;
+	uint32_t i;
+
+	if (mq->capacity == 0 || (mq->capacity & (mq->capacity - 1)) != 0 ||
+	    mq->msg_len == 0 || mq->pool == NULL ||
+	    mq->msg_len > mq->pool->buff_len)
+		return -EINVAL;
+
+	if (priv == NULL) {
+		priv = calloc(1, sizeof(*priv));
+		if (priv == NULL)
+			return -ENOMEM;
+
+		mq->priv = priv;
+	}
+
+	priv->buffs = malloc(mq->capacity * sizeof(*priv->buffs));
+	priv->len = malloc(mq->capacity * sizeof(*priv->len));
+	priv->seq = malloc(mq->capacity * sizeof(*priv->seq));
+	if (priv->buffs == NULL || priv->len == NULL || priv->seq == NULL) {
+		msg_queue_free(mq);
+		return -ENOMEM;
+	}
+
+	for (i = 0; i < mq->capacity; i++)
+		priv->seq[i] = i;
+
+	priv->mask = mq->capacity - 1;
+
+	return 0;
+}
+
+unsigned int msg_queue_peek(struct msg_queue_handle *mq, unsigned int skip,
+			    struct conn_iovec *iov, unsigned int count)
+{
+	struct msg_queue_priv *priv = mq->priv;
+	uint32_t pos = priv->head + skip;
+	uint32_t slot;
+	unsigned int i;
+
+	for (i = 0; i < count; i++, pos++) {
+		slot = pos & priv->mask;
+
+		/* The producer may not have finished writing the message yet */
+		if (atomic_load_u32(&priv->seq[slot]) != pos + 1)
+			break;
+
+		iov[i].buff = priv->buffs[slot];
+		iov[i].len = priv->len[slot];
+	}
+
+	return i;
+}
+
+void msg_queue_pop(struct msg_queue_handle *mq, unsigned int count)
+{
+	struct msg_queue_priv *priv = mq->priv;
+	uint32_t pos = priv->head;
+	uint32_t bytes = 0;
+	unsigned int i;
+
+	for (i = 0; i < count; i++)
+		bytes += priv->len[(pos + i) & priv->mask];
+
+	atomic_store_u32(&priv->head, pos + count);
+	atomic_sub_u32(&priv->bytes, bytes);
+
+	/* Hand the slots back to the producers for the next lap */
+	for (i = 0; i < count; i++, pos++) {
+		buff_pool_release(mq->pool, priv->buffs[pos & priv->mask]);
+		atomic_store_u32(&priv->seq[pos & priv->mask],
+				 pos + mq->capacity);
+	}
+}
+
+static void msg_queue_publish(struct msg_queue_handle *mq, uint32_t pos,
+			      uint8_t *buff, size_t len)
+{
+	struct msg_queue_priv *priv = mq->priv;
+	uint32_t slot = pos & priv->mask;
+
+	priv->buffs[slot] = buff;
+	priv->len[slot] = (uint32_t)len;
+
+	/* The message can't be removed until it is published, so these are
+	 * accounted for first
+	 */
+	msg_queue_update_max(&priv->depth_max,
+			     pos + 1 - atomic_load_u32(&priv->head));
+	msg_queue_update_max(&priv->bytes_max,
+			     atomic_add_u32(&priv->bytes, len));
+
+	/* Publish the message to the consumer */
+	atomic_store_u32(&priv->seq[slot], pos + 1);
+}
+
+int msg_queue_push(struct msg_queue_handle *mq, const struct conn_iovec *iov,
+		   unsigned int count)
+{
+	size_t len = 0;
+	uint8_t *buff;
+	uint8_t *dst;
+	uint32_t pos;
+	unsigned int i;
+	int ret;
+
+	for (i = 0; i < count; i++)
+		len += iov[i].len;
+
+	if (len > mq->msg_len)
+		return -EMSGSIZE;
+
+	/* A slot can't be given back once it is claimed, so the buffer has to be
+	 * secured first
+	 */
+	buff = buff_pool_borrow(mq->pool);
+	if (buff == NULL)
+		return -ENOMEM;
+
+	ret = msg_queue_claim(mq, &pos);
+	if (ret < 0) {
+		buff_pool_release(mq->pool, buff);
+		return ret;
+	}
+
+	dst = buff;
+	for (i = 0; i < count; i++) {
+		memcpy(dst, iov[i].buff, iov[i].len);
+		dst += iov[i].len;
+	}
+
+	msg_queue_publish(mq, pos, buff, len);
+
+	return 0;
+}
+
+int msg_queue_push_buff(struct msg_queue_handle *mq, uint8_t *buff,
+			size_t len)
+{
+	uint32_t pos;
+	int ret;
+
+	if (len > mq->msg_len)
+		return -EMSGSIZE;
+
+	ret = msg_queue_claim(mq, &pos);
+	if (ret < 0)
+		return ret;
+
+	buff_pool_ref(buff);
+
+	msg_queue_publish(mq, pos, buff, len);
+
+	return 0;
+}
+
+int msg_queue_replace(struct msg_queue_handle *mq, unsigned int skip,
+		      uint8_t *buff, size_t len)
+{
+	struct msg_queue_priv *priv = mq->priv;
+	uint32_t pos = priv->head + skip;
+	uint32_t end = pos;
+	uint32_t slot;
+	uint8_t *old;
+	uint32_t old_len;
+
+	if (len > mq->msg_len)
+		return -EMSGSIZE;
+
+	/* Only messages which have been completely written can be moved */
+	while (atomic_load_u32(&priv->seq[end & priv->mask]) == end + 1)
+		end++;
+
+	if (end == pos)
+		return -ENOSPC;
+
+	slot = pos & priv->mask;
+	old = priv->buffs[slot];
+	old_len = priv->len[slot];
+
+	for (; pos + 1 != end; pos++, slot = pos & priv->mask) {
+		priv->buffs[slot] = priv->buffs[(pos + 1) & priv->mask];
+		priv->len[slot] = priv->len[(pos + 1) & priv->mask];
+	}
+
+	buff_pool_ref(buff);
+	priv->buffs[slot] = buff;
+	priv->len[slot] = (uint32_t)len;
+
+	atomic_sub_u32(&priv->bytes, old_len);
+	msg_queue_update_max(&priv->bytes_max,
+			     atomic_add_u32(&priv->bytes, len));
+
+	buff_pool_release(mq->pool, old);
+
+	return (int)old_len;
+}
+
+void msg_queue_reset_stats(struct msg_queue_handle *mq)
+{
+	struct msg_queue_priv *priv = mq->priv;
+	uint32_t head = atomic_load_u32(&priv->head);
+
+	atomic_store_u32(&priv->depth_max, atomic_load_u32(&priv->tail) - head);
+	atomic_store_u32(&priv->bytes_max, atomic_load_u32(&priv->bytes));
+}
@@ -44,6 +44,11 @@
  * @brief Mutex implementation for POSIX machines
  */
 
+#ifdef __linux__
+/* Required for pthread_rwlockattr_setkind_np */
+#  define _GNU_SOURCE
+#endif
+
 #include <errno.h>
 #include <stdlib.h>
 #include <string.h>
@@ -56,27 +61,32 @@
  * @brief Private data for an instance of a POSIX mutex
  */
 struct mutex_priv {
-	/*! Condition variable used to implement the shared lock */
-	pthread_cond_t	cond;
-
-	/*! POSIX mutex used for exclusive locking */
-	pthread_mutex_t lock;
-
-	/*! Number of holders of the shared lock */
-	unsigned int	readers;
+	/*! POSIX reader/writer lock backing both the shared and exclusive locks */
+	pthread_rwlock_t lock;
 };
 
 /*!
  * @brief Private data for an instance of a POSIX condition variable
+ *
+ * POSIX condition variables can only be used with a POSIX mutex, so waiters
+ * hold this internal one while they release the reader/writer lock. The
+ * sequence number tells them apart from spurious wakeups.
  */
 struct condvar_priv {
 	/*! POSIX condition variable */
 	pthread_cond_t cond;
+
+	/*! POSIX mutex protecting condvar_priv::seq */
+	pthread_mutex_t lock;
+
+	/*! Incremented each time a waiter is awoken */
+	unsigned long seq;
 };
 
 int mutex_init(struct mutex_handle *mutex)
 {
 	struct mutex_priv *priv = mutex->priv;
+	pthread_rwlockattr_t attr;
 	int ret;
 
 	if (priv == NULL) {
@@ -87,24 +97,37 @@ int mutex_init(struct mutex_handle *mutex)
 		mutex->priv = priv;
 	}
 
-	ret = pthread_mutex_init(&priv->lock, NULL);
+	ret = pthread_rwlockattr_init(&attr);
 	if (ret != 0) {
 		ret = -ret;
 
 		goto mutex_init_exit;
 	}
 
-	ret = pthread_cond_init(&priv->cond, NULL);
+#ifdef __GLIBC__
+	/* Exclusive lockers must not be starved by a steady stream of packets */
+	ret = pthread_rwlockattr_setkind_np(&attr,
+					    PTHREAD_RWLOCK_PREFER_WRITER_NONRECURSIVE_NP);
 	if (ret != 0) {
 		ret = -ret;
 
 		goto mutex_init_exit_late;
 	}
 
+#endif
+	ret = pthread_rwlock_init(&priv->lock, &attr);
+	if (ret != 0) {
+		ret = -ret;
+
+		goto mutex_init_exit_late;
+	}
+
+	pthread_rwlockattr_destroy(&attr);
+
 	return 0;
 
 mutex_init_exit_late:
-	pthread_mutex_destroy(&priv->lock);
+	pthread_rwlockattr_destroy(&attr);
 
 mutex_init_exit:
 	free(mutex->priv);
@@ -116,72 +139,29 @@ mutex_init_exit:
 int mutex_lock(struct mutex_handle *mutex)
 {
 	struct mutex_priv *priv = mutex->priv;
-	int ret;
-
-	ret = pthread_mutex_lock(&priv->lock);
-	if (ret != 0)
-		return -ret;
-
-	while (priv->readers > 0) {
-		ret = pthread_cond_wait(&priv->cond, &priv->lock);
-		if (ret != 0) {
-			ret = -ret;
-			goto mutex_lock_exit;
-		}
-	}
-
-	return 0;
 
-mutex_lock_exit:
-	pthread_mutex_unlock(&priv->lock);
-
-	return ret;
+	return -pthread_rwlock_wrlock(&priv->lock);
 }
 
 int mutex_lock_shared(struct mutex_handle *mutex)
 {
 	struct mutex_priv *priv = mutex->priv;
-	int ret;
 
-	ret = pthread_mutex_lock(&priv->lock);
-	if (ret != 0)
-		return -ret;
-
-	priv->readers++;
-
-	return -pthread_mutex_unlock(&priv->lock);
+	return -pthread_rwlock_rdlock(&priv->lock);
 }
 
 int mutex_unlock(struct mutex_handle *mutex)
 {
 	struct mutex_priv *priv = mutex->priv;
 
-	return pthread_mutex_unlock(&priv->lock);
+	return -pthread_rwlock_unlock(&priv->lock);
 }
 
 int mutex_unlock_shared(struct mutex_handle *mutex)
 {
 	struct mutex_priv *priv = mutex->priv;
-	int ret;
 
-	ret = pthread_mutex_lock(&priv->lock);
-	if (ret != 0)
-		return -ret;
-
-	if (--(priv->readers) <= 0) {
-		ret = pthread_cond_broadcast(&priv->cond);
-		if (ret != 0) {
-			ret = -ret;
-			goto mutex_unlock_shared_exit;
-		}
-	}
-
-	return -pthread_mutex_unlock(&priv->lock);
-
-mutex_unlock_shared_exit:
-	pthread_mutex_unlock(&priv->lock);
-
-	return ret;
+	return -pthread_rwlock_unlock(&priv->lock);
 }
 
 void mutex_free(struct mutex_handle *mutex)
@@ -189,9 +169,7 @@ void mutex_free(struct mutex_handle *mutex)
 	if (mutex->priv != NULL) {
 		struct mutex_priv *priv = mutex->priv;
 
-		pthread_mutex_destroy(&priv->lock);
-
-		pthread_cond_destroy(&priv->cond);
+		pthread_rwlock_destroy(&priv->lock);
 
 		free(mutex->priv);
 		mutex->priv = NULL;
@@ -211,15 +189,25 @@ int condvar_init(struct condvar_handle *condvar)
 		condvar->priv = priv;
 	}
 
-	ret = pthread_cond_init(&priv->cond, NULL);
+	ret = pthread_mutex_init(&priv->lock, NULL);
 	if (ret != 0) {
 		ret = -ret;
 
 		goto condvar_init_exit;
 	}
 
+	ret = pthread_cond_init(&priv->cond, NULL);
+	if (ret != 0) {
+		ret = -ret;
+
+		goto condvar_init_exit_late;
+	}
+
 	return 0;
 
+condvar_init_exit_late:
+	pthread_mutex_destroy(&priv->lock);
+
 condvar_init_exit:
 	free(condvar->priv);
 	condvar->priv = NULL;
@@ -231,8 +219,25 @@ int condvar_wait(struct condvar_handle *condvar, struct mutex_handle *mutex)
 {
 	struct condvar_priv *priv = condvar->priv;
 	struct mutex_priv *mpriv = mutex->priv;
+	unsigned long seq;
+	int ret;
 
-	return -pthread_cond_wait(&priv->cond, &mpriv->lock);
+	ret = pthread_mutex_lock(&priv->lock);
+	if (ret != 0)
+		return -ret;
+
+	/* Wakeups can't be missed while the internal mutex is held */
+	seq = priv->seq;
+	pthread_rwlock_unlock(&mpriv->lock);
+
+	while (ret == 0 && seq == priv->seq)
+		ret = pthread_cond_wait(&priv->cond, &priv->lock);
+
+	pthread_mutex_unlock(&priv->lock);
+
+	pthread_rwlock_wrlock(&mpriv->lock);
+
+	return -ret;
 }
 
 int condvar_wait_time(struct condvar_handle *condvar,
@@ -241,6 +246,7 @@ int condvar_wait_time(struct condvar_handle *condvar,
 	struct condvar_priv *priv = condvar->priv;
 	struct mutex_priv *mpriv = mutex->priv;
 	struct timespec abstime;
+	unsigned long seq;
 	int ret;
 
 	clock_gettime(CLOCK_REALTIME, &abstime);
@@ -248,22 +254,56 @@ int condvar_wait_time(struct condvar_handle *condvar,
 	abstime.tv_sec += (msec / 1000) + (abstime.tv_nsec / 1000000000);
 	abstime.tv_nsec %= 1000000000;
 
-	ret = pthread_cond_timedwait(&priv->cond, &mpriv->lock, &abstime);
+	ret = pthread_mutex_lock(&priv->lock);
+	if (ret != 0)
+		return -ret;
+
+	seq = priv->seq;
+	pthread_rwlock_unlock(&mpriv->lock);
+
+	while (ret == 0 && seq == priv->seq)
+		ret = pthread_cond_timedwait(&priv->cond, &priv->lock,
+					     &abstime);
+
+	pthread_mutex_unlock(&priv->lock);
+
+	pthread_rwlock_wrlock(&mpriv->lock);
+
 	return ret == ETIMEDOUT ? 1 : -ret;
 }
 
 int condvar_wake_one(struct condvar_handle *condvar)
 {
 	struct condvar_priv *priv = condvar->priv;
+	int ret;
+
+	ret = pthread_mutex_lock(&priv->lock);
+	if (ret != 0)
+		return -ret;
+
+	priv->seq++;
+	ret = pthread_cond_signal(&priv->cond);
 
-	return -pthread_cond_signal(&priv->cond);
+	pthread_mutex_unlock(&priv->lock);
+
+	return -ret;
 }
 
 int condvar_wake_all(struct condvar_handle *condvar)
 {
 	struct condvar_priv *priv = condvar->priv;
+	int ret;
+
+	ret = pthread_mutex_lock(&priv->lock);
+	if (ret != 0)
+		return -ret;
+
+	priv->seq++;
+	ret = pthread_cond_broadcast(&priv->cond);
+
+	pthread_mutex_unlock(&priv->lock);
 
-	return -pthread_cond_broadcast(&priv->cond);
+	return -ret;
 }
 
 void condvar_free(struct condvar_handle *condvar)
@@ -273,6 +313,8 @@ void condvar_free(struct condvar_handle *condvar)
 
 		pthread_cond_destroy(&priv->cond);
 
+		pthread_mutex_destroy(&priv->lock);
+
 		free(condvar->priv);
 		condvar->priv = NULL;
 	}
@@ -50,9 +50,13 @@
 #include <string.h>
 
 #include "openelp/openelp.h"
+#include "alloc_guard.h"
+#include "atomic.h"
+#include "buff_pool.h"
 #include "conf.h"
 #include "conn.h"
 #include "digest.h"
+#include "event.h"
 #include "log.h"
 #include "mutex.h"
 #include "pearson.h"
@@ -60,12 +64,30 @@
 #include "rand.h"
 #include "regex.h"
 #include "registration.h"
+#include "thread.h"
 #include "worker.h"
 
 #if PROXY_PASS_RES_LEN != DIGEST_LEN
 #error Password Response Length Mismatch
 #endif
 
+#ifdef HAVE_EPOLL
+/*! Maximum number of clients to accept for a single event */
+#define PROXY_ACCEPT_MAX 16
+#endif
+
+/*! Number of bytes in the nonce which follows the password when computing a
+ *  password response */
+#define PROXY_NONCE_STR_LEN 8
+
+/*! Bits of proxy_priv::idle_workers holding the index of the top worker plus
+ *  one, which also limits the number of workers */
+#define PROXY_WORKERS_INDEX 0xFFFF
+
+/*! Added to proxy_priv::idle_workers on each change so that a stale top of
+ *  the stack is never mistaken for the current one */
+#define PROXY_WORKERS_TAG 0x10000
+
 /*!
  * @brief Owns and processes connections to clients
  */
@@ -76,8 +98,9 @@ struct proxy_worker {
 	/*! Connection to the currently active client */
 	struct conn_handle *conn_client;
 
-	/*! The next ::proxy_worker in the linked list */
-	struct proxy_worker *next;
+	/*! Index plus one of the next ::proxy_worker in proxy_priv::idle_workers,
+	 *  or zero at the bottom of the stack */
+	uint32_t next_idle;
 
 	/*! Mutex for protecting proxy_worker::conn_client */
 	struct mutex_handle mutex;
@@ -87,6 +110,42 @@ struct proxy_worker {
 
 	/*! Last callsign that this worker was connected to */
 	char callsign[12];
+
+	/*! Event source for proxy_worker::conn_client during authorization */
+	struct event_source source;
+
+	/*! Buffer for the callsign and password response from the client */
+	uint8_t buff[28];
+
+	/*! Number of bytes received into proxy_worker::buff so far */
+	size_t buff_len;
+
+	/*! Expected password response from the client */
+	uint8_t response[PROXY_PASS_RES_LEN];
+
+	/*! The password as used to compute password responses, followed by space
+	 *  for the nonce */
+	uint8_t *pass_with_nonce;
+
+	/*! Number of bytes of password in proxy_worker::pass_with_nonce */
+	size_t pass_len;
+};
+
+/*!
+ * @brief Event loop thread which services a subset of the slots
+ */
+struct proxy_shard {
+	/*! Reference to the parent proxy instance handle */
+	struct proxy_handle *ph;
+
+	/*! Event loop for the slots assigned to this shard */
+	struct event_handle event;
+
+	/*! Thread which runs proxy_shard::event */
+	struct thread_handle thread;
+
+	/*! Index of this shard in proxy_priv::shards */
+	int index;
 };
 
 /*!
@@ -109,8 +168,23 @@ struct proxy_priv {
 	/*! Array which holds all of the client connection worker handles */
 	struct proxy_worker *client_workers;
 
-	/*! Linked list of available client connection worker handles */
-	struct proxy_worker *idle_workers_head;
+	/*! Lock-free stack of available client connection worker handles, see
+	 *  ::PROXY_WORKERS_INDEX and ::PROXY_WORKERS_TAG */
+	uint32_t idle_workers;
+
+	/*! Number of client connection workers which aren't in
+	 *  proxy_priv::idle_workers */
+	uint32_t busy_workers;
+
+	/*! Connections to clients, one for each worker and one for turning a
+	 *  client away when all of the workers are busy */
+	struct conn_handle *client_conns;
+
+	/*! Stack of the entries in proxy_priv::client_conns which are not in use */
+	struct conn_handle **idle_conns;
+
+	/*! Number of entries in proxy_priv::idle_conns */
+	int num_idle_conns;
 
 	/*! Regular expression for matching allowed callsigns */
 	struct regex_handle *re_calls_allowed;
@@ -122,22 +196,38 @@ struct proxy_priv {
 	int num_clients;
 
 	/*! Number of 'usable' clients in proxy_priv::clients */
-	int usable_clients;
+	uint32_t usable_clients;
 
 	/*! Network connection which listens for connections from clients */
 	struct conn_handle conn_listen;
 
+	/*! Event loop which services all connections, if enabled */
+	struct event_handle event;
+
+	/*! Event source for proxy_priv::conn_listen */
+	struct event_source source_listen;
+
+	/*! Error encountered while accepting clients in the event loop */
+	int listen_ret;
+
+	/*! Packet buffers shared by all of the client connections */
+	struct buff_pool_handle pool;
+
+	/*! Array of event loop threads which service the slots, if sharded */
+	struct proxy_shard *shards;
+
+	/*! Total number of shards in proxy_priv::shards */
+	int num_shards;
+
 	/*! Logging infrastructure handle */
 	struct log_handle log;
 
-	/*! Used to protect proxy_priv::usable_clients */
-	struct mutex_handle usable_clients_mutex;
-
-	/*! Used to protect proxy_priv::idle_clients_head */
+	/*! Used to protect proxy_priv::idle_clients_head and
+	 *  proxy_priv::clients_by_call */
 	struct mutex_handle idle_clients_mutex;
 
-	/*! Used to protect proxy_priv::idle_workers_head */
-	struct mutex_handle idle_workers_mutex;
+	/*! Used to protect proxy_priv::idle_conns */
+	struct mutex_handle idle_conns_mutex;
 
 	/*! Service for registering with echolink.org */
 	struct registration_service_handle reg_service;
@@ -146,6 +236,103 @@ struct proxy_priv {
 	char port_str[6];
 };
 
+/*!
+ * @brief Takes an unused connection from proxy_priv::idle_conns
+ *
+ * @param[in,out] ph Target proxy instance
+ *
+ * @returns Connection ready to accept a client, or NULL if all are in use
+ */
+static struct conn_handle *proxy_conns_acquire(struct proxy_handle *ph);
+
+/*!
+ * @brief Frees the connections allocated by ::proxy_conns_init
+ *
+ * @param[in,out] ph Target proxy instance
+ */
+static void proxy_conns_free(struct proxy_handle *ph);
+
+/*!
+ * @brief Allocates and initializes proxy_priv::client_conns
+ *
+ * @param[in,out] ph Target proxy instance
+ *
+ * @returns 0 on success, negative ERRNO value on failure
+ *
+ * This is done up front so that accepting a client does not allocate memory.
+ */
+static int proxy_conns_init(struct proxy_handle *ph);
+
+/*!
+ * @brief Closes a connection and returns it to proxy_priv::idle_conns
+ *
+ * @param[in,out] ph Target proxy instance
+ * @param[in,out] conn Connection returned by ::proxy_conns_acquire
+ */
+static void proxy_conns_release(struct proxy_handle *ph,
+				struct conn_handle *conn);
+
+#ifdef HAVE_EPOLL
+/*!
+ * @brief Event loop callback for the listening connection
+ *
+ * @param[in,out] es Event source for the listening connection
+ * @param[in] flags Bitwise combination of ready ::EVENT_FLAG values
+ */
+static void proxy_listen_event(struct event_source *es, uint32_t flags);
+
+/*!
+ * @brief Processes one batch of events for all connections
+ *
+ * @param[in,out] ph Target proxy instance
+ *
+ * @returns 0 on success, -EINTR if the proxy was shut down and no clients
+ *          remain connected, other negative ERRNO value on failure
+ */
+static int proxy_process_events(struct proxy_handle *ph);
+
+/*!
+ * @brief Thread function which runs a shard's event loop
+ *
+ * @param[in,out] ctx The thread context
+ *
+ * @returns Always returns NULL
+ */
+static void *proxy_shard_func(void *ctx);
+
+/*!
+ * @brief Frees data allocated by ::proxy_shards_init
+ *
+ * @param[in,out] ph Target proxy instance
+ */
+static void proxy_shards_free(struct proxy_handle *ph);
+
+/*!
+ * @brief Creates the event loops which service the slots when sharded
+ *
+ * @param[in,out] ph Target proxy instance
+ *
+ * @returns 0 on success, negative ERRNO value on failure
+ */
+static int proxy_shards_init(struct proxy_handle *ph);
+
+/*!
+ * @brief Starts the shard threads and pins each of them to a CPU
+ *
+ * @param[in,out] ph Target proxy instance
+ *
+ * @returns 0 on success, negative ERRNO value on failure
+ */
+static int proxy_shards_start(struct proxy_handle *ph);
+
+/*!
+ * @brief Stops the shard threads and waits for them to return
+ *
+ * @param[in,out] ph Target proxy instance
+ */
+static void proxy_shards_stop(struct proxy_handle *ph);
+
+#endif
 /*!
  * @brief Transfer ownership of a connection to the worker
  *
@@ -157,6 +344,28 @@ struct proxy_priv {
 static int proxy_worker_accept(struct proxy_worker *pw,
 			       struct conn_handle *conn_client);
 
+/*!
+ * @brief Assigns a slot to the worker's newly authorized client
+ *
+ * @param[in,out] pw Target proxy client worker instance
+ *
+ * @returns The slot which is now serving the client, or NULL on failure
+ *
+ * A slot which was last used by the same callsign is preferred, otherwise the
+ * slot which has been idle the longest is used.
+ */
+static struct proxy_conn_handle *proxy_worker_acquire(struct proxy_worker *pw);
+
+#ifdef HAVE_EPOLL
+/*!
+ * @brief Event loop callback for a client which is being authorized
+ *
+ * @param[in,out] es Event source for the client connection
+ * @param[in] flags Bitwise combination of ready ::EVENT_FLAG values
+ */
+static void proxy_worker_auth_event(struct event_source *es, uint32_t flags);
+
+#endif
 /*!
  * @brief Authorize an incoming client for use of this proxy
  *
@@ -166,6 +375,37 @@ static int proxy_worker_accept(struct proxy_worker *pw,
  */
 static int proxy_worker_authorize(struct proxy_worker *pw);
 
+#ifdef HAVE_EPOLL
+/*!
+ * @brief Begins authorizing a new client without blocking
+ *
+ * @param[in,out] pw Target proxy client worker instance
+ * @param[in] conn_client Connection to a client
+ */
+static void proxy_worker_begin(struct proxy_worker *pw,
+			       struct conn_handle *conn_client);
+
+#endif
+/*!
+ * @brief Determines the length of the callsign sent by a client
+ *
+ * @param[in] buff The first 16 bytes received from the client
+ *
+ * @returns Length of the callsign on success, negative ERRNO value on failure
+ */
+static int proxy_worker_callsign_len(const uint8_t *buff);
+
+/*!
+ * @brief Sends a nonce to the client and computes the expected response
+ *
+ * @param[in,out] pw Target proxy client worker instance
+ * @param[out] response Expected password response from the client
+ *
+ * @returns 0 on success, negative ERRNO value on failure
+ */
+static int proxy_worker_challenge(struct proxy_worker *pw,
+				  uint8_t response[PROXY_PASS_RES_LEN]);
+
 /*!
  * @brief Begins an orderly shutdown of any active connections
  *
@@ -173,6 +413,15 @@ static int proxy_worker_authorize(struct proxy_worker *pw);
  */
 static void proxy_worker_drop(struct proxy_worker *pw);
 
+#ifdef HAVE_EPOLL
+/*!
+ * @brief Releases a slot and its worker after the client disconnects
+ *
+ * @param[in,out] pc Slot which was serving the client
+ */
+static void proxy_worker_finish(struct proxy_conn_handle *pc);
+
+#endif
 /*!
  * @brief Frees data allocated by ::proxy_worker_init
  *
@@ -196,137 +445,663 @@ static void proxy_worker_func(struct worker_handle *wh);
  */
 static int proxy_worker_init(struct proxy_worker *pw);
 
-static int proxy_worker_accept(struct proxy_worker *pw,
-			       struct conn_handle *conn_client)
-{
-	int ret;
-
-	mutex_lock(&pw->mutex);
-
-	if (pw->conn_client != NULL) {
-		ret = -EBUSY;
-		goto proxy_worker_accept_exit;
-	}
-
-	pw->conn_client = conn_client;
-	ret = worker_wake(&pw->worker);
-	if (ret < 0)
-		pw->conn_client = NULL;
-
-proxy_worker_accept_exit:
-	mutex_unlock(&pw->mutex);
-
-	return ret;
-}
+/*!
+ * @brief Reports a failed authorization and releases the worker
+ *
+ * @param[in,out] pw Target proxy client worker instance
+ * @param[in] ret Negative ERRNO value describing the failure
+ */
+static void proxy_worker_reject(struct proxy_worker *pw, int ret);
 
-static int proxy_worker_authorize(struct proxy_worker *pw)
-{
-	uint8_t buff[28];
-	size_t idx, j;
-	uint32_t nonce;
-	char nonce_str[9];
-	uint8_t response[PROXY_PASS_RES_LEN];
-	int ret;
+/*!
+ * @brief Frees the worker's client connection and returns it to the pool
+ *
+ * @param[in,out] pw Target proxy client worker instance
+ */
+static void proxy_worker_release(struct proxy_worker *pw);
 
-	static const uint8_t msg_bad_pw[] = {
-		0x07, 0x00, 0x00, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00, 0x01,
-	};
-	static const uint8_t msg_bad_auth[] = {
-		0x07, 0x00, 0x00, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00, 0x02,
-	};
+/*!
+ * @brief Finishes the client's session and returns the slot to the pool
+ *
+ * @param[in,out] pw Target proxy client worker instance
+ * @param[in,out] pc Slot which was serving the client
+ */
+static void proxy_worker_release_slot(struct proxy_worker *pw,
+				      struct proxy_conn_handle *pc);
 
+/*!
+ * @brief Prepares proxy_worker::pass_with_nonce for generating challenges
+ *
+ * @param[in,out] pw Target proxy client worker instance
+ *
+ * @returns 0 on success, negative ERRNO value on failure
+ */
+static int proxy_worker_set_password(struct proxy_worker *pw);
 
-	ret = get_nonce(&nonce);
-	if (ret < 0)
-		return ret;
+/*!
+ * @brief Verifies the client's password response and callsign
+ *
+ * @param[in,out] pw Target proxy client worker instance
+ * @param[in,out] buff Complete callsign and password response from the client
+ * @param[in] response Expected password response from the client
+ *
+ * @returns 0 on success, negative ERRNO value on failure
+ */
+static int proxy_worker_verify(struct proxy_worker *pw, uint8_t *buff,
+			       const uint8_t response[PROXY_PASS_RES_LEN]);
 
-	digest_to_hex32(nonce, nonce_str);
+/*!
+ * @brief Takes an available worker from the pool without locking
+ *
+ * @param[in,out] ph Target proxy instance
+ *
+ * @returns The worker, or NULL if none are available
+ */
+static struct proxy_worker *proxy_workers_pop(struct proxy_handle *ph);
 
-	/* Generate the expected auth response */
-	ret = get_password_response(nonce, pw->ph->conf.password, response);
-	if (ret < 0)
-		return ret;
+/*!
+ * @brief Returns a worker to the pool without locking
+ *
+ * @param[in,out] pw Target proxy client worker instance
+ */
+static void proxy_workers_push(struct proxy_worker *pw);
 
-	/* Send the nonce */
-	ret = conn_send(pw->conn_client, (uint8_t *)nonce_str, 8);
-	if (ret < 0)
-		return ret;
+static struct conn_handle *proxy_conns_acquire(struct proxy_handle *ph)
+{
+	struct proxy_priv *priv = ph->priv;
+	struct conn_handle *conn = NULL;
 
-	/* We can expect to receive a newline-terminated callsign and a 16-byte
-	 * password response.
-	 * Since this is variable-length, initially look only for 16 bytes. The
-	 * callsign will be part of that, and we can figure out how much we're
-	 * missing.
-	 */
-	ret = conn_recv(pw->conn_client, buff, 16);
-	if (ret < 0)
-		return ret;
+	mutex_lock(&priv->idle_conns_mutex);
+	if (priv->num_idle_conns > 0)
+		conn = priv->idle_conns[--priv->num_idle_conns];
+	mutex_unlock(&priv->idle_conns_mutex);
 
-	idx = 0;
-	while (idx < 11 && buff[idx] != '\n')
-		idx++;
+	return conn;
+}
 
-	if (idx >= 11)
-		return -EINVAL;
+static void proxy_conns_free(struct proxy_handle *ph)
+{
+	struct proxy_priv *priv = ph->priv;
+	int i;
 
-	/* Make the callsign null-terminated */
-	buff[idx] = '\0';
-	strcpy(pw->callsign, (char *)buff);
+	if (priv->client_conns != NULL) {
+		for (i = 0; i <= priv->num_clients; i++)
+			conn_free(&priv->client_conns[i]);
 
-	ret = conn_recv(pw->conn_client, &buff[16], idx + 1);
-	if (ret < 0)
-		return ret;
+		free(priv->client_conns);
+		priv->client_conns = NULL;
+	}
 
-	for (idx += 1, j = 0; j < PROXY_PASS_RES_LEN; idx++, j++) {
-		if (response[j] != buff[idx]) {
-			proxy_log(pw->ph, LOG_LEVEL_INFO,
-				  "Client '%s' supplied an incorrect password. Dropping...\n",
-				  pw->callsign);
+	free(priv->idle_conns);
+	priv->idle_conns = NULL;
+	priv->num_idle_conns = 0;
+}
 
-			ret = conn_send(pw->conn_client, msg_bad_pw, sizeof(msg_bad_pw));
+static int proxy_conns_init(struct proxy_handle *ph)
+{
+	struct proxy_priv *priv = ph->priv;
+	int i;
+	int ret;
 
-			return ret < 0 ? ret : -EACCES;
-		}
+	priv->client_conns = calloc(priv->num_clients + 1,
+				    sizeof(*priv->client_conns));
+	priv->idle_conns = calloc(priv->num_clients + 1,
+				  sizeof(*priv->idle_conns));
+	if (priv->client_conns == NULL || priv->idle_conns == NULL) {
+		ret = -ENOMEM;
+		goto proxy_conns_init_exit;
 	}
 
-	ret = proxy_authorize_callsign(pw->ph, pw->callsign);
-	if (ret != 1) {
-		proxy_log(pw->ph, LOG_LEVEL_INFO,
-			  "Client '%s' is not authorized to use this proxy. Dropping...\n",
-			  pw->callsign);
+	for (i = 0; i <= priv->num_clients; i++) {
+		priv->client_conns[i].nonblocking = priv->event.priv != NULL;
 
-		ret = conn_send(pw->conn_client, msg_bad_auth, sizeof(msg_bad_pw));
+		ret = conn_init(&priv->client_conns[i]);
+		if (ret < 0)
+			goto proxy_conns_init_exit;
 
-		return ret < 0 ? ret : -EACCES;
+		priv->idle_conns[priv->num_idle_conns++] =
+			&priv->client_conns[i];
 	}
 
 	return 0;
+
+proxy_conns_init_exit:
+	proxy_conns_free(ph);
+
+	return ret;
 }
 
-static void proxy_worker_drop(struct proxy_worker *pw)
+static void proxy_conns_release(struct proxy_handle *ph,
+				struct conn_handle *conn)
 {
-	mutex_lock_shared(&pw->mutex);
+	struct proxy_priv *priv = ph->priv;
 
-	if (pw->conn_client != NULL)
-		conn_drop(pw->conn_client);
+	conn_close(conn);
 
-	mutex_unlock_shared(&pw->mutex);
+	mutex_lock(&priv->idle_conns_mutex);
+	priv->idle_conns[priv->num_idle_conns++] = conn;
+	mutex_unlock(&priv->idle_conns_mutex);
 }
 
-static void proxy_worker_free(struct proxy_worker *pw)
+#ifdef HAVE_EPOLL
+static void proxy_listen_event(struct event_source *es, uint32_t flags)
+{
+	struct proxy_handle *ph = es->func_ctx;
+	struct proxy_priv *priv = ph->priv;
+	struct conn_handle *conn;
+	struct proxy_worker *worker;
+	char remote_addr[54] = { 0 };
+	int ret;
+	int i;
+
+	(void)flags;
+
+	for (i = 0; i < PROXY_ACCEPT_MAX; i++) {
+		conn = proxy_conns_acquire(ph);
+		if (conn == NULL)
+			return;
+
+		ret = conn_accept(&priv->conn_listen, conn);
+		if (ret < 0) {
+			proxy_conns_release(ph, conn);
+
+			switch (ret) {
+			case -EAGAIN:
+			case -ECONNABORTED:
+			case -EINTR:
+				return;
+			default:
+				/* Reported by the next call to proxy_process */
+				event_remove(&priv->event, &priv->source_listen);
+				priv->listen_ret = ret;
+				return;
+			}
+		}
+
+		conn_get_remote_addr(conn, remote_addr);
+		proxy_log(ph, LOG_LEVEL_DEBUG, "Incoming connection from %s.\n",
+			  remote_addr);
+
+		worker = proxy_workers_pop(ph);
+
+		if (worker == NULL) {
+			proxy_log(ph, LOG_LEVEL_INFO,
+				  "Dropping client because there are no available slots.\n");
+			proxy_conns_release(ph, conn);
+			continue;
+		}
+
+		proxy_worker_begin(worker, conn);
+	}
+}
+
+static int proxy_process_events(struct proxy_handle *ph)
+{
+	struct proxy_priv *priv = ph->priv;
+	int ret;
+
+	/* Accepting, authorizing and serving clients must not allocate */
+	alloc_guard_enter();
+	ret = event_process(&priv->event, 0);
+	alloc_guard_leave();
+	if (ret < 0 && ret != -EINTR)
+		return ret;
+
+	if (atomic_load_u32(&priv->usable_clients) > 0)
+		return priv->listen_ret;
+
+	/* Stop accepting new clients, but keep serving the connected ones */
+	event_remove(&priv->event, &priv->source_listen);
+
+	return atomic_load_u32(&priv->busy_workers) > 0 ? 0 : -EINTR;
+}
+
+static void *proxy_shard_func(void *ctx)
+{
+	struct thread_handle *th = ctx;
+	struct proxy_shard *shard = th->func_ctx;
+	int ret;
+
+	alloc_guard_enter();
+
+	do {
+		ret = event_process(&shard->event, 0);
+	} while (ret == 0);
+
+	alloc_guard_leave();
+
+	/* The shard is woken only when it is being stopped */
+	if (ret != -EINTR)
+		proxy_log(shard->ph, LOG_LEVEL_ERROR,
+			  "Event loop thread #%d failed (%d): %s\n",
+			  shard->index, -ret, strerror(-ret));
+
+	return NULL;
+}
+
+static void proxy_shards_free(struct proxy_handle *ph)
+{
+	struct proxy_priv *priv = ph->priv;
+	int i;
+
+	if (priv->shards == NULL)
+		return;
+
+	proxy_shards_stop(ph);
+
+	for (i = 0; i < priv->num_shards; i++) {
+		thread_free(&priv->shards[i].thread);
+		event_free(&priv->shards[i].event);
+	}
+
+	free(priv->shards);
+	priv->shards = NULL;
+	priv->num_shards = 0;
+}
+
+static int proxy_shards_init(struct proxy_handle *ph)
+{
+	struct proxy_priv *priv = ph->priv;
+	int ret;
+	int i;
+
+	if (ph->conf.event_loop_threads == 0)
+		priv->num_shards = thread_cpu_count();
+	else if (ph->conf.event_loop_threads < (uint32_t)priv->num_clients)
+		priv->num_shards = (int)ph->conf.event_loop_threads;
+	else
+		priv->num_shards = priv->num_clients;
+
+	/* Additional shards would have no slots to service */
+	if (priv->num_shards > priv->num_clients)
+		priv->num_shards = priv->num_clients;
+
+	priv->shards = calloc(priv->num_shards, sizeof(*priv->shards));
+	if (priv->shards == NULL) {
+		priv->num_shards = 0;
+		return -ENOMEM;
+	}
+
+	for (i = 0; i < priv->num_shards; i++) {
+		priv->shards[i].ph = ph;
+		priv->shards[i].index = i;
+
+		ret = event_init(&priv->shards[i].event);
+		if (ret < 0)
+			goto proxy_shards_init_exit;
+
+		priv->shards[i].thread.func_ctx = &priv->shards[i];
+		priv->shards[i].thread.func_ptr = proxy_shard_func;
+		priv->shards[i].thread.stack_size =
+			ph->conf.thread_stack_size * 1024;
+		ret = thread_init(&priv->shards[i].thread);
+		if (ret < 0)
+			goto proxy_shards_init_exit;
+	}
+
+	proxy_log(ph, LOG_LEVEL_INFO,
+		  "Processing %d slots using %d event loop threads\n",
+		  priv->num_clients, priv->num_shards);
+
+	return 0;
+
+proxy_shards_init_exit:
+	proxy_shards_free(ph);
+
+	return ret;
+}
+
+static int proxy_shards_start(struct proxy_handle *ph)
+{
+	struct proxy_priv *priv = ph->priv;
+	int num_cpus = thread_cpu_count();
+	int ret;
+	int i;
+
+	for (i = 0; i < priv->num_shards; i++) {
+		ret = thread_start(&priv->shards[i].thread);
+		if (ret < 0) {
+			proxy_shards_stop(ph);
+			return ret;
+		}
+
+		ret = thread_set_affinity(&priv->shards[i].thread,
+					  i % num_cpus);
+		if (ret < 0)
+			proxy_log(ph, LOG_LEVEL_WARN,
+				  "Failed to pin event loop thread #%d to CPU %d (%d): %s\n",
+				  i, i % num_cpus, -ret, strerror(-ret));
+		else
+			proxy_log(ph, LOG_LEVEL_DEBUG,
+				  "Event loop thread #%d is pinned to CPU %d\n",
+				  i, i % num_cpus);
+	}
+
+	return 0;
+}
+
+static void proxy_shards_stop(struct proxy_handle *ph)
+{
+	struct proxy_priv *priv = ph->priv;
+	int i;
+
+	for (i = 0; i < priv->num_shards; i++) {
+		event_wake(&priv->shards[i].event);
+		thread_join(&priv->shards[i].thread);
+	}
+}
+
+#endif
+static int proxy_worker_accept(struct proxy_worker *pw,
+			       struct conn_handle *conn_client)
+{
+	int ret;
+
+	mutex_lock(&pw->mutex);
+
+	if (pw->conn_client != NULL) {
+		ret = -EBUSY;
+		goto proxy_worker_accept_exit;
+	}
+
+	pw->conn_client = conn_client;
+	ret = worker_wake(&pw->worker);
+	if (ret < 0)
+		pw->conn_client = NULL;
+
+proxy_worker_accept_exit:
+	mutex_unlock(&pw->mutex);
+
+	return ret;
+}
+
+static struct proxy_conn_handle *proxy_worker_acquire(struct proxy_worker *pw)
+{
+	struct proxy_priv *priv = pw->ph->priv;
+	struct proxy_conn_handle *pc;
+	uint8_t reconnect;
+	uint8_t hash;
+	int ret;
+
+	hash = pearson_get((uint8_t *)pw->callsign, strlen(pw->callsign));
+	proxy_log(pw->ph, LOG_LEVEL_DEBUG,
+		  "Searching callsign bucket %u\n", hash);
+
+	mutex_lock(&priv->idle_clients_mutex);
+
+	/* First, check for a reconnect */
+	for (pc = priv->clients_by_call[hash]; pc != NULL; pc = pc->next_by_call) {
+		if (pc->prev_ptr != NULL && strcmp(pc->callsign, pw->callsign) == 0)
+			break;
+	}
+
+	reconnect = pc != NULL;
+
+	/* Fall back on the oldest available slot */
+	if (pc == NULL)
+		pc = priv->idle_clients_head;
+
+	if (pc == NULL) {
+		mutex_unlock(&priv->idle_clients_mutex);
+		proxy_log(pw->ph, LOG_LEVEL_ERROR,
+			  "Idle slot pool is empty.\n");
+		return NULL;
+	}
+
+	pc->finish_ctx = pw;
+
+	/* Remove the slot from the pool */
+	*pc->prev_ptr = pc->next;
+	if (pc->next == NULL)
+		priv->idle_clients_tail_ptr = pc->prev_ptr;
+	else
+		pc->next->prev_ptr = pc->prev_ptr;
+	pc->prev_ptr = NULL;
+
+	mutex_unlock(&priv->idle_clients_mutex);
+
+	/* The slot is ours, so opening its sockets doesn't hold up anyone else */
+	ret = proxy_conn_accept(pc, pw->conn_client, pw->callsign, reconnect);
+	if (ret < 0) {
+		proxy_log(pw->ph, LOG_LEVEL_ERROR,
+			  "Failed to acquire slot (%d): %s\n",
+			  -ret, strerror(-ret));
+
+		/* The slot keeps its callsign, but is the last to be reused */
+		mutex_lock(&priv->idle_clients_mutex);
+		pc->next = NULL;
+		pc->prev_ptr = priv->idle_clients_tail_ptr;
+		*priv->idle_clients_tail_ptr = pc;
+		priv->idle_clients_tail_ptr = &pc->next;
+		mutex_unlock(&priv->idle_clients_mutex);
+
+		return NULL;
+	}
+
+	if (reconnect)
+		return pc;
+
+	/* Only a slot which is serving the client is found by its callsign */
+	mutex_lock(&priv->idle_clients_mutex);
+
+	/* Remove the slot from the hash map */
+	if (pc->prev_by_call_ptr != NULL) {
+		*pc->prev_by_call_ptr = pc->next_by_call;
+		if (pc->next_by_call)
+			pc->next_by_call->prev_by_call_ptr = pc->prev_by_call_ptr;
+	}
+
+	/* Add the slot to the hash map */
+	pc->prev_by_call_ptr = &priv->clients_by_call[hash];
+	pc->next_by_call = priv->clients_by_call[hash];
+	if (pc->next_by_call != NULL)
+		pc->next_by_call->prev_by_call_ptr = &pc->next_by_call;
+	priv->clients_by_call[hash] = pc;
+	strcpy(pc->callsign, pw->callsign);
+	mutex_unlock(&priv->idle_clients_mutex);
+
+	return pc;
+}
+
+#ifdef HAVE_EPOLL
+static void proxy_worker_auth_event(struct event_source *es, uint32_t flags)
+{
+	struct proxy_worker *pw = es->func_ctx;
+	struct proxy_priv *priv = pw->ph->priv;
+	size_t expected;
+	int ret;
+
+	(void)flags;
+
+	/* The callsign is variable-length, so initially look for 16 bytes */
+	for (;;) {
+		expected = 16;
+
+		if (pw->buff_len >= expected) {
+			ret = proxy_worker_callsign_len(pw->buff);
+			if (ret < 0)
+				goto proxy_worker_auth_event_exit;
+
+			expected += ret + 1;
+			if (pw->buff_len == expected)
+				break;
+		}
+
+		ret = conn_recv_any(pw->conn_client, &pw->buff[pw->buff_len],
+				    expected - pw->buff_len, NULL, NULL);
+		if (ret == -EAGAIN)
+			return;
+		else if (ret < 0)
+			goto proxy_worker_auth_event_exit;
+
+		pw->buff_len += ret;
+	}
+
+	event_remove(&priv->event, &pw->source);
+
+	ret = proxy_worker_verify(pw, pw->buff, pw->response);
+	if (ret < 0)
+		goto proxy_worker_auth_event_exit;
+
+	proxy_update_registration(pw->ph);
+
+	if (proxy_worker_acquire(pw) == NULL) {
+		proxy_worker_release(pw);
+		proxy_update_registration(pw->ph);
+	}
+
+	return;
+
+proxy_worker_auth_event_exit:
+	event_remove(&priv->event, &pw->source);
+
+	proxy_worker_reject(pw, ret);
+}
+
+#endif
+static int proxy_worker_authorize(struct proxy_worker *pw)
+{
+	uint8_t buff[28];
+	uint8_t response[PROXY_PASS_RES_LEN];
+	int ret;
+
+	ret = proxy_worker_challenge(pw, response);
+	if (ret < 0)
+		return ret;
+
+	/* We can expect to receive a newline-terminated callsign and a 16-byte
+	 * password response.
+	 * Since this is variable-length, initially look only for 16 bytes. The
+	 * callsign will be part of that, and we can figure out how much we're
+	 * missing.
+	 */
+	ret = conn_recv(pw->conn_client, buff, 16);
+	if (ret < 0)
+		return ret;
+
+	ret = proxy_worker_callsign_len(buff);
+	if (ret < 0)
+		return ret;
+
+	ret = conn_recv(pw->conn_client, &buff[16], ret + 1);
+	if (ret < 0)
+		return ret;
+
+	return proxy_worker_verify(pw, buff, response);
+}
+
+#ifdef HAVE_EPOLL
+static void proxy_worker_begin(struct proxy_worker *pw,
+			       struct conn_handle *conn_client)
+{
+	struct proxy_priv *priv = pw->ph->priv;
+	int ret;
+
+	mutex_lock(&pw->mutex);
+	pw->conn_client = conn_client;
+	mutex_unlock(&pw->mutex);
+
+	proxy_log(pw->ph, LOG_LEVEL_DEBUG,
+		  "New connection - beginning authorization procedure\n");
+
+	pw->buff_len = 0;
+
+	ret = proxy_worker_challenge(pw, pw->response);
+	if (ret < 0) {
+		proxy_worker_reject(pw, ret);
+		return;
+	}
+
+	pw->source.conn = conn_client;
+	ret = event_add(&priv->event, &pw->source, EVENT_FLAG_IN);
+	if (ret < 0)
+		proxy_worker_reject(pw, ret);
+}
+
+#endif
+static int proxy_worker_callsign_len(const uint8_t *buff)
+{
+	int idx = 0;
+
+	while (idx < 11 && buff[idx] != '\n')
+		idx++;
+
+	if (idx >= 11)
+		return -EINVAL;
+
+	return idx;
+}
+
+static int proxy_worker_challenge(struct proxy_worker *pw,
+				  uint8_t response[PROXY_PASS_RES_LEN])
+{
+	uint8_t *nonce_str = &pw->pass_with_nonce[pw->pass_len];
+	uint32_t nonce;
+	int ret;
+
+	ret = get_nonce(&nonce);
+	if (ret < 0)
+		return ret;
+
+	/* Generate the expected auth response */
+	digest_to_hex32(nonce, (char *)nonce_str);
+	digest_get(pw->pass_with_nonce, pw->pass_len + PROXY_NONCE_STR_LEN,
+		   response);
+
+	/* Send the nonce */
+	return conn_send(pw->conn_client, nonce_str, PROXY_NONCE_STR_LEN);
+}
+
+static void proxy_worker_drop(struct proxy_worker *pw)
+{
+	struct proxy_priv *priv = pw->ph->priv;
+
+	mutex_lock_shared(&pw->mutex);
+
+	/* The event loop must be the one to close the socket */
+	if (pw->conn_client != NULL && priv->event.priv != NULL)
+		conn_shutdown(pw->conn_client);
+	else if (pw->conn_client != NULL)
+		conn_drop(pw->conn_client);
+
+	mutex_unlock_shared(&pw->mutex);
+}
+
+#ifdef HAVE_EPOLL
+static void proxy_worker_finish(struct proxy_conn_handle *pc)
+{
+	struct proxy_priv *priv = pc->ph->priv;
+	struct proxy_worker *pw = pc->finish_ctx;
+
+	proxy_worker_release_slot(pw, pc);
+
+	proxy_worker_release(pw);
+
+	proxy_update_registration(pw->ph);
+
+	/* Let proxy_process notice if the last client left after shutdown */
+	if (pc->event != &priv->event)
+		event_wake(&priv->event);
+}
+
+#endif
+static void proxy_worker_free(struct proxy_worker *pw)
 {
 	worker_free(&pw->worker);
 	mutex_free(&pw->mutex);
+
+	free(pw->pass_with_nonce);
+	pw->pass_with_nonce = NULL;
 }
 
 static void proxy_worker_func(struct worker_handle *wh)
 {
 	struct proxy_worker *pw = wh->func_ctx;
-	struct proxy_priv *priv = pw->ph->priv;
 	struct proxy_conn_handle *pc = NULL;
 	int ret;
-	char remote_addr[54];
-	uint8_t hash;
+
+	/* Authorizing and serving the client must not allocate */
+	alloc_guard_enter();
 
 	mutex_lock_shared(&pw->mutex);
 
@@ -336,106 +1111,130 @@ static void proxy_worker_func(struct worker_handle *wh)
 
 		mutex_unlock_shared(&pw->mutex);
 
-		return;
-	}
+		alloc_guard_leave();
+
+		return;
+	}
+
+	mutex_unlock_shared(&pw->mutex);
+
+	proxy_log(pw->ph, LOG_LEVEL_DEBUG,
+		  "New connection - beginning authorization procedure\n");
+
+	ret = proxy_worker_authorize(pw);
+	if (ret < 0) {
+		proxy_worker_reject(pw, ret);
+
+		alloc_guard_leave();
+
+		return;
+	}
+
+	proxy_update_registration(pw->ph);
+
+	pc = proxy_worker_acquire(pw);
+	if (pc == NULL)
+		goto proxy_worker_func_exit;
+
+	do {
+		ret = proxy_conn_process(pc);
+	} while (ret >= 0);
+
+	proxy_worker_release_slot(pw, pc);
+
+proxy_worker_func_exit:
+	proxy_worker_release(pw);
+
+	proxy_update_registration(pw->ph);
+
+	alloc_guard_leave();
+
+	proxy_log(pw->ph, LOG_LEVEL_DEBUG,
+		  "Client worker is returning cleanly.\n");
+}
+
+static int proxy_worker_init(struct proxy_worker *pw)
+{
+	struct proxy_priv *priv = pw->ph->priv;
+	int ret;
+
+	ret = mutex_init(&pw->mutex);
+	if (ret < 0)
+		return ret;
+
+	ret = proxy_worker_set_password(pw);
+	if (ret < 0)
+		goto proxy_worker_init_exit;
 
-	mutex_unlock_shared(&pw->mutex);
+#ifdef HAVE_EPOLL
+	/* Authorization is performed by the event loop instead of a thread */
+	if (priv->event.priv != NULL) {
+		pw->source.func_ctx = pw;
+		pw->source.func_ptr = proxy_worker_auth_event;
 
-	conn_get_remote_addr(pw->conn_client, remote_addr);
+		return 0;
+	}
 
-	proxy_log(pw->ph, LOG_LEVEL_DEBUG,
-		  "New connection - beginning authorization procedure\n");
+#else
+	(void)priv;
 
-	ret = proxy_worker_authorize(pw);
-	if (ret < 0) {
-		switch (ret) {
-		case -ECONNRESET:
-		case -EINTR:
-		case -ENOTCONN:
-		case -EPIPE:
-			proxy_log(pw->ph, LOG_LEVEL_WARN,
-				  "Connection to client was lost before authorization could complete\n");
-			break;
-		default:
-			proxy_log(pw->ph, LOG_LEVEL_ERROR,
-				  "Authorization failed for client '%s' (%d): %s\n",
-				  remote_addr, -ret, strerror(-ret));
-		}
+#endif
+	pw->worker.func_ctx = pw;
+	pw->worker.func_ptr = proxy_worker_func;
+	pw->worker.stack_size = pw->ph->conf.thread_stack_size * 1024;
+	pw->worker.idle_timeout = pw->ph->conf.thread_idle_timeout * 1000;
+	ret = worker_init(&pw->worker);
+	if (ret < 0)
+		goto proxy_worker_init_exit;
 
-		mutex_lock(&pw->mutex);
-		conn_free(pw->conn_client);
-		free(pw->conn_client);
-		pw->conn_client = NULL;
-		mutex_unlock(&pw->mutex);
+	return 0;
 
-		mutex_lock(&priv->idle_workers_mutex);
-		pw->next = priv->idle_workers_head;
-		priv->idle_workers_head = pw;
-		mutex_unlock(&priv->idle_workers_mutex);
+proxy_worker_init_exit:
+	free(pw->pass_with_nonce);
+	pw->pass_with_nonce = NULL;
 
-		return;
-	}
+	mutex_free(&pw->mutex);
 
-	proxy_update_registration(pw->ph);
+	return ret;
+}
 
-	hash = pearson_get((uint8_t *)pw->callsign, strlen(pw->callsign));
-	proxy_log(pw->ph, LOG_LEVEL_DEBUG,
-		  "Searching callsign bucket %u\n", hash);
+static void proxy_worker_reject(struct proxy_worker *pw, int ret)
+{
+	char remote_addr[54];
 
-	mutex_lock(&priv->idle_clients_mutex);
-	if (priv->idle_clients_head == NULL) {
-		mutex_unlock(&priv->idle_clients_mutex);
-		proxy_log(pw->ph, LOG_LEVEL_ERROR,
-			  "Idle slot pool is empty.\n");
-		goto proxy_worker_func_exit;
-	}
+	conn_get_remote_addr(pw->conn_client, remote_addr);
 
-	pc = priv->clients_by_call[hash];
-	/* First, check for a reconnect */
-	while (pc != NULL) {
-		ret = proxy_conn_accept(pc, pw->conn_client, pw->callsign, 1);
-		if (ret != -EBUSY)
-			break;
-		pc = pc->next_by_call;
-	}
-	/* Fall back on the oldest available slot */
-	if (pc == NULL) {
-		pc = priv->idle_clients_head;
-		ret = proxy_conn_accept(pc, pw->conn_client, pw->callsign, 0);
-	}
-	if (ret < 0) {
-		mutex_unlock(&priv->idle_clients_mutex);
+	switch (ret) {
+	case -ECONNRESET:
+	case -EINTR:
+	case -ENOTCONN:
+	case -EPIPE:
+		proxy_log(pw->ph, LOG_LEVEL_WARN,
+			  "Connection to client was lost before authorization could complete\n");
+		break;
+	default:
 		proxy_log(pw->ph, LOG_LEVEL_ERROR,
-			  "Failed to acquire slot (%d): %s\n",
-			  -ret, strerror(-ret));
-		goto proxy_worker_func_exit;
+			  "Authorization failed for client '%s' (%d): %s\n",
+			  remote_addr, -ret, strerror(-ret));
 	}
 
-	/* Remove the slot from the pool */
-	*pc->prev_ptr = pc->next;
-	if (pc->next == NULL)
-		priv->idle_clients_tail_ptr = pc->prev_ptr;
-	else
-		pc->next->prev_ptr = pc->prev_ptr;
+	proxy_worker_release(pw);
+}
 
-	/* Remove the slot from the hash map */
-	if (pc->prev_by_call_ptr != NULL) {
-		*pc->prev_by_call_ptr = pc->next_by_call;
-		if (pc->next_by_call)
-			pc->next_by_call->prev_by_call_ptr = pc->prev_by_call_ptr;
-	}
+static void proxy_worker_release(struct proxy_worker *pw)
+{
+	mutex_lock(&pw->mutex);
+	proxy_conns_release(pw->ph, pw->conn_client);
+	pw->conn_client = NULL;
+	mutex_unlock(&pw->mutex);
 
-	/* Add the slot to the hash map */
-	pc->prev_by_call_ptr = &priv->clients_by_call[hash];
-	pc->next_by_call = priv->clients_by_call[hash];
-	if (pc->next_by_call != NULL)
-		pc->next_by_call->prev_by_call_ptr = &pc->next_by_call;
-	priv->clients_by_call[hash] = pc;
-	mutex_unlock(&priv->idle_clients_mutex);
+	proxy_workers_push(pw);
+}
 
-	do {
-		ret = proxy_conn_process(pc);
-	} while (ret >= 0);
+static void proxy_worker_release_slot(struct proxy_worker *pw,
+				      struct proxy_conn_handle *pc)
+{
+	struct proxy_priv *priv = pw->ph->priv;
 
 	proxy_log(pw->ph, LOG_LEVEL_INFO,
 		  "Disconnected from client '%s'.\n", pw->callsign);
@@ -449,46 +1248,117 @@ static void proxy_worker_func(struct worker_handle *wh)
 	*priv->idle_clients_tail_ptr = pc;
 	priv->idle_clients_tail_ptr = &pc->next;
 	mutex_unlock(&priv->idle_clients_mutex);
+}
 
-proxy_worker_func_exit:
-	mutex_lock(&pw->mutex);
-	conn_free(pw->conn_client);
-	free(pw->conn_client);
-	pw->conn_client = NULL;
-	mutex_unlock(&pw->mutex);
+static int proxy_worker_set_password(struct proxy_worker *pw)
+{
+	const char *password = pw->ph->conf.password;
+	size_t i;
 
-	mutex_lock(&priv->idle_workers_mutex);
-	pw->next = priv->idle_workers_head;
-	priv->idle_workers_head = pw;
-	mutex_unlock(&priv->idle_workers_mutex);
+	pw->pass_len = strlen(password);
+	pw->pass_with_nonce = malloc(pw->pass_len + PROXY_NONCE_STR_LEN);
+	if (pw->pass_with_nonce == NULL)
+		return -ENOMEM;
 
-	proxy_update_registration(pw->ph);
+	for (i = 0; i < pw->pass_len; i++) {
+		if (password[i] >= 97 && password[i] <= 122)
+			pw->pass_with_nonce[i] = password[i] - 32;
+		else
+			pw->pass_with_nonce[i] = password[i];
+	}
 
-	proxy_log(pw->ph, LOG_LEVEL_DEBUG,
-		  "Client worker is returning cleanly.\n");
+	return 0;
 }
 
-static int proxy_worker_init(struct proxy_worker *pw)
+static int proxy_worker_verify(struct proxy_worker *pw, uint8_t *buff,
+			       const uint8_t response[PROXY_PASS_RES_LEN])
 {
+	size_t idx, j;
 	int ret;
 
-	ret = mutex_init(&pw->mutex);
+	static const uint8_t msg_bad_pw[] = {
+		0x07, 0x00, 0x00, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00, 0x01,
+	};
+	static const uint8_t msg_bad_auth[] = {
+		0x07, 0x00, 0x00, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00, 0x02,
+	};
+
+	ret = proxy_worker_callsign_len(buff);
 	if (ret < 0)
 		return ret;
 
-	pw->worker.func_ctx = pw;
-	pw->worker.func_ptr = proxy_worker_func;
-	pw->worker.stack_size = 1024 * 1024;
-	ret = worker_init(&pw->worker);
-	if (ret < 0)
-		goto proxy_worker_init_exit;
+	idx = ret;
+
+	/* Make the callsign null-terminated */
+	buff[idx] = '\0';
+	strcpy(pw->callsign, (char *)buff);
+
+	for (idx += 1, j = 0; j < PROXY_PASS_RES_LEN; idx++, j++) {
+		if (response[j] != buff[idx]) {
+			proxy_log(pw->ph, LOG_LEVEL_INFO,
+				  "Client '%s' supplied an incorrect password. Dropping...\n",
+				  pw->callsign);
+
+			ret = conn_send(pw->conn_client, msg_bad_pw, sizeof(msg_bad_pw));
+
+			return ret < 0 ? ret : -EACCES;
+		}
+	}
+
+	ret = proxy_authorize_callsign(pw->ph, pw->callsign);
+	if (ret != 1) {
+		proxy_log(pw->ph, LOG_LEVEL_INFO,
+			  "Client '%s' is not authorized to use this proxy. Dropping...\n",
+			  pw->callsign);
+
+		ret = conn_send(pw->conn_client, msg_bad_auth, sizeof(msg_bad_pw));
+
+		return ret < 0 ? ret : -EACCES;
+	}
 
 	return 0;
+}
 
-proxy_worker_init_exit:
-	mutex_free(&pw->mutex);
+static struct proxy_worker *proxy_workers_pop(struct proxy_handle *ph)
+{
+	struct proxy_priv *priv = ph->priv;
+	struct proxy_worker *pw;
+	uint32_t head;
+	uint32_t next;
 
-	return ret;
+	if (atomic_load_u32(&priv->usable_clients) == 0)
+		return NULL;
+
+	do {
+		head = atomic_load_u32(&priv->idle_workers);
+		if ((head & PROXY_WORKERS_INDEX) == 0)
+			return NULL;
+
+		pw = &priv->client_workers[(head & PROXY_WORKERS_INDEX) - 1];
+		next = atomic_load_u32(&pw->next_idle);
+	} while (!atomic_cas_u32(&priv->idle_workers, head,
+				 ((head & ~PROXY_WORKERS_INDEX) +
+				  PROXY_WORKERS_TAG) | next));
+
+	atomic_add_u32(&priv->busy_workers, 1);
+
+	return pw;
+}
+
+static void proxy_workers_push(struct proxy_worker *pw)
+{
+	struct proxy_priv *priv = pw->ph->priv;
+	uint32_t index = (uint32_t)(pw - priv->client_workers) + 1;
+	uint32_t head;
+
+	do {
+		head = atomic_load_u32(&priv->idle_workers);
+		atomic_store_u32(&pw->next_idle, head & PROXY_WORKERS_INDEX);
+	} while (!atomic_cas_u32(&priv->idle_workers, head,
+				 ((head & ~PROXY_WORKERS_INDEX) +
+				  PROXY_WORKERS_TAG) | index));
+
+	atomic_sub_u32(&priv->busy_workers, 1);
 }
 
 int proxy_authorize_callsign(struct proxy_handle *ph,
@@ -596,18 +1466,13 @@ int proxy_init(struct proxy_handle *ph)
 	if (ret < 0)
 		goto proxy_init_exit;
 
-	/* Initialize the usable_clients mutex */
-	ret = mutex_init(&priv->usable_clients_mutex);
-	if (ret < 0)
-		goto proxy_init_exit;
-
 	/* Initialize the idle_clients mutex */
 	ret = mutex_init(&priv->idle_clients_mutex);
 	if (ret < 0)
 		goto proxy_init_exit;
 
-	/* Initialize the idle_workers mutex */
-	ret = mutex_init(&priv->idle_workers_mutex);
+	/* Initialize the idle_conns mutex */
+	ret = mutex_init(&priv->idle_conns_mutex);
 	if (ret < 0)
 		goto proxy_init_exit;
 
@@ -626,15 +1491,12 @@ void proxy_free(struct proxy_handle *ph)
 
 		proxy_close(ph);
 
-		/* Free idle_workers mutex */
-		mutex_free(&priv->idle_workers_mutex);
+		/* Free idle_conns mutex */
+		mutex_free(&priv->idle_conns_mutex);
 
 		/* Free idle_clients mutex */
 		mutex_free(&priv->idle_clients_mutex);
 
-		/* Free usable_clients mutex */
-		mutex_free(&priv->usable_clients_mutex);
-
 		/* Free registration service */
 		registration_service_free(&priv->reg_service);
 
@@ -674,6 +1536,8 @@ int proxy_open(struct proxy_handle *ph)
 	conn_port_to_str(ph->conf.port, priv->port_str);
 
 	priv->num_clients = 1 + ph->conf.bind_addr_ext_add_len;
+	if (priv->num_clients > PROXY_WORKERS_INDEX)
+		return -EINVAL;
 
 	priv->clients = calloc(priv->num_clients, sizeof(*priv->clients));
 	if (priv->clients == NULL)
@@ -754,6 +1618,32 @@ int proxy_open(struct proxy_handle *ph)
 		priv->re_calls_denied = NULL;
 	}
 
+#ifdef HAVE_EPOLL
+	if (ph->conf.event_loop != PROXY_EVENT_LOOP_OFF) {
+		ret = event_init(&priv->event);
+		if (ret < 0) {
+			proxy_log(ph, LOG_LEVEL_FATAL,
+				  "Failed to initialize event loop (%d): %s\n",
+				  -ret, strerror(-ret));
+			goto proxy_open_exit;
+		}
+
+		if (ph->conf.event_loop == PROXY_EVENT_LOOP_SHARDED) {
+			ret = proxy_shards_init(ph);
+			if (ret < 0) {
+				proxy_log(ph, LOG_LEVEL_FATAL,
+					  "Failed to initialize event loop threads (%d): %s\n",
+					  -ret, strerror(-ret));
+				goto proxy_open_exit;
+			}
+		}
+	}
+#else
+	if (ph->conf.event_loop != PROXY_EVENT_LOOP_OFF)
+		proxy_log(ph, LOG_LEVEL_WARN,
+			  "EventLoop is not supported by this build of OpenELP\n");
+#endif
+
 	memset(priv->clients_by_call, 0x0, sizeof(priv->clients_by_call));
 
 	priv->clients[0].source_addr = ph->conf.bind_addr_ext;
@@ -772,10 +1662,59 @@ int proxy_open(struct proxy_handle *ph)
 	priv->clients[i - 1].next = NULL;
 	priv->idle_clients_tail_ptr = &priv->clients[i - 1].next;
 
+	/* The pool never grows, so packets are discarded once it is exhausted */
+	priv->pool.buff_len = PROXY_CONN_BUFF_LEN;
+	priv->pool.init_buffs = priv->num_clients * PROXY_CONN_POOL_BUFFS;
+	priv->pool.max_buffs = priv->pool.init_buffs;
+	ret = buff_pool_init(&priv->pool);
+	if (ret < 0) {
+		proxy_log(ph, LOG_LEVEL_FATAL,
+			  "Failed to initialize packet buffer pool (%d): %s\n",
+			  -ret, strerror(-ret));
+		goto proxy_open_exit;
+	}
+
+	ret = proxy_conns_init(ph);
+	if (ret < 0) {
+		proxy_log(ph, LOG_LEVEL_FATAL,
+			  "Failed to initialize client connections (%d): %s\n",
+			  -ret, strerror(-ret));
+		goto proxy_open_exit;
+	}
+
 	for (i = 0; i < priv->num_clients; i++) {
 		priv->clients[i].control_port = "5199";
 		priv->clients[i].data_port = "5198";
 		priv->clients[i].ph = ph;
+		priv->clients[i].pool = &priv->pool;
+
+		/* Resolve the address now rather than when a client is waiting */
+		ret = conn_addr_resolve(&priv->clients[i].source,
+					priv->clients[i].source_addr);
+		if (ret < 0)
+			proxy_log(ph, LOG_LEVEL_WARN,
+				  "Failed to resolve external bind address '%s' (%d): %s\n",
+				  priv->clients[i].source_addr == NULL ?
+				  "0.0.0.0" : priv->clients[i].source_addr,
+				  -ret, strerror(-ret));
+#ifdef HAVE_EPOLL
+		if (priv->event.priv != NULL) {
+			priv->clients[i].event = &priv->event;
+			priv->clients[i].finish_func = proxy_worker_finish;
+		}
+
+		if (priv->shards != NULL) {
+			/* Spread the slots evenly across the shards */
+			priv->clients[i].event =
+				&priv->shards[i % priv->num_shards].event;
+
+			proxy_log(ph, LOG_LEVEL_INFO,
+				  "Slot #%d (%s) is assigned to event loop thread #%d\n",
+				  i, priv->clients[i].source_addr == NULL ?
+				  "0.0.0.0" : priv->clients[i].source_addr,
+				  i % priv->num_shards);
+		}
+#endif
 		ret = proxy_conn_init(&priv->clients[i]);
 		if (ret < 0) {
 			proxy_log(ph, LOG_LEVEL_FATAL,
@@ -789,6 +1728,9 @@ int proxy_open(struct proxy_handle *ph)
 		}
 	}
 
+	/* Each worker is counted as busy until it is first pushed */
+	priv->busy_workers = (uint32_t)priv->num_clients;
+
 	for (i = 0; i < priv->num_clients; i++) {
 		priv->client_workers[i].ph = ph;
 		ret = proxy_worker_init(&priv->client_workers[i]);
@@ -803,12 +1745,12 @@ int proxy_open(struct proxy_handle *ph)
 			goto proxy_open_exit_late;
 		}
 
-		priv->client_workers[i].next = priv->idle_workers_head;
-		priv->idle_workers_head = &priv->client_workers[i];
+		proxy_workers_push(&priv->client_workers[i]);
 	}
 
 	priv->conn_listen.source_addr = (const char *)ph->conf.bind_addr;
 	priv->conn_listen.source_port = (const char *)priv->port_str;
+	priv->conn_listen.nonblocking = priv->event.priv != NULL;
 
 	ret = conn_listen(&priv->conn_listen);
 	if (ret < 0) {
@@ -818,6 +1760,24 @@ int proxy_open(struct proxy_handle *ph)
 		goto proxy_open_exit_later;
 	}
 
+#ifdef HAVE_EPOLL
+	if (priv->event.priv != NULL) {
+		priv->listen_ret = 0;
+		priv->source_listen.conn = &priv->conn_listen;
+		priv->source_listen.func_ctx = ph;
+		priv->source_listen.func_ptr = proxy_listen_event;
+		ret = event_add(&priv->event, &priv->source_listen,
+				EVENT_FLAG_IN);
+		if (ret < 0) {
+			proxy_log(ph, LOG_LEVEL_FATAL,
+				  "Failed to monitor listening port (%d): %s\n",
+				  -ret, strerror(-ret));
+			conn_close(&priv->conn_listen);
+			goto proxy_open_exit_later;
+		}
+	}
+#endif
+
 	if (ph->conf.bind_addr == NULL)
 		proxy_log(ph, LOG_LEVEL_INFO,
 			  "Listening for connections on port %s\n",
@@ -831,17 +1791,22 @@ int proxy_open(struct proxy_handle *ph)
 	return 0;
 
 proxy_open_exit_later:
-	priv->idle_workers_head = NULL;
 	for (i = 0; i < priv->num_clients; i++)
 		proxy_worker_free(&priv->client_workers[i]);
 
 proxy_open_exit_late:
+	priv->idle_workers = 0;
+	priv->busy_workers = 0;
 	priv->idle_clients_head = NULL;
 	priv->idle_clients_tail_ptr = NULL;
 	for (i = 0; i < priv->num_clients; i++)
 		proxy_conn_free(&priv->clients[i]);
 
 proxy_open_exit:
+	proxy_conns_free(ph);
+
+	buff_pool_free(&priv->pool);
+
 	if (priv->re_calls_allowed != NULL) {
 		regex_free(priv->re_calls_allowed);
 		free(priv->re_calls_allowed);
@@ -850,6 +1815,11 @@ proxy_open_exit:
 
 	log_close(&priv->log);
 
+#ifdef HAVE_EPOLL
+	proxy_shards_free(ph);
+	event_free(&priv->event);
+
+#endif
 	free(priv->client_workers);
 	priv->client_workers = NULL;
 
@@ -864,21 +1834,56 @@ proxy_open_exit:
 void proxy_close(struct proxy_handle *ph)
 {
 	struct proxy_priv *priv = ph->priv;
+	struct buff_pool_stats pool_stats;
+	struct registration_service_stats reg_stats;
 	int i;
 	int ret;
 
+	alloc_guard_disarm();
+
 	ret = registration_service_stop(&priv->reg_service);
 	if (ret < 0)
 		proxy_log(ph, LOG_LEVEL_ERROR,
 			  "Failed to stop registration service (%d): %s\n",
 			  -ret, strerror(-ret));
 
+	if (ph->conf.reg_name != NULL && priv->reg_service.priv != NULL) {
+		registration_service_get_stats(&priv->reg_service, &reg_stats);
+		proxy_log(ph, LOG_LEVEL_DEBUG,
+			  "Sent %u registration updates, %u suppressed and %u failed\n",
+			  reg_stats.sent, reg_stats.suppressed, reg_stats.failed);
+	}
+
 	proxy_shutdown(ph);
 	proxy_drop(ph);
 
 	proxy_log(ph, LOG_LEVEL_DEBUG, "Closing client connections...\n");
 
-	priv->idle_workers_head = NULL;
+#ifdef HAVE_EPOLL
+	/* The event loops are no longer running, so finish the clients here */
+	if (priv->event.priv != NULL) {
+		proxy_shards_stop(ph);
+
+		event_remove(&priv->event, &priv->source_listen);
+
+		for (i = 0; i < priv->num_clients; i++) {
+			if (proxy_conn_in_use(&priv->clients[i]))
+				proxy_worker_finish(&priv->clients[i]);
+		}
+
+		for (i = 0; i < priv->num_clients; i++) {
+			if (priv->client_workers[i].conn_client == NULL)
+				continue;
+
+			event_remove(&priv->event,
+				     &priv->client_workers[i].source);
+			proxy_worker_release(&priv->client_workers[i]);
+		}
+	}
+
+#endif
+	priv->idle_workers = 0;
+	priv->busy_workers = 0;
 	for (i = 0; i < priv->num_clients; i++)
 		proxy_worker_free(&priv->client_workers[i]);
 
@@ -888,6 +1893,17 @@ void proxy_close(struct proxy_handle *ph)
 	for (i = 0; i < priv->num_clients; i++)
 		proxy_conn_free(&priv->clients[i]);
 
+	if (priv->pool.priv != NULL) {
+		buff_pool_get_stats(&priv->pool, &pool_stats);
+		proxy_log(ph, LOG_LEVEL_DEBUG,
+			  "Packet buffer pool grew to %u buffers, with at most %u in use at once\n",
+			  pool_stats.size, pool_stats.in_use_max);
+	}
+
+	proxy_conns_free(ph);
+
+	buff_pool_free(&priv->pool);
+
 	free(priv->client_workers);
 	priv->client_workers = NULL;
 	free(priv->clients);
@@ -898,6 +1914,12 @@ void proxy_close(struct proxy_handle *ph)
 
 	conn_close(&priv->conn_listen);
 
+#ifdef HAVE_EPOLL
+	proxy_shards_free(ph);
+	event_free(&priv->event);
+
+#endif
+
 	proxy_log(ph, LOG_LEVEL_DEBUG, "Proxy is down - closing log.\n");
 
 	log_close(&priv->log);
@@ -920,13 +1942,16 @@ void proxy_shutdown(struct proxy_handle *ph)
 
 	proxy_log(ph, LOG_LEVEL_DEBUG, "Proxy shutdown requested.\n");
 
-	mutex_lock(&priv->usable_clients_mutex);
-	priv->usable_clients = 0;
-	mutex_unlock(&priv->usable_clients_mutex);
+	atomic_store_u32(&priv->usable_clients, 0);
 
 	proxy_update_registration(ph);
 
 	conn_shutdown(&priv->conn_listen);
+
+#ifdef HAVE_EPOLL
+	if (priv->event.priv != NULL)
+		event_wake(&priv->event);
+#endif
 }
 
 void proxy_log(struct proxy_handle *ph, enum LOG_LEVEL lvl,
@@ -971,18 +1996,20 @@ int proxy_process(struct proxy_handle *ph)
 	int ret = -EBUSY;
 	char remote_addr[54] = { 0 };
 
-	conn = calloc(1, sizeof(*conn));
+#ifdef HAVE_EPOLL
+	if (priv->event.priv != NULL)
+		return proxy_process_events(ph);
+
+#endif
+	conn = proxy_conns_acquire(ph);
 	if (conn == NULL)
 		return -ENOMEM;
 
-	ret = conn_init(conn);
-	if (ret < 0) {
-		free(conn);
-		return ret;
-	}
-
 	proxy_log(ph, LOG_LEVEL_DEBUG, "Waiting for a client...\n");
 
+	/* Accepting a client and handing it to a worker must not allocate */
+	alloc_guard_enter();
+
 	ret = conn_accept(&priv->conn_listen, conn);
 	if (ret < 0)
 		goto conn_process_exit;
@@ -991,14 +2018,7 @@ int proxy_process(struct proxy_handle *ph)
 	proxy_log(ph, LOG_LEVEL_DEBUG, "Incoming connection from %s.\n",
 		  remote_addr);
 
-	mutex_lock_shared(&priv->usable_clients_mutex);
-	mutex_lock(&priv->idle_workers_mutex);
-	if (priv->usable_clients > 0 && priv->idle_workers_head != NULL) {
-		worker = priv->idle_workers_head;
-		priv->idle_workers_head = worker->next;
-	}
-	mutex_unlock(&priv->idle_workers_mutex);
-	mutex_unlock_shared(&priv->usable_clients_mutex);
+	worker = proxy_workers_pop(ph);
 
 	if (worker == NULL) {
 		proxy_log(ph, LOG_LEVEL_INFO,
@@ -1011,11 +2031,14 @@ int proxy_process(struct proxy_handle *ph)
 	if (ret < 0)
 		goto conn_process_exit;
 
+	alloc_guard_leave();
+
 	return 0;
 
 conn_process_exit:
-	conn_free(conn);
-	free(conn);
+	proxy_conns_release(ph, conn);
+
+	alloc_guard_leave();
 
 	return ret;
 }
@@ -1032,6 +2055,9 @@ int get_password_response(uint32_t nonce, const char *password,
 	uint8_t *pass_with_nonce = malloc(pass_with_nonce_len);
 	char *iter = (char *)pass_with_nonce;
 
+	if (pass_with_nonce == NULL)
+		return -ENOMEM;
+
 	while (*password != '\0') {
 		if (*password >= 97 && *password <= 122)
 			*iter = *password - 32;
@@ -1057,6 +2083,16 @@ int proxy_start(struct proxy_handle *ph)
 	int ret;
 	int i;
 
+#ifdef HAVE_EPOLL
+	ret = proxy_shards_start(ph);
+	if (ret < 0) {
+		proxy_log(ph, LOG_LEVEL_FATAL,
+			  "Failed to start event loop threads (%d): %s\n",
+			  -ret, strerror(-ret));
+		return ret;
+	}
+
+#endif
 	for (i = 0; i < priv->num_clients; i++) {
 		ret = proxy_conn_start(&priv->clients[i]);
 		if (ret < 0) {
@@ -1067,7 +2103,8 @@ int proxy_start(struct proxy_handle *ph)
 		}
 	}
 
-	for (i = 0; i < priv->num_clients; i++) {
+	/* Clients are authorized by the event loop when it is enabled */
+	for (i = 0; i < priv->num_clients && priv->event.priv == NULL; i++) {
 		ret = worker_start(&priv->client_workers[i].worker);
 		if (ret < 0) {
 			proxy_log(ph, LOG_LEVEL_FATAL,
@@ -1077,9 +2114,7 @@ int proxy_start(struct proxy_handle *ph)
 		}
 	}
 
-	mutex_lock(&priv->usable_clients_mutex);
-	priv->usable_clients = priv->num_clients;
-	mutex_unlock(&priv->usable_clients_mutex);
+	atomic_store_u32(&priv->usable_clients, priv->num_clients);
 
 	proxy_update_registration(ph);
 	ret = registration_service_start(&priv->reg_service, &ph->conf);
@@ -1090,10 +2125,13 @@ int proxy_start(struct proxy_handle *ph)
 		goto proxy_start_exit;
 	}
 
+	/* Everything needed to serve clients has been allocated by now */
+	alloc_guard_arm();
+
 	return 0;
 
 proxy_start_exit:
-	for (i--; i >= 0; i--)
+	for (i--; i >= 0 && priv->event.priv == NULL; i--)
 		worker_join(&priv->client_workers[i].worker);
 
 	i = priv->num_clients;
@@ -1102,25 +2140,21 @@ proxy_start_exit_early:
 	for (i--; i >= 0; i--)
 		proxy_conn_stop(&priv->clients[i]);
 
+#ifdef HAVE_EPOLL
+	proxy_shards_stop(ph);
+
+#endif
 	return ret;
 }
 
 void proxy_update_registration(struct proxy_handle *ph)
 {
 	struct proxy_priv *priv = ph->priv;
-	struct proxy_worker *pw;
 	int slots_used;
 	int slots_total;
 
-	mutex_lock_shared(&priv->usable_clients_mutex);
-	slots_total = priv->usable_clients;
-	slots_used = priv->num_clients;
-	mutex_unlock_shared(&priv->usable_clients_mutex);
-
-	mutex_lock_shared(&priv->idle_workers_mutex);
-	for (pw = priv->idle_workers_head; pw != NULL; pw = pw->next)
-		slots_used--;
-	mutex_unlock_shared(&priv->idle_workers_mutex);
+	slots_total = (int)atomic_load_u32(&priv->usable_clients);
+	slots_used = (int)atomic_load_u32(&priv->busy_workers);
 
 	proxy_log(ph, LOG_LEVEL_DEBUG,
 		  "Sending update to registrar (%d/%d)\n",
@@ -196,3 +196,10 @@ int proxy_client_send(struct proxy_client_handle *ch,
 
 	return ret;
 }
+
+int proxy_client_set_timeout(struct proxy_client_handle *ch, uint32_t msec)
+{
+	struct proxy_client_priv *priv = ch->priv;
+
+	return conn_set_timeout(&priv->conn, msec);
+}
@@ -50,8 +50,12 @@
 #include <string.h>
 
 #include "openelp/openelp.h"
+#include "alloc_guard.h"
+#include "atomic.h"
+#include "buff_pool.h"
 #include "conn.h"
 #include "digest.h"
+#include "msg_queue.h"
 #include "mutex.h"
 #include "proxy_conn.h"
 #include "proxy_msg.h"
@@ -65,11 +69,93 @@
  * @note It seems that the official client can't handle messages from proxies which
  * are larger than 4096 or so
  */
-#define CONN_BUFF_LEN 4096
+#define CONN_BUFF_LEN PROXY_CONN_BUFF_LEN
 
 /*! Maximum amount of data to process not including the message header */
 #define CONN_BUFF_LEN_HEADERLESS (CONN_BUFF_LEN - sizeof(struct proxy_msg))
 
+/*! Maximum number of messages waiting to be sent to the client */
+#define CONN_QUEUE_LEN 64
+
+/*! Maximum number of queued messages to send to the client at once */
+#define CONN_QUEUE_SEND_MAX 16
+
+/*! Maximum number of UDP datagrams to receive and forward at once */
+#define CONN_RECV_BATCH 8
+
+/*! Size of the buffer for data received from the client */
+#define CONN_RX_LEN (4 * CONN_BUFF_LEN)
+
+/*! Maximum number of UDP datagrams from the client to send at once */
+#define CONN_SEND_BATCH 16
+
+/*! Milliseconds to wait at once for the kernel to finish with messages which
+ *  were sent to the client without copying them */
+#define CONN_ZEROCOPY_WAIT 100
+
+#ifdef HAVE_EPOLL
+/*! Size of the queue for data waiting to be sent to the client */
+#define EVENT_FIFO_CLIENT_LEN 32768
+
+/*! Size of the queue for data waiting to be sent to the remote TCP host */
+#define EVENT_FIFO_TCP_LEN 8192
+
+/*!
+ * @brief Space in the client queue which cannot be used by forwarded data
+ *
+ * This ensures that ::PROXY_MSG_TYPE_TCP_STATUS and
+ * ::PROXY_MSG_TYPE_TCP_CLOSE messages can always be queued.
+ */
+#define EVENT_FIFO_RESERVE 64
+
+/*! Maximum number of receive operations to perform for a single event */
+#define EVENT_RECV_MAX 16
+#endif
+
+/*!
+ * @brief Datagrams from the client waiting to be sent on a UDP connection
+ */
+struct proxy_conn_batch {
+	/*! UDP connection to send the datagrams on */
+	struct conn_handle *conn;
+
+	/*! Remote port to send the datagrams to */
+	uint16_t port;
+
+	/*! Descriptors of the datagrams in proxy_conn_batch::buff */
+	struct conn_datagram dgrams[CONN_SEND_BATCH];
+
+	/*! Number of datagrams in proxy_conn_batch::dgrams */
+	unsigned int count;
+
+	/*! Buffer from proxy_conn_handle::pool holding the datagrams, or NULL
+	 *  while the batch is empty */
+	uint8_t *buff;
+
+	/*! Number of bytes of proxy_conn_batch::buff in use */
+	size_t len;
+};
+
+/*!
+ * @brief Queue of data waiting to be sent on a non-blocking connection
+ */
+struct proxy_conn_fifo {
+	/*! Storage for the queued data */
+	uint8_t *buff;
+
+	/*! Size of proxy_conn_fifo::buff in bytes */
+	size_t size;
+
+	/*! Offset of the first queued byte in proxy_conn_fifo::buff */
+	size_t head;
+
+	/*! Number of bytes currently queued */
+	size_t len;
+
+	/*! Highest value of proxy_conn_fifo::len since the last reset */
+	size_t len_max;
+};
+
 /*!
  * @brief Private data for an instance of a proxy client connection
  */
@@ -89,8 +175,44 @@ struct proxy_conn_priv {
 	/*! Mutex for protecting the proxy_conn_priv::sentinel */
 	struct mutex_handle mutex_client;
 
-	/*! Mutex for protecting transmissions on proxy_conn_priv::conn_client */
-	struct mutex_handle mutex_client_send;
+	/*! Mutex for waiting on space in proxy_conn_priv::queue_client */
+	struct mutex_handle mutex_client_space;
+
+	/*! Signaled when messages are removed from proxy_conn_priv::queue_client */
+	struct condvar_handle condvar_client_space;
+
+	/*! Messages other than UDP data waiting to be sent to the client */
+	struct msg_queue_handle queue_client;
+
+	/*! Number of threads waiting for space in proxy_conn_priv::queue_client */
+	uint32_t client_space_waiters;
+
+	/*! Non-zero once proxy_conn_priv::worker_client has been signaled */
+	uint32_t client_signaled;
+
+	/*! Non-zero once sending to the client has failed */
+	uint32_t client_failed;
+
+	/*! Number of bytes of messages in proxy_conn_priv::queue_client and
+	 *  proxy_conn_priv::queue_data which have been sent, but are held until
+	 *  the kernel is done with them */
+	uint32_t client_held_bytes;
+
+	/*! Number of UDP messages discarded during this session */
+	uint32_t data_dropped;
+
+	/*! Mutex for keeping the messages in proxy_conn_priv::queue_data in place
+	 *  while proxy_conn_priv::worker_client takes them */
+	struct mutex_handle mutex_data;
+
+	/*! Number of the oldest messages in proxy_conn_priv::queue_data which
+	 *  proxy_conn_priv::worker_client has taken, and which must therefore not
+	 *  be discarded by another thread */
+	uint32_t data_taken;
+
+	/*! Worker for sending the messages in proxy_conn_priv::queue_client and
+	 *  proxy_conn_priv::queue_data */
+	struct worker_handle worker_client;
 
 	/*! Worker for handling data sent to proxy_conn_priv::conn_control */
 	struct worker_handle worker_control;
@@ -101,13 +223,211 @@ struct proxy_conn_priv {
 	/*! Worker for handling data sent to proxy_conn_priv::conn_tcp */
 	struct worker_handle worker_tcp;
 
-	/*! The buffer for receiving data from the client */
-	uint8_t buff[CONN_BUFF_LEN];
+	/*! Data from proxy_conn_priv::conn_tcp waiting to be sent to the client
+	 *  after its header in proxy_conn_priv::queue_client */
+	struct conn_pipe pipe_tcp;
+
+	/*! Data received from the client which has not been processed yet */
+	uint8_t *rx_buff;
+
+	/*! Offset of the first unprocessed byte in proxy_conn_priv::rx_buff */
+	size_t rx_head;
+
+	/*! Number of unprocessed bytes in proxy_conn_priv::rx_buff */
+	size_t rx_len;
+
+	/*! Datagrams from the client waiting to be sent on
+	 *  proxy_conn_priv::conn_control */
+	struct proxy_conn_batch batch_control;
+
+	/*! Datagrams from the client waiting to be sent on
+	 *  proxy_conn_priv::conn_data */
+	struct proxy_conn_batch batch_data;
 
 	/*! Callsign of the currently connected client */
 	char callsign[12];
+
+	/*! Event source for proxy_conn_priv::conn_client */
+	struct event_source source_client;
+
+	/*! Event source for proxy_conn_priv::conn_control */
+	struct event_source source_control;
+
+	/*! Event source for proxy_conn_priv::conn_data */
+	struct event_source source_data;
+
+	/*! Event source for proxy_conn_priv::conn_tcp */
+	struct event_source source_tcp;
+
+	/*! Data waiting to be sent to the client */
+	struct proxy_conn_fifo fifo_client;
+
+	/*! UDP data messages waiting to be sent to the client after all other
+	 *  messages */
+	struct msg_queue_handle queue_data;
+
+	/*! Data waiting to be sent to the remote TCP host */
+	struct proxy_conn_fifo fifo_tcp;
+
+	/*! Header of the message currently being received from the client */
+	struct proxy_msg msg;
+
+	/*! Number of bytes of proxy_conn_priv::msg received so far */
+	size_t msg_len;
+
+	/*! Number of bytes of the current message's data not yet received */
+	size_t msg_remaining;
+
+	/*! Non-zero while the remote TCP connection is being established */
+	uint8_t tcp_connecting;
+
+	/*! Non-zero if the current message's data could not be sent to the remote
+	 *  TCP host */
+	uint8_t tcp_failed;
 };
 
+/*!
+ * @brief Holds a datagram from the client to be sent with others
+ *
+ * @param[in,out] pc Target proxy client connection instance
+ * @param[in,out] batch Batch of datagrams to add the datagram to
+ * @param[in] buff Buffer containing the datagram
+ * @param[in] len Number of bytes in buff
+ * @param[in] addr Remote address to send the datagram to
+ *
+ * The batch is sent first if the datagram would not fit in it.
+ */
+static void batch_datagram(struct proxy_conn_handle *pc,
+			   struct proxy_conn_batch *batch,
+			   const uint8_t *buff, size_t len, uint32_t addr);
+
+/*!
+ * @brief Borrows a buffer from proxy_conn_handle::pool for each datagram
+ *        descriptor which lacks one
+ *
+ * @param[in] pc Target proxy client connection instance
+ * @param[in,out] dgrams Array of CONN_RECV_BATCH datagram descriptors
+ *
+ * @returns Number of descriptors at the start of dgrams which have a buffer
+ *
+ * Each datagram is received after space for its message header, so that it
+ * can be framed and queued without copying it. If the pool is exhausted, the
+ * descriptors which do have a buffer are moved to the start of dgrams.
+ */
+static int borrow_datagrams(struct proxy_conn_handle *pc,
+			    struct conn_datagram *dgrams);
+
+/*!
+ * @brief Gets the number of bytes of messages waiting to be sent to the client
+ *
+ * @param[in] pc Target proxy client connection instance
+ *
+ * @returns Number of bytes held by the proxy for the client
+ *
+ * Messages which have been sent without copying them are not included, even
+ * though they are still in the queues.
+ */
+static size_t client_queued_bytes(struct proxy_conn_handle *pc);
+
+/*!
+ * @brief Discards the datagrams in a batch and returns its buffer to the pool
+ *
+ * @param[in] pc Target proxy client connection instance
+ * @param[in,out] batch Batch of datagrams to empty
+ */
+static void clear_batch(struct proxy_conn_handle *pc,
+			struct proxy_conn_batch *batch);
+
+/*!
+ * @brief Closes a UDP port at the end of a client session, unless it stays
+ *        bound for the next client
+ *
+ * @param[in] pc Target proxy client connection instance
+ * @param[in,out] conn UDP Control or UDP Data connection of the client
+ */
+static void close_udp(struct proxy_conn_handle *pc, struct conn_handle *conn);
+
+/*!
+ * @brief Gets the number of bytes which may be queued ahead of UDP data
+ *
+ * @param[in] pc Target proxy client connection instance
+ *
+ * @returns The configured budget, at least CONN_BUFF_LEN, or 0 for no limit
+ */
+static size_t data_budget(struct proxy_conn_handle *pc);
+
+/*!
+ * @brief Receives and discards a single datagram
+ *
+ * @param[in,out] pc Target proxy client connection instance
+ * @param[in,out] conn UDP connection to receive the datagram from
+ *
+ * @returns 0 on success, negative ERRNO value on failure
+ *
+ * This keeps a connection moving when proxy_conn_handle::pool has no buffer to
+ * receive into. The datagram is counted in proxy_conn_priv::data_dropped.
+ */
+static int discard_datagram(struct proxy_conn_handle *pc,
+			    struct conn_handle *conn);
+
+/*!
+ * @brief Determines how many stale UDP data messages should be discarded
+ *
+ * @param[in,out] pc Target proxy client connection instance
+ * @param[in] iov Oldest messages in proxy_conn_priv::queue_data
+ * @param[in] count Number of entries in iov
+ *
+ * @returns Number of messages at the start of iov to discard
+ *
+ * Messages are discarded, oldest first, until the messages waiting to be sent
+ * to the client fit within the budget given by ::data_budget.
+ */
+static unsigned int discard_stale_data(struct proxy_conn_handle *pc,
+				       const struct conn_iovec *iov,
+				       unsigned int count);
+
+/*!
+ * @brief Sends all datagrams held in a batch
+ *
+ * @param[in,out] pc Target proxy client connection instance
+ * @param[in,out] batch Batch of datagrams to send
+ *
+ * Datagrams which cannot be sent are discarded.
+ */
+static void flush_datagrams(struct proxy_conn_handle *pc,
+			    struct proxy_conn_batch *batch);
+
+/*!
+ * @brief Receives as much data from the client as is available
+ *
+ * @param[in,out] pc Target proxy client connection instance
+ *
+ * @returns Number of bytes received on success, negative ERRNO value on
+ *          failure
+ *
+ * Blocks until some data is available, unless the client connection is
+ * non-blocking. Unprocessed data is first moved to the start of the buffer.
+ */
+static int fill_client_buff(struct proxy_conn_handle *pc);
+
+/*!
+ * @brief Worker thread for sending queued messages to the client
+ *
+ * @param[in,out] wh Worker thread context
+ *
+ * Messages in proxy_conn_priv::queue_client are always sent ahead of those in
+ * proxy_conn_priv::queue_data, so a backlog of UDP data only delays other
+ * messages by a single write. Messages are discarded rather than sent once
+ * sending to the client has failed, so that threads waiting for space in the
+ * queues can proceed.
+ *
+ * TCP data held in proxy_conn_priv::pipe_tcp is sent directly after its header,
+ * so it never needs to be copied through this process. Messages which were sent
+ * without copying them are held in the queues until the kernel has finished
+ * with them.
+ */
+static void forwarder_client(struct worker_handle *wh);
+
 /*!
  * @brief Worker thread for forwarding control information
  *
@@ -129,6 +449,28 @@ static void forwarder_data(struct worker_handle *wh);
  */
 static void forwarder_tcp(struct worker_handle *wh);
 
+/*!
+ * @brief Adds a message to a queue to the client without blocking
+ *
+ * @param[in,out] pc Target proxy client connection instance
+ * @param[in] iov Array of buffers containing the message, in order
+ * @param[in] count Number of entries in iov
+ * @param[in,out] buff Buffer from proxy_conn_handle::pool which holds the
+ *                     message described by iov, so that it can be queued
+ *                     without copying it, or NULL
+ * @param[in] limit Maximum number of bytes which may be queued including the
+ *                  message, or 0 for no limit
+ *
+ * @returns 0 on success, -ENOSPC if the message does not fit, other negative
+ *          ERRNO value on failure
+ *
+ * UDP data messages are added to proxy_conn_priv::queue_data, and all others
+ * to proxy_conn_priv::queue_client.
+ */
+static int offer_client_msg(struct proxy_conn_handle *pc,
+			    const struct conn_iovec *iov, unsigned int count,
+			    uint8_t *buff, size_t limit);
+
 /*!
  * @brief Process an incoming ::PROXY_MSG_TYPE_UDP_CONTROL message from the
  *        client
@@ -196,6 +538,71 @@ static int process_tcp_data_message(struct proxy_conn_handle *pc,
 static int process_tcp_open_message(struct proxy_conn_handle *pc,
 				    const struct proxy_msg *msg);
 
+/*!
+ * @brief Adds a message to a queue of messages to be sent to the client
+ *
+ * @param[in,out] pc Target proxy client connection instance
+ * @param[in] iov Array of buffers containing the message, in order
+ * @param[in] count Number of entries in iov
+ * @param[in,out] buff Buffer from proxy_conn_handle::pool which holds the
+ *                     message described by iov, so that it can be queued
+ *                     without copying it, or NULL
+ * @param[in] limit Maximum number of bytes which may be queued including the
+ *                  message, or 0 for no limit
+ *
+ * @returns 0 on success, negative ERRNO value on failure
+ *
+ * Blocks while the message does not fit. The writer is only signaled when this
+ * happens, so ::signal_client_writer must be called once the caller is done
+ * queueing messages.
+ */
+static int push_client_msg(struct proxy_conn_handle *pc,
+			   const struct conn_iovec *iov, unsigned int count,
+			   uint8_t *buff, size_t limit);
+
+/*!
+ * @brief Takes a contiguous block of data received from the client
+ *
+ * @param[in,out] pc Target proxy client connection instance
+ * @param[out] data Set to the start of the block in the receive buffer
+ * @param[in] len Number of bytes to take, at most CONN_BUFF_LEN
+ *
+ * @returns 0 on success, negative ERRNO value on failure
+ *
+ * Blocks until enough data has been received. Any batched datagrams are sent
+ * before blocking.
+ */
+static int read_client_buff(struct proxy_conn_handle *pc, const uint8_t **data,
+			    size_t len);
+
+/*!
+ * @brief Returns the buffers held by datagram descriptors to
+ *        proxy_conn_handle::pool
+ *
+ * @param[in] pc Target proxy client connection instance
+ * @param[in,out] dgrams Array of CONN_RECV_BATCH datagram descriptors
+ */
+static void release_datagrams(struct proxy_conn_handle *pc,
+			      struct conn_datagram *dgrams);
+
+/*!
+ * @brief Sends received datagrams as consecutive messages to the client
+ *
+ * @param[in] pc Target proxy client connection instance
+ * @param[in] type Type of message to frame the datagrams as
+ * @param[in,out] dgrams Datagrams received by ::conn_recv_many into buffers
+ *                       from ::borrow_datagrams
+ * @param[in] count Number of entries in dgrams to send
+ *
+ * @returns 0 on success, negative ERRNO value on failure
+ *
+ * Each message header is written in front of its datagram and the buffer is
+ * queued by reference. The buffers are then released and their descriptors
+ * cleared, so they must be borrowed again before the next receive.
+ */
+static int send_datagrams(struct proxy_conn_handle *pc, uint8_t type,
+			  struct conn_datagram *dgrams, int count);
+
 /*!
  * @brief Send a ::PROXY_MSG_TYPE_TCP_CLOSE message to the client
  *
@@ -205,70 +612,633 @@ static int process_tcp_open_message(struct proxy_conn_handle *pc,
  */
 static int send_tcp_close(struct proxy_conn_handle *pc);
 
-static void forwarder_control(struct worker_handle *wh)
-{
-	struct proxy_conn_handle *pc = wh->func_ctx;
-	struct proxy_conn_priv *priv = pc->priv;
+/*!
+ * @brief Gets the number of bytes of TCP data held in proxy_conn_priv::pipe_tcp
+ *        for a queued message
+ *
+ * @param[in] iov Queued message
+ *
+ * @returns Number of bytes of data which follow the message, or 0 if the
+ *          message is complete
+ *
+ * A ::PROXY_MSG_TYPE_TCP_DATA message is queued as just its header when its
+ * data was received into proxy_conn_priv::pipe_tcp.
+ */
+static size_t spliced_tcp_len(const struct conn_iovec *iov);
 
-	uint32_t addr;
-	uint8_t buf[CONN_BUFF_LEN] = { 0 };
-	struct proxy_msg *msg = (struct proxy_msg *)buf;
-	int ret;
+/*!
+ * @brief Signals the worker which sends queued messages to the client
+ *
+ * @param[in,out] pc Target proxy client connection instance
+ *
+ * @returns 0 on success, negative ERRNO value on failure
+ */
+static int signal_client_writer(struct proxy_conn_handle *pc);
 
-	msg->type = PROXY_MSG_TYPE_UDP_CONTROL;
+#ifdef HAVE_EPOLL
+/*!
+ * @brief Gets the number of bytes of messages which may be queued to the client
+ *
+ * @param[in] pc Target proxy client connection instance
+ *
+ * @returns Number of bytes which may be added to proxy_conn_priv::fifo_client
+ */
+static size_t client_space(struct proxy_conn_handle *pc);
 
-	proxy_log(pc->ph, LOG_LEVEL_DEBUG,
-		  "UDP Control forwarding thread is starting for client '%s'\n",
-		  priv->callsign);
+/*!
+ * @brief Determines whether processing of data from the client is paused
+ *
+ * @param[in] pc Target proxy client connection instance
+ *
+ * @returns Non-zero if the current message's data is waiting for space in
+ *          the queue to the remote TCP host, zero otherwise
+ */
+static int client_stream_paused(struct proxy_conn_handle *pc);
 
-	do {
-		ret = conn_recv_any(&priv->conn_control, buf + sizeof(*msg),
-				    CONN_BUFF_LEN_HEADERLESS, &addr, NULL);
-		if (ret > 0) {
-			msg->address = addr;
-			msg->size = ret;
+/*!
+ * @brief Gets the number of UDP data messages which may be queued to the client
+ *
+ * @param[in] pc Target proxy client connection instance
+ *
+ * @returns Number of messages of any size which can be added to
+ *          proxy_conn_priv::queue_data without discarding any
+ */
+static unsigned int data_room(struct proxy_conn_handle *pc);
 
-			proxy_log(pc->ph, LOG_LEVEL_DEBUG,
-				  "Sending UDP_DATA message to client '%s' (%d bytes)\n",
-				  priv->callsign, msg->size);
+/*!
+ * @brief Sends as much queued data as possible without blocking
+ *
+ * @param[in,out] fifo Queue of data waiting to be sent
+ * @param[in,out] conn Connection to send the data on
+ *
+ * @returns 0 on success, negative ERRNO value on failure
+ */
+static int fifo_flush(struct proxy_conn_fifo *fifo, struct conn_handle *conn);
 
-			mutex_lock(&priv->mutex_client_send);
+/*!
+ * @brief Sends data without blocking, queueing any which cannot be sent
+ *
+ * @param[in,out] fifo Queue of data waiting to be sent on conn
+ * @param[in,out] conn Connection to send the data on, or NULL to only queue it
+ * @param[in] buff Buffer containing data to be sent
+ * @param[in] buff_len Number of bytes in buff to send
+ * @param[in] reserve Number of bytes which must remain free in the queue
+ *
+ * @returns 0 on success, -ENOSPC if the data would not fit in the queue, other
+ *          negative ERRNO value on failure
+ *
+ * Either all of the data is sent or queued, or none of it is.
+ */
+static int fifo_send(struct proxy_conn_fifo *fifo, struct conn_handle *conn,
+		     const uint8_t *buff, size_t buff_len, size_t reserve);
 
-			ret = conn_send(priv->conn_client, (uint8_t *)msg,
-					sizeof(*msg) + msg->size);
+/*!
+ * @brief Moves queued UDP data messages to the client
+ *
+ * @param[in,out] pc Target proxy client connection instance
+ *
+ * @returns 0 on success, negative ERRNO value on failure
+ *
+ * Messages are only moved into proxy_conn_priv::fifo_client once it has
+ * nearly drained, so other messages never wait behind much UDP data.
+ */
+static int flush_data_queue(struct proxy_conn_handle *pc);
 
-			mutex_unlock(&priv->mutex_client_send);
+/*!
+ * @brief Event loop callback for the client connection
+ *
+ * @param[in,out] es Event source for the client connection
+ * @param[in] flags Bitwise combination of ready ::EVENT_FLAG values
+ */
+static void process_client_event(struct event_source *es, uint32_t flags);
 
-			/* This is an error with the client connection */
-			if (ret < 0) {
-				conn_close(&priv->conn_control);
+/*!
+ * @brief Processes as many buffered messages from the client as possible
+ *
+ * @param[in,out] pc Target proxy client connection instance
+ *
+ * @returns 0 on success, negative ERRNO value on client connection failure
+ */
+static int process_client_buff(struct proxy_conn_handle *pc);
 
-				proxy_log(pc->ph, LOG_LEVEL_DEBUG,
-					  "Client '%s' UDP Control thread is returning due to a client connection error (%d): %s\n",
-					  priv->callsign, -ret, strerror(-ret));
+/*!
+ * @brief Handles the buffered data for the current client message
+ *
+ * @param[in,out] pc Target proxy client connection instance
+ *
+ * @returns 0 on success, negative ERRNO value on failure
+ *
+ * Datagrams are only handled once a complete segment has been buffered, so
+ * that they can be sent directly from the receive buffer.
+ */
+static int process_client_payload(struct proxy_conn_handle *pc);
 
-				switch (ret) {
-				case -ECONNRESET:
-				case -EINTR:
-				case -ENOTCONN:
-				case -EPIPE:
-					break;
-				default:
-					proxy_conn_drop(pc);
-					break;
-				}
+/*!
+ * @brief Receives and processes messages from the client without blocking
+ *
+ * @param[in,out] pc Target proxy client connection instance
+ *
+ * @returns 0 on success, negative ERRNO value on client connection failure
+ */
+static int process_client_stream(struct proxy_conn_handle *pc);
 
-				return;
-			}
-		} else if (ret == 0) {
-			ret = -EPIPE;
-		}
-	} while (ret >= 0);
+/*!
+ * @brief Event loop callback for the remote TCP connection
+ *
+ * @param[in,out] es Event source for the remote TCP connection
+ * @param[in] flags Bitwise combination of ready ::EVENT_FLAG values
+ */
+static void process_tcp_event(struct event_source *es, uint32_t flags);
 
-	switch (ret) {
-	case -ECONNRESET:
-	case -EINTR:
-	case -ENOTCONN:
+/*!
+ * @brief Event loop callback for the UDP control and data connections
+ *
+ * @param[in,out] es Event source for the UDP connection
+ * @param[in] flags Bitwise combination of ready ::EVENT_FLAG values
+ */
+static void process_udp_event(struct event_source *es, uint32_t flags);
+
+/*!
+ * @brief Queues a UDP data message to the client
+ *
+ * @param[in,out] pc Target proxy client connection instance
+ * @param[in] dgram Datagram received on the UDP data connection into a buffer
+ *                  from ::borrow_datagrams
+ *
+ * @returns Number of messages which were discarded
+ *
+ * The message header is written in front of the datagram and the buffer is
+ * queued by reference, so the caller must still release its reference.
+ *
+ * If the message does not fit in proxy_conn_priv::queue_data or within the
+ * budget given by ::data_budget, either the oldest queued messages or the new
+ * message are discarded according to the ::PROXY_DATA_OVERFLOW policy.
+ */
+static int queue_datagram(struct proxy_conn_handle *pc,
+			  const struct conn_datagram *dgram);
+
+/*!
+ * @brief Queues a ::PROXY_MSG_TYPE_TCP_CLOSE message to the client
+ *
+ * @param[in,out] pc Target proxy client connection instance
+ *
+ * @returns 0 on success, negative ERRNO value on failure
+ */
+static int queue_tcp_close(struct proxy_conn_handle *pc);
+
+/*!
+ * @brief Queues a ::PROXY_MSG_TYPE_TCP_STATUS message to the client
+ *
+ * @param[in,out] pc Target proxy client connection instance
+ * @param[in] status Result of the connection attempt
+ *
+ * @returns 0 on success, negative ERRNO value on failure
+ */
+static int queue_tcp_status(struct proxy_conn_handle *pc, int status);
+
+/*!
+ * @brief Begins processing a message after its header has been received
+ *
+ * @param[in,out] pc Target proxy client connection instance
+ *
+ * @returns 0 on success, negative ERRNO value on client connection failure
+ */
+static int start_client_message(struct proxy_conn_handle *pc);
+
+/*!
+ * @brief Begins establishing the remote TCP connection without blocking
+ *
+ * @param[in,out] pc Target proxy client connection instance
+ *
+ * @returns 0 on success, negative ERRNO value on client connection failure
+ */
+static int start_tcp_connection(struct proxy_conn_handle *pc);
+
+/*!
+ * @brief Closes the remote TCP connection and discards any queued data
+ *
+ * @param[in,out] pc Target proxy client connection instance
+ */
+static void stop_tcp_connection(struct proxy_conn_handle *pc);
+
+/*!
+ * @brief Updates the conditions monitored by the event loop
+ *
+ * @param[in,out] pc Target proxy client connection instance
+ *
+ * Reading from either TCP connection is paused while the queue for the
+ * opposite connection is full.
+ */
+static void update_events(struct proxy_conn_handle *pc);
+#endif
+
+static void batch_datagram(struct proxy_conn_handle *pc,
+			   struct proxy_conn_batch *batch,
+			   const uint8_t *buff, size_t len, uint32_t addr)
+{
+	struct proxy_conn_priv *priv = pc->priv;
+	struct conn_datagram *dgram;
+	int ret;
+
+	if (batch->count >= CONN_SEND_BATCH ||
+	    batch->len + len > CONN_BUFF_LEN)
+		flush_datagrams(pc, batch);
+
+	if (batch->buff == NULL) {
+		batch->buff = buff_pool_borrow(pc->pool);
+
+		/* Without a buffer, the datagram is sent on its own */
+		if (batch->buff == NULL) {
+			ret = conn_send_to(batch->conn, buff, len, addr,
+					   batch->port);
+			if (ret < 0)
+				proxy_log(pc->ph, LOG_LEVEL_WARN,
+					  "Failed to send %s packet of size %zu to client '%s': %d (%s)\n",
+					  batch->port == 5199 ? "UDP_CONTROL" : "UDP_DATA",
+					  len, priv->callsign, -ret, strerror(-ret));
+
+			return;
+		}
+	}
+
+	dgram = &batch->dgrams[batch->count];
+	dgram->buff = &batch->buff[batch->len];
+	dgram->len = len;
+	dgram->addr = addr;
+	dgram->port = batch->port;
+
+	memcpy(dgram->buff, buff, len);
+
+	batch->len += len;
+	batch->count++;
+}
+
+static int borrow_datagrams(struct proxy_conn_handle *pc,
+			    struct conn_datagram *dgrams)
+{
+	uint8_t *buff;
+	int count = 0;
+	int i;
+
+	for (i = 0; i < CONN_RECV_BATCH; i++) {
+		if (dgrams[i].buff == NULL) {
+			buff = buff_pool_borrow(pc->pool);
+			if (buff == NULL)
+				continue;
+
+			dgrams[i].buff = buff + sizeof(struct proxy_msg);
+			dgrams[i].buff_len = CONN_BUFF_LEN_HEADERLESS;
+		}
+
+		if (i != count) {
+			dgrams[count] = dgrams[i];
+			dgrams[i].buff = NULL;
+		}
+
+		count++;
+	}
+
+	return count;
+}
+
+static size_t client_queued_bytes(struct proxy_conn_handle *pc)
+{
+	struct proxy_conn_priv *priv = pc->priv;
+	struct msg_queue_stats stats;
+	size_t bytes;
+
+	msg_queue_get_stats(&priv->queue_data, &stats);
+	bytes = stats.bytes;
+
+	if (priv->queue_client.priv == NULL)
+		return bytes + priv->fifo_client.len;
+
+	msg_queue_get_stats(&priv->queue_client, &stats);
+
+	return bytes + stats.bytes - atomic_load_u32(&priv->client_held_bytes);
+}
+
+static void clear_batch(struct proxy_conn_handle *pc,
+			struct proxy_conn_batch *batch)
+{
+	if (batch->buff != NULL) {
+		buff_pool_release(pc->pool, batch->buff);
+		batch->buff = NULL;
+	}
+
+	batch->count = 0;
+	batch->len = 0;
+}
+
+static void close_udp(struct proxy_conn_handle *pc, struct conn_handle *conn)
+{
+	if (!pc->ph->conf.persistent_udp)
+		conn_close(conn);
+}
+
+static size_t data_budget(struct proxy_conn_handle *pc)
+{
+	size_t budget = pc->ph->conf.data_queue_budget;
+
+	/* There must always be room for at least one message */
+	if (budget != 0 && budget < CONN_BUFF_LEN)
+		budget = CONN_BUFF_LEN;
+
+	return budget;
+}
+
+static int discard_datagram(struct proxy_conn_handle *pc,
+			    struct conn_handle *conn)
+{
+	struct proxy_conn_priv *priv = pc->priv;
+	struct conn_datagram dgram;
+	uint8_t buff[sizeof(struct proxy_msg)];
+	int ret;
+
+	dgram.buff = buff;
+	dgram.buff_len = sizeof(buff);
+
+	ret = conn_recv_many(conn, &dgram, 1);
+	if (ret < 0)
+		return ret;
+	else if (ret == 0)
+		return -EPIPE;
+
+	atomic_add_u32(&priv->data_dropped, 1);
+
+	proxy_log(pc->ph, LOG_LEVEL_WARN,
+		  "Discarding UDP %s message for client '%s' because no buffer is available\n",
+		  conn == &priv->conn_control ? "Control" : "Data",
+		  priv->callsign);
+
+	return 0;
+}
+
+static unsigned int discard_stale_data(struct proxy_conn_handle *pc,
+				       const struct conn_iovec *iov,
+				       unsigned int count)
+{
+	struct proxy_conn_priv *priv = pc->priv;
+	size_t budget = data_budget(pc);
+	size_t queued;
+	size_t excess;
+	unsigned int dropped;
+
+	if (budget == 0)
+		return 0;
+
+	queued = client_queued_bytes(pc);
+	if (queued <= budget)
+		return 0;
+
+	excess = queued - budget;
+
+	for (dropped = 0; dropped < count && excess > 0; dropped++)
+		excess = excess > iov[dropped].len ?
+			 excess - iov[dropped].len : 0;
+
+	if (dropped > 0) {
+		atomic_add_u32(&priv->data_dropped, dropped);
+
+		proxy_log(pc->ph, LOG_LEVEL_DEBUG,
+			  "Discarding %u stale UDP Data messages for client '%s' which is not keeping up\n",
+			  dropped, priv->callsign);
+	}
+
+	return dropped;
+}
+
+static void flush_datagrams(struct proxy_conn_handle *pc,
+			    struct proxy_conn_batch *batch)
+{
+	struct proxy_conn_priv *priv = pc->priv;
+	unsigned int sent = 0;
+	int ret;
+
+	while (sent < batch->count) {
+		ret = conn_send_many(batch->conn, &batch->dgrams[sent],
+				     batch->count - sent);
+		if (ret < 0) {
+			proxy_log(pc->ph, LOG_LEVEL_WARN,
+				  "Failed to send %s packet of size %zu to client '%s': %d (%s)\n",
+				  batch->port == 5199 ? "UDP_CONTROL" : "UDP_DATA",
+				  batch->dgrams[sent].len, priv->callsign, -ret,
+				  strerror(-ret));
+			/*! @TODO Drop? */
+			ret = 1;
+		}
+
+		sent += ret;
+	}
+
+	clear_batch(pc, batch);
+}
+
+static int fill_client_buff(struct proxy_conn_handle *pc)
+{
+	struct proxy_conn_priv *priv = pc->priv;
+	int ret;
+
+	if (priv->rx_head > 0) {
+		memmove(priv->rx_buff, &priv->rx_buff[priv->rx_head],
+			priv->rx_len);
+		priv->rx_head = 0;
+	}
+
+	if (priv->rx_len == CONN_RX_LEN)
+		return -ENOBUFS;
+
+	ret = conn_recv_any(priv->conn_client, &priv->rx_buff[priv->rx_len],
+			    CONN_RX_LEN - priv->rx_len, NULL, NULL);
+	if (ret < 0)
+		return ret;
+
+	priv->rx_len += ret;
+
+	return ret;
+}
+
+static void forwarder_client(struct worker_handle *wh)
+{
+	struct proxy_conn_handle *pc = wh->func_ctx;
+	struct proxy_conn_priv *priv = pc->priv;
+
+	struct conn_iovec iov[CONN_QUEUE_SEND_MAX];
+	unsigned int count;
+	unsigned int count_data;
+	unsigned int held = 0;
+	unsigned int held_data = 0;
+	unsigned int stale;
+	unsigned int i;
+	size_t spliced;
+	uint32_t handled;
+	int ret;
+
+	atomic_store_u32(&priv->client_signaled, 0);
+
+	/* Sending to the client must not allocate */
+	alloc_guard_enter();
+
+	for (;;) {
+		count = msg_queue_peek(&priv->queue_client, held, iov,
+				       CONN_QUEUE_SEND_MAX);
+
+		/* Stop after the first message with data in the pipe */
+		spliced = 0;
+		for (i = 0; i < count; i++) {
+			spliced = spliced_tcp_len(&iov[i]);
+			if (spliced > 0) {
+				count = i + 1;
+				break;
+			}
+		}
+
+		count_data = 0;
+		if (spliced == 0) {
+			mutex_lock(&priv->mutex_data);
+			count_data = msg_queue_peek(&priv->queue_data, held_data,
+						    &iov[count],
+						    CONN_QUEUE_SEND_MAX - count);
+			priv->data_taken = held_data + count_data;
+			mutex_unlock(&priv->mutex_data);
+		}
+		if (count + count_data + held + held_data == 0)
+			break;
+
+		for (i = 0, handled = 0; i < count + count_data; i++)
+			handled += (uint32_t)iov[i].len;
+
+		stale = 0;
+		if (pc->ph->conf.data_overflow == PROXY_DATA_OVERFLOW_DROP_OLDEST)
+			stale = discard_stale_data(pc, &iov[count], count_data);
+
+		if (stale > 0)
+			memmove(&iov[count], &iov[count + stale],
+				(count_data - stale) * sizeof(*iov));
+
+		if (count + count_data > stale &&
+		    atomic_load_u32(&priv->client_failed) == 0) {
+			if (spliced > 0)
+				ret = conn_splice_send(priv->conn_client, iov,
+						       count, &priv->pipe_tcp,
+						       spliced);
+			else
+				ret = conn_sendv(priv->conn_client, iov,
+						 count + count_data - stale);
+			if (ret < 0) {
+				atomic_store_u32(&priv->client_failed, 1);
+
+				proxy_log(pc->ph, LOG_LEVEL_DEBUG,
+					  "Discarding messages for client '%s' due to a client connection error (%d): %s\n",
+					  priv->callsign, -ret, strerror(-ret));
+
+				switch (ret) {
+				case -ECONNRESET:
+				case -EINTR:
+				case -ENOTCONN:
+				case -EPIPE:
+					break;
+				default:
+					proxy_conn_drop(pc);
+					break;
+				}
+			}
+		} else if (spliced > 0) {
+			conn_pipe_discard(&priv->pipe_tcp, spliced);
+		}
+
+		held += count;
+		held_data += count_data;
+		atomic_add_u32(&priv->client_held_bytes, handled);
+
+		/* Wait for the kernel only when there is nothing else to send */
+		if (atomic_load_u32(&priv->client_failed) == 0 &&
+		    conn_zerocopy_reap(priv->conn_client,
+				       count + count_data == 0 ?
+				       CONN_ZEROCOPY_WAIT : 0) > 0)
+			continue;
+
+		atomic_store_u32(&priv->client_held_bytes, 0);
+		msg_queue_pop(&priv->queue_client, held);
+		mutex_lock(&priv->mutex_data);
+		msg_queue_pop(&priv->queue_data, held_data);
+		priv->data_taken = 0;
+		mutex_unlock(&priv->mutex_data);
+		held = 0;
+		held_data = 0;
+
+		if (atomic_load_u32(&priv->client_space_waiters) > 0) {
+			mutex_lock(&priv->mutex_client_space);
+			condvar_wake_all(&priv->condvar_client_space);
+			mutex_unlock(&priv->mutex_client_space);
+		}
+	}
+
+	alloc_guard_leave();
+}
+
+static void forwarder_control(struct worker_handle *wh)
+{
+	struct proxy_conn_handle *pc = wh->func_ctx;
+	struct proxy_conn_priv *priv = pc->priv;
+
+	struct conn_datagram dgrams[CONN_RECV_BATCH];
+	int count;
+	int ret;
+
+	memset(dgrams, 0x0, sizeof(dgrams));
+
+	alloc_guard_enter();
+
+	proxy_log(pc->ph, LOG_LEVEL_DEBUG,
+		  "UDP Control forwarding thread is starting for client '%s'\n",
+		  priv->callsign);
+
+	do {
+		count = borrow_datagrams(pc, dgrams);
+		if (count == 0) {
+			ret = discard_datagram(pc, &priv->conn_control);
+			continue;
+		}
+
+		ret = conn_recv_many(&priv->conn_control, dgrams, count);
+		if (ret > 0) {
+			ret = send_datagrams(pc, PROXY_MSG_TYPE_UDP_CONTROL, dgrams,
+					     ret);
+
+			/* This is an error with the client connection */
+			if (ret < 0) {
+				release_datagrams(pc, dgrams);
+				close_udp(pc, &priv->conn_control);
+
+				proxy_log(pc->ph, LOG_LEVEL_DEBUG,
+					  "Client '%s' UDP Control thread is returning due to a client connection error (%d): %s\n",
+					  priv->callsign, -ret, strerror(-ret));
+
+				switch (ret) {
+				case -ECONNRESET:
+				case -EINTR:
+				case -ENOTCONN:
+				case -EPIPE:
+					break;
+				default:
+					proxy_conn_drop(pc);
+					break;
+				}
+
+				alloc_guard_leave();
+
+				return;
+			}
+		} else if (ret == 0) {
+			ret = -EPIPE;
+		}
+	} while (ret >= 0);
+
+	switch (ret) {
+	case -ECONNRESET:
+	case -EINTR:
+	case -ENOTCONN:
 	case -EPIPE:
 		break;
 	default:
@@ -282,7 +1252,10 @@ static void forwarder_control(struct worker_handle *wh)
 		break;
 	}
 
-	conn_close(&priv->conn_control);
+	release_datagrams(pc, dgrams);
+	close_udp(pc, &priv->conn_control);
+
+	alloc_guard_leave();
 
 	proxy_log(pc->ph, LOG_LEVEL_DEBUG,
 		  "Client '%s' UDP Control worker is returning cleanly\n",
@@ -294,38 +1267,34 @@ static void forwarder_data(struct worker_handle *wh)
 	struct proxy_conn_handle *pc = wh->func_ctx;
 	struct proxy_conn_priv *priv = pc->priv;
 
-	uint32_t addr;
-	uint8_t buf[CONN_BUFF_LEN] = { 0 };
-	struct proxy_msg *msg = (struct proxy_msg *)buf;
+	struct conn_datagram dgrams[CONN_RECV_BATCH];
+	int count;
 	int ret;
 
-	msg->type = PROXY_MSG_TYPE_UDP_DATA;
+	memset(dgrams, 0x0, sizeof(dgrams));
+
+	alloc_guard_enter();
 
 	proxy_log(pc->ph, LOG_LEVEL_DEBUG,
 		  "UDP Data forwarding thread is starting for client '%s'\n",
 		  priv->callsign);
 
 	do {
-		ret = conn_recv_any(&priv->conn_data, buf + sizeof(*msg),
-				    CONN_BUFF_LEN_HEADERLESS, &addr, NULL);
-		if (ret > 0) {
-			msg->address = addr;
-			msg->size = ret;
-
-			proxy_log(pc->ph, LOG_LEVEL_DEBUG,
-				  "Sending UDP_DATA message to client '%s' (%d bytes)\n",
-				  priv->callsign, msg->size);
-
-			mutex_lock(&priv->mutex_client_send);
-
-			ret = conn_send(priv->conn_client, (uint8_t *)msg,
-					sizeof(*msg) + msg->size);
+		count = borrow_datagrams(pc, dgrams);
+		if (count == 0) {
+			ret = discard_datagram(pc, &priv->conn_data);
+			continue;
+		}
 
-			mutex_unlock(&priv->mutex_client_send);
+		ret = conn_recv_many(&priv->conn_data, dgrams, count);
+		if (ret > 0) {
+			ret = send_datagrams(pc, PROXY_MSG_TYPE_UDP_DATA, dgrams,
+					     ret);
 
 			/* This is an error with the client connection */
 			if (ret < 0) {
-				conn_close(&priv->conn_data);
+				release_datagrams(pc, dgrams);
+				close_udp(pc, &priv->conn_data);
 
 				proxy_log(pc->ph, LOG_LEVEL_DEBUG,
 					  "Client '%s' UDP Data thread is returning due to a client connection error (%d): %s\n",
@@ -342,6 +1311,8 @@ static void forwarder_data(struct worker_handle *wh)
 					break;
 				}
 
+				alloc_guard_leave();
+
 				return;
 			}
 		} else if (ret == 0) {
@@ -366,7 +1337,10 @@ static void forwarder_data(struct worker_handle *wh)
 		break;
 	}
 
-	conn_close(&priv->conn_data);
+	release_datagrams(pc, dgrams);
+	close_udp(pc, &priv->conn_data);
+
+	alloc_guard_leave();
 
 	proxy_log(pc->ph, LOG_LEVEL_DEBUG,
 		  "Client '%s' UDP Data worker is returning cleanly\n",
@@ -378,32 +1352,67 @@ static void forwarder_tcp(struct worker_handle *wh)
 	struct proxy_conn_handle *pc = wh->func_ctx;
 	struct proxy_conn_priv *priv = pc->priv;
 
-	uint8_t buf[CONN_BUFF_LEN] = { 0 };
-	struct proxy_msg *msg = (struct proxy_msg *)buf;
+	struct proxy_msg msg;
+	const int use_pipe = priv->pipe_tcp.fd_read >= 0;
+	struct conn_iovec iov;
+	uint8_t *buff = NULL;
 	int ret;
 
-	msg->type = PROXY_MSG_TYPE_TCP_DATA;
+	msg.type = PROXY_MSG_TYPE_TCP_DATA;
+	msg.address = 0;
+
+	alloc_guard_enter();
 
 	proxy_log(pc->ph, LOG_LEVEL_DEBUG,
 		  "TCP forwarding thread is starting for client '%s'\n",
 		  priv->callsign);
 
 	do {
-		ret = conn_recv_any(&priv->conn_tcp, buf + sizeof(*msg),
-				    CONN_BUFF_LEN_HEADERLESS, NULL, NULL);
+		/* The data stays in the kernel when it can be spliced */
+		if (use_pipe) {
+			ret = conn_splice_recv(&priv->conn_tcp, &priv->pipe_tcp,
+					       CONN_BUFF_LEN_HEADERLESS);
+		} else {
+			if (buff == NULL) {
+				buff = buff_pool_borrow(pc->pool);
+				if (buff == NULL) {
+					ret = -ENOMEM;
+					break;
+				}
+			}
+
+			ret = conn_recv_any(&priv->conn_tcp, buff + sizeof(msg),
+					    CONN_BUFF_LEN_HEADERLESS, NULL,
+					    NULL);
+		}
 		if (ret > 0) {
-			msg->size = ret;
+			msg.size = ret;
 
 			proxy_log(pc->ph, LOG_LEVEL_DEBUG,
 				  "Sending TCP_DATA message to client '%s' (%d bytes)\n",
-				  priv->callsign, msg->size);
+				  priv->callsign, msg.size);
+
+			if (use_pipe) {
+				iov.buff = (const uint8_t *)&msg;
+				iov.len = sizeof(msg);
+
+				ret = push_client_msg(pc, &iov, 1, NULL, 0);
+				if (ret < 0)
+					conn_pipe_discard(&priv->pipe_tcp,
+							  msg.size);
+			} else {
+				memcpy(buff, &msg, sizeof(msg));
+				iov.buff = buff;
+				iov.len = sizeof(msg) + msg.size;
 
-			mutex_lock(&priv->mutex_client_send);
+				ret = push_client_msg(pc, &iov, 1, buff, 0);
 
-			ret = conn_send(priv->conn_client, (uint8_t *)msg,
-					sizeof(*msg) + msg->size);
+				buff_pool_release(pc->pool, buff);
+				buff = NULL;
+			}
 
-			mutex_unlock(&priv->mutex_client_send);
+			if (ret == 0)
+				ret = signal_client_writer(pc);
 
 			/* This is an error with the client connection */
 			if (ret < 0) {
@@ -424,6 +1433,8 @@ static void forwarder_tcp(struct worker_handle *wh)
 					break;
 				}
 
+				alloc_guard_leave();
+
 				return;
 			}
 		} else if (ret == 0) {
@@ -444,21 +1455,54 @@ static void forwarder_tcp(struct worker_handle *wh)
 		break;
 	}
 
+	if (buff != NULL)
+		buff_pool_release(pc->pool, buff);
+
 	conn_close(&priv->conn_tcp);
 
 	send_tcp_close(pc);
 
+	alloc_guard_leave();
+
 	proxy_log(pc->ph, LOG_LEVEL_DEBUG,
 		  "Client '%s' TCP worker is returning cleanly\n",
 		  priv->callsign);
 }
 
+static int offer_client_msg(struct proxy_conn_handle *pc,
+			    const struct conn_iovec *iov, unsigned int count,
+			    uint8_t *buff, size_t limit)
+{
+	struct proxy_conn_priv *priv = pc->priv;
+	struct msg_queue_handle *queue = &priv->queue_client;
+	size_t len = 0;
+	unsigned int i;
+
+	if (limit != 0) {
+		for (i = 0; i < count; i++)
+			len += iov[i].len;
+
+		if (client_queued_bytes(pc) + len > limit)
+			return -ENOSPC;
+	}
+
+	/* Every message begins with its header */
+	if (iov[0].buff[0] == PROXY_MSG_TYPE_UDP_DATA)
+		queue = &priv->queue_data;
+
+	if (buff != NULL)
+		return msg_queue_push_buff(queue, buff, iov[0].len);
+
+	return msg_queue_push(queue, iov, count);
+}
+
 static int process_control_data_message(struct proxy_conn_handle *pc,
 					struct proxy_msg *msg)
 {
 	struct proxy_conn_priv *priv = pc->priv;
 	size_t msg_size = msg->size;
 	uint32_t addr = msg->address;
+	const uint8_t *data;
 	int ret;
 
 	proxy_log(pc->ph, LOG_LEVEL_DEBUG,
@@ -470,22 +1514,14 @@ static int process_control_data_message(struct proxy_conn_handle *pc,
 				       CONN_BUFF_LEN : msg_size;
 
 		/* Get the data segment from the client */
-		ret = conn_recv(priv->conn_client, (void *)msg, curr_msg_size);
+		ret = read_client_buff(pc, &data, curr_msg_size);
 		if (ret < 0)
 			return ret;
-		else if (ret == 0)
-			return -EPIPE;
 
-		msg_size -= ret;
+		msg_size -= curr_msg_size;
 
-		/* Send the data */
-		ret = conn_send_to(&priv->conn_control, (void *)msg, ret, addr, 5199);
-		if (ret < 0)
-			proxy_log(pc->ph, LOG_LEVEL_WARN,
-				  "Failed to send UDP_CONTROL packet of size %zu to client '%s': %d (%s)\n",
-				  curr_msg_size, priv->callsign, -ret,
-				  strerror(-ret));
-			/*! @TODO Drop? */
+		/* Held until the client has nothing more queued */
+		batch_datagram(pc, &priv->batch_control, data, curr_msg_size, addr);
 	}
 
 	return 0;
@@ -497,6 +1533,7 @@ static int process_data_message(struct proxy_conn_handle *pc,
 	struct proxy_conn_priv *priv = pc->priv;
 	size_t msg_size = msg->size;
 	uint32_t addr = msg->address;
+	const uint8_t *data;
 	int ret;
 
 	proxy_log(pc->ph, LOG_LEVEL_DEBUG,
@@ -508,22 +1545,14 @@ static int process_data_message(struct proxy_conn_handle *pc,
 				       CONN_BUFF_LEN : msg_size;
 
 		/* Get the data segment from the client */
-		ret = conn_recv(priv->conn_client, (void *)msg, curr_msg_size);
+		ret = read_client_buff(pc, &data, curr_msg_size);
 		if (ret < 0)
 			return ret;
-		else if (ret == 0)
-			return -EPIPE;
 
-		msg_size -= ret;
+		msg_size -= curr_msg_size;
 
-		/* Send the data */
-		ret = conn_send_to(&priv->conn_data, (void *)msg, ret, addr, 5198);
-		if (ret < 0)
-			proxy_log(pc->ph, LOG_LEVEL_WARN,
-				  "Failed to send UDP_DATA packet of size %zu to client '%s': %d (%s)\n",
-				  curr_msg_size, priv->callsign, -ret,
-				  strerror(-ret));
-			/*! @TODO Drop? */
+		/* Held until the client has nothing more queued */
+		batch_datagram(pc, &priv->batch_data, data, curr_msg_size, addr);
 	}
 
 	return 0;
@@ -552,77 +1581,1065 @@ static int process_message(struct proxy_conn_handle *pc,
 	}
 }
 
-static int process_tcp_close_message(struct proxy_conn_handle *pc,
-				     struct proxy_msg *msg)
+static int process_tcp_close_message(struct proxy_conn_handle *pc,
+				     struct proxy_msg *msg)
+{
+	struct proxy_conn_priv *priv = pc->priv;
+
+	proxy_log(pc->ph, LOG_LEVEL_DEBUG,
+		  "Processing TCP_CLOSE message from client '%s'\n",
+		  priv->callsign);
+	(void)msg;
+
+	conn_close(&priv->conn_tcp);
+
+	return 0;
+}
+
+static int process_tcp_data_message(struct proxy_conn_handle *pc,
+				    struct proxy_msg *msg)
+{
+	struct proxy_conn_priv *priv = pc->priv;
+	size_t msg_size = msg->size;
+	size_t curr_msg_size;
+	const uint8_t *data;
+	int tcp_ret = 0;
+	int ret;
+
+	proxy_log(pc->ph, LOG_LEVEL_DEBUG,
+		  "Processing TCP_DATA message (%zu bytes) from client '%s'\n",
+		  msg_size, priv->callsign);
+
+	while (msg_size > 0) {
+		curr_msg_size = msg_size > CONN_BUFF_LEN ? CONN_BUFF_LEN :
+				msg_size;
+
+		/* Get the data segment from the client */
+		ret = read_client_buff(pc, &data, curr_msg_size);
+		if (ret < 0)
+			return ret;
+
+		msg_size -= curr_msg_size;
+
+		/* Send the data */
+		if (tcp_ret == 0) {
+			proxy_log(pc->ph, LOG_LEVEL_DEBUG,
+				  "Sending TCP_DATA message (%zu bytes) from client '%s' to remote host\n",
+				  curr_msg_size, priv->callsign);
+
+			tcp_ret = conn_send(&priv->conn_tcp, data, curr_msg_size);
+			if (tcp_ret < 0) {
+				proxy_log(pc->ph, LOG_LEVEL_DEBUG,
+					  "Error sending data to remote host (%d): %s\n",
+					  -tcp_ret, strerror(-tcp_ret));
+
+				conn_close(&priv->conn_tcp);
+			}
+		}
+	}
+
+	if (tcp_ret != 0)
+		send_tcp_close(pc);
+
+	return 0;
+}
+
+static int process_tcp_open_message(struct proxy_conn_handle *pc,
+				    const struct proxy_msg *msg)
+{
+	struct proxy_conn_priv *priv = pc->priv;
+	struct proxy_msg status_msg = { 0 };
+	struct conn_iovec iov[2];
+	const uint8_t *addr_sep = (const uint8_t *)&msg->address;
+	char addr[16] = "";
+	int32_t status;
+	int ret;
+
+	proxy_log(pc->ph, LOG_LEVEL_DEBUG,
+		  "Processing TCP_OPEN message from client '%s'\n",
+		  priv->callsign);
+
+	ret = snprintf(addr, 16, "%hu.%hu.%hu.%hu",
+		       (uint16_t)addr_sep[0], (uint16_t)addr_sep[1],
+		       (uint16_t)addr_sep[2], (uint16_t)addr_sep[3]);
+	if (ret < 7 || ret > 15) {
+		proxy_log(pc->ph, LOG_LEVEL_ERROR,
+			  "Address conversion failed (%d)\n", ret);
+		return -EINVAL;
+	}
+
+	/* Attempt to connect */
+	ret = conn_connect(&priv->conn_tcp, (const char *)addr, "5200");
+	if (ret < 0) {
+		proxy_log(pc->ph, LOG_LEVEL_WARN,
+			  "Failed to open TCP connection for client '%s' (%d): %s\n",
+			  priv->callsign, -ret, strerror(-ret));
+	} else {
+		/* Connection succeeded - signal the thread */
+		ret = worker_wake(&priv->worker_tcp);
+		if (ret < 0)
+			conn_close(&priv->conn_tcp);
+	}
+
+	status_msg.type = PROXY_MSG_TYPE_TCP_STATUS;
+	status_msg.size = 4;
+
+	/* Unless we can figure out what the client is expecting here, the
+	 * best we can do is a "non-zero" value to indicate failure.
+	 */
+	status = ret;
+	iov[0].buff = (const uint8_t *)&status_msg;
+	iov[0].len = sizeof(status_msg);
+	iov[1].buff = (const uint8_t *)&status;
+	iov[1].len = sizeof(status);
+
+	proxy_log(pc->ph, LOG_LEVEL_DEBUG,
+		  "Sending TCP_STATUS message (%d) to client '%s'\n",
+		  ret, priv->callsign);
+
+	ret = push_client_msg(pc, iov, 2, NULL, 0);
+	if (ret < 0)
+		return ret;
+
+	return signal_client_writer(pc);
+}
+
+static int push_client_msg(struct proxy_conn_handle *pc,
+			   const struct conn_iovec *iov, unsigned int count,
+			   uint8_t *buff, size_t limit)
+{
+	struct proxy_conn_priv *priv = pc->priv;
+	int ret;
+
+	if (atomic_load_u32(&priv->client_failed) != 0)
+		return -EPIPE;
+
+	ret = offer_client_msg(pc, iov, count, buff, limit);
+	if (ret != -ENOSPC)
+		return ret;
+
+	/* Make sure the queue is being drained before waiting on it */
+	ret = signal_client_writer(pc);
+	if (ret < 0)
+		return ret;
+
+	mutex_lock(&priv->mutex_client_space);
+
+	atomic_add_u32(&priv->client_space_waiters, 1);
+
+	do {
+		ret = offer_client_msg(pc, iov, count, buff, limit);
+		if (ret == -ENOSPC)
+			condvar_wait(&priv->condvar_client_space,
+				     &priv->mutex_client_space);
+	} while (ret == -ENOSPC);
+
+	atomic_sub_u32(&priv->client_space_waiters, 1);
+
+	mutex_unlock(&priv->mutex_client_space);
+
+	return ret;
+}
+
+static int read_client_buff(struct proxy_conn_handle *pc, const uint8_t **data,
+			    size_t len)
+{
+	struct proxy_conn_priv *priv = pc->priv;
+	int ret;
+
+	while (priv->rx_len < len) {
+		/* Datagrams from the client are sent together once it has
+		 * nothing more queued, rather than one at a time
+		 */
+		if ((priv->batch_control.count > 0 ||
+		     priv->batch_data.count > 0) &&
+		    conn_recv_pending(priv->conn_client) <= 0) {
+			flush_datagrams(pc, &priv->batch_control);
+			flush_datagrams(pc, &priv->batch_data);
+		}
+
+		ret = fill_client_buff(pc);
+		if (ret < 0)
+			return ret;
+	}
+
+	*data = &priv->rx_buff[priv->rx_head];
+
+	priv->rx_head += len;
+	priv->rx_len -= len;
+
+	return 0;
+}
+
+static void release_datagrams(struct proxy_conn_handle *pc,
+			      struct conn_datagram *dgrams)
+{
+	int i;
+
+	for (i = 0; i < CONN_RECV_BATCH; i++) {
+		if (dgrams[i].buff != NULL) {
+			buff_pool_release(pc->pool, dgrams[i].buff -
+					  sizeof(struct proxy_msg));
+			dgrams[i].buff = NULL;
+		}
+	}
+}
+
+static int send_datagrams(struct proxy_conn_handle *pc, uint8_t type,
+			  struct conn_datagram *dgrams, int count)
+{
+	struct proxy_conn_priv *priv = pc->priv;
+	enum PROXY_DATA_OVERFLOW policy = PROXY_DATA_OVERFLOW_BLOCK;
+	size_t limit = 0;
+	struct proxy_msg msg;
+	struct conn_iovec iov;
+	uint8_t *buff;
+	int dropped = 0;
+	int ret;
+	int i;
+
+	/* Control messages are never discarded */
+	if (type == PROXY_MSG_TYPE_UDP_DATA) {
+		policy = pc->ph->conf.data_overflow;
+		limit = data_budget(pc);
+	}
+
+	msg.type = type;
+
+	for (i = 0; i < count; i++) {
+		msg.address = dgrams[i].addr;
+		msg.size = (uint32_t)dgrams[i].len;
+
+		proxy_log(pc->ph, LOG_LEVEL_DEBUG,
+			  "Sending %s message to client '%s' (%u bytes)\n",
+			  type == PROXY_MSG_TYPE_UDP_CONTROL ?
+			  "UDP_CONTROL" : "UDP_DATA",
+			  priv->callsign, msg.size);
+
+		/* The header goes in the space left in front of the datagram */
+		buff = dgrams[i].buff - sizeof(msg);
+		memcpy(buff, &msg, sizeof(msg));
+
+		iov.buff = buff;
+		iov.len = sizeof(msg) + dgrams[i].len;
+
+		switch (policy) {
+		case PROXY_DATA_OVERFLOW_DROP_NEWEST:
+			ret = offer_client_msg(pc, &iov, 1, buff, limit);
+
+			/* A full queue which is within the budget is still
+			 * being drained, so it is worth waiting for
+			 */
+			if (ret == -ENOSPC && limit != 0 &&
+			    client_queued_bytes(pc) + iov.len <= limit)
+				ret = push_client_msg(pc, &iov, 1, buff, 0);
+			break;
+		case PROXY_DATA_OVERFLOW_DROP_OLDEST:
+			ret = offer_client_msg(pc, &iov, 1, buff, limit);
+			if (ret != -ENOSPC)
+				break;
+
+			/* Make room by discarding the oldest message which the
+			 * writer hasn't taken yet. If it has taken them all,
+			 * this message is discarded instead.
+			 */
+			mutex_lock(&priv->mutex_data);
+			ret = msg_queue_replace(&priv->queue_data,
+						priv->data_taken, buff,
+						iov.len);
+			mutex_unlock(&priv->mutex_data);
+			if (ret >= 0) {
+				dropped++;
+				ret = 0;
+			}
+			break;
+		default:
+			ret = push_client_msg(pc, &iov, 1, buff, limit);
+			break;
+		}
+
+		/* The queue holds its own reference if the message was added */
+		buff_pool_release(pc->pool, buff);
+		dgrams[i].buff = NULL;
+
+		if (ret == -ENOSPC) {
+			dropped++;
+			continue;
+		} else if (ret < 0) {
+			return ret;
+		}
+	}
+
+	if (dropped > 0) {
+		atomic_add_u32(&priv->data_dropped, dropped);
+
+		proxy_log(pc->ph, LOG_LEVEL_DEBUG,
+			  "Discarding %d UDP Data messages for client '%s' which is not keeping up\n",
+			  dropped, priv->callsign);
+	}
+
+	return signal_client_writer(pc);
+}
+
+static int send_tcp_close(struct proxy_conn_handle *pc)
+{
+	struct proxy_conn_priv *priv = pc->priv;
+	struct proxy_msg message = { 0 };
+	struct conn_iovec iov;
+	int ret;
+
+	message.type = PROXY_MSG_TYPE_TCP_CLOSE;
+	message.size = 0;
+
+	proxy_log(pc->ph, LOG_LEVEL_DEBUG,
+		  "Sending TCP_CLOSE message to client '%s'\n", priv->callsign);
+
+	iov.buff = (const uint8_t *)&message;
+	iov.len = sizeof(message);
+
+	ret = push_client_msg(pc, &iov, 1, NULL, 0);
+	if (ret < 0)
+		return ret;
+
+	return signal_client_writer(pc);
+}
+
+static size_t spliced_tcp_len(const struct conn_iovec *iov)
+{
+	struct proxy_msg msg;
+
+	if (iov->len != sizeof(msg) ||
+	    iov->buff[0] != PROXY_MSG_TYPE_TCP_DATA)
+		return 0;
+
+	memcpy(&msg, iov->buff, sizeof(msg));
+
+	return msg.size;
+}
+
+static int signal_client_writer(struct proxy_conn_handle *pc)
+{
+	struct proxy_conn_priv *priv = pc->priv;
+
+	/* Only the first signal since the writer last started is needed */
+	if (atomic_exchange_u32(&priv->client_signaled, 1) != 0)
+		return 0;
+
+	return worker_wake(&priv->worker_client);
+}
+
+#ifdef HAVE_EPOLL
+static size_t client_space(struct proxy_conn_handle *pc)
+{
+	struct proxy_conn_priv *priv = pc->priv;
+	size_t space;
+
+	space = priv->fifo_client.size - priv->fifo_client.len;
+
+	return space > EVENT_FIFO_RESERVE ? space - EVENT_FIFO_RESERVE : 0;
+}
+
+static int client_stream_paused(struct proxy_conn_handle *pc)
+{
+	struct proxy_conn_priv *priv = pc->priv;
+
+	return priv->msg_len == sizeof(priv->msg) &&
+	       priv->msg.type == PROXY_MSG_TYPE_TCP_DATA &&
+	       priv->source_tcp.flags != 0 && !priv->tcp_failed &&
+	       priv->fifo_tcp.len == priv->fifo_tcp.size;
+}
+
+static unsigned int data_room(struct proxy_conn_handle *pc)
+{
+	struct proxy_conn_priv *priv = pc->priv;
+	struct msg_queue_stats stats;
+	size_t budget = data_budget(pc);
+	size_t queued;
+	unsigned int room;
+
+	msg_queue_get_stats(&priv->queue_data, &stats);
+	room = priv->queue_data.capacity - stats.depth;
+
+	if (budget != 0) {
+		queued = client_queued_bytes(pc);
+		if (queued >= budget)
+			return 0;
+
+		if ((budget - queued) / CONN_BUFF_LEN < room)
+			room = (unsigned int)((budget - queued) / CONN_BUFF_LEN);
+	}
+
+	return room;
+}
+
+static int fifo_flush(struct proxy_conn_fifo *fifo, struct conn_handle *conn)
+{
+	size_t chunk;
+	int ret;
+
+	while (fifo->len > 0) {
+		chunk = fifo->size - fifo->head;
+		if (chunk > fifo->len)
+			chunk = fifo->len;
+
+		ret = conn_send_any(conn, &fifo->buff[fifo->head], chunk);
+		if (ret < 0)
+			return ret == -EAGAIN ? 0 : ret;
+
+		fifo->head = (fifo->head + ret) % fifo->size;
+		fifo->len -= ret;
+	}
+
+	fifo->head = 0;
+
+	return 0;
+}
+
+static int fifo_send(struct proxy_conn_fifo *fifo, struct conn_handle *conn,
+		     const uint8_t *buff, size_t buff_len, size_t reserve)
+{
+	size_t chunk;
+	size_t tail;
+	int ret;
+
+	if (fifo->size - fifo->len < buff_len + reserve)
+		return -ENOSPC;
+
+	/* Nothing is queued, so try to skip the queue entirely */
+	if (conn != NULL && fifo->len == 0) {
+		ret = conn_send_any(conn, buff, buff_len);
+		if (ret < 0 && ret != -EAGAIN)
+			return ret;
+
+		if (ret > 0) {
+			buff += ret;
+			buff_len -= ret;
+		}
+	}
+
+	while (buff_len > 0) {
+		tail = (fifo->head + fifo->len) % fifo->size;
+		chunk = fifo->size - tail;
+		if (chunk > buff_len)
+			chunk = buff_len;
+
+		memcpy(&fifo->buff[tail], buff, chunk);
+
+		fifo->len += chunk;
+		buff += chunk;
+		buff_len -= chunk;
+	}
+
+	if (fifo->len > fifo->len_max)
+		fifo->len_max = fifo->len;
+
+	return 0;
+}
+
+static int flush_data_queue(struct proxy_conn_handle *pc)
+{
+	struct proxy_conn_priv *priv = pc->priv;
+	struct conn_iovec iov;
+	int ret;
+
+	while (priv->fifo_client.len < CONN_BUFF_LEN &&
+	       msg_queue_peek(&priv->queue_data, 0, &iov, 1) > 0) {
+		ret = fifo_send(&priv->fifo_client, priv->conn_client, iov.buff,
+				iov.len, EVENT_FIFO_RESERVE);
+		if (ret < 0)
+			return ret;
+
+		msg_queue_pop(&priv->queue_data, 1);
+	}
+
+	return 0;
+}
+
+static void process_client_event(struct event_source *es, uint32_t flags)
+{
+	struct proxy_conn_handle *pc = es->func_ctx;
+	struct proxy_conn_priv *priv = pc->priv;
+	int ret = 0;
+
+	if (flags & EVENT_FLAG_OUT) {
+		ret = fifo_flush(&priv->fifo_client, priv->conn_client);
+		if (ret == 0)
+			ret = flush_data_queue(pc);
+	}
+
+	if (ret == 0 && (flags & EVENT_FLAG_ERR) &&
+	    !(es->flags & EVENT_FLAG_IN))
+		ret = -EPIPE;
+	else if (ret == 0 && (flags & (EVENT_FLAG_IN | EVENT_FLAG_ERR))) {
+		ret = process_client_stream(pc);
+
+		flush_datagrams(pc, &priv->batch_control);
+		flush_datagrams(pc, &priv->batch_data);
+	}
+
+	if (ret < 0) {
+		switch (ret) {
+		case -ECONNRESET:
+		case -EINTR:
+		case -EINVAL:
+		case -ENOTCONN:
+		case -EPIPE:
+			break;
+		default:
+			proxy_log(pc->ph, LOG_LEVEL_ERROR,
+				  "Failed to communicate with client '%s' (%d): %s\n",
+				  priv->callsign, -ret, strerror(-ret));
+			break;
+		}
+
+		pc->finish_func(pc);
+
+		return;
+	}
+
+	update_events(pc);
+}
+
+static int process_client_buff(struct proxy_conn_handle *pc)
+{
+	struct proxy_conn_priv *priv = pc->priv;
+	size_t len;
+	int ret;
+
+	while (!client_stream_paused(pc)) {
+		if (priv->msg_len < sizeof(priv->msg)) {
+			if (priv->rx_len < sizeof(priv->msg))
+				return 0;
+
+			memcpy(&priv->msg, &priv->rx_buff[priv->rx_head],
+			       sizeof(priv->msg));
+			priv->rx_head += sizeof(priv->msg);
+			priv->rx_len -= sizeof(priv->msg);
+			priv->msg_len = sizeof(priv->msg);
+
+			ret = start_client_message(pc);
+			if (ret < 0)
+				return ret;
+		} else {
+			len = priv->rx_len;
+
+			ret = process_client_payload(pc);
+			if (ret < 0)
+				return ret;
+
+			/* Nothing more can be done until more data arrives */
+			if (priv->rx_len == len)
+				return 0;
+		}
+
+		if (priv->msg_remaining == 0) {
+			if (priv->tcp_failed) {
+				ret = queue_tcp_close(pc);
+				if (ret < 0)
+					return ret;
+			}
+
+			priv->msg_len = 0;
+		}
+	}
+
+	return 0;
+}
+
+static int process_client_payload(struct proxy_conn_handle *pc)
+{
+	struct proxy_conn_priv *priv = pc->priv;
+	struct proxy_conn_batch *batch = &priv->batch_data;
+	const uint8_t *data = &priv->rx_buff[priv->rx_head];
+	size_t len = priv->rx_len;
+	int ret;
+
+	if (len > priv->msg_remaining)
+		len = priv->msg_remaining;
+
+	switch (priv->msg.type) {
+	case PROXY_MSG_TYPE_TCP_DATA:
+		if (priv->source_tcp.flags != 0 && !priv->tcp_failed) {
+			if (len > priv->fifo_tcp.size - priv->fifo_tcp.len)
+				len = priv->fifo_tcp.size - priv->fifo_tcp.len;
+
+			/* Resumed once the remote host accepts more data */
+			if (len == 0)
+				return 0;
+
+			proxy_log(pc->ph, LOG_LEVEL_DEBUG,
+				  "Sending TCP_DATA message (%zu bytes) from client '%s' to remote host\n",
+				  len, priv->callsign);
+
+			ret = fifo_send(&priv->fifo_tcp,
+					priv->tcp_connecting ? NULL : &priv->conn_tcp,
+					data, len, 0);
+			if (ret < 0) {
+				proxy_log(pc->ph, LOG_LEVEL_DEBUG,
+					  "Error sending data to remote host (%d): %s\n",
+					  -ret, strerror(-ret));
+
+				stop_tcp_connection(pc);
+				priv->tcp_failed = 1;
+			}
+		} else {
+			priv->tcp_failed = 1;
+		}
+		break;
+	case PROXY_MSG_TYPE_UDP_CONTROL:
+		batch = &priv->batch_control;
+	/* fall through */
+	case PROXY_MSG_TYPE_UDP_DATA:
+		/* Datagrams are forwarded in segments of at most CONN_BUFF_LEN */
+		if (len < priv->msg_remaining && len < CONN_BUFF_LEN)
+			return 0;
+
+		if (len > CONN_BUFF_LEN)
+			len = CONN_BUFF_LEN;
+
+		/* Sent once the available client data has been processed */
+		batch_datagram(pc, batch, data, len, priv->msg.address);
+		break;
+	default:
+		/* Data accompanying other messages is discarded */
+		break;
+	}
+
+	priv->rx_head += len;
+	priv->rx_len -= len;
+	priv->msg_remaining -= len;
+
+	return 0;
+}
+
+static int process_client_stream(struct proxy_conn_handle *pc)
+{
+	int ret;
+	int i;
+
+	ret = process_client_buff(pc);
+
+	for (i = 0; i < EVENT_RECV_MAX && ret == 0; i++) {
+		/* Resumed once the remote host accepts more data */
+		if (client_stream_paused(pc))
+			return 0;
+
+		ret = fill_client_buff(pc);
+		if (ret < 0)
+			return ret == -EAGAIN ? 0 : ret;
+
+		ret = process_client_buff(pc);
+	}
+
+	return ret;
+}
+
+static void process_tcp_event(struct event_source *es, uint32_t flags)
+{
+	struct proxy_conn_handle *pc = es->func_ctx;
+	struct proxy_conn_priv *priv = pc->priv;
+	uint8_t *buff = NULL;
+	struct proxy_msg msg;
+	int paused = client_stream_paused(pc);
+	int ret = 0;
+	int i;
+
+	if (priv->tcp_connecting) {
+		priv->tcp_connecting = 0;
+
+		ret = conn_connect_finish(&priv->conn_tcp);
+		if (ret < 0) {
+			proxy_log(pc->ph, LOG_LEVEL_WARN,
+				  "Failed to open TCP connection for client '%s' (%d): %s\n",
+				  priv->callsign, -ret, strerror(-ret));
+
+			stop_tcp_connection(pc);
+		}
+
+		ret = queue_tcp_status(pc, ret);
+
+		goto process_tcp_event_exit;
+	}
+
+	if (flags & EVENT_FLAG_OUT) {
+		ret = fifo_flush(&priv->fifo_tcp, &priv->conn_tcp);
+		if (ret < 0) {
+			proxy_log(pc->ph, LOG_LEVEL_DEBUG,
+				  "Error sending data to remote host (%d): %s\n",
+				  -ret, strerror(-ret));
+
+			stop_tcp_connection(pc);
+			ret = queue_tcp_close(pc);
+
+			goto process_tcp_event_exit;
+		}
+	}
+
+	if ((flags & EVENT_FLAG_ERR) && !(es->flags & EVENT_FLAG_IN)) {
+		stop_tcp_connection(pc);
+		ret = queue_tcp_close(pc);
+
+		goto process_tcp_event_exit;
+	}
+
+	if (!(flags & (EVENT_FLAG_IN | EVENT_FLAG_ERR)))
+		goto process_tcp_event_exit;
+
+	msg.type = PROXY_MSG_TYPE_TCP_DATA;
+	msg.address = 0;
+
+	for (i = 0; i < EVENT_RECV_MAX; i++) {
+		/* Resumed once the client accepts more data */
+		if (priv->fifo_client.size - priv->fifo_client.len <
+		    CONN_BUFF_LEN + EVENT_FIFO_RESERVE)
+			break;
+
+		/* The data stays in the socket until a buffer is available */
+		if (buff == NULL) {
+			buff = buff_pool_borrow(pc->pool);
+			if (buff == NULL)
+				break;
+		}
+
+		ret = conn_recv_any(&priv->conn_tcp, buff + sizeof(msg),
+				    CONN_BUFF_LEN_HEADERLESS, NULL, NULL);
+		if (ret < 0) {
+			if (ret == -EAGAIN) {
+				ret = 0;
+				break;
+			}
+
+			switch (ret) {
+			case -ECONNRESET:
+			case -EINTR:
+			case -ENOTCONN:
+			case -EPIPE:
+				break;
+			default:
+				proxy_log(pc->ph, LOG_LEVEL_WARN,
+					  "Failed to receive data on client '%s' TCP connection (%d): %s\n",
+					  priv->callsign, -ret, strerror(-ret));
+				break;
+			}
+
+			stop_tcp_connection(pc);
+			ret = queue_tcp_close(pc);
+
+			break;
+		}
+
+		msg.size = ret;
+
+		proxy_log(pc->ph, LOG_LEVEL_DEBUG,
+			  "Sending TCP_DATA message to client '%s' (%d bytes)\n",
+			  priv->callsign, msg.size);
+
+		memcpy(buff, &msg, sizeof(msg));
+
+		ret = fifo_send(&priv->fifo_client, priv->conn_client, buff,
+				sizeof(msg) + msg.size, EVENT_FIFO_RESERVE);
+		if (ret < 0)
+			break;
+	}
+
+	if (buff != NULL)
+		buff_pool_release(pc->pool, buff);
+
+process_tcp_event_exit:
+	/* This is an error with the client connection */
+	if (ret < 0) {
+		proxy_log(pc->ph, LOG_LEVEL_DEBUG,
+			  "Dropping client '%s' due to a client connection error (%d): %s\n",
+			  priv->callsign, -ret, strerror(-ret));
+
+		proxy_conn_drop(pc);
+
+		return;
+	}
+
+	/* Client data which was already received may be processed now */
+	if (paused && !client_stream_paused(pc)) {
+		process_client_event(&priv->source_client, EVENT_FLAG_IN);
+
+		return;
+	}
+
+	update_events(pc);
+}
+
+static void process_udp_event(struct event_source *es, uint32_t flags)
+{
+	struct proxy_conn_handle *pc = es->func_ctx;
+	struct proxy_conn_priv *priv = pc->priv;
+	const char *name = es == &priv->source_control ? "Control" : "Data";
+	struct conn_datagram dgrams[CONN_RECV_BATCH];
+	struct proxy_msg msg;
+	uint8_t *buff;
+	unsigned int avail;
+	unsigned int max;
+	int dropped = 0;
+	int count;
+	int ret = 0;
+	int i;
+	int j;
+
+	(void)flags;
+
+	memset(dgrams, 0x0, sizeof(dgrams));
+
+	msg.type = PROXY_MSG_TYPE_UDP_CONTROL;
+
+	for (i = 0; i < EVENT_RECV_MAX; i += count) {
+		/* Without discarding, only receive what is sure to fit */
+		max = CONN_RECV_BATCH;
+		if (es == &priv->source_control) {
+			if (client_space(pc) / CONN_BUFF_LEN < max)
+				max = (unsigned int)(client_space(pc) /
+						     CONN_BUFF_LEN);
+		} else if (pc->ph->conf.data_overflow ==
+			   PROXY_DATA_OVERFLOW_BLOCK) {
+			if (data_room(pc) < max)
+				max = data_room(pc);
+		}
+
+		if (max == 0)
+			break;
+
+		/* With no buffer to receive into, the datagram is discarded */
+		avail = borrow_datagrams(pc, dgrams);
+		if (avail == 0) {
+			ret = discard_datagram(pc, es->conn);
+			if (ret < 0)
+				break;
+
+			count = 1;
+			continue;
+		}
+
+		if (avail < max)
+			max = avail;
+
+		count = conn_recv_many(es->conn, dgrams, max);
+		if (count < 0) {
+			ret = count;
+			break;
+		}
+
+		for (j = 0; j < count; j++) {
+			buff = dgrams[j].buff - sizeof(msg);
+
+			if (es == &priv->source_data) {
+				dropped += queue_datagram(pc, &dgrams[j]);
+				continue;
+			}
+
+			msg.address = dgrams[j].addr;
+			msg.size = (uint32_t)dgrams[j].len;
+
+			proxy_log(pc->ph, LOG_LEVEL_DEBUG,
+				  "Sending UDP_CONTROL message to client '%s' (%u bytes)\n",
+				  priv->callsign, msg.size);
+
+			/* The header goes in the space left in front of the
+			 * datagram
+			 */
+			memcpy(buff, &msg, sizeof(msg));
+
+			ret = fifo_send(&priv->fifo_client, priv->conn_client,
+					buff, sizeof(msg) + dgrams[j].len,
+					EVENT_FIFO_RESERVE);
+			if (ret < 0)
+				break;
+		}
+
+		/* The messages were either copied or queued with their own
+		 * reference to the buffer
+		 */
+		for (j = 0; j < count; j++) {
+			buff_pool_release(pc->pool,
+					  dgrams[j].buff - sizeof(msg));
+			dgrams[j].buff = NULL;
+		}
+
+		if (ret >= 0 && es == &priv->source_data)
+			ret = flush_data_queue(pc);
+
+		if (ret < 0) {
+			/* This is an error with the client connection */
+			proxy_log(pc->ph, LOG_LEVEL_DEBUG,
+				  "Dropping client '%s' due to a client connection error (%d): %s\n",
+				  priv->callsign, -ret, strerror(-ret));
+
+			release_datagrams(pc, dgrams);
+			event_remove(pc->event, es);
+			proxy_conn_drop(pc);
+
+			return;
+		}
+	}
+
+	release_datagrams(pc, dgrams);
+
+	if (dropped > 0) {
+		priv->data_dropped += dropped;
+
+		proxy_log(pc->ph, LOG_LEVEL_DEBUG,
+			  "Discarding %d UDP %s messages for client '%s' which is not keeping up\n",
+			  dropped, name, priv->callsign);
+	}
+
+	if (ret < 0 && ret != -EAGAIN) {
+		event_remove(pc->event, es);
+
+		switch (ret) {
+		case -ECONNRESET:
+		case -EINTR:
+		case -ENOTCONN:
+		case -EPIPE:
+			break;
+		default:
+			proxy_log(pc->ph, LOG_LEVEL_INFO,
+				  "Failed to receive data on client '%s' UDP %s connection (%d): %s\n",
+				  priv->callsign, name, -ret, strerror(-ret));
+			/* Since the UDP ports must be open while the client is connected,
+			 * we should shut down the client if we don't exit cleanly
+			 */
+			proxy_conn_drop(pc);
+			break;
+		}
+
+		return;
+	}
+
+	update_events(pc);
+}
+
+static int queue_datagram(struct proxy_conn_handle *pc,
+			  const struct conn_datagram *dgram)
 {
 	struct proxy_conn_priv *priv = pc->priv;
+	struct msg_queue_stats stats;
+	size_t budget = data_budget(pc);
+	struct proxy_msg msg;
+	uint8_t *buff = dgram->buff - sizeof(msg);
+	int dropped = 0;
+	int ret;
+
+	msg.type = PROXY_MSG_TYPE_UDP_DATA;
+	msg.address = dgram->addr;
+	msg.size = (uint32_t)dgram->len;
 
 	proxy_log(pc->ph, LOG_LEVEL_DEBUG,
-		  "Processing TCP_CLOSE message from client '%s'\n",
-		  priv->callsign);
-	(void)msg;
+		  "Sending UDP_DATA message to client '%s' (%u bytes)\n",
+		  priv->callsign, msg.size);
+
+	/* The header goes in the space left in front of the datagram */
+	memcpy(buff, &msg, sizeof(msg));
+
+	for (;;) {
+		msg_queue_get_stats(&priv->queue_data, &stats);
+		if (stats.depth == 0 || budget == 0 ||
+		    client_queued_bytes(pc) + sizeof(msg) + dgram->len <=
+		    budget) {
+			ret = msg_queue_push_buff(&priv->queue_data, buff,
+						  sizeof(msg) + dgram->len);
+			if (ret != -ENOSPC)
+				break;
+		}
 
-	conn_close(&priv->conn_tcp);
+		if (pc->ph->conf.data_overflow !=
+		    PROXY_DATA_OVERFLOW_DROP_OLDEST)
+			return 1;
 
-	return 0;
+		msg_queue_pop(&priv->queue_data, 1);
+		dropped++;
+	}
+
+	return dropped;
 }
 
-static int process_tcp_data_message(struct proxy_conn_handle *pc,
-				    struct proxy_msg *msg)
+static int queue_tcp_close(struct proxy_conn_handle *pc)
 {
 	struct proxy_conn_priv *priv = pc->priv;
-	size_t msg_size = msg->size;
-	size_t curr_msg_size;
-	int tcp_ret = 0;
-	int ret;
+	struct proxy_msg message = { 0 };
+
+	message.type = PROXY_MSG_TYPE_TCP_CLOSE;
+	message.size = 0;
 
 	proxy_log(pc->ph, LOG_LEVEL_DEBUG,
-		  "Processing TCP_DATA message (%zu bytes) from client '%s'\n",
-		  msg_size, priv->callsign);
+		  "Sending TCP_CLOSE message to client '%s'\n", priv->callsign);
 
-	while (msg_size > 0) {
-		curr_msg_size = msg_size > CONN_BUFF_LEN ? CONN_BUFF_LEN :
-				msg_size;
+	return fifo_send(&priv->fifo_client, priv->conn_client,
+			 (uint8_t *)&message, sizeof(message), 0);
+}
 
-		/* Get the data segment from the client */
-		ret = conn_recv(priv->conn_client, (void *)msg, curr_msg_size);
-		if (ret < 0)
-			return ret;
-		else if (ret == 0)
-			return -EPIPE;
+static int queue_tcp_status(struct proxy_conn_handle *pc, int status)
+{
+	struct proxy_conn_priv *priv = pc->priv;
+	uint8_t status_buf[sizeof(struct proxy_msg) + 4] = { 0 };
+	struct proxy_msg *status_msg = (struct proxy_msg *)status_buf;
 
-		msg_size -= ret;
+	status_msg->type = PROXY_MSG_TYPE_TCP_STATUS;
+	status_msg->size = 4;
 
-		/* Send the data */
-		if (tcp_ret == 0) {
-			proxy_log(pc->ph, LOG_LEVEL_DEBUG,
-				  "Sending TCP_DATA message (%d bytes) from client '%s' to remote host\n",
-				  ret, priv->callsign);
+	memcpy(status_buf + sizeof(*status_msg), &status, 4);
 
-			tcp_ret = conn_send(&priv->conn_tcp, (void *)msg, ret);
-			if (tcp_ret < 0) {
-				proxy_log(pc->ph, LOG_LEVEL_DEBUG,
-					  "Error sending data to remote host (%d): %s\n",
-					  -tcp_ret, strerror(-tcp_ret));
+	proxy_log(pc->ph, LOG_LEVEL_DEBUG,
+		  "Sending TCP_STATUS message (%d) to client '%s'\n",
+		  status, priv->callsign);
 
-				conn_close(&priv->conn_tcp);
-			}
-		}
-	}
+	return fifo_send(&priv->fifo_client, priv->conn_client, status_buf,
+			 sizeof(status_buf), 0);
+}
 
-	if (tcp_ret != 0)
-		send_tcp_close(pc);
+static int start_client_message(struct proxy_conn_handle *pc)
+{
+	struct proxy_conn_priv *priv = pc->priv;
 
-	return 0;
+	priv->msg_remaining = priv->msg.size;
+	priv->tcp_failed = 0;
+
+	switch (priv->msg.type) {
+	case PROXY_MSG_TYPE_TCP_OPEN:
+		return start_tcp_connection(pc);
+	case PROXY_MSG_TYPE_TCP_DATA:
+		proxy_log(pc->ph, LOG_LEVEL_DEBUG,
+			  "Processing TCP_DATA message (%zu bytes) from client '%s'\n",
+			  priv->msg_remaining, priv->callsign);
+		return 0;
+	case PROXY_MSG_TYPE_TCP_CLOSE:
+		proxy_log(pc->ph, LOG_LEVEL_DEBUG,
+			  "Processing TCP_CLOSE message from client '%s'\n",
+			  priv->callsign);
+
+		if (priv->source_tcp.flags == 0)
+			return 0;
+
+		stop_tcp_connection(pc);
+
+		return queue_tcp_close(pc);
+	case PROXY_MSG_TYPE_UDP_DATA:
+		proxy_log(pc->ph, LOG_LEVEL_DEBUG,
+			  "Processing UDP_DATA message (%zu bytes) from client '%s'\n",
+			  priv->msg_remaining, priv->callsign);
+		return 0;
+	case PROXY_MSG_TYPE_UDP_CONTROL:
+		proxy_log(pc->ph, LOG_LEVEL_DEBUG,
+			  "Processing UDP_CONTROL message (%zu bytes) from client '%s'\n",
+			  priv->msg_remaining, priv->callsign);
+		return 0;
+	default:
+		proxy_log(pc->ph, LOG_LEVEL_ERROR,
+			  "Invalid data received from client (beginning with %02x)\n",
+			  priv->msg.type);
+		return -EINVAL;
+	}
 }
 
-static int process_tcp_open_message(struct proxy_conn_handle *pc,
-				    const struct proxy_msg *msg)
+static int start_tcp_connection(struct proxy_conn_handle *pc)
 {
 	struct proxy_conn_priv *priv = pc->priv;
-	uint8_t status_buf[sizeof(struct proxy_msg) + 4] = { 0 };
-	struct proxy_msg *status_msg = (struct proxy_msg *)status_buf;
-	const uint8_t *addr_sep = (const uint8_t *)&msg->address;
+	const uint8_t *addr_sep = (const uint8_t *)&priv->msg.address;
 	char addr[16] = "";
 	int ret;
 
@@ -639,62 +2656,97 @@ static int process_tcp_open_message(struct proxy_conn_handle *pc,
 		return -EINVAL;
 	}
 
-	/* Attempt to connect */
+	if (priv->source_tcp.flags != 0)
+		stop_tcp_connection(pc);
+
+	/* The status is sent once the connection attempt completes */
 	ret = conn_connect(&priv->conn_tcp, (const char *)addr, "5200");
-	if (ret < 0) {
-		proxy_log(pc->ph, LOG_LEVEL_WARN,
-			  "Failed to open TCP connection for client '%s' (%d): %s\n",
-			  priv->callsign, -ret, strerror(-ret));
-	} else {
-		/* Connection succeeded - signal the thread */
-		ret = worker_wake(&priv->worker_tcp);
+	if (ret == -EINPROGRESS) {
+		ret = event_add(pc->event, &priv->source_tcp, EVENT_FLAG_OUT);
+		if (ret == 0) {
+			priv->tcp_connecting = 1;
+			return 0;
+		}
+
+		conn_close(&priv->conn_tcp);
+	} else if (ret == 0) {
+		ret = event_add(pc->event, &priv->source_tcp, EVENT_FLAG_IN);
 		if (ret < 0)
 			conn_close(&priv->conn_tcp);
 	}
 
-	status_msg->type = PROXY_MSG_TYPE_TCP_STATUS;
-	status_msg->size = 4;
-
-	/* Unless we can figure out what the client is expecting here, the
-	 * best we can do is a "non-zero" value to indicate failure.
-	 */
-	memcpy(status_buf + sizeof(*status_msg), &ret, 4);
+	if (ret < 0)
+		proxy_log(pc->ph, LOG_LEVEL_WARN,
+			  "Failed to open TCP connection for client '%s' (%d): %s\n",
+			  priv->callsign, -ret, strerror(-ret));
 
-	proxy_log(pc->ph, LOG_LEVEL_DEBUG,
-		  "Sending TCP_STATUS message (%d) to client '%s'\n",
-		  ret, priv->callsign);
+	return queue_tcp_status(pc, ret);
+}
 
-	mutex_lock(&priv->mutex_client_send);
+static void stop_tcp_connection(struct proxy_conn_handle *pc)
+{
+	struct proxy_conn_priv *priv = pc->priv;
 
-	ret = conn_send(priv->conn_client, status_buf,
-			sizeof(*status_msg) + status_msg->size);
+	event_remove(pc->event, &priv->source_tcp);
 
-	mutex_unlock(&priv->mutex_client_send);
+	conn_close(&priv->conn_tcp);
 
-	return ret;
+	priv->tcp_connecting = 0;
+	priv->fifo_tcp.head = 0;
+	priv->fifo_tcp.len = 0;
 }
 
-static int send_tcp_close(struct proxy_conn_handle *pc)
+static void update_events(struct proxy_conn_handle *pc)
 {
 	struct proxy_conn_priv *priv = pc->priv;
-	struct proxy_msg message = { 0 };
-	int ret;
+	uint32_t flags;
 
-	message.type = PROXY_MSG_TYPE_TCP_CLOSE;
-	message.size = 0;
+	if (priv->source_client.flags != 0) {
+		flags = EVENT_FLAG_IN;
 
-	proxy_log(pc->ph, LOG_LEVEL_DEBUG,
-		  "Sending TCP_CLOSE message to client '%s'\n", priv->callsign);
+		if (client_stream_paused(pc))
+			flags = 0;
 
-	mutex_lock(&priv->mutex_client_send);
+		if (priv->fifo_client.len > 0)
+			flags |= EVENT_FLAG_OUT;
 
-	ret = conn_send(priv->conn_client, (uint8_t *)&message,
-			sizeof(struct proxy_msg));
+		event_modify(pc->event, &priv->source_client, flags);
+	}
 
-	mutex_unlock(&priv->mutex_client_send);
+	if (priv->source_tcp.flags != 0 && !priv->tcp_connecting) {
+		flags = 0;
 
-	return ret;
+		if (priv->fifo_client.size - priv->fifo_client.len >=
+		    CONN_BUFF_LEN + EVENT_FIFO_RESERVE)
+			flags |= EVENT_FLAG_IN;
+
+		if (priv->fifo_tcp.len > 0)
+			flags |= EVENT_FLAG_OUT;
+
+		event_modify(pc->event, &priv->source_tcp, flags);
+	}
+
+	/* Datagrams which are never discarded wait in the socket instead */
+	if (priv->source_control.flags != 0) {
+		flags = 0;
+
+		if (client_space(pc) >= CONN_BUFF_LEN)
+			flags |= EVENT_FLAG_IN;
+
+		event_modify(pc->event, &priv->source_control, flags);
+	}
+
+	if (priv->source_data.flags != 0) {
+		flags = 0;
+
+		if (pc->ph->conf.data_overflow != PROXY_DATA_OVERFLOW_BLOCK ||
+		    data_room(pc) > 0)
+			flags |= EVENT_FLAG_IN;
+
+		event_modify(pc->event, &priv->source_data, flags);
+	}
 }
+#endif
 
 /*
  * API Functions
@@ -705,6 +2757,7 @@ int proxy_conn_accept(struct proxy_conn_handle *pc,
 		      uint8_t reconnect_only)
 {
 	struct proxy_conn_priv *priv = pc->priv;
+	int discarded;
 	int ret = 0;
 
 	mutex_lock(&priv->mutex_client);
@@ -717,21 +2770,87 @@ int proxy_conn_accept(struct proxy_conn_handle *pc,
 
 	strncpy(priv->callsign, callsign, sizeof(priv->callsign) - 1);
 	priv->conn_client = conn_client;
+	priv->rx_head = 0;
+	priv->rx_len = 0;
 
 	mutex_unlock(&priv->mutex_client);
 
-	ret = conn_listen(&priv->conn_control);
-	if (ret < 0) {
-		proxy_log(pc->ph, LOG_LEVEL_ERROR,
-			  "Failed to open UDP control port (5199). Dropping...\n");
-		goto proxy_conn_accept_exit;
+	if (pc->ph->conf.persistent_udp) {
+		/* Anything already queued was meant for the previous client */
+		ret = conn_drain(&priv->conn_control);
+		if (ret < 0) {
+			proxy_log(pc->ph, LOG_LEVEL_ERROR,
+				  "Failed to reuse UDP control port (5199). Dropping...\n");
+			goto proxy_conn_accept_exit;
+		}
+
+		discarded = ret;
+
+		ret = conn_drain(&priv->conn_data);
+		if (ret < 0) {
+			proxy_log(pc->ph, LOG_LEVEL_ERROR,
+				  "Failed to reuse UDP data port (5198). Dropping...\n");
+			goto proxy_conn_accept_exit;
+		}
+
+		discarded += ret;
+
+		if (discarded > 0)
+			proxy_log(pc->ph, LOG_LEVEL_DEBUG,
+				  "Discarded %d stale UDP messages before connecting client '%s'\n",
+				  discarded, priv->callsign);
+	} else {
+		ret = conn_listen(&priv->conn_control);
+		if (ret < 0) {
+			proxy_log(pc->ph, LOG_LEVEL_ERROR,
+				  "Failed to open UDP control port (5199). Dropping...\n");
+			goto proxy_conn_accept_exit;
+		}
+
+		ret = conn_listen(&priv->conn_data);
+		if (ret < 0) {
+			proxy_log(pc->ph, LOG_LEVEL_ERROR,
+				  "Failed to open UDP data port (5198). Dropping...\n");
+			goto proxy_conn_accept_exit;
+		}
 	}
 
-	ret = conn_listen(&priv->conn_data);
-	if (ret < 0) {
-		proxy_log(pc->ph, LOG_LEVEL_ERROR,
-			  "Failed to open UDP data port (5198). Dropping...\n");
-		goto proxy_conn_accept_exit;
+#ifdef HAVE_EPOLL
+	if (pc->event != NULL) {
+		ret = event_add(pc->event, &priv->source_control, EVENT_FLAG_IN);
+		if (ret < 0) {
+			proxy_log(pc->ph, LOG_LEVEL_ERROR,
+				  "Failed to monitor UDP control port. Dropping...\n");
+			goto proxy_conn_accept_exit;
+		}
+
+		ret = event_add(pc->event, &priv->source_data, EVENT_FLAG_IN);
+		if (ret < 0) {
+			proxy_log(pc->ph, LOG_LEVEL_ERROR,
+				  "Failed to monitor UDP data port. Dropping...\n");
+			goto proxy_conn_accept_exit;
+		}
+
+		/* The client is added last, since it may be finished immediately */
+		priv->source_client.conn = conn_client;
+		ret = event_add(pc->event, &priv->source_client, EVENT_FLAG_IN);
+		if (ret < 0) {
+			proxy_log(pc->ph, LOG_LEVEL_ERROR,
+				  "Failed to monitor client connection. Dropping...\n");
+			goto proxy_conn_accept_exit;
+		}
+
+		goto proxy_conn_accept_done;
+	}
+
+#endif
+	if (pc->ph->conf.zerocopy_threshold > 0) {
+		ret = conn_set_zerocopy(conn_client,
+					pc->ph->conf.zerocopy_threshold);
+		if (ret < 0)
+			proxy_log(pc->ph, LOG_LEVEL_DEBUG,
+				  "Data for client '%s' will be copied when sent (%d): %s\n",
+				  priv->callsign, -ret, strerror(-ret));
 	}
 
 	ret = worker_wake(&priv->worker_control);
@@ -748,6 +2867,9 @@ int proxy_conn_accept(struct proxy_conn_handle *pc,
 		goto proxy_conn_accept_exit;
 	}
 
+#ifdef HAVE_EPOLL
+proxy_conn_accept_done:
+#endif
 	proxy_log(pc->ph, LOG_LEVEL_INFO,
 		  "%s to client '%s', using external interface '%s'.\n",
 		  reconnect_only ? "Reconnected" : "Connected", priv->callsign,
@@ -767,7 +2889,10 @@ void proxy_conn_drop(struct proxy_conn_handle *pc)
 
 	mutex_lock_shared(&priv->mutex_client);
 
-	if (priv->conn_client != NULL)
+	/* The event loop must be the one to close the socket */
+	if (priv->conn_client != NULL && pc->event != NULL)
+		conn_shutdown(priv->conn_client);
+	else if (priv->conn_client != NULL)
 		conn_drop(priv->conn_client);
 
 	mutex_unlock_shared(&priv->mutex_client);
@@ -776,16 +2901,88 @@ void proxy_conn_drop(struct proxy_conn_handle *pc)
 void proxy_conn_finish(struct proxy_conn_handle *pc)
 {
 	struct proxy_conn_priv *priv = pc->priv;
+	struct buff_pool_stats pool_stats;
+	struct proxy_conn_stats stats;
+#ifdef HAVE_EPOLL
+	struct msg_queue_stats queue_stats;
+#endif
+
+#ifdef HAVE_EPOLL
+	if (pc->event != NULL) {
+		event_remove(pc->event, &priv->source_client);
+		event_remove(pc->event, &priv->source_control);
+		event_remove(pc->event, &priv->source_data);
 
+		stop_tcp_connection(pc);
+
+		close_udp(pc, &priv->conn_control);
+		close_udp(pc, &priv->conn_data);
+
+		priv->fifo_client.head = 0;
+		priv->fifo_client.len = 0;
+
+		msg_queue_get_stats(&priv->queue_data, &queue_stats);
+		msg_queue_pop(&priv->queue_data, queue_stats.depth);
+		priv->msg_len = 0;
+		priv->msg_remaining = 0;
+
+		goto proxy_conn_finish_release;
+	}
+
+#endif
 	proxy_conn_drop(pc);
 
-	conn_close(&priv->conn_control);
-	conn_close(&priv->conn_data);
+	/* The forwarders must still be woken if the UDP ports stay bound */
+	if (pc->ph->conf.persistent_udp && priv->conn_client != NULL) {
+		conn_interrupt(&priv->conn_control);
+		conn_interrupt(&priv->conn_data);
+	}
+
+	close_udp(pc, &priv->conn_control);
+	close_udp(pc, &priv->conn_data);
 	conn_close(&priv->conn_tcp);
 
 	worker_wait_idle(&priv->worker_tcp);
 	worker_wait_idle(&priv->worker_data);
 	worker_wait_idle(&priv->worker_control);
+	worker_wait_idle(&priv->worker_client);
+
+	atomic_store_u32(&priv->client_failed, 0);
+
+#ifdef HAVE_EPOLL
+proxy_conn_finish_release:
+#endif
+	/* Datagrams the client sent just before leaving are dropped */
+	clear_batch(pc, &priv->batch_control);
+	clear_batch(pc, &priv->batch_data);
+
+	if (priv->conn_client != NULL) {
+		proxy_conn_get_stats(pc, &stats);
+
+		proxy_log(pc->ph, LOG_LEVEL_DEBUG,
+			  "Client '%s' outbound queues peaked at %u messages (%u bytes) and %u UDP Data messages (%u bytes), %u UDP Data messages discarded\n",
+			  priv->callsign, stats.queue_depth_max,
+			  stats.queue_bytes_max, stats.data_depth_max,
+			  stats.data_bytes_max, stats.data_dropped);
+
+		if (stats.zerocopy_sends > 0)
+			proxy_log(pc->ph, LOG_LEVEL_DEBUG,
+				  "Client '%s' was sent %u bytes in %u writes without copying, %u of which the kernel copied anyway\n",
+				  priv->callsign, stats.zerocopy_bytes,
+				  stats.zerocopy_sends, stats.zerocopy_copied);
+
+		buff_pool_get_stats(pc->pool, &pool_stats);
+		proxy_log(pc->ph, LOG_LEVEL_DEBUG,
+			  "Packet buffer pool holds %u buffers, %u in use and at most %u in use at once\n",
+			  pool_stats.size, pool_stats.in_use,
+			  pool_stats.in_use_max);
+	}
+
+	priv->data_dropped = 0;
+	priv->fifo_client.len_max = 0;
+	msg_queue_reset_stats(&priv->queue_data);
+	if (priv->queue_client.priv != NULL)
+		msg_queue_reset_stats(&priv->queue_client);
 
 	mutex_lock(&priv->mutex_client);
 
@@ -804,14 +3001,27 @@ void proxy_conn_free(struct proxy_conn_handle *pc)
 		worker_free(&priv->worker_tcp);
 		worker_free(&priv->worker_data);
 		worker_free(&priv->worker_control);
+		worker_free(&priv->worker_client);
 
+		msg_queue_free(&priv->queue_data);
+		msg_queue_free(&priv->queue_client);
+
+		conn_pipe_free(&priv->pipe_tcp);
+
+		condvar_free(&priv->condvar_client_space);
+
+		mutex_free(&priv->mutex_data);
 		mutex_free(&priv->mutex_client);
-		mutex_free(&priv->mutex_client_send);
+		mutex_free(&priv->mutex_client_space);
 
 		conn_free(&priv->conn_tcp);
 		conn_free(&priv->conn_data);
 		conn_free(&priv->conn_control);
 
+		free(priv->fifo_tcp.buff);
+		free(priv->fifo_client.buff);
+		free(priv->rx_buff);
+
 		free(pc->priv);
 		pc->priv = NULL;
 	}
@@ -820,6 +3030,8 @@ void proxy_conn_free(struct proxy_conn_handle *pc)
 int proxy_conn_init(struct proxy_conn_handle *pc)
 {
 	struct proxy_conn_priv *priv = pc->priv;
+	unsigned int stack_size = pc->ph->conf.thread_stack_size * 1024;
+	uint32_t idle_timeout = pc->ph->conf.thread_idle_timeout * 1000;
 	int ret;
 
 	if (priv == NULL) {
@@ -830,8 +3042,12 @@ int proxy_conn_init(struct proxy_conn_handle *pc)
 		pc->priv = priv;
 	}
 
+	priv->pipe_tcp.fd_read = -1;
+	priv->pipe_tcp.fd_write = -1;
+
 	priv->conn_control.source_addr = pc->source_addr;
 	priv->conn_control.source_port = pc->control_port;
+	priv->conn_control.source = &pc->source;
 	priv->conn_control.type = CONN_TYPE_UDP;
 	ret = conn_init(&priv->conn_control);
 	if (ret != 0)
@@ -839,19 +3055,37 @@ int proxy_conn_init(struct proxy_conn_handle *pc)
 
 	priv->conn_data.source_addr = pc->source_addr;
 	priv->conn_data.source_port = pc->data_port;
+	priv->conn_data.source = &pc->source;
 	priv->conn_data.type = CONN_TYPE_UDP;
 	ret = conn_init(&priv->conn_data);
 	if (ret != 0)
 		goto proxy_conn_init_exit;
 
+	priv->batch_control.conn = &priv->conn_control;
+	priv->batch_control.port = 5199;
+	priv->batch_data.conn = &priv->conn_data;
+	priv->batch_data.port = 5198;
+
 	priv->conn_tcp.source_addr = pc->source_addr;
 	priv->conn_tcp.source_port = NULL;
+	priv->conn_tcp.source = &pc->source;
 	priv->conn_tcp.type = CONN_TYPE_TCP;
 	ret = conn_init(&priv->conn_tcp);
 	if (ret != 0)
 		goto proxy_conn_init_exit;
 
-	ret = mutex_init(&priv->mutex_client_send);
+	ret = mutex_init(&priv->mutex_client_space);
+	if (ret != 0)
+		goto proxy_conn_init_exit;
+
+	ret = condvar_init(&priv->condvar_client_space);
+	if (ret != 0)
+		goto proxy_conn_init_exit;
+
+	priv->queue_data.capacity = CONN_QUEUE_LEN;
+	priv->queue_data.msg_len = CONN_BUFF_LEN;
+	priv->queue_data.pool = pc->pool;
+	ret = msg_queue_init(&priv->queue_data);
 	if (ret != 0)
 		goto proxy_conn_init_exit;
 
@@ -859,45 +3093,200 @@ int proxy_conn_init(struct proxy_conn_handle *pc)
 	if (ret != 0)
 		goto proxy_conn_init_exit;
 
+	ret = mutex_init(&priv->mutex_data);
+	if (ret != 0)
+		goto proxy_conn_init_exit;
+
+	priv->rx_buff = malloc(CONN_RX_LEN);
+	if (priv->rx_buff == NULL) {
+		ret = -ENOMEM;
+		goto proxy_conn_init_exit;
+	}
+
+#ifdef HAVE_EPOLL
+	if (pc->event != NULL) {
+		priv->conn_control.nonblocking = 1;
+		priv->conn_data.nonblocking = 1;
+		priv->conn_tcp.nonblocking = 1;
+
+		/* The per-packet paths are offloaded where supported */
+		priv->source_client.func_ctx = pc;
+		priv->source_client.func_ptr = process_client_event;
+		priv->source_client.offload = 1;
+
+		priv->source_control.conn = &priv->conn_control;
+		priv->source_control.func_ctx = pc;
+		priv->source_control.func_ptr = process_udp_event;
+		priv->source_control.offload = 1;
+
+		priv->source_data.conn = &priv->conn_data;
+		priv->source_data.func_ctx = pc;
+		priv->source_data.func_ptr = process_udp_event;
+		priv->source_data.offload = 1;
+
+		priv->source_tcp.conn = &priv->conn_tcp;
+		priv->source_tcp.func_ctx = pc;
+		priv->source_tcp.func_ptr = process_tcp_event;
+
+		priv->fifo_client.size = EVENT_FIFO_CLIENT_LEN;
+		priv->fifo_client.buff = malloc(priv->fifo_client.size);
+		if (priv->fifo_client.buff == NULL) {
+			ret = -ENOMEM;
+			goto proxy_conn_init_exit;
+		}
+
+		priv->fifo_tcp.size = EVENT_FIFO_TCP_LEN;
+		priv->fifo_tcp.buff = malloc(priv->fifo_tcp.size);
+		if (priv->fifo_tcp.buff == NULL) {
+			ret = -ENOMEM;
+			goto proxy_conn_init_exit;
+		}
+
+		/* Offloading a client must not allocate once it is accepted */
+		ret = event_reserve(pc->event, CONN_TYPE_TCP, 1);
+		if (ret != 0)
+			goto proxy_conn_init_exit;
+
+		ret = event_reserve(pc->event, CONN_TYPE_UDP, 2);
+		if (ret != 0)
+			goto proxy_conn_init_exit;
+
+		goto proxy_conn_init_bind;
+	}
+
+#endif
+	priv->queue_client.capacity = CONN_QUEUE_LEN;
+	priv->queue_client.msg_len = CONN_BUFF_LEN;
+	priv->queue_client.pool = pc->pool;
+	ret = msg_queue_init(&priv->queue_client);
+	if (ret != 0)
+		goto proxy_conn_init_exit;
+
+	/* TCP data is copied through this process if this isn't supported */
+	conn_pipe_init(&priv->pipe_tcp);
+
+	priv->worker_client.func_ctx = pc;
+	priv->worker_client.func_ptr = forwarder_client;
+	priv->worker_client.stack_size = stack_size;
+	priv->worker_client.idle_timeout = idle_timeout;
+	ret = worker_init(&priv->worker_client);
+	if (ret != 0)
+		goto proxy_conn_init_exit;
+
 	priv->worker_control.func_ctx = pc;
 	priv->worker_control.func_ptr = forwarder_control;
-	priv->worker_control.stack_size = 1024 * 1024;
+	priv->worker_control.stack_size = stack_size;
+	priv->worker_control.idle_timeout = idle_timeout;
 	ret = worker_init(&priv->worker_control);
 	if (ret != 0)
 		goto proxy_conn_init_exit;
 
 	priv->worker_data.func_ctx = pc;
 	priv->worker_data.func_ptr = forwarder_data;
-	priv->worker_data.stack_size = 1024 * 1024;
+	priv->worker_data.stack_size = stack_size;
+	priv->worker_data.idle_timeout = idle_timeout;
 	ret = worker_init(&priv->worker_data);
 	if (ret != 0)
 		goto proxy_conn_init_exit;
 
 	priv->worker_tcp.func_ctx = pc;
 	priv->worker_tcp.func_ptr = forwarder_tcp;
-	priv->worker_tcp.stack_size = 1024 * 1024;
+	priv->worker_tcp.stack_size = stack_size;
+	priv->worker_tcp.idle_timeout = idle_timeout;
 	ret = worker_init(&priv->worker_tcp);
 	if (ret != 0)
 		goto proxy_conn_init_exit;
 
+#ifdef HAVE_EPOLL
+proxy_conn_init_bind:
+#endif
+	/* These stay bound until the connection is freed */
+	if (pc->ph->conf.persistent_udp) {
+		ret = conn_listen(&priv->conn_control);
+		if (ret < 0) {
+			proxy_log(pc->ph, LOG_LEVEL_ERROR,
+				  "Failed to open UDP control port (5199)\n");
+			goto proxy_conn_init_exit;
+		}
+
+		ret = conn_listen(&priv->conn_data);
+		if (ret < 0) {
+			proxy_log(pc->ph, LOG_LEVEL_ERROR,
+				  "Failed to open UDP data port (5198)\n");
+			goto proxy_conn_init_exit;
+		}
+	}
+
 	return 0;
 
 proxy_conn_init_exit:
 	worker_free(&priv->worker_tcp);
 	worker_free(&priv->worker_data);
 	worker_free(&priv->worker_control);
+	worker_free(&priv->worker_client);
 
+	msg_queue_free(&priv->queue_data);
+	msg_queue_free(&priv->queue_client);
+
+	conn_pipe_free(&priv->pipe_tcp);
+
+	condvar_free(&priv->condvar_client_space);
+
+	mutex_free(&priv->mutex_data);
 	mutex_free(&priv->mutex_client);
-	mutex_free(&priv->mutex_client_send);
+	mutex_free(&priv->mutex_client_space);
 
 	conn_free(&priv->conn_tcp);
 	conn_free(&priv->conn_data);
 	conn_free(&priv->conn_control);
 
+	free(priv->fifo_tcp.buff);
+	free(priv->fifo_client.buff);
+	free(priv->rx_buff);
+
 	free(pc->priv);
 	pc->priv = NULL;
 
-	return 0;
+	return ret;
+}
+
+void proxy_conn_get_stats(struct proxy_conn_handle *pc,
+			  struct proxy_conn_stats *stats)
+{
+	struct proxy_conn_priv *priv = pc->priv;
+	struct conn_zerocopy_stats zerocopy_stats;
+	struct msg_queue_stats queue_stats;
+
+	memset(&zerocopy_stats, 0x0, sizeof(zerocopy_stats));
+	if (priv->conn_client != NULL)
+		conn_get_zerocopy_stats(priv->conn_client, &zerocopy_stats);
+
+	stats->zerocopy_sends = zerocopy_stats.sends;
+	stats->zerocopy_bytes = zerocopy_stats.bytes;
+	stats->zerocopy_copied = zerocopy_stats.copied;
+
+	msg_queue_get_stats(&priv->queue_data, &queue_stats);
+
+	stats->data_depth = queue_stats.depth;
+	stats->data_depth_max = queue_stats.depth_max;
+	stats->data_bytes = queue_stats.bytes;
+	stats->data_bytes_max = queue_stats.bytes_max;
+	stats->data_dropped = atomic_load_u32(&priv->data_dropped);
+
+	if (priv->queue_client.priv == NULL) {
+		stats->queue_depth = 0;
+		stats->queue_depth_max = 0;
+		stats->queue_bytes = (uint32_t)priv->fifo_client.len;
+		stats->queue_bytes_max = (uint32_t)priv->fifo_client.len_max;
+		return;
+	}
+
+	msg_queue_get_stats(&priv->queue_client, &queue_stats);
+
+	stats->queue_depth = queue_stats.depth;
+	stats->queue_depth_max = queue_stats.depth_max;
+	stats->queue_bytes = queue_stats.bytes;
+	stats->queue_bytes_max = queue_stats.bytes_max;
 }
 
 int proxy_conn_in_use(struct proxy_conn_handle *pc)
@@ -918,9 +3307,11 @@ int proxy_conn_in_use(struct proxy_conn_handle *pc)
 int proxy_conn_process(struct proxy_conn_handle *pc)
 {
 	struct proxy_conn_priv *priv = pc->priv;
+	const uint8_t *data;
+	struct proxy_msg msg;
 	int ret;
 
-	ret = conn_recv(priv->conn_client, priv->buff, sizeof(struct proxy_msg));
+	ret = read_client_buff(pc, &data, sizeof(msg));
 	if (ret < 0) {
 		switch (ret) {
 		case -ECONNRESET:
@@ -938,7 +3329,9 @@ int proxy_conn_process(struct proxy_conn_handle *pc)
 		return ret;
 	}
 
-	return process_message(pc, (struct proxy_msg *)priv->buff);
+	memcpy(&msg, data, sizeof(msg));
+
+	return process_message(pc, &msg);
 }
 
 int proxy_conn_start(struct proxy_conn_handle *pc)
@@ -946,8 +3339,15 @@ int proxy_conn_start(struct proxy_conn_handle *pc)
 	struct proxy_conn_priv *priv = pc->priv;
 	int ret;
 
+	if (pc->event != NULL)
+		return 0;
+
 	mutex_lock_shared(&priv->mutex_client);
 
+	ret = worker_start(&priv->worker_client);
+	if (ret < 0)
+		goto proxy_conn_start_exit;
+
 	ret = worker_start(&priv->worker_control);
 	if (ret < 0)
 		goto proxy_conn_start_exit;
@@ -974,6 +3374,9 @@ int proxy_conn_stop(struct proxy_conn_handle *pc)
 
 	proxy_conn_finish(pc);
 
+	if (pc->event != NULL)
+		return 0;
+
 	ret = worker_join(&priv->worker_tcp);
 	if (ret < 0)
 		final_ret = ret;
@@ -986,5 +3389,9 @@ int proxy_conn_stop(struct proxy_conn_handle *pc)
 	if (ret < 0)
 		final_ret = ret;
 
+	ret = worker_join(&priv->worker_client);
+	if (ret < 0)
+		final_ret = ret;
+
 	return final_ret;
 }
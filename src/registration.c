@@ -44,13 +44,21 @@
  * @brief Implementation of proxy server registration
  */
 
+#include <ctype.h>
 #include <errno.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
+#ifdef _WIN32
+#  include <windows.h>
+#else
+#  include <time.h>
+#endif
+
 #include "openelp/openelp.h"
 #include "digest.h"
+#include "alloc_guard.h"
 #include "conn.h"
 #include "mutex.h"
 #include "registration.h"
@@ -65,6 +73,15 @@
 /*! Update (at least) every 10 minutes */
 #define UPDATE_INTERVAL 600000
 
+/*! Size of the buffer for responses from the registrar */
+#define HTTP_RESPONSE_LEN 512
+
+/*! Milliseconds to wait for the registrar to respond */
+#define HTTP_TIMEOUT 10000
+
+/*! Seconds to use the registrar's address before resolving it again */
+#define RESOLVE_TTL 300
+
 /*!
  * @brief Possible statuses of a proxy server to report to registrar
  */
@@ -88,10 +105,42 @@ struct registration_service_priv {
 	/*! Pre-computed static portion of the update body */
 	char *reg_suffix;
 
+	/*! Buffer large enough for any update body, allocated up front */
+	char *message_body;
+
+	/*! Connection to the registrar, reused for each update */
+	struct conn_handle conn;
+
+	/*! Cache of the registrar's address, used by
+	 *  registration_service_priv::conn */
+	struct conn_resolver resolver;
+
+	/*! Handle to the worker thread which resolves the registrar's address
+	 *  before it expires from registration_service_priv::resolver */
+	struct worker_handle refresher;
+
+	/*! Non-zero while registration_service_priv::conn is open and in sync,
+	 *  so that it can be used for the next update */
+	int connected;
+
+	/*! Buffer for responses from the registrar */
+	char response[HTTP_RESPONSE_LEN];
+
+	/*! Offset of the first unread byte in
+	 *  registration_service_priv::response */
+	size_t response_head;
+
+	/*! Number of unread bytes in registration_service_priv::response */
+	size_t response_len;
+
 	/*! 'Y' to list the server for public access, otherwise 'N' */
 	char public;
 
-	/*! Mutex for protecting the status and slot members */
+	/*! Signaled when the service is stopping, which ends a held report */
+	struct condvar_handle condvar;
+
+	/*! Mutex for protecting the status, slot, report and statistics
+	 *  members */
 	struct mutex_handle mutex;
 
 	/*! Handle to the worker thread which services update requests */
@@ -105,6 +154,31 @@ struct registration_service_priv {
 
 	/*! Server status to report on the next update */
 	enum REGISTRATION_STATUS status;
+
+	/*! Minimum milliseconds between reports, except for the final one */
+	uint32_t hold_time;
+
+	/*! Maximum milliseconds between reports */
+	uint32_t heartbeat;
+
+	/*! Number of updates which have not been reported yet */
+	uint32_t pending;
+
+	/*! Server status sent in the last successful report, or
+	 *  ::REGISTRATION_STATUS_UNKNOWN if there hasn't been one */
+	enum REGISTRATION_STATUS reported_status;
+
+	/*! Number of connected clients sent in the last successful report */
+	size_t reported_slots_used;
+
+	/*! Maximum number of clients sent in the last successful report */
+	size_t reported_slots_total;
+
+	/*! Time of the last successful report, from ::registration_time */
+	uint32_t reported_time;
+
+	/*! Reports sent and updates suppressed so far */
+	struct registration_service_stats stats;
 };
 
 /*! First part of the HTTP message sent to the registrar */
@@ -140,6 +214,91 @@ static const char * const status_phrase[] = {
 	"Off",
 };
 
+/*!
+ * @brief Compares two strings without regard to case
+ *
+ * @param[in] a First string
+ * @param[in] b Second string
+ * @param[in] len Maximum number of characters to compare
+ *
+ * @returns 0 if the strings match, non-zero otherwise
+ */
+static int http_casecmp(const char *a, const char *b, size_t len);
+
+/*!
+ * @brief Discards data in the body of a response from the registrar
+ *
+ * @param[in,out] priv Private data of the target registration service
+ * @param[in] len Number of bytes to discard
+ *
+ * @returns 0 on success, negative ERRNO value on failure
+ */
+static int http_discard(struct registration_service_priv *priv, size_t len);
+
+/*!
+ * @brief Reads more of a response from the registrar into the buffer
+ *
+ * @param[in,out] priv Private data of the target registration service
+ *
+ * @returns Number of bytes read on success, negative ERRNO value on failure
+ */
+static int http_fill(struct registration_service_priv *priv);
+
+/*!
+ * @brief Gets the value of a header line if it has a given name
+ *
+ * @param[in] line Header line, without the line ending
+ * @param[in] name Name of the header, which is not case sensitive
+ *
+ * @returns Value of the header, or NULL if the name does not match
+ */
+static const char *http_header_value(const char *line, const char *name);
+
+/*!
+ * @brief Reads a line of a response from the registrar
+ *
+ * @param[in,out] priv Private data of the target registration service
+ * @param[out] line Terminated line without the line ending, which is valid
+ *                  until the next read
+ *
+ * @returns Length of the line on success, negative ERRNO value on failure
+ */
+static int http_recv_line(struct registration_service_priv *priv,
+			  char **line);
+
+/*!
+ * @brief Reads an entire response from the registrar
+ *
+ * @param[in,out] priv Private data of the target registration service
+ * @param[out] keep_alive Set to non-zero if the connection may be reused
+ *
+ * @returns HTTP status code on success, negative ERRNO value on failure
+ *
+ * The body of the response is discarded, leaving the connection ready for
+ * another request.
+ */
+static int http_recv_response(struct registration_service_priv *priv,
+			      int *keep_alive);
+
+/*!
+ * @brief Sends a request to the registrar and reads the response
+ *
+ * @param[in,out] rs Target registration service instance
+ * @param[in] header Header of the request
+ * @param[in] header_len Number of bytes in header
+ * @param[in] body Body of the request
+ * @param[in] body_len Number of bytes in body
+ *
+ * @returns HTTP status code on success, negative ERRNO value on failure
+ *
+ * The connection to the registrar is made if it isn't already open, and is
+ * left open afterward unless the registrar asked for it to be closed or it
+ * failed.
+ */
+static int http_request(struct registration_service_handle *rs,
+			const char *header, size_t header_len,
+			const char *body, size_t body_len);
+
 /*!
  * @brief Worker function for registration updates
  *
@@ -147,6 +306,20 @@ static const char * const status_phrase[] = {
  */
 static void registration_func(struct worker_handle *wh);
 
+/*!
+ * @brief Worker function which keeps the registrar's address resolved
+ *
+ * @param[in,out] wh The handle to the worker object
+ */
+static void registration_refresh_func(struct worker_handle *wh);
+
+/*!
+ * @brief Gets a monotonic time stamp
+ *
+ * @returns Time stamp in milliseconds, which wraps around
+ */
+static uint32_t registration_time(void);
+
 /*!
  * @brief Reports status to the registrar
  *
@@ -161,24 +334,279 @@ static int send_report(struct registration_service_handle *rs,
 		       enum REGISTRATION_STATUS status, size_t slots_used,
 		       size_t slots_total);
 
+static int http_casecmp(const char *a, const char *b, size_t len)
+{
+	for (; len > 0; len--, a++, b++) {
+		if (tolower((unsigned char)*a) != tolower((unsigned char)*b))
+			return 1;
+		if (*a == '\0')
+			break;
+	}
+
+	return 0;
+}
+
+static int http_discard(struct registration_service_priv *priv, size_t len)
+{
+	size_t chunk;
+	int ret;
+
+	while (len > 0) {
+		if (priv->response_len == 0) {
+			ret = http_fill(priv);
+			if (ret < 0)
+				return ret;
+		}
+
+		chunk = priv->response_len < len ? priv->response_len : len;
+		priv->response_head += chunk;
+		priv->response_len -= chunk;
+		len -= chunk;
+	}
+
+	return 0;
+}
+
+static int http_fill(struct registration_service_priv *priv)
+{
+	size_t tail;
+	int ret;
+
+	if (priv->response_len == 0) {
+		priv->response_head = 0;
+	} else if (priv->response_head > 0) {
+		memmove(priv->response, &priv->response[priv->response_head],
+			priv->response_len);
+		priv->response_head = 0;
+	}
+
+	/* Leave room to terminate a line */
+	tail = sizeof(priv->response) - 1 - priv->response_len;
+	if (tail == 0)
+		return -ENOSPC;
+
+	ret = conn_recv_any(&priv->conn,
+			    (uint8_t *)&priv->response[priv->response_len],
+			    tail, NULL, NULL);
+	if (ret < 0)
+		return ret;
+
+	priv->response_len += ret;
+
+	return ret;
+}
+
+static const char *http_header_value(const char *line, const char *name)
+{
+	size_t name_len = strlen(name);
+
+	if (http_casecmp(line, name, name_len) != 0 || line[name_len] != ':')
+		return NULL;
+
+	for (line += name_len + 1; *line == ' ' || *line == '\t'; line++)
+		;
+
+	return line;
+}
+
+static int http_recv_line(struct registration_service_priv *priv,
+			  char **line)
+{
+	char *start;
+	char *end;
+	size_t scanned = 0;
+	int ret;
+
+	for (;;) {
+		start = &priv->response[priv->response_head];
+
+		for (; scanned + 1 < priv->response_len; scanned++) {
+			if (start[scanned] == '\r' && start[scanned + 1] == '\n')
+				break;
+		}
+
+		if (scanned + 1 < priv->response_len)
+			break;
+
+		ret = http_fill(priv);
+		if (ret < 0)
+			return ret;
+	}
+
+	end = &start[scanned];
+	*end = '\0';
+	*line = start;
+
+	priv->response_head += scanned + 2;
+	priv->response_len -= scanned + 2;
+
+	return (int)scanned;
+}
+
+static int http_recv_response(struct registration_service_priv *priv,
+			      int *keep_alive)
+{
+	const char *value;
+	char *line;
+	unsigned long content_length = 0;
+	unsigned long chunk_length;
+	int has_length;
+	int chunked;
+	int major;
+	int minor;
+	int status;
+	int ret;
+
+	/* Informational responses are followed by the real one */
+	do {
+		ret = http_recv_line(priv, &line);
+		if (ret < 0)
+			return ret;
+
+		if (sscanf(line, "HTTP/%d.%d %d", &major, &minor, &status) != 3)
+			return -EBADMSG;
+
+		*keep_alive = major > 1 || (major == 1 && minor >= 1);
+		has_length = 0;
+		chunked = 0;
+
+		for (;;) {
+			ret = http_recv_line(priv, &line);
+			if (ret < 0)
+				return ret;
+			else if (ret == 0)
+				break;
+
+			value = http_header_value(line, "Content-Length");
+			if (value != NULL) {
+				content_length = strtoul(value, NULL, 10);
+				has_length = 1;
+				continue;
+			}
+
+			value = http_header_value(line, "Transfer-Encoding");
+			if (value != NULL) {
+				chunked = http_casecmp(value, "chunked", 8) == 0;
+				continue;
+			}
+
+			value = http_header_value(line, "Connection");
+			if (value != NULL) {
+				if (http_casecmp(value, "close", 6) == 0)
+					*keep_alive = 0;
+				else if (http_casecmp(value, "keep-alive", 11) == 0)
+					*keep_alive = 1;
+			}
+		}
+	} while (status >= 100 && status < 200);
+
+	if (status == 204 || status == 304)
+		return status;
+
+	if (chunked) {
+		for (;;) {
+			ret = http_recv_line(priv, &line);
+			if (ret < 0)
+				return ret;
+
+			chunk_length = strtoul(line, NULL, 16);
+			if (chunk_length == 0)
+				break;
+
+			ret = http_discard(priv, chunk_length);
+			if (ret < 0)
+				return ret;
+
+			ret = http_recv_line(priv, &line);
+			if (ret < 0)
+				return ret;
+		}
+
+		/* Skip any trailers */
+		do {
+			ret = http_recv_line(priv, &line);
+			if (ret < 0)
+				return ret;
+		} while (ret > 0);
+	} else if (has_length) {
+		ret = http_discard(priv, content_length);
+		if (ret < 0)
+			return ret;
+	} else {
+		/* The body ends when the registrar closes the connection */
+		do {
+			priv->response_len = 0;
+			ret = http_fill(priv);
+		} while (ret > 0);
+
+		if (ret != -EPIPE)
+			return ret;
+
+		*keep_alive = 0;
+	}
+
+	return status;
+}
+
+static int http_request(struct registration_service_handle *rs,
+			const char *header, size_t header_len,
+			const char *body, size_t body_len)
+{
+	struct registration_service_priv *priv = rs->priv;
+	int keep_alive = 0;
+	int ret;
+
+	if (!priv->connected) {
+		ret = conn_connect(&priv->conn,
+				   rs->host == NULL ? http_host : rs->host,
+				   rs->port == NULL ? "80" : rs->port);
+		if (ret < 0)
+			goto http_request_exit;
+
+		ret = conn_set_timeout(&priv->conn, HTTP_TIMEOUT);
+		if (ret < 0)
+			goto http_request_exit;
+
+		priv->connected = 1;
+		priv->response_head = 0;
+		priv->response_len = 0;
+	}
+
+	ret = conn_send(&priv->conn, (const uint8_t *)header, header_len);
+	if (ret < 0)
+		goto http_request_exit;
+
+	ret = conn_send(&priv->conn, (const uint8_t *)body, body_len);
+	if (ret < 0)
+		goto http_request_exit;
+
+	ret = http_recv_response(priv, &keep_alive);
+
+http_request_exit:
+	if (ret < 0 || !keep_alive) {
+		conn_close(&priv->conn);
+		priv->connected = 0;
+	}
+
+	return ret;
+}
+
 static int send_report(struct registration_service_handle *rs,
 		       enum REGISTRATION_STATUS status, size_t slots_used,
 		       size_t slots_total)
 {
 	struct registration_service_priv *priv = rs->priv;
-	struct conn_handle conn;
 	int ret = 0;
 	int header_length;
 	int body_length = 0;
 	char message_header[sizeof(http_message) + 14];
-	char *message_body = NULL;
+	char *message_body = priv->message_body;
 	const char *status_str = status_phrase[status];
+	int reused;
 
 	if (status_str == NULL)
 		return -EINVAL;
 
-	memset(&conn, 0x0, sizeof(conn));
-
 	/* printf("Updating registration (%s %s, %lu/%lu)\n",
 	 *	 priv->reg_name, status_str,
 	 *	 (unsigned long)slots_used, (unsigned long)slots_total);
@@ -186,12 +614,7 @@ static int send_report(struct registration_service_handle *rs,
 
 	/*! @TODO URL encoding */
 
-	/* Allocate a buffer we *know* will be big enough for the body */
-	message_body = malloc(strlen(priv->reg_name) +
-			      strlen(priv->reg_comment) +
-			      strlen(priv->reg_suffix) + 80);
-	if (message_body == NULL)
-		return -ENOMEM;
+	alloc_guard_enter();
 
 	if (slots_total == 1)
 		body_length = sprintf(
@@ -218,34 +641,26 @@ static int send_report(struct registration_service_handle *rs,
 		goto registration_update_exit;
 	}
 
-	conn.type = CONN_TYPE_TCP;
-	ret = conn_init(&conn);
-	if (ret < 0)
-		goto registration_update_exit;
-
-	ret = conn_connect(&conn, http_host, "80");
-	if (ret < 0)
-		goto registration_update_exit;
-
-	ret = conn_send(&conn, (uint8_t *)message_header, header_length);
-	if (ret < 0)
-		goto registration_update_exit;
+	alloc_guard_leave();
 
-	ret = conn_send(&conn, (uint8_t *)message_body, body_length);
-	if (ret < 0)
-		goto registration_update_exit;
-
-	ret = conn_recv(&conn, (uint8_t *)message_body, 13);
-	if (ret < 0)
-		goto registration_update_exit;
+	/* The registrar may have closed an idle connection since the last
+	 * update, which is only discovered by using it
+	 */
+	do {
+		reused = priv->connected;
+		ret = http_request(rs, message_header, header_length,
+				   message_body, body_length);
+	} while (ret < 0 && reused);
 
-	if (strncmp(message_body, "HTTP/1.1 200 ", 13) != 0)
+	if (ret >= 0 && ret != 200)
 		ret = -EINVAL;
+	else if (ret > 0)
+		ret = 0;
 
-registration_update_exit:
-	conn_free(&conn);
+	return ret;
 
-	free(message_body);
+registration_update_exit:
+	alloc_guard_leave();
 
 	return ret;
 }
@@ -257,9 +672,14 @@ void registration_service_free(struct registration_service_handle *rs)
 
 		registration_service_stop(rs);
 
+		worker_free(&priv->refresher);
 		worker_free(&priv->worker);
+		conn_free(&priv->conn);
+		conn_resolver_free(&priv->resolver);
+		condvar_free(&priv->condvar);
 		mutex_free(&priv->mutex);
 
+		free(priv->message_body);
 		free((void *)priv->reg_suffix);
 
 		free(rs->priv);
@@ -284,21 +704,48 @@ int registration_service_init(struct registration_service_handle *rs)
 	if (ret != 0)
 		goto registration_service_init_exit;
 
+	ret = condvar_init(&priv->condvar);
+	if (ret != 0)
+		goto registration_service_init_exit;
+
+	priv->resolver.ttl = RESOLVE_TTL;
+	ret = conn_resolver_init(&priv->resolver);
+	if (ret != 0)
+		goto registration_service_init_exit;
+
+	priv->conn.resolver = &priv->resolver;
+	priv->conn.type = CONN_TYPE_TCP;
+	ret = conn_init(&priv->conn);
+	if (ret != 0)
+		goto registration_service_init_exit;
+
 	priv->worker.func_ctx = rs;
 	priv->worker.func_ptr = registration_func;
-	priv->worker.periodic_wake = UPDATE_INTERVAL;
-	priv->worker.stack_size = 1024 * 1024;
+	priv->heartbeat = rs->heartbeat != 0 ? rs->heartbeat : UPDATE_INTERVAL;
+
+	priv->worker.periodic_wake = priv->heartbeat;
 	ret = worker_init(&priv->worker);
 	if (ret != 0)
 		goto registration_service_init_exit;
 
+	priv->refresher.func_ctx = rs;
+	priv->refresher.func_ptr = registration_refresh_func;
+	priv->refresher.periodic_wake = RESOLVE_TTL * 1000 / 2;
+	ret = worker_init(&priv->refresher);
+	if (ret != 0)
+		goto registration_service_init_exit;
+
 	if (priv->status == REGISTRATION_STATUS_OFF)
 		priv->status = REGISTRATION_STATUS_UNKNOWN;
 
 	return 0;
 
 registration_service_init_exit:
+	worker_free(&priv->refresher);
 	worker_free(&priv->worker);
+	conn_free(&priv->conn);
+	conn_resolver_free(&priv->resolver);
+	condvar_free(&priv->condvar);
 	mutex_free(&priv->mutex);
 
 	free(rs->priv);
@@ -307,6 +754,16 @@ registration_service_init_exit:
 	return ret;
 }
 
+void registration_service_get_stats(struct registration_service_handle *rs,
+				    struct registration_service_stats *stats)
+{
+	struct registration_service_priv *priv = rs->priv;
+
+	mutex_lock(&priv->mutex);
+	*stats = priv->stats;
+	mutex_unlock(&priv->mutex);
+}
+
 int registration_service_start(struct registration_service_handle *rs,
 			       const struct proxy_conf *conf)
 {
@@ -327,8 +784,8 @@ int registration_service_start(struct registration_service_handle *rs,
 	priv->reg_name = conf->reg_name;
 	priv->reg_comment = conf->reg_comment;
 
-	if (priv->reg_suffix != NULL)
-		free((void *)priv->reg_suffix);
+	free((void *)priv->reg_suffix);
+	priv->reg_suffix = NULL;
 	reg_suffix = malloc(strlen(public_addr) + (2 * DIGEST_LEN) +
 			    sizeof(protocol_version) + 18);
 	if (reg_suffix == NULL) {
@@ -357,6 +814,19 @@ int registration_service_start(struct registration_service_handle *rs,
 	priv->reg_suffix = reg_suffix;
 	reg_suffix = NULL;
 
+	/* Allocate a buffer we *know* will be big enough for the body */
+	free(priv->message_body);
+	priv->message_body = malloc(strlen(priv->reg_name) +
+				    strlen(priv->reg_comment) +
+				    strlen(priv->reg_suffix) + 80);
+	if (priv->message_body == NULL) {
+		ret = -ENOMEM;
+		goto registration_service_start_end;
+	}
+
+	priv->hold_time = conf->reg_interval * 1000;
+
+	priv->worker.stack_size = conf->thread_stack_size * 1024;
 	ret = worker_start(&priv->worker);
 	if (ret < 0)
 		goto registration_service_start_end;
@@ -365,8 +835,20 @@ int registration_service_start(struct registration_service_handle *rs,
 	if (ret < 0)
 		goto registration_service_start_end;
 
-	if (priv->status == REGISTRATION_STATUS_OFF)
+	priv->refresher.stack_size = priv->worker.stack_size;
+	ret = worker_start(&priv->refresher);
+	if (ret < 0)
+		goto registration_service_start_end;
+
+	ret = worker_wake(&priv->refresher);
+	if (ret < 0)
+		goto registration_service_start_end;
+
+	/* A restarted service reports again as soon as it can */
+	if (priv->status == REGISTRATION_STATUS_OFF) {
 		priv->status = REGISTRATION_STATUS_UNKNOWN;
+		priv->reported_status = REGISTRATION_STATUS_UNKNOWN;
+	}
 
 registration_service_start_end:
 	mutex_unlock(&priv->mutex);
@@ -379,13 +861,22 @@ registration_service_start_end:
 int registration_service_stop(struct registration_service_handle *rs)
 {
 	struct registration_service_priv *priv = rs->priv;
+	int ret;
 
 	mutex_lock(&priv->mutex);
 	priv->status = REGISTRATION_STATUS_OFF;
+	condvar_wake_all(&priv->condvar);
 	worker_wake(&priv->worker);
 	mutex_unlock(&priv->mutex);
 
-	return worker_join(&priv->worker);
+	ret = worker_join(&priv->worker);
+
+	worker_join(&priv->refresher);
+
+	conn_close(&priv->conn);
+	priv->connected = 0;
+
+	return ret;
 }
 
 void registration_service_update(struct registration_service_handle *rs,
@@ -393,13 +884,23 @@ void registration_service_update(struct registration_service_handle *rs,
 {
 	struct registration_service_priv *priv = rs->priv;
 
+	enum REGISTRATION_STATUS status = slots_used >= slots_total ?
+					  REGISTRATION_STATUS_BUSY :
+					  REGISTRATION_STATUS_READY;
+
 	mutex_lock(&priv->mutex);
-	if (priv->status < REGISTRATION_STATUS_OFF) {
-		priv->status = slots_used >= slots_total ?
-			       REGISTRATION_STATUS_BUSY :
-			       REGISTRATION_STATUS_READY;
+	if (priv->status >= REGISTRATION_STATUS_OFF) {
+		/* Shutting down */
+	} else if (priv->status == status && priv->slots_used == slots_used &&
+		   priv->slots_total == slots_total) {
+		/* Already queued or reported */
+		priv->stats.suppressed++;
+	} else {
+		priv->status = status;
 		priv->slots_used = slots_used;
 		priv->slots_total = slots_total;
+		priv->pending++;
+		condvar_wake_all(&priv->condvar);
 		worker_wake(&priv->worker);
 	}
 	mutex_unlock(&priv->mutex);
@@ -414,22 +915,95 @@ static void registration_func(struct worker_handle *wh)
 	size_t slots_total;
 	size_t slots_used;
 	enum REGISTRATION_STATUS status;
+	uint32_t elapsed;
 
 	mutex_lock(&priv->mutex);
 
-	slots_total = priv->slots_total;
-	slots_used = priv->slots_used;
-	status = priv->status;
+	for (;;) {
+		slots_total = priv->slots_total;
+		slots_used = priv->slots_used;
+		status = priv->status;
 
-	mutex_unlock(&priv->mutex);
+		/* The final report may already have been sent by a run
+		 * which was waiting when the service was stopped
+		 */
+		if (status <= REGISTRATION_STATUS_UNKNOWN ||
+		    (status == REGISTRATION_STATUS_OFF &&
+		     priv->reported_status == REGISTRATION_STATUS_OFF)) {
+			mutex_unlock(&priv->mutex);
+			return;
+		}
+
+		/* Nothing holds back the first, final or periodic report */
+		elapsed = registration_time() - priv->reported_time;
+		if (status == REGISTRATION_STATUS_OFF ||
+		    priv->reported_status == REGISTRATION_STATUS_UNKNOWN ||
+		    elapsed >= priv->heartbeat)
+			break;
+
+		/* Waking the worker restarted its periodic wake, so the
+		 * periodic report is waited for here instead
+		 */
+		if (status == priv->reported_status &&
+		    slots_used == priv->reported_slots_used &&
+		    slots_total == priv->reported_slots_total) {
+			priv->stats.suppressed += priv->pending;
+			priv->pending = 0;
+			condvar_wait_time(&priv->condvar, &priv->mutex,
+					  priv->heartbeat - elapsed);
+			continue;
+		}
+
+		if (elapsed >= priv->hold_time)
+			break;
+
+		/* Changes made while the report is held are sent with it */
+		condvar_wait_time(&priv->condvar, &priv->mutex,
+				  priv->hold_time - elapsed);
+	}
+
+	if (priv->pending > 1)
+		priv->stats.suppressed += priv->pending - 1;
+	priv->pending = 0;
 
-	if (status <= REGISTRATION_STATUS_UNKNOWN)
-		return;
+	mutex_unlock(&priv->mutex);
 
 	ret = send_report(rs, status, slots_used, slots_total);
+
+	mutex_lock(&priv->mutex);
+
 	if (ret < 0) {
-		/* printf("Proxy registration failed (%d): %s\n",
-		 *	  -ret, strerror(-ret));
-		 */
+		priv->stats.failed++;
+	} else {
+		priv->stats.sent++;
+		priv->reported_status = status;
+		priv->reported_slots_used = slots_used;
+		priv->reported_slots_total = slots_total;
+		priv->reported_time = registration_time();
 	}
+
+	mutex_unlock(&priv->mutex);
+}
+
+static void registration_refresh_func(struct worker_handle *wh)
+{
+	struct registration_service_handle *rs = wh->func_ctx;
+	struct registration_service_priv *priv = rs->priv;
+
+	conn_resolver_prefetch(&priv->resolver,
+			       rs->host == NULL ? http_host : rs->host, 0);
+	conn_resolver_refresh(&priv->resolver);
+}
+
+static uint32_t registration_time(void)
+{
+#ifdef _WIN32
+	return (uint32_t)GetTickCount();
+#else
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	return (uint32_t)now.tv_sec * 1000 + (uint32_t)(now.tv_nsec / 1000000);
+#endif
 }
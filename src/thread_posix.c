@@ -44,11 +44,21 @@
  * @brief Threading implementation for POSIX machines
  */
 
+#ifdef __linux__
+/* Required for pthread_setaffinity_np */
+#  define _GNU_SOURCE
+#endif
+
 #include <errno.h>
+#include <limits.h>
 #include <stdlib.h>
 #include <string.h>
 
 #include <pthread.h>
+#ifdef __linux__
+#  include <sched.h>
+#endif
+#include <unistd.h>
 
 #include "mutex.h"
 #include "thread.h"
@@ -67,6 +77,13 @@ struct thread_priv {
 	uint8_t			dirty;
 };
 
+int thread_cpu_count(void)
+{
+	long ret = sysconf(_SC_NPROCESSORS_ONLN);
+
+	return ret > 0 ? (int)ret : 1;
+}
+
 void thread_free(struct thread_handle *pt)
 {
 	struct thread_priv *priv = pt->priv;
@@ -130,6 +147,34 @@ int thread_join(struct thread_handle *pt)
 	return ret > 0 ? -ret : ret;
 }
 
+int thread_set_affinity(struct thread_handle *pt, unsigned int cpu)
+{
+#ifdef __linux__
+	struct thread_priv *priv = pt->priv;
+	cpu_set_t cpus;
+	int ret;
+
+	CPU_ZERO(&cpus);
+	CPU_SET(cpu, &cpus);
+
+	mutex_lock(&priv->mutex);
+
+	if (priv->dirty)
+		ret = pthread_setaffinity_np(priv->thread, sizeof(cpus), &cpus);
+	else
+		ret = ESRCH;
+
+	mutex_unlock(&priv->mutex);
+
+	return -ret;
+#else
+	(void)pt;
+	(void)cpu;
+
+	return -ENOSYS;
+#endif
+}
+
 int thread_start(struct thread_handle *pt)
 {
 	struct thread_priv *priv = pt->priv;
@@ -141,7 +186,14 @@ int thread_start(struct thread_handle *pt)
 		return ret > 0 ? -ret : ret;
 
 	if (pt->stack_size > 0) {
-		ret = pthread_attr_setstacksize(&attr, pt->stack_size);
+		size_t stack_size = pt->stack_size;
+
+#ifdef PTHREAD_STACK_MIN
+		if (stack_size < (size_t)PTHREAD_STACK_MIN)
+			stack_size = (size_t)PTHREAD_STACK_MIN;
+
+#endif
+		ret = pthread_attr_setstacksize(&attr, stack_size);
 		if (ret != 0)
 			return ret > 0 ? -ret : ret;
 	}
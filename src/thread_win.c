@@ -85,6 +85,15 @@ static DWORD WINAPI windows_thread_wrapper(LPVOID ctx)
 	return 0;
 }
 
+int thread_cpu_count(void)
+{
+	SYSTEM_INFO info;
+
+	GetSystemInfo(&info);
+
+	return info.dwNumberOfProcessors > 0 ? (int)info.dwNumberOfProcessors : 1;
+}
+
 void thread_free(struct thread_handle *pt)
 {
 	struct thread_priv *priv = pt->priv;
@@ -146,6 +155,23 @@ int thread_join(struct thread_handle *pt)
 	return ret;
 }
 
+int thread_set_affinity(struct thread_handle *pt, unsigned int cpu)
+{
+	struct thread_priv *priv = pt->priv;
+	DWORD_PTR ret;
+
+	if (cpu >= sizeof(DWORD_PTR) * 8)
+		return -EINVAL;
+
+	mutex_lock(&priv->mutex);
+
+	ret = SetThreadAffinityMask(priv->thread, (DWORD_PTR)1 << cpu);
+
+	mutex_unlock(&priv->mutex);
+
+	return ret == 0 ? -EINVAL : 0;
+}
+
 int thread_start(struct thread_handle *pt)
 {
 	struct thread_priv *priv = pt->priv;
@@ -48,6 +48,16 @@
 #include <stdlib.h>
 #include <string.h>
 
+#ifdef __linux__
+#  include <limits.h>
+#  include <time.h>
+#  include <unistd.h>
+
+#  include <linux/futex.h>
+#  include <sys/syscall.h>
+#endif
+
+#include "atomic.h"
 #include "worker.h"
 
 /*!
@@ -73,29 +83,62 @@ enum worker_state {
 	WORKER_IDLE,
 
 	/*! The worker is starting up */
-	WORKER_STARTING
+	WORKER_STARTING,
+
+	/*! The worker is waiting for new work, but its thread is not running */
+	WORKER_DORMANT
 };
 
 /*!
  * @brief Private data for an instance of a worker
  */
 struct worker_priv {
-	/*! Used to signal new work available */
+#ifndef __linux__
+	/*! Used to wake threads parked in ::worker_park */
 	struct condvar_handle condvar;
 
-	/*! Used to signal that the worker is idle */
-	struct condvar_handle condvar_idle;
-
-	/*! Mutex for protecting worker_priv::state */
+#endif
+	/*! Serializes starting and stopping, and parking where there is no
+	 *  futex */
 	struct mutex_handle mutex;
 
 	/*! Execution thread */
 	struct thread_handle thread;
 
-	/*! The current state of the worker */
-	enum worker_state state;
+	/*! The current ::worker_state of the worker, which is also the word
+	 *  that parked threads wait on */
+	uint32_t state;
+
+	/*! Number of threads in ::worker_wait_idle */
+	uint32_t waiters;
 };
 
+/*!
+ * @brief Blocks until worker_priv::state may no longer be equal to a value
+ *
+ * @param[in,out] priv Private data of the target worker
+ * @param[in] state Value of worker_priv::state to wait for a change from
+ * @param[in] timeout Maximum time to wait in milliseconds, or 0 to wait
+ *                    indefinitely
+ *
+ * @returns 1 if the wait timed out, 0 otherwise
+ *
+ * Like a condition variable, this function may return before the value
+ * changes, so callers must check it again.
+ */
+static int worker_park(struct worker_priv *priv, uint32_t state,
+		       uint32_t timeout);
+
+/*!
+ * @brief Signals a dormant worker by starting its thread
+ *
+ * @param[in,out] wh Target worker instance
+ *
+ * @returns 0 on success, -EAGAIN if the worker is no longer dormant, other
+ *          negative ERRNO value on failure
+ */
+static int worker_revive(struct worker_handle *wh);
+
 /*!
  * @brief Thread function which services a worker's work signals
  *
@@ -105,46 +148,55 @@ struct worker_priv {
  */
 static void *worker_func(void *ctx);
 
+/*!
+ * @brief Wakes all threads parked in ::worker_park
+ *
+ * @param[in,out] priv Private data of the target worker
+ */
+static void worker_unpark(struct worker_priv *priv);
+
 static void *worker_func(void *ctx)
 {
 	struct thread_handle *th = ctx;
 	struct worker_handle *wh = th->func_ctx;
 	struct worker_priv *priv = wh->priv;
-
-	mutex_lock(&priv->mutex);
-
-	while (priv->state > WORKER_STOPPING) {
-		while (priv->state == WORKER_SIGNALED ||
-		       priv->state == WORKER_STOPPING_AFTER_WORK) {
-			if (priv->state == WORKER_STOPPING_AFTER_WORK)
-				priv->state = WORKER_STOPPING;
-			else
-				priv->state = WORKER_BUSY;
-			mutex_unlock(&priv->mutex);
-			wh->func_ptr(wh);
-			mutex_lock(&priv->mutex);
+	uint32_t timeout;
+	uint32_t state;
+
+	timeout = wh->periodic_wake > 0 ? wh->periodic_wake : wh->idle_timeout;
+
+	while ((state = atomic_load_u32(&priv->state)) > WORKER_STOPPING) {
+		if (state == WORKER_SIGNALED ||
+		    state == WORKER_STOPPING_AFTER_WORK) {
+			if (atomic_cas_u32(&priv->state, state,
+					   state == WORKER_SIGNALED ?
+					   WORKER_BUSY : WORKER_STOPPING))
+				wh->func_ptr(wh);
+			continue;
 		}
 
-		if (priv->state <= WORKER_STOPPING)
-			break;
+		if (state != WORKER_IDLE) {
+			if (!atomic_cas_u32(&priv->state, state, WORKER_IDLE))
+				continue;
 
-		priv->state = WORKER_IDLE;
+			if (atomic_load_u32(&priv->waiters) > 0)
+				worker_unpark(priv);
+		}
 
-		condvar_wake_all(&priv->condvar_idle);
+		if (worker_park(priv, WORKER_IDLE, timeout) == 1 &&
+		    wh->periodic_wake == 0 &&
+		    atomic_cas_u32(&priv->state, WORKER_IDLE, WORKER_DORMANT))
+			return NULL;
 
-		if (wh->periodic_wake > 0) {
-			condvar_wait_time(&priv->condvar, &priv->mutex,
-					  wh->periodic_wake);
-			if (priv->state == WORKER_IDLE)
-				priv->state = WORKER_SIGNALED;
-		} else {
-			condvar_wait(&priv->condvar, &priv->mutex);
-		}
+		if (wh->periodic_wake > 0)
+			atomic_cas_u32(&priv->state, WORKER_IDLE,
+				       WORKER_SIGNALED);
 	}
 
-	priv->state = WORKER_STOPPED;
+	atomic_store_u32(&priv->state, WORKER_STOPPED);
 
-	mutex_unlock(&priv->mutex);
+	if (atomic_load_u32(&priv->waiters) > 0)
+		worker_unpark(priv);
 
 	return NULL;
 }
@@ -158,8 +210,9 @@ void worker_free(struct worker_handle *wh)
 
 		thread_free(&priv->thread);
 		mutex_free(&priv->mutex);
-		condvar_free(&priv->condvar_idle);
+#ifndef __linux__
 		condvar_free(&priv->condvar);
+#endif
 
 		free(wh->priv);
 		wh->priv = NULL;
@@ -179,21 +232,18 @@ int worker_init(struct worker_handle *wh)
 		wh->priv = priv;
 	}
 
+#ifndef __linux__
 	ret = condvar_init(&priv->condvar);
 	if (ret < 0)
 		goto worker_init_exit;
 
-	ret = condvar_init(&priv->condvar_idle);
-	if (ret < 0)
-		goto worker_init_exit;
-
+#endif
 	ret = mutex_init(&priv->mutex);
 	if (ret < 0)
 		goto worker_init_exit;
 
 	priv->thread.func_ctx = wh;
 	priv->thread.func_ptr = worker_func;
-	priv->thread.stack_size = wh->stack_size;
 	ret = thread_init(&priv->thread);
 	if (ret < 0)
 		goto worker_init_exit;
@@ -203,9 +253,10 @@ int worker_init(struct worker_handle *wh)
 worker_init_exit:
 	mutex_free(&priv->mutex);
 
-	condvar_free(&priv->condvar_idle);
+#ifndef __linux__
 	condvar_free(&priv->condvar);
 
+#endif
 	free(wh->priv);
 	wh->priv = NULL;
 
@@ -215,39 +266,92 @@ worker_init_exit:
 int worker_is_idle(struct worker_handle *wh)
 {
 	struct worker_priv *priv = wh->priv;
-	int ret = 0;
 
-	mutex_lock_shared(&priv->mutex);
-
-	if (priv->state >= WORKER_IDLE)
-		ret = 1;
-
-	mutex_unlock_shared(&priv->mutex);
-
-	return ret;
+	return atomic_load_u32(&priv->state) >= WORKER_IDLE ? 1 : 0;
 }
 
 int worker_join(struct worker_handle *wh)
 {
 	struct worker_priv *priv = wh->priv;
+	uint32_t state;
 
 	mutex_lock(&priv->mutex);
 
-	if (priv->state > WORKER_STOPPING_AFTER_WORK) {
-		if (priv->state == WORKER_IDLE)
-			condvar_wake_all(&priv->condvar);
+	do {
+		state = atomic_load_u32(&priv->state);
+		if (state <= WORKER_STOPPING_AFTER_WORK)
+			break;
+	} while (!atomic_cas_u32(&priv->state, state,
+				 state == WORKER_SIGNALED ?
+				 WORKER_STOPPING_AFTER_WORK :
+				 state == WORKER_DORMANT ?
+				 WORKER_STOPPED : WORKER_STOPPING));
+
+	mutex_unlock(&priv->mutex);
+
+	/* Both the worker and any threads waiting for it to be idle */
+	worker_unpark(priv);
 
-		if (priv->state == WORKER_SIGNALED)
-			priv->state = WORKER_STOPPING_AFTER_WORK;
+	return thread_join(&priv->thread);
+}
+
+static int worker_park(struct worker_priv *priv, uint32_t state,
+		       uint32_t timeout)
+{
+#ifdef __linux__
+	struct timespec ts;
+
+	if (timeout > 0) {
+		ts.tv_sec = timeout / 1000;
+		ts.tv_nsec = (long)(timeout % 1000) * 1000000L;
+	}
+
+	if (syscall(__NR_futex, &priv->state, FUTEX_WAIT_PRIVATE, state,
+		    timeout > 0 ? &ts : NULL, NULL, 0) != 0 &&
+	    errno == ETIMEDOUT)
+		return 1;
+
+	return 0;
+#else
+	int ret = 0;
+
+	mutex_lock(&priv->mutex);
+
+	if (atomic_load_u32(&priv->state) == state) {
+		if (timeout > 0)
+			ret = condvar_wait_time(&priv->condvar, &priv->mutex,
+						timeout);
 		else
-			priv->state = WORKER_STOPPING;
+			condvar_wait(&priv->condvar, &priv->mutex);
 	}
 
-	condvar_wake_all(&priv->condvar_idle);
+	mutex_unlock(&priv->mutex);
+
+	return ret == 1 ? 1 : 0;
+#endif
+}
+
+static int worker_revive(struct worker_handle *wh)
+{
+	struct worker_priv *priv = wh->priv;
+	int ret = -EAGAIN;
+
+	mutex_lock(&priv->mutex);
+
+	if (atomic_cas_u32(&priv->state, WORKER_DORMANT, WORKER_SIGNALED)) {
+		/* This also reaps the thread which went dormant, if any */
+		priv->thread.stack_size = wh->stack_size;
+		ret = thread_start(&priv->thread);
+		if (ret < 0)
+			atomic_store_u32(&priv->state, WORKER_STOPPED);
+	}
 
 	mutex_unlock(&priv->mutex);
 
-	return thread_join(&priv->thread);
+	if (ret < 0 && ret != -EAGAIN)
+		worker_unpark(priv);
+
+	return ret;
 }
 
 int worker_start(struct worker_handle *wh)
@@ -257,9 +361,15 @@ int worker_start(struct worker_handle *wh)
 
 	mutex_lock(&priv->mutex);
 
-	if (priv->state <= WORKER_STOPPED) {
-		priv->state = WORKER_STARTING;
+	/* Only a periodic worker needs its thread before it is signaled */
+	if (wh->periodic_wake == 0) {
+		atomic_cas_u32(&priv->state, WORKER_STOPPED, WORKER_DORMANT);
+	} else if (atomic_cas_u32(&priv->state, WORKER_STOPPED,
+				  WORKER_STARTING)) {
+		priv->thread.stack_size = wh->stack_size;
 		ret = thread_start(&priv->thread);
+		if (ret < 0)
+			atomic_store_u32(&priv->state, WORKER_STOPPED);
 	}
 
 	mutex_unlock(&priv->mutex);
@@ -267,23 +377,38 @@ int worker_start(struct worker_handle *wh)
 	return ret;
 }
 
+static void worker_unpark(struct worker_priv *priv)
+{
+#ifdef __linux__
+	syscall(__NR_futex, &priv->state, FUTEX_WAKE_PRIVATE, INT_MAX,
+		NULL, NULL, 0);
+#else
+	mutex_lock(&priv->mutex);
+	condvar_wake_all(&priv->condvar);
+	mutex_unlock(&priv->mutex);
+#endif
+}
+
 int worker_wait_idle(struct worker_handle *wh)
 {
 	struct worker_priv *priv = wh->priv;
+	uint32_t state;
 	int ret = 0;
 
-	mutex_lock(&priv->mutex);
+	/* Announce ourselves before looking, so the worker can't go idle
+	 * without seeing us */
+	atomic_add_u32(&priv->waiters, 1);
 
-	while (priv->state < WORKER_IDLE) {
-		if (priv->state < WORKER_BUSY) {
+	while ((state = atomic_load_u32(&priv->state)) < WORKER_IDLE) {
+		if (state < WORKER_BUSY) {
 			ret = -EINVAL;
 			break;
 		}
 
-		condvar_wait(&priv->condvar_idle, &priv->mutex);
+		worker_park(priv, state, 0);
 	}
 
-	mutex_unlock(&priv->mutex);
+	atomic_sub_u32(&priv->waiters, 1);
 
 	return ret;
 }
@@ -291,18 +416,29 @@ int worker_wait_idle(struct worker_handle *wh)
 int worker_wake(struct worker_handle *wh)
 {
 	struct worker_priv *priv = wh->priv;
-	int ret = -EINVAL;
-
-	mutex_lock(&priv->mutex);
+	uint32_t state;
+	int ret;
 
-	if (priv->state > WORKER_STOPPING_AFTER_WORK) {
-		if (priv->state == WORKER_IDLE)
-			condvar_wake_all(&priv->condvar);
-		priv->state = WORKER_SIGNALED;
-		ret = 0;
+	for (;;) {
+		state = atomic_load_u32(&priv->state);
+		if (state <= WORKER_STOPPING_AFTER_WORK)
+			return -EINVAL;
+		else if (state == WORKER_SIGNALED)
+			return 0;
+
+		if (state == WORKER_DORMANT) {
+			ret = worker_revive(wh);
+			if (ret != -EAGAIN)
+				return ret;
+		} else if (atomic_cas_u32(&priv->state, state,
+					  WORKER_SIGNALED)) {
+			break;
+		}
 	}
 
-	mutex_unlock(&priv->mutex);
+	/* Only an idle worker may be parked */
+	if (state == WORKER_IDLE)
+		worker_unpark(priv);
 
-	return ret;
+	return 0;
 }
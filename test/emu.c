@@ -0,0 +1,1086 @@
+/*!
+ * @file emu.c
+ *
+ * @copyright
+ * Copyright &copy; 2026, Scott K Logan
+ *
+ * @copyright
+ * All rights reserved.
+ *
+ * @copyright
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * @copyright
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * @copyright
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * @copyright
+ * EchoLink&reg; is a registered trademark of Synergenics, LLC
+ *
+ * @author Scott K Logan &lt;logans@cottsay.net&gt;
+ *
+ * @brief Offline emulators for EchoLink stations, the directory server and
+ *        the proxy registrar
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#  include <windows.h>
+#else
+#  include <unistd.h>
+#endif
+
+#include "atomic.h"
+#include "conn.h"
+#include "emu.h"
+#include "mutex.h"
+#include "thread.h"
+
+/*! Number of bytes in the header of an RTP packet */
+#define EMU_RTP_HDR_LEN 12
+
+/*! Number of bytes in each GSM frame of an RTP packet */
+#define EMU_GSM_FRAME_LEN 33
+
+/*! RTP payload type of GSM audio */
+#define EMU_RTP_PT_GSM 3
+
+/*! RTCP packet type of a receiver report */
+#define EMU_RTCP_PT_RR 201
+
+/*! RTCP packet type of a source description */
+#define EMU_RTCP_PT_SDES 202
+
+/*! RTCP packet type of a goodbye */
+#define EMU_RTCP_PT_BYE 203
+
+/*! Maximum number of bytes of the callsign in a source description */
+#define EMU_CALLSIGN_LEN_MAX 32
+
+/*! Maximum number of bytes in a login request to the directory server */
+#define EMU_LOGIN_LEN_MAX 256
+
+/*! Maximum number of bytes in each entry of the station list */
+#define EMU_LIST_ENTRY_LEN_MAX 96
+
+/*! Maximum number of bytes in the header of a request to the registrar */
+#define EMU_REQUEST_LEN_MAX 1024
+
+/*! Body of each response from the registrar */
+#define EMU_RESPONSE_BODY "<html><body>OK</body></html>\r\n"
+
+/*! UDP port used by EchoLink stations for RTP */
+#define EMU_PORT_DATA 5198
+
+/*! UDP port used by EchoLink stations for RTCP */
+#define EMU_PORT_CONTROL 5199
+
+/*!
+ * @brief Private data for an instance of an emulated directory server
+ */
+struct emu_directory_priv {
+	/*! Connection which listens for clients */
+	struct conn_handle conn_listen;
+
+	/*! Connection to the client currently being served */
+	struct conn_handle conn_client;
+
+	/*! Thread which serves the clients */
+	struct thread_handle thread;
+
+	/*! Pre-formatted station list */
+	char *list;
+
+	/*! Number of bytes in emu_directory_priv::list */
+	size_t list_len;
+};
+
+/*!
+ * @brief Private data for an instance of an emulated registrar
+ */
+struct emu_registrar_priv {
+	/*! Connection which listens for clients */
+	struct conn_handle conn_listen;
+
+	/*! Connection to the client currently being served */
+	struct conn_handle conn_client;
+
+	/*! Protects emu_registrar_priv::last_body */
+	struct mutex_handle mutex;
+
+	/*! Thread which serves the clients */
+	struct thread_handle thread;
+
+	/*! See emu_registrar_stats::last_body */
+	char last_body[EMU_REGISTRAR_BODY_LEN_MAX];
+
+	/*! See emu_registrar_stats::connections */
+	uint32_t connections;
+
+	/*! See emu_registrar_stats::requests */
+	uint32_t requests;
+};
+
+/*!
+ * @brief Private data for an instance of an emulated station
+ */
+struct emu_station_priv {
+	/*! Connection for RTCP */
+	struct conn_handle conn_control;
+
+	/*! Connection for RTP */
+	struct conn_handle conn_data;
+
+	/*! Thread which handles RTCP and sends RTP */
+	struct thread_handle thread_control;
+
+	/*! Thread which receives RTP */
+	struct thread_handle thread_data;
+
+	/*! Address of the peer the station is currently talking to, if any */
+	uint32_t peer_addr;
+
+	/*! Synchronization source identifier of the station */
+	uint32_t ssrc;
+
+	/*! Non-zero once ::emu_station_stop has been called */
+	uint32_t stopping;
+
+	/*! See emu_station_stats::rx_packets */
+	uint32_t rx_packets;
+
+	/*! See emu_station_stats::tx_packets */
+	uint32_t tx_packets;
+
+	/*! See emu_station_stats::byes */
+	uint32_t byes;
+};
+
+/*!
+ * @brief Thread function which accepts and serves directory clients
+ *
+ * @param[in,out] ctx The thread handle
+ *
+ * @returns Always returns NULL
+ */
+static void *emu_directory_func(void *ctx);
+
+/*!
+ * @brief Serves a single request from a directory client
+ *
+ * @param[in,out] priv Private data of the target directory server instance
+ *
+ * @returns 0 on success, negative ERRNO value on failure
+ */
+static int emu_directory_serve(struct emu_directory_priv *priv);
+
+/*!
+ * @brief Reads a big-endian 16-bit value
+ *
+ * @param[in] buff Buffer containing the value
+ *
+ * @returns The value in host byte order
+ */
+static uint16_t emu_read_u16(const uint8_t *buff);
+
+/*!
+ * @brief Reads a big-endian 32-bit value
+ *
+ * @param[in] buff Buffer containing the value
+ *
+ * @returns The value in host byte order
+ */
+static uint32_t emu_read_u32(const uint8_t *buff);
+
+/*!
+ * @brief Thread function which accepts and serves registrar clients
+ *
+ * @param[in,out] ctx The thread handle
+ *
+ * @returns Always returns NULL
+ */
+static void *emu_registrar_func(void *ctx);
+
+/*!
+ * @brief Answers the requests made by the current registrar client
+ *
+ * @param[in,out] rh Target registrar instance
+ *
+ * @returns 0 once the connection should be closed, negative ERRNO value on
+ *          failure
+ */
+static int emu_registrar_serve(struct emu_registrar_handle *rh);
+
+/*!
+ * @brief Formats the common header of an RTCP packet
+ *
+ * @param[out] buff Buffer to populate
+ * @param[in] count Value of the count field
+ * @param[in] type RTCP packet type
+ * @param[in] len Total number of bytes in the packet, a multiple of 4
+ * @param[in] ssrc Synchronization source identifier of the sender
+ *
+ * @returns Number of bytes in the header
+ */
+static size_t emu_rtcp_header(uint8_t *buff, uint8_t count, uint8_t type,
+			      size_t len, uint32_t ssrc);
+
+/*!
+ * @brief Blocks the calling thread
+ *
+ * @param[in] msec Number of milliseconds to block for
+ */
+static void emu_sleep(uint32_t msec);
+
+/*!
+ * @brief Thread function which handles RTCP for an emulated station
+ *
+ * @param[in,out] ctx The thread handle
+ *
+ * @returns Always returns NULL
+ */
+static void *emu_station_control_func(void *ctx);
+
+/*!
+ * @brief Thread function which receives RTP for an emulated station
+ *
+ * @param[in,out] ctx The thread handle
+ *
+ * @returns Always returns NULL
+ */
+static void *emu_station_data_func(void *ctx);
+
+/*!
+ * @brief Introduces the station to a peer and sends it a transmission
+ *
+ * @param[in,out] sh Target station instance
+ * @param[in] addr Address of the peer
+ *
+ * @returns 0 on success, negative ERRNO value on failure
+ */
+static int emu_station_talk(struct emu_station_handle *sh, uint32_t addr);
+
+/*!
+ * @brief Writes a big-endian 16-bit value
+ *
+ * @param[out] buff Buffer to write the value to
+ * @param[in] val The value in host byte order
+ */
+static void emu_write_u16(uint8_t *buff, uint16_t val);
+
+/*!
+ * @brief Writes a big-endian 32-bit value
+ *
+ * @param[out] buff Buffer to write the value to
+ * @param[in] val The value in host byte order
+ */
+static void emu_write_u32(uint8_t *buff, uint32_t val);
+
+void emu_directory_free(struct emu_directory_handle *dh)
+{
+	struct emu_directory_priv *priv = dh->priv;
+
+	if (dh->priv != NULL) {
+		emu_directory_stop(dh);
+
+		thread_free(&priv->thread);
+		conn_free(&priv->conn_client);
+		conn_free(&priv->conn_listen);
+
+		free(priv->list);
+
+		free(dh->priv);
+		dh->priv = NULL;
+	}
+}
+
+static void *emu_directory_func(void *ctx)
+{
+	struct thread_handle *th = ctx;
+	struct emu_directory_handle *dh = th->func_ctx;
+	struct emu_directory_priv *priv = dh->priv;
+	int ret;
+
+	while (1) {
+		ret = conn_accept(&priv->conn_listen, &priv->conn_client);
+		if (ret == -ECONNABORTED || ret == -EINTR)
+			continue;
+		else if (ret < 0)
+			break;
+
+		/* A failed request only affects that client */
+		emu_directory_serve(priv);
+
+		conn_close(&priv->conn_client);
+	}
+
+	return NULL;
+}
+
+int emu_directory_init(struct emu_directory_handle *dh)
+{
+	struct emu_directory_priv *priv = dh->priv;
+	int ret;
+
+	if (priv == NULL) {
+		priv = calloc(1, sizeof(*priv));
+		if (priv == NULL)
+			return -ENOMEM;
+
+		dh->priv = priv;
+	}
+
+	priv->conn_listen.type = CONN_TYPE_TCP;
+	ret = conn_init(&priv->conn_listen);
+	if (ret < 0)
+		goto emu_directory_init_exit;
+
+	priv->conn_client.type = CONN_TYPE_TCP;
+	ret = conn_init(&priv->conn_client);
+	if (ret < 0)
+		goto emu_directory_init_exit;
+
+	priv->thread.func_ptr = emu_directory_func;
+	priv->thread.func_ctx = dh;
+	ret = thread_init(&priv->thread);
+	if (ret < 0)
+		goto emu_directory_init_exit;
+
+	return 0;
+
+emu_directory_init_exit:
+	conn_free(&priv->conn_client);
+	conn_free(&priv->conn_listen);
+
+	free(dh->priv);
+	dh->priv = NULL;
+
+	return ret;
+}
+
+static int emu_directory_serve(struct emu_directory_priv *priv)
+{
+	char req[EMU_LOGIN_LEN_MAX];
+	size_t len;
+	int fields = 0;
+	int ret;
+
+	ret = conn_recv(&priv->conn_client, (uint8_t *)req, 1);
+	if (ret < 0)
+		return ret;
+
+	switch (req[0]) {
+	case 'l':
+		/* The callsign and password, status and location are each
+		 * terminated by a carriage return
+		 */
+		for (len = 1; fields < 3; len++) {
+			if (len >= sizeof(req))
+				return -ENOSPC;
+
+			ret = conn_recv(&priv->conn_client,
+					(uint8_t *)&req[len], 1);
+			if (ret < 0)
+				return ret;
+
+			if (req[len] == '\r')
+				fields++;
+		}
+
+		return conn_send(&priv->conn_client, (const uint8_t *)"OK", 2);
+	case 's':
+		return conn_send(&priv->conn_client,
+				 (const uint8_t *)priv->list, priv->list_len);
+	default:
+		return -EINVAL;
+	}
+}
+
+int emu_directory_start(struct emu_directory_handle *dh)
+{
+	struct emu_directory_priv *priv = dh->priv;
+	unsigned long i;
+	int ret;
+
+	/* Format the list up front so that serving it is cheap */
+	free(priv->list);
+	priv->list = malloc(16 + (size_t)dh->num_stations *
+			    EMU_LIST_ENTRY_LEN_MAX);
+	if (priv->list == NULL)
+		return -ENOMEM;
+
+	ret = sprintf(priv->list, "@@@\n%lu\n",
+		      (unsigned long)dh->num_stations);
+	if (ret < 0)
+		return -EINVAL;
+
+	priv->list_len = ret;
+
+	for (i = 0; i < dh->num_stations; i++) {
+		ret = sprintf(&priv->list[priv->list_len],
+			      "EMU%05lu\nEmulated station %lu [ON 00:00]\n%lu\n127.1.%lu.%lu\n",
+			      i, i, 100000 + i, (i >> 8) & 0xFF, i & 0xFF);
+		if (ret < 0)
+			return -EINVAL;
+
+		priv->list_len += ret;
+	}
+
+	memcpy(&priv->list[priv->list_len], "+++", 3);
+	priv->list_len += 3;
+
+	priv->conn_listen.source_addr = dh->addr;
+	priv->conn_listen.source_port = "5200";
+	ret = conn_listen(&priv->conn_listen);
+	if (ret < 0)
+		return ret;
+
+	ret = thread_start(&priv->thread);
+	if (ret < 0)
+		conn_close(&priv->conn_listen);
+
+	return ret;
+}
+
+void emu_directory_stop(struct emu_directory_handle *dh)
+{
+	struct emu_directory_priv *priv = dh->priv;
+
+	conn_shutdown(&priv->conn_listen);
+	conn_shutdown(&priv->conn_client);
+
+	thread_join(&priv->thread);
+
+	conn_close(&priv->conn_client);
+	conn_close(&priv->conn_listen);
+}
+
+static uint16_t emu_read_u16(const uint8_t *buff)
+{
+	return (uint16_t)((buff[0] << 8) | buff[1]);
+}
+
+static uint32_t emu_read_u32(const uint8_t *buff)
+{
+	return ((uint32_t)buff[0] << 24) | ((uint32_t)buff[1] << 16) |
+	       ((uint32_t)buff[2] << 8) | buff[3];
+}
+
+void emu_registrar_free(struct emu_registrar_handle *rh)
+{
+	struct emu_registrar_priv *priv = rh->priv;
+
+	if (rh->priv != NULL) {
+		emu_registrar_stop(rh);
+
+		thread_free(&priv->thread);
+		mutex_free(&priv->mutex);
+		conn_free(&priv->conn_client);
+		conn_free(&priv->conn_listen);
+
+		free(rh->priv);
+		rh->priv = NULL;
+	}
+}
+
+static void *emu_registrar_func(void *ctx)
+{
+	struct thread_handle *th = ctx;
+	struct emu_registrar_handle *rh = th->func_ctx;
+	struct emu_registrar_priv *priv = rh->priv;
+	int ret;
+
+	while (1) {
+		ret = conn_accept(&priv->conn_listen, &priv->conn_client);
+		if (ret == -ECONNABORTED || ret == -EINTR)
+			continue;
+		else if (ret < 0)
+			break;
+
+		atomic_add_u32(&priv->connections, 1);
+
+		/* A failed request only affects that client */
+		emu_registrar_serve(rh);
+
+		conn_close(&priv->conn_client);
+	}
+
+	return NULL;
+}
+
+void emu_registrar_get_stats(struct emu_registrar_handle *rh,
+			     struct emu_registrar_stats *stats)
+{
+	struct emu_registrar_priv *priv = rh->priv;
+
+	mutex_lock(&priv->mutex);
+	memcpy(stats->last_body, priv->last_body, sizeof(stats->last_body));
+	mutex_unlock(&priv->mutex);
+
+	stats->connections = atomic_load_u32(&priv->connections);
+	stats->requests = atomic_load_u32(&priv->requests);
+}
+
+int emu_registrar_init(struct emu_registrar_handle *rh)
+{
+	struct emu_registrar_priv *priv = rh->priv;
+	int ret;
+
+	if (priv == NULL) {
+		priv = calloc(1, sizeof(*priv));
+		if (priv == NULL)
+			return -ENOMEM;
+
+		rh->priv = priv;
+	}
+
+	priv->conn_listen.type = CONN_TYPE_TCP;
+	ret = conn_init(&priv->conn_listen);
+	if (ret < 0)
+		goto emu_registrar_init_exit;
+
+	priv->conn_client.type = CONN_TYPE_TCP;
+	ret = conn_init(&priv->conn_client);
+	if (ret < 0)
+		goto emu_registrar_init_exit;
+
+	ret = mutex_init(&priv->mutex);
+	if (ret < 0)
+		goto emu_registrar_init_exit;
+
+	priv->thread.func_ptr = emu_registrar_func;
+	priv->thread.func_ctx = rh;
+	ret = thread_init(&priv->thread);
+	if (ret < 0)
+		goto emu_registrar_init_exit;
+
+	return 0;
+
+emu_registrar_init_exit:
+	mutex_free(&priv->mutex);
+	conn_free(&priv->conn_client);
+	conn_free(&priv->conn_listen);
+
+	free(rh->priv);
+	rh->priv = NULL;
+
+	return ret;
+}
+
+static int emu_registrar_serve(struct emu_registrar_handle *rh)
+{
+	struct emu_registrar_priv *priv = rh->priv;
+	char req[EMU_REQUEST_LEN_MAX];
+	char resp[256];
+	const char *content_length;
+	unsigned long body_len;
+	uint32_t served;
+	size_t len;
+	int ret;
+
+	for (served = 0; rh->requests_per_conn == 0 ||
+	     served < rh->requests_per_conn; served++) {
+		/* The header ends with an empty line */
+		for (len = 0; len < 4 || memcmp(&req[len - 4], "\r\n\r\n", 4) != 0;
+		     len++) {
+			if (len >= sizeof(req) - 1)
+				return -ENOSPC;
+
+			ret = conn_recv(&priv->conn_client,
+					(uint8_t *)&req[len], 1);
+			if (ret < 0)
+				return ret == -EPIPE ? 0 : ret;
+		}
+
+		req[len] = '\0';
+
+		content_length = strstr(req, "\r\nContent-Length: ");
+		if (content_length == NULL)
+			return -EINVAL;
+
+		body_len = strtoul(content_length + 18, NULL, 10);
+		if (body_len >= sizeof(req))
+			return -ENOSPC;
+
+		ret = conn_recv(&priv->conn_client, (uint8_t *)req, body_len);
+		if (ret < 0)
+			return ret;
+
+		req[body_len] = '\0';
+
+		mutex_lock(&priv->mutex);
+		strncpy(priv->last_body, req, sizeof(priv->last_body) - 1);
+		mutex_unlock(&priv->mutex);
+
+		atomic_add_u32(&priv->requests, 1);
+
+		if (rh->chunked)
+			ret = sprintf(resp,
+				      "HTTP/1.1 200 OK\r\n"
+				      "Content-Type: text/html\r\n"
+				      "Transfer-Encoding: chunked\r\n"
+				      "\r\n"
+				      "6\r\n%.6s\r\n"
+				      "%x\r\n%s\r\n"
+				      "0\r\n"
+				      "\r\n",
+				      EMU_RESPONSE_BODY,
+				      (unsigned int)sizeof(EMU_RESPONSE_BODY) - 7,
+				      &EMU_RESPONSE_BODY[6]);
+		else
+			ret = sprintf(resp,
+				      "HTTP/1.1 200 OK\r\n"
+				      "Content-Type: text/html\r\n"
+				      "Content-Length: %u\r\n"
+				      "\r\n"
+				      "%s",
+				      (unsigned int)sizeof(EMU_RESPONSE_BODY) - 1,
+				      EMU_RESPONSE_BODY);
+		if (ret < 0)
+			return -EINVAL;
+
+		ret = conn_send(&priv->conn_client, (const uint8_t *)resp, ret);
+		if (ret < 0)
+			return ret;
+	}
+
+	return 0;
+}
+
+int emu_registrar_start(struct emu_registrar_handle *rh)
+{
+	struct emu_registrar_priv *priv = rh->priv;
+	int ret;
+
+	memset(priv->last_body, 0x0, sizeof(priv->last_body));
+	atomic_store_u32(&priv->connections, 0);
+	atomic_store_u32(&priv->requests, 0);
+
+	priv->conn_listen.source_addr = rh->addr;
+	priv->conn_listen.source_port = rh->port;
+	ret = conn_listen(&priv->conn_listen);
+	if (ret < 0)
+		return ret;
+
+	ret = thread_start(&priv->thread);
+	if (ret < 0)
+		conn_close(&priv->conn_listen);
+
+	return ret;
+}
+
+void emu_registrar_stop(struct emu_registrar_handle *rh)
+{
+	struct emu_registrar_priv *priv = rh->priv;
+
+	conn_shutdown(&priv->conn_listen);
+	conn_shutdown(&priv->conn_client);
+
+	thread_join(&priv->thread);
+
+	conn_close(&priv->conn_client);
+	conn_close(&priv->conn_listen);
+}
+
+size_t emu_rtcp_bye(uint8_t *buff, uint32_t ssrc)
+{
+	static const char reason[] = "jan2002 USER";
+	size_t start;
+	size_t len;
+
+	/* An empty receiver report precedes every packet */
+	start = emu_rtcp_header(buff, 0, EMU_RTCP_PT_RR, 8, ssrc);
+
+	len = start + 8;
+	buff[len++] = sizeof(reason) - 1;
+	memcpy(&buff[len], reason, sizeof(reason) - 1);
+	len += sizeof(reason) - 1;
+
+	while ((len - start) % 4 != 0)
+		buff[len++] = 0;
+
+	emu_rtcp_header(&buff[start], 1, EMU_RTCP_PT_BYE, len - start, ssrc);
+
+	return len;
+}
+
+static size_t emu_rtcp_header(uint8_t *buff, uint8_t count, uint8_t type,
+			      size_t len, uint32_t ssrc)
+{
+	/* EchoLink sets the version bits to 3 */
+	buff[0] = 0xC0 | count;
+	buff[1] = type;
+	emu_write_u16(&buff[2], (uint16_t)(len / 4 - 1));
+	emu_write_u32(&buff[4], ssrc);
+
+	return 8;
+}
+
+int emu_rtcp_parse(const uint8_t *buff, size_t len)
+{
+	size_t rr_len;
+
+	if (len < 8 || (buff[0] & 0xC0) != 0xC0 || buff[1] != EMU_RTCP_PT_RR)
+		return -EINVAL;
+
+	rr_len = ((size_t)emu_read_u16(&buff[2]) + 1) * 4;
+	if (len < rr_len + 8 || (buff[rr_len] & 0xC0) != 0xC0)
+		return -EINVAL;
+
+	switch (buff[rr_len + 1]) {
+	case EMU_RTCP_PT_SDES:
+		return EMU_RTCP_TYPE_SDES;
+	case EMU_RTCP_PT_BYE:
+		return EMU_RTCP_TYPE_BYE;
+	default:
+		return -EINVAL;
+	}
+}
+
+size_t emu_rtcp_sdes(uint8_t *buff, uint32_t ssrc, const char *callsign)
+{
+	size_t call_len = strlen(callsign);
+	size_t start;
+	size_t len;
+
+	if (call_len > EMU_CALLSIGN_LEN_MAX)
+		call_len = EMU_CALLSIGN_LEN_MAX;
+
+	/* An empty receiver report precedes every packet */
+	start = emu_rtcp_header(buff, 0, EMU_RTCP_PT_RR, 8, ssrc);
+
+	len = start + 8;
+
+	/* EchoLink always sends the literal CALLSIGN as the CNAME */
+	buff[len++] = 1;
+	buff[len++] = 8;
+	memcpy(&buff[len], "CALLSIGN", 8);
+	len += 8;
+
+	buff[len++] = 2;
+	buff[len++] = (uint8_t)call_len;
+	memcpy(&buff[len], callsign, call_len);
+	len += call_len;
+
+	/* The end of the items, padded to a 32-bit boundary */
+	do {
+		buff[len++] = 0;
+	} while ((len - start) % 4 != 0);
+
+	emu_rtcp_header(&buff[start], 1, EMU_RTCP_PT_SDES, len - start, ssrc);
+
+	return len;
+}
+
+void emu_rtp(uint8_t buff[EMU_RTP_LEN], uint32_t ssrc, uint16_t seq)
+{
+	size_t i;
+
+	/* EchoLink sets the version bits to 3 */
+	buff[0] = 0xC0;
+	buff[1] = EMU_RTP_PT_GSM;
+	emu_write_u16(&buff[2], seq);
+	emu_write_u32(&buff[4], (uint32_t)seq * EMU_RTP_INTERVAL * 8);
+	emu_write_u32(&buff[8], ssrc);
+
+	for (i = EMU_RTP_HDR_LEN; i < EMU_RTP_LEN; i++)
+		buff[i] = (uint8_t)(seq + i);
+
+	/* Each GSM frame starts with its signature nibble */
+	for (i = EMU_RTP_HDR_LEN; i < EMU_RTP_LEN; i += EMU_GSM_FRAME_LEN)
+		buff[i] = 0xD0 | (seq & 0x0F);
+}
+
+int emu_rtp_parse(const uint8_t *buff, size_t len, uint16_t *seq)
+{
+	uint8_t expected[EMU_RTP_LEN];
+
+	if (len != EMU_RTP_LEN)
+		return -EINVAL;
+
+	*seq = emu_read_u16(&buff[2]);
+
+	emu_rtp(expected, emu_read_u32(&buff[8]), *seq);
+
+	return memcmp(buff, expected, EMU_RTP_LEN) == 0 ? 0 : -EINVAL;
+}
+
+static void emu_sleep(uint32_t msec)
+{
+#ifdef _WIN32
+	Sleep(msec);
+#else
+	usleep(msec * 1000);
+#endif
+}
+
+static void *emu_station_control_func(void *ctx)
+{
+	struct thread_handle *th = ctx;
+	struct emu_station_handle *sh = th->func_ctx;
+	struct emu_station_priv *priv = sh->priv;
+	uint8_t buff[EMU_RTCP_LEN_MAX];
+	uint32_t addr;
+	int ret;
+
+	while (!atomic_load_u32(&priv->stopping)) {
+		ret = conn_recv_any(&priv->conn_control, buff, sizeof(buff),
+				    &addr, NULL);
+		if (ret < 0)
+			break;
+
+		switch (emu_rtcp_parse(buff, ret)) {
+		case EMU_RTCP_TYPE_SDES:
+			/* Peers repeat their source description periodically */
+			if (addr == priv->peer_addr)
+				break;
+
+			priv->peer_addr = addr;
+
+			emu_station_talk(sh, addr);
+			break;
+		case EMU_RTCP_TYPE_BYE:
+			if (addr == priv->peer_addr)
+				priv->peer_addr = 0;
+
+			atomic_add_u32(&priv->byes, 1);
+			break;
+		}
+	}
+
+	return NULL;
+}
+
+static void *emu_station_data_func(void *ctx)
+{
+	struct thread_handle *th = ctx;
+	struct emu_station_handle *sh = th->func_ctx;
+	struct emu_station_priv *priv = sh->priv;
+	uint8_t buff[EMU_RTP_LEN + 1];
+	uint16_t seq;
+	int ret;
+
+	while (!atomic_load_u32(&priv->stopping)) {
+		ret = conn_recv_any(&priv->conn_data, buff, sizeof(buff),
+				    NULL, NULL);
+		if (ret < 0)
+			break;
+
+		if (emu_rtp_parse(buff, ret, &seq) == 0)
+			atomic_add_u32(&priv->rx_packets, 1);
+	}
+
+	return NULL;
+}
+
+void emu_station_free(struct emu_station_handle *sh)
+{
+	struct emu_station_priv *priv = sh->priv;
+
+	if (sh->priv != NULL) {
+		emu_station_stop(sh);
+
+		thread_free(&priv->thread_data);
+		thread_free(&priv->thread_control);
+		conn_free(&priv->conn_data);
+		conn_free(&priv->conn_control);
+
+		free(sh->priv);
+		sh->priv = NULL;
+	}
+}
+
+void emu_station_get_stats(struct emu_station_handle *sh,
+			   struct emu_station_stats *stats)
+{
+	struct emu_station_priv *priv = sh->priv;
+
+	stats->rx_packets = atomic_load_u32(&priv->rx_packets);
+	stats->tx_packets = atomic_load_u32(&priv->tx_packets);
+	stats->byes = atomic_load_u32(&priv->byes);
+}
+
+int emu_station_init(struct emu_station_handle *sh)
+{
+	struct emu_station_priv *priv = sh->priv;
+	int ret;
+
+	if (priv == NULL) {
+		priv = calloc(1, sizeof(*priv));
+		if (priv == NULL)
+			return -ENOMEM;
+
+		sh->priv = priv;
+	}
+
+	priv->conn_control.type = CONN_TYPE_UDP;
+	ret = conn_init(&priv->conn_control);
+	if (ret < 0)
+		goto emu_station_init_exit;
+
+	priv->conn_data.type = CONN_TYPE_UDP;
+	ret = conn_init(&priv->conn_data);
+	if (ret < 0)
+		goto emu_station_init_exit;
+
+	priv->thread_control.func_ptr = emu_station_control_func;
+	priv->thread_control.func_ctx = sh;
+	ret = thread_init(&priv->thread_control);
+	if (ret < 0)
+		goto emu_station_init_exit;
+
+	priv->thread_data.func_ptr = emu_station_data_func;
+	priv->thread_data.func_ctx = sh;
+	ret = thread_init(&priv->thread_data);
+	if (ret < 0)
+		goto emu_station_init_exit;
+
+	return 0;
+
+emu_station_init_exit:
+	thread_free(&priv->thread_control);
+	conn_free(&priv->conn_data);
+	conn_free(&priv->conn_control);
+
+	free(sh->priv);
+	sh->priv = NULL;
+
+	return ret;
+}
+
+int emu_station_start(struct emu_station_handle *sh)
+{
+	struct emu_station_priv *priv = sh->priv;
+	const char *iter;
+	int ret;
+
+	priv->ssrc = 0;
+	for (iter = sh->callsign; *iter != '\0'; iter++)
+		priv->ssrc = priv->ssrc * 31 + (uint8_t)*iter;
+
+	priv->peer_addr = 0;
+	atomic_store_u32(&priv->stopping, 0);
+	atomic_store_u32(&priv->rx_packets, 0);
+	atomic_store_u32(&priv->tx_packets, 0);
+	atomic_store_u32(&priv->byes, 0);
+
+	priv->conn_control.source_addr = sh->addr;
+	priv->conn_control.source_port = "5199";
+	ret = conn_listen(&priv->conn_control);
+	if (ret < 0)
+		return ret;
+
+	priv->conn_data.source_addr = sh->addr;
+	priv->conn_data.source_port = "5198";
+	ret = conn_listen(&priv->conn_data);
+	if (ret < 0)
+		goto emu_station_start_exit;
+
+	ret = thread_start(&priv->thread_data);
+	if (ret < 0)
+		goto emu_station_start_exit;
+
+	ret = thread_start(&priv->thread_control);
+	if (ret < 0)
+		goto emu_station_start_exit;
+
+	return 0;
+
+emu_station_start_exit:
+	emu_station_stop(sh);
+
+	return ret;
+}
+
+void emu_station_stop(struct emu_station_handle *sh)
+{
+	struct emu_station_priv *priv = sh->priv;
+
+	atomic_store_u32(&priv->stopping, 1);
+
+	conn_shutdown(&priv->conn_control);
+	conn_shutdown(&priv->conn_data);
+
+	thread_join(&priv->thread_control);
+	thread_join(&priv->thread_data);
+
+	conn_close(&priv->conn_data);
+	conn_close(&priv->conn_control);
+}
+
+static int emu_station_talk(struct emu_station_handle *sh, uint32_t addr)
+{
+	struct emu_station_priv *priv = sh->priv;
+	uint8_t rtcp[EMU_RTCP_LEN_MAX];
+	uint8_t rtp[EMU_RTP_LEN];
+	uint32_t i;
+	size_t len;
+	int ret;
+
+	len = emu_rtcp_sdes(rtcp, priv->ssrc, sh->callsign);
+	ret = conn_send_to(&priv->conn_control, rtcp, len, addr,
+			   EMU_PORT_CONTROL);
+	if (ret < 0)
+		return ret;
+
+	for (i = 0; i < sh->packets; i++) {
+		if (atomic_load_u32(&priv->stopping))
+			return -EINTR;
+
+		if (i > 0 && sh->interval > 0)
+			emu_sleep(sh->interval);
+
+		emu_rtp(rtp, priv->ssrc, (uint16_t)i);
+		ret = conn_send_to(&priv->conn_data, rtp, sizeof(rtp), addr,
+				   EMU_PORT_DATA);
+		if (ret < 0)
+			return ret;
+
+		atomic_add_u32(&priv->tx_packets, 1);
+	}
+
+	len = emu_rtcp_bye(rtcp, priv->ssrc);
+
+	return conn_send_to(&priv->conn_control, rtcp, len, addr,
+			    EMU_PORT_CONTROL);
+}
+
+static void emu_write_u16(uint8_t *buff, uint16_t val)
+{
+	buff[0] = (uint8_t)(val >> 8);
+	buff[1] = (uint8_t)val;
+}
+
+static void emu_write_u32(uint8_t *buff, uint32_t val)
+{
+	buff[0] = (uint8_t)(val >> 24);
+	buff[1] = (uint8_t)(val >> 16);
+	buff[2] = (uint8_t)(val >> 8);
+	buff[3] = (uint8_t)val;
+}
@@ -0,0 +1,377 @@
+/*!
+ * @file emu.h
+ *
+ * @copyright
+ * Copyright &copy; 2026, Scott K Logan
+ *
+ * @copyright
+ * All rights reserved.
+ *
+ * @copyright
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * @copyright
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * @copyright
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * @copyright
+ * EchoLink&reg; is a registered trademark of Synergenics, LLC
+ *
+ * @author Scott K Logan &lt;logans@cottsay.net&gt;
+ *
+ * @brief Offline emulators for EchoLink stations and the directory server
+ */
+
+#ifndef EMU_H_
+#define EMU_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*!
+ * @brief Number of bytes in an RTP packet produced by ::emu_rtp
+ *
+ * This matches the GSM packets sent by EchoLink stations: a 12 byte RTP
+ * header followed by four 33 byte GSM frames.
+ */
+#define EMU_RTP_LEN 144
+
+/*!
+ * @brief Milliseconds of audio in each packet produced by ::emu_rtp
+ */
+#define EMU_RTP_INTERVAL 80
+
+/*!
+ * @brief Maximum number of bytes in an RTCP packet produced by ::emu_rtcp_bye
+ *        or ::emu_rtcp_sdes
+ */
+#define EMU_RTCP_LEN_MAX 128
+
+/*!
+ * @brief Maximum number of bytes of a request body kept by an emulated
+ *        registrar, including the terminator
+ */
+#define EMU_REGISTRAR_BODY_LEN_MAX 256
+
+/*!
+ * @brief Types of RTCP packets understood by ::emu_rtcp_parse
+ */
+enum EMU_RTCP_TYPE {
+	/*! Source description, sent when a station connects */
+	EMU_RTCP_TYPE_SDES = 1,
+
+	/*! Goodbye, sent when a station disconnects */
+	EMU_RTCP_TYPE_BYE
+};
+
+/*!
+ * @brief Represents an instance of an emulated EchoLink directory server
+ *
+ * The server listens on TCP port 5200 and answers two requests. A login
+ * request starting with 'l' is answered with "OK", and a station list request
+ * of 's' is answered with a list of emu_directory_handle::num_stations
+ * stations. The connection is closed after each request, like the real
+ * server does.
+ *
+ * This struct should be initialized to zero before being used. The private
+ * data should be initialized using the ::emu_directory_init function, and
+ * subsequently freed by ::emu_directory_free when the server is no longer
+ * needed.
+ */
+struct emu_directory_handle {
+	/*! Private data - used internally by emu_directory functions */
+	void *priv;
+
+	/*! Local address to listen on, typically a loopback alias */
+	const char *addr;
+
+	/*! Number of stations to include in the station list */
+	uint32_t num_stations;
+};
+
+/*!
+ * @brief Represents an instance of an emulated EchoLink proxy registrar
+ *
+ * The server accepts HTTP/1.1 requests like the updates a proxy posts to the
+ * official registrar, and answers each with "200 OK". Connections are kept
+ * open for further requests unless emu_registrar_handle::requests_per_conn
+ * says otherwise.
+ *
+ * This struct should be initialized to zero before being used. The private
+ * data should be initialized using the ::emu_registrar_init function, and
+ * subsequently freed by ::emu_registrar_free when the server is no longer
+ * needed.
+ */
+struct emu_registrar_handle {
+	/*! Private data - used internally by emu_registrar functions */
+	void *priv;
+
+	/*! Local address to listen on, typically a loopback alias */
+	const char *addr;
+
+	/*! TCP port to listen on */
+	const char *port;
+
+	/*! Number of requests to answer on each connection before closing it
+	 *  without warning, as a server does to an idle connection, or 0 for
+	 *  no limit */
+	uint32_t requests_per_conn;
+
+	/*! Non-zero to send each response body in chunks */
+	uint8_t chunked;
+};
+
+/*!
+ * @brief Statistics about the requests handled by an emulated registrar
+ */
+struct emu_registrar_stats {
+	/*! Number of connections accepted */
+	uint32_t connections;
+
+	/*! Number of requests received */
+	uint32_t requests;
+
+	/*! Terminated body of the last request, which may be truncated */
+	char last_body[EMU_REGISTRAR_BODY_LEN_MAX];
+};
+
+/*!
+ * @brief Represents an instance of an emulated remote EchoLink station
+ *
+ * The station listens on UDP ports 5198 and 5199. When it receives an RTCP
+ * source description from a peer, it replies with its own, sends
+ * emu_station_handle::packets RTP packets to the peer at the given cadence and
+ * then says goodbye. RTP packets received from the peer are counted.
+ *
+ * This struct should be initialized to zero before being used. The private
+ * data should be initialized using the ::emu_station_init function, and
+ * subsequently freed by ::emu_station_free when the station is no longer
+ * needed.
+ */
+struct emu_station_handle {
+	/*! Private data - used internally by emu_station functions */
+	void *priv;
+
+	/*! Local address to listen on, typically a loopback alias */
+	const char *addr;
+
+	/*! Callsign to report in RTCP source descriptions */
+	const char *callsign;
+
+	/*! Number of RTP packets to send to each peer */
+	uint32_t packets;
+
+	/*! Milliseconds to wait between RTP packets, or 0 to send them as fast
+	 *  as possible */
+	uint32_t interval;
+};
+
+/*!
+ * @brief Statistics about the traffic handled by an emulated station
+ */
+struct emu_station_stats {
+	/*! Number of valid RTP packets received */
+	uint32_t rx_packets;
+
+	/*! Number of RTP packets sent */
+	uint32_t tx_packets;
+
+	/*! Number of peers which have said goodbye */
+	uint32_t byes;
+};
+
+/*!
+ * @brief Frees data allocated by ::emu_directory_init
+ *
+ * @param[in,out] dh Target directory server instance
+ */
+void emu_directory_free(struct emu_directory_handle *dh);
+
+/*!
+ * @brief Initializes the private data in an ::emu_directory_handle
+ *
+ * @param[in,out] dh Target directory server instance
+ *
+ * @returns 0 on success, negative ERRNO value on failure
+ */
+int emu_directory_init(struct emu_directory_handle *dh);
+
+/*!
+ * @brief Starts serving requests
+ *
+ * @param[in,out] dh Target directory server instance
+ *
+ * @returns 0 on success, negative ERRNO value on failure
+ */
+int emu_directory_start(struct emu_directory_handle *dh);
+
+/*!
+ * @brief Stops serving requests and waits for the server to finish
+ *
+ * @param[in,out] dh Target directory server instance
+ */
+void emu_directory_stop(struct emu_directory_handle *dh);
+
+/*!
+ * @brief Frees data allocated by ::emu_registrar_init
+ *
+ * @param[in,out] rh Target registrar instance
+ */
+void emu_registrar_free(struct emu_registrar_handle *rh);
+
+/*!
+ * @brief Gets statistics about the requests handled by the registrar so far
+ *
+ * @param[in] rh Target registrar instance
+ * @param[out] stats Statistics to populate
+ */
+void emu_registrar_get_stats(struct emu_registrar_handle *rh,
+			     struct emu_registrar_stats *stats);
+
+/*!
+ * @brief Initializes the private data in an ::emu_registrar_handle
+ *
+ * @param[in,out] rh Target registrar instance
+ *
+ * @returns 0 on success, negative ERRNO value on failure
+ */
+int emu_registrar_init(struct emu_registrar_handle *rh);
+
+/*!
+ * @brief Starts serving requests
+ *
+ * @param[in,out] rh Target registrar instance
+ *
+ * @returns 0 on success, negative ERRNO value on failure
+ */
+int emu_registrar_start(struct emu_registrar_handle *rh);
+
+/*!
+ * @brief Stops serving requests and waits for the server to finish
+ *
+ * @param[in,out] rh Target registrar instance
+ */
+void emu_registrar_stop(struct emu_registrar_handle *rh);
+
+/*!
+ * @brief Formats an RTCP goodbye packet
+ *
+ * @param[out] buff Buffer of at least ::EMU_RTCP_LEN_MAX bytes to populate
+ * @param[in] ssrc Synchronization source identifier of the sender
+ *
+ * @returns Number of bytes in the packet
+ */
+size_t emu_rtcp_bye(uint8_t *buff, uint32_t ssrc);
+
+/*!
+ * @brief Determines the type of an RTCP packet
+ *
+ * @param[in] buff Buffer containing the packet
+ * @param[in] len Number of bytes in buff
+ *
+ * @returns One of ::EMU_RTCP_TYPE on success, negative ERRNO value on failure
+ */
+int emu_rtcp_parse(const uint8_t *buff, size_t len);
+
+/*!
+ * @brief Formats an RTCP source description packet
+ *
+ * @param[out] buff Buffer of at least ::EMU_RTCP_LEN_MAX bytes to populate
+ * @param[in] ssrc Synchronization source identifier of the sender
+ * @param[in] callsign Callsign of the sender, which may be truncated
+ *
+ * @returns Number of bytes in the packet
+ */
+size_t emu_rtcp_sdes(uint8_t *buff, uint32_t ssrc, const char *callsign);
+
+/*!
+ * @brief Formats an RTP packet of GSM audio
+ *
+ * @param[out] buff Buffer to populate
+ * @param[in] ssrc Synchronization source identifier of the sender
+ * @param[in] seq Sequence number of the packet
+ *
+ * The audio is a pattern derived from the sequence number so that
+ * ::emu_rtp_parse can detect corruption.
+ */
+void emu_rtp(uint8_t buff[EMU_RTP_LEN], uint32_t ssrc, uint16_t seq);
+
+/*!
+ * @brief Validates an RTP packet produced by ::emu_rtp
+ *
+ * @param[in] buff Buffer containing the packet
+ * @param[in] len Number of bytes in buff
+ * @param[out] seq Sequence number of the packet
+ *
+ * @returns 0 on success, negative ERRNO value on failure
+ */
+int emu_rtp_parse(const uint8_t *buff, size_t len, uint16_t *seq);
+
+/*!
+ * @brief Frees data allocated by ::emu_station_init
+ *
+ * @param[in,out] sh Target station instance
+ */
+void emu_station_free(struct emu_station_handle *sh);
+
+/*!
+ * @brief Gets statistics about the traffic handled by the station so far
+ *
+ * @param[in] sh Target station instance
+ * @param[out] stats Statistics to populate
+ */
+void emu_station_get_stats(struct emu_station_handle *sh,
+			   struct emu_station_stats *stats);
+
+/*!
+ * @brief Initializes the private data in an ::emu_station_handle
+ *
+ * @param[in,out] sh Target station instance
+ *
+ * @returns 0 on success, negative ERRNO value on failure
+ */
+int emu_station_init(struct emu_station_handle *sh);
+
+/*!
+ * @brief Starts listening for peers
+ *
+ * @param[in,out] sh Target station instance
+ *
+ * @returns 0 on success, negative ERRNO value on failure
+ *
+ * Binding to a loopback alias other than 127.0.0.1 fails with
+ * -EADDRNOTAVAIL on platforms which do not route all of 127.0.0.0/8 to the
+ * loopback interface, unless the alias has been configured.
+ */
+int emu_station_start(struct emu_station_handle *sh);
+
+/*!
+ * @brief Stops listening for peers and waits for the station to finish
+ *
+ * @param[in,out] sh Target station instance
+ */
+void emu_station_stop(struct emu_station_handle *sh);
+
+#endif /* EMU_H_ */
@@ -0,0 +1,301 @@
+/*!
+ * @file test_buff_pool.c
+ *
+ * @copyright
+ * Copyright &copy; 2026, Scott K Logan
+ *
+ * @copyright
+ * All rights reserved.
+ *
+ * @copyright
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * @copyright
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * @copyright
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * @copyright
+ * EchoLink&reg; is a registered trademark of Synergenics, LLC
+ *
+ * @author Scott K Logan &lt;logans@cottsay.net&gt;
+ *
+ * @brief Tests related to the shared packet buffer pool
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "buff_pool.h"
+#include "thread.h"
+
+/*! Number of threads which borrow buffers concurrently */
+#define TEST_THREADS 4
+
+/*! Number of buffers borrowed by each thread */
+#define TEST_BORROWS 20000
+
+/*!
+ * @brief Contextual data for a thread which borrows buffers from a pool
+ */
+struct buff_pool_borrower {
+	/*! The pool to borrow buffers from */
+	struct buff_pool_handle *bp;
+
+	/*! The thread which borrows the buffers */
+	struct thread_handle thread;
+
+	/*! Identifies the data written by this thread */
+	uint8_t id;
+
+	/*! Number of buffers which were found to be shared with another thread */
+	uint32_t collisions;
+};
+
+/*!
+ * @brief Thread function which borrows and releases TEST_BORROWS buffers
+ *
+ * @param[in,out] ctx The thread context
+ *
+ * @returns Always returns NULL
+ */
+static void *buff_pool_borrower_func(void *ctx);
+
+/*!
+ * @brief Basic test of borrowing and releasing buffers from a single thread
+ *
+ * @returns 0 on success, negative ERRNO value on failure
+ *
+ * @test Basic test of borrowing and releasing buffers from a single thread
+ */
+static int test_buff_pool_basic(void);
+
+/*!
+ * @brief Test of several threads borrowing buffers concurrently
+ *
+ * @returns 0 on success, negative ERRNO value on failure
+ *
+ * @test Test of several threads borrowing buffers concurrently
+ */
+static int test_buff_pool_concurrent(void);
+
+static void *buff_pool_borrower_func(void *ctx)
+{
+	struct thread_handle *th = ctx;
+	struct buff_pool_borrower *borrower = th->func_ctx;
+	uint8_t *buff;
+	uint32_t i;
+
+	for (i = 0; i < TEST_BORROWS; i++) {
+		buff = buff_pool_borrow(borrower->bp);
+		if (buff == NULL)
+			continue;
+
+		memset(buff, borrower->id, borrower->bp->buff_len);
+
+		/* No other thread may have written to the buffer meanwhile */
+		if (buff[0] != borrower->id ||
+		    buff[borrower->bp->buff_len - 1] != borrower->id)
+			borrower->collisions++;
+
+		buff_pool_release(borrower->bp, buff);
+	}
+
+	return NULL;
+}
+
+/*!
+ * @brief Main entry point for buffer pool tests
+ *
+ * @returns 0 on success, non-zero value on failure
+ */
+int main(void);
+
+int main(void)
+{
+	int ret = 0;
+
+	ret |= test_buff_pool_basic();
+	ret |= test_buff_pool_concurrent();
+
+	return ret;
+}
+
+static int test_buff_pool_basic(void)
+{
+	struct buff_pool_handle bp;
+	struct buff_pool_stats stats;
+	uint8_t *buffs[3];
+	uint8_t *extra;
+	unsigned int i;
+	int ret;
+
+	memset(&bp, 0x0, sizeof(bp));
+
+	bp.buff_len = 100;
+	bp.init_buffs = 2;
+	bp.max_buffs = 3;
+	ret = buff_pool_init(&bp);
+	if (ret < 0)
+		return ret;
+
+	buff_pool_get_stats(&bp, &stats);
+	if (stats.size < 2 || stats.in_use != 0 || stats.in_use_max != 0) {
+		fprintf(stderr, "Error: Invalid statistics for a new pool\n");
+		ret = -EINVAL;
+		goto test_buff_pool_basic_exit;
+	}
+
+	for (i = 0; i < 3; i++) {
+		buffs[i] = buff_pool_borrow(&bp);
+		if (buffs[i] == NULL) {
+			fprintf(stderr, "Error: Failed to borrow buffer %u\n", i);
+			ret = -ENOMEM;
+			goto test_buff_pool_basic_exit;
+		}
+
+		if ((size_t)buffs[i] % 64 != 0) {
+			fprintf(stderr, "Error: Buffer %u is not aligned\n", i);
+			ret = -EINVAL;
+			goto test_buff_pool_basic_exit;
+		}
+
+		memset(buffs[i], (int)i, bp.buff_len);
+	}
+
+	extra = buff_pool_borrow(&bp);
+	if (extra != NULL) {
+		fprintf(stderr, "Error: Borrowed more buffers than the maximum\n");
+		ret = -EINVAL;
+		goto test_buff_pool_basic_exit;
+	}
+
+	for (i = 0; i < 3; i++) {
+		if (buffs[i][0] != i || buffs[i][bp.buff_len - 1] != i) {
+			fprintf(stderr, "Error: Buffer %u was corrupted\n", i);
+			ret = -EINVAL;
+			goto test_buff_pool_basic_exit;
+		}
+	}
+
+	/* A buffer with an extra reference must survive one release */
+	buff_pool_ref(buffs[0]);
+	buff_pool_release(&bp, buffs[0]);
+
+	buff_pool_get_stats(&bp, &stats);
+	if (stats.size != 3 || stats.in_use != 3 || stats.in_use_max != 3) {
+		fprintf(stderr, "Error: Invalid statistics for a full pool\n");
+		ret = -EINVAL;
+		goto test_buff_pool_basic_exit;
+	}
+
+	buff_pool_release(&bp, buffs[0]);
+	buff_pool_release(&bp, buffs[1]);
+
+	buff_pool_get_stats(&bp, &stats);
+	if (stats.in_use != 1 || stats.in_use_max != 3) {
+		fprintf(stderr, "Error: Invalid statistics after release\n");
+		ret = -EINVAL;
+		goto test_buff_pool_basic_exit;
+	}
+
+	/* Released buffers are reused before the pool grows */
+	extra = buff_pool_borrow(&bp);
+	if (extra != buffs[0] && extra != buffs[1]) {
+		fprintf(stderr, "Error: Released buffer was not reused\n");
+		ret = -EINVAL;
+		goto test_buff_pool_basic_exit;
+	}
+
+	buff_pool_release(&bp, extra);
+	buff_pool_release(&bp, buffs[2]);
+
+	ret = 0;
+
+test_buff_pool_basic_exit:
+	buff_pool_free(&bp);
+
+	return ret;
+}
+
+static int test_buff_pool_concurrent(void)
+{
+	struct buff_pool_handle bp;
+	struct buff_pool_borrower borrowers[TEST_THREADS];
+	struct buff_pool_stats stats;
+	unsigned int i;
+	int ret;
+
+	memset(&bp, 0x0, sizeof(bp));
+	memset(borrowers, 0x0, sizeof(borrowers));
+
+	bp.buff_len = 256;
+	bp.max_buffs = TEST_THREADS - 1;
+	ret = buff_pool_init(&bp);
+	if (ret < 0)
+		return ret;
+
+	for (i = 0; i < TEST_THREADS; i++) {
+		borrowers[i].bp = &bp;
+		borrowers[i].id = (uint8_t)(i + 1);
+		borrowers[i].thread.func_ctx = &borrowers[i];
+		borrowers[i].thread.func_ptr = buff_pool_borrower_func;
+		ret = thread_init(&borrowers[i].thread);
+		if (ret < 0)
+			goto test_buff_pool_concurrent_exit;
+	}
+
+	for (i = 0; i < TEST_THREADS; i++) {
+		ret = thread_start(&borrowers[i].thread);
+		if (ret < 0)
+			goto test_buff_pool_concurrent_exit;
+	}
+
+test_buff_pool_concurrent_exit:
+	for (i = 0; i < TEST_THREADS; i++) {
+		thread_join(&borrowers[i].thread);
+		thread_free(&borrowers[i].thread);
+
+		if (borrowers[i].collisions != 0) {
+			fprintf(stderr,
+				"Error: Thread %u shared %u buffers with another thread\n",
+				i, borrowers[i].collisions);
+			ret = -EINVAL;
+		}
+	}
+
+	if (ret == 0) {
+		buff_pool_get_stats(&bp, &stats);
+		if (stats.in_use != 0 || stats.in_use_max > bp.max_buffs) {
+			fprintf(stderr,
+				"Error: Invalid statistics after concurrent use\n");
+			ret = -EINVAL;
+		}
+	}
+
+	buff_pool_free(&bp);
+
+	return ret;
+}
@@ -55,6 +55,9 @@
 #endif
 
 #include "conn.h"
+#ifdef HAVE_IO_URING
+#  include "conn_uring.h"
+#endif
 #include "thread.h"
 
 /*!
@@ -80,6 +83,17 @@ struct conn_recv_data {
  */
 static void *conn_recv_func(void *ctx);
 
+/*!
+ * @brief Test for binding connections to an address resolved by
+ *        ::conn_addr_resolve
+ *
+ * @returns 0 on success, negative ERRNO value on failure
+ *
+ * @test Test for binding connections to an address resolved by
+ *       ::conn_addr_resolve
+ */
+static int test_conn_addr(void);
+
 /*!
  * @brief Basic test for connection closure during a blocking read
  *
@@ -89,6 +103,66 @@ static void *conn_recv_func(void *ctx);
  */
 static int test_conn_close(void);
 
+/*!
+ * @brief Test for ending a blocking read with ::conn_interrupt and discarding
+ *        queued datagrams with ::conn_drain
+ *
+ * @returns 0 on success, negative ERRNO value on failure
+ *
+ * @test Test for ending a blocking read with ::conn_interrupt and discarding
+ *       queued datagrams with ::conn_drain
+ */
+static int test_conn_interrupt(void);
+
+/*!
+ * @brief Test for receiving several datagrams with ::conn_recv_many
+ *
+ * @returns 0 on success, negative ERRNO value on failure
+ *
+ * @test Test for receiving several datagrams with ::conn_recv_many
+ */
+static int test_conn_recv_many(void);
+
+/*!
+ * @brief Test for connecting through a ::conn_resolver and refreshing the
+ *        names it cached
+ *
+ * @returns 0 on success, negative ERRNO value on failure
+ *
+ * @test Test for connecting through a ::conn_resolver and refreshing the
+ *       names it cached
+ */
+static int test_conn_resolver(void);
+
+/*!
+ * @brief Test for sending several datagrams with ::conn_send_many
+ *
+ * @returns 0 on success, negative ERRNO value on failure
+ *
+ * @test Test for sending several datagrams with ::conn_send_many
+ */
+static int test_conn_send_many(void);
+
+/*!
+ * @brief Test for sending data from several buffers with ::conn_sendv
+ *
+ * @returns 0 on success, negative ERRNO value on failure
+ *
+ * @test Test for sending data from several buffers with ::conn_sendv
+ */
+static int test_conn_sendv(void);
+
+/*!
+ * @brief Test for relaying data through a kernel buffer with
+ *        ::conn_splice_recv and ::conn_splice_send
+ *
+ * @returns 0 on success, negative ERRNO value on failure
+ *
+ * @test Test for relaying data through a kernel buffer with
+ *       ::conn_splice_recv and ::conn_splice_send
+ */
+static int test_conn_splice(void);
+
 /*!
  * @brief Test for ::conn_set_timeout on a blocking read
  *
@@ -98,6 +172,26 @@ static int test_conn_close(void);
  */
 static int test_conn_timeout(void);
 
+/*!
+ * @brief Test for sending data without copying it with ::conn_set_zerocopy
+ *
+ * @returns 0 on success, negative ERRNO value on failure
+ *
+ * @test Test for sending data without copying it with ::conn_set_zerocopy
+ */
+static int test_conn_zerocopy(void);
+
+#ifdef HAVE_IO_URING
+/*!
+ * @brief Test for receiving a datagram through an io_uring instance
+ *
+ * @returns 0 on success, negative ERRNO value on failure
+ *
+ * @test Test for receiving a datagram through an io_uring instance
+ */
+static int test_conn_uring_recv(void);
+#endif
+
 static void *conn_recv_func(void *ctx)
 {
 	struct thread_handle *th = ctx;
@@ -120,8 +214,86 @@ int main(void)
 {
 	int ret = 0;
 
+	ret |= test_conn_addr();
 	ret |= test_conn_close();
+	ret |= test_conn_interrupt();
+	ret |= test_conn_recv_many();
+	ret |= test_conn_resolver();
+	ret |= test_conn_send_many();
+	ret |= test_conn_sendv();
+	ret |= test_conn_splice();
 	ret |= test_conn_timeout();
+	ret |= test_conn_zerocopy();
+#ifdef HAVE_IO_URING
+	ret |= test_conn_uring_recv();
+#endif
+
+	return ret;
+}
+
+static int test_conn_addr(void)
+{
+	struct conn_handle conn_accepted;
+	struct conn_handle conn_listener;
+	struct conn_handle conn_tx;
+	struct conn_addr source;
+	char remote_addr[54];
+	int ret;
+
+	memset(&conn_accepted, 0x0, sizeof(conn_accepted));
+	memset(&conn_listener, 0x0, sizeof(conn_listener));
+	memset(&conn_tx, 0x0, sizeof(conn_tx));
+	memset(&source, 0x0, sizeof(source));
+
+	ret = conn_addr_resolve(&source, "127.0.0.1");
+	if (ret < 0)
+		return ret;
+
+	/* The name is never resolved when the address already was */
+	conn_listener.source = &source;
+	conn_listener.source_addr = "invalid.invalid";
+	conn_listener.source_port = "8117";
+	conn_listener.type = CONN_TYPE_TCP;
+	ret = conn_init(&conn_listener);
+	if (ret < 0)
+		goto test_conn_addr_exit;
+
+	conn_accepted.type = CONN_TYPE_TCP;
+	ret = conn_init(&conn_accepted);
+	if (ret < 0)
+		goto test_conn_addr_exit;
+
+	conn_tx.source = &source;
+	conn_tx.type = CONN_TYPE_TCP;
+	ret = conn_init(&conn_tx);
+	if (ret < 0)
+		goto test_conn_addr_exit;
+
+	ret = conn_listen(&conn_listener);
+	if (ret < 0) {
+		fprintf(stderr, "Error: Failed to listen (%d): %s\n",
+			-ret, strerror(-ret));
+		goto test_conn_addr_exit;
+	}
+
+	ret = conn_connect(&conn_tx, "127.0.0.1", "8117");
+	if (ret < 0)
+		goto test_conn_addr_exit;
+
+	ret = conn_accept(&conn_listener, &conn_accepted);
+	if (ret < 0)
+		goto test_conn_addr_exit;
+
+	conn_get_remote_addr(&conn_accepted, remote_addr);
+	if (strncmp(remote_addr, "127.0.0.1:", 10) != 0) {
+		fprintf(stderr, "Error: Connected from '%s'\n", remote_addr);
+		ret = -EINVAL;
+	}
+
+test_conn_addr_exit:
+	conn_free(&conn_tx);
+	conn_free(&conn_accepted);
+	conn_free(&conn_listener);
 
 	return ret;
 }
@@ -184,6 +356,558 @@ test_conn_blocking_exit:
 	return ret;
 }
 
+static int test_conn_interrupt(void)
+{
+	struct conn_handle conn_tx;
+	struct conn_recv_data data;
+	static const uint8_t loopback[4] = { 127, 0, 0, 1 };
+	uint8_t payload[3] = { 0 };
+	unsigned int i;
+	int ret;
+
+	memset(&conn_tx, 0x0, sizeof(conn_tx));
+	memset(&data, 0x0, sizeof(data));
+
+	data.conn.source_addr = "127.0.0.1";
+	data.conn.source_port = "8118";
+	data.conn.type = CONN_TYPE_UDP;
+	ret = conn_init(&data.conn);
+	if (ret < 0)
+		goto test_conn_interrupt_exit;
+
+	conn_tx.source_addr = "127.0.0.1";
+	conn_tx.type = CONN_TYPE_UDP;
+	ret = conn_init(&conn_tx);
+	if (ret < 0)
+		goto test_conn_interrupt_exit;
+
+	ret = conn_listen(&data.conn);
+	if (ret < 0)
+		goto test_conn_interrupt_exit;
+
+	ret = conn_listen(&conn_tx);
+	if (ret < 0)
+		goto test_conn_interrupt_exit;
+
+	data.thread.func_ctx = &data;
+	data.thread.func_ptr = conn_recv_func;
+	ret = thread_init(&data.thread);
+	if (ret < 0)
+		goto test_conn_interrupt_exit;
+
+	data.ret = -EINPROGRESS;
+
+	ret = thread_start(&data.thread);
+	if (ret < 0)
+		goto test_conn_interrupt_exit;
+
+	sleep(1);
+
+	ret = conn_interrupt(&data.conn);
+	if (ret < 0) {
+		fprintf(stderr, "Error: Failed to interrupt receive (%d): %s\n",
+			-ret, strerror(-ret));
+		goto test_conn_interrupt_exit;
+	}
+
+	ret = thread_join(&data.thread);
+	if (ret < 0)
+		goto test_conn_interrupt_exit;
+
+	if (data.ret != -EPIPE) {
+		ret = data.ret < 0 ? data.ret : -EINVAL;
+		fprintf(stderr,
+			"Error: Invalid return from conn_recv on interrupt (%d)\n",
+			data.ret);
+		goto test_conn_interrupt_exit;
+	}
+
+	/* The connection is still bound, so these are queued */
+	for (i = 0; i < sizeof(payload); i++) {
+		ret = conn_send_to(&conn_tx, payload, i + 1,
+				   *(const uint32_t *)loopback, 8118);
+		if (ret < 0)
+			goto test_conn_interrupt_exit;
+	}
+
+	ret = conn_interrupt(&data.conn);
+	if (ret < 0)
+		goto test_conn_interrupt_exit;
+
+	ret = conn_drain(&data.conn);
+	if (ret != sizeof(payload) + 1) {
+		fprintf(stderr, "Error: Drained %d datagrams instead of %u\n",
+			ret, (unsigned int)sizeof(payload) + 1);
+		ret = -EINVAL;
+		goto test_conn_interrupt_exit;
+	}
+
+	ret = conn_drain(&data.conn);
+	if (ret != 0) {
+		fprintf(stderr, "Error: Drained %d datagrams from an empty connection\n",
+			ret);
+		ret = -EINVAL;
+		goto test_conn_interrupt_exit;
+	}
+
+test_conn_interrupt_exit:
+	thread_free(&data.thread);
+	conn_free(&conn_tx);
+	conn_free(&data.conn);
+
+	return ret;
+}
+
+static int test_conn_recv_many(void)
+{
+	struct conn_handle conn_rx;
+	struct conn_handle conn_tx;
+	struct conn_datagram dgrams[4];
+	static const uint8_t loopback[4] = { 127, 0, 0, 1 };
+	uint8_t buff[4][16];
+	uint8_t payload[3] = { 0 };
+	unsigned int received = 0;
+	unsigned int i;
+	int ret;
+
+	memset(&conn_rx, 0x0, sizeof(conn_rx));
+	memset(&conn_tx, 0x0, sizeof(conn_tx));
+
+	for (i = 0; i < 4; i++) {
+		dgrams[i].buff = buff[i];
+		dgrams[i].buff_len = sizeof(buff[i]);
+	}
+
+	conn_rx.source_addr = "127.0.0.1";
+	conn_rx.source_port = "8111";
+	conn_rx.type = CONN_TYPE_UDP;
+	ret = conn_init(&conn_rx);
+	if (ret < 0)
+		goto test_conn_recv_many_exit;
+
+	conn_tx.source_addr = "127.0.0.1";
+	conn_tx.type = CONN_TYPE_UDP;
+	ret = conn_init(&conn_tx);
+	if (ret < 0)
+		goto test_conn_recv_many_exit;
+
+	ret = conn_listen(&conn_rx);
+	if (ret < 0)
+		goto test_conn_recv_many_exit;
+
+	ret = conn_listen(&conn_tx);
+	if (ret < 0)
+		goto test_conn_recv_many_exit;
+
+	for (i = 0; i < sizeof(payload); i++) {
+		payload[i] = (uint8_t)i;
+		ret = conn_send_to(&conn_tx, payload, i + 1,
+				   *(const uint32_t *)loopback, 8111);
+		if (ret < 0)
+			goto test_conn_recv_many_exit;
+	}
+
+	/* Each call blocks for the first datagram, and may return fewer */
+	while (received < sizeof(payload)) {
+		ret = conn_recv_many(&conn_rx, dgrams, 4);
+		if (ret < 0) {
+			fprintf(stderr,
+				"Error: Failed to receive datagrams (%d): %s\n",
+				-ret, strerror(-ret));
+			goto test_conn_recv_many_exit;
+		}
+
+		for (i = 0; i < (unsigned int)ret; i++, received++) {
+			if (received >= sizeof(payload) ||
+			    dgrams[i].len != received + 1 ||
+			    memcmp(dgrams[i].buff, payload, received + 1) != 0 ||
+			    dgrams[i].addr != *(const uint32_t *)loopback) {
+				fprintf(stderr, "Error: Datagram was corrupted\n");
+				ret = -EINVAL;
+				goto test_conn_recv_many_exit;
+			}
+		}
+	}
+
+	ret = 0;
+
+test_conn_recv_many_exit:
+	conn_free(&conn_rx);
+	conn_free(&conn_tx);
+
+	return ret;
+}
+
+static int test_conn_resolver(void)
+{
+	struct conn_handle conn_accepted;
+	struct conn_handle conn_listener;
+	struct conn_handle conn_tx;
+	struct conn_resolver cr;
+	uint8_t buff[1] = { 0x5A };
+	int i;
+	int ret;
+
+	memset(&conn_accepted, 0x0, sizeof(conn_accepted));
+	memset(&conn_listener, 0x0, sizeof(conn_listener));
+	memset(&conn_tx, 0x0, sizeof(conn_tx));
+	memset(&cr, 0x0, sizeof(cr));
+
+	/* Every name is due to be refreshed as soon as it is resolved */
+	cr.ttl = 1;
+	ret = conn_resolver_init(&cr);
+	if (ret < 0)
+		return ret;
+
+	conn_listener.resolver = &cr;
+	conn_listener.source_addr = "localhost";
+	conn_listener.source_port = "8116";
+	conn_listener.type = CONN_TYPE_TCP;
+	ret = conn_init(&conn_listener);
+	if (ret < 0)
+		goto test_conn_resolver_exit;
+
+	conn_accepted.type = CONN_TYPE_TCP;
+	ret = conn_init(&conn_accepted);
+	if (ret < 0)
+		goto test_conn_resolver_exit;
+
+	conn_tx.resolver = &cr;
+	conn_tx.type = CONN_TYPE_TCP;
+	ret = conn_init(&conn_tx);
+	if (ret < 0)
+		goto test_conn_resolver_exit;
+
+	ret = conn_listen(&conn_listener);
+	if (ret < 0)
+		goto test_conn_resolver_exit;
+
+	/* The second connection uses the cached addresses */
+	for (i = 0; i < 2; i++) {
+		ret = conn_connect(&conn_tx, "localhost", "8116");
+		if (ret < 0)
+			goto test_conn_resolver_exit;
+
+		ret = conn_accept(&conn_listener, &conn_accepted);
+		if (ret < 0)
+			goto test_conn_resolver_exit;
+
+		ret = conn_send(&conn_tx, buff, sizeof(buff));
+		if (ret < 0)
+			goto test_conn_resolver_exit;
+
+		buff[0] = 0x00;
+		ret = conn_recv(&conn_accepted, buff, sizeof(buff));
+		if (ret < 0)
+			goto test_conn_resolver_exit;
+
+		if (buff[0] != 0x5A) {
+			fprintf(stderr, "Error: Data was corrupted\n");
+			ret = -EINVAL;
+			goto test_conn_resolver_exit;
+		}
+
+		conn_close(&conn_accepted);
+		conn_close(&conn_tx);
+	}
+
+	/* Numeric addresses are parsed rather than cached */
+	ret = conn_resolver_prefetch(&cr, "127.0.0.1", 1);
+	if (ret < 0)
+		goto test_conn_resolver_exit;
+
+	/* The listening name, the wildcard source and the remote name */
+	ret = conn_resolver_refresh(&cr);
+	if (ret != 3) {
+		fprintf(stderr, "Error: Refreshed %d names instead of 3\n",
+			ret);
+		if (ret >= 0)
+			ret = -EINVAL;
+		goto test_conn_resolver_exit;
+	}
+
+	ret = 0;
+
+test_conn_resolver_exit:
+	conn_free(&conn_tx);
+	conn_free(&conn_accepted);
+	conn_free(&conn_listener);
+	conn_resolver_free(&cr);
+
+	return ret;
+}
+
+static int test_conn_send_many(void)
+{
+	struct conn_handle conn_rx;
+	struct conn_handle conn_tx;
+	struct conn_datagram dgrams[3];
+	static const uint8_t loopback[4] = { 127, 0, 0, 1 };
+	uint8_t payload[3] = { 0 };
+	uint8_t buff[16];
+	unsigned int sent = 0;
+	unsigned int i;
+	int ret;
+
+	memset(&conn_rx, 0x0, sizeof(conn_rx));
+	memset(&conn_tx, 0x0, sizeof(conn_tx));
+
+	for (i = 0; i < 3; i++) {
+		payload[i] = (uint8_t)i;
+		dgrams[i].buff = payload;
+		dgrams[i].len = i + 1;
+		dgrams[i].addr = *(const uint32_t *)loopback;
+		dgrams[i].port = 8112;
+	}
+
+	conn_rx.source_addr = "127.0.0.1";
+	conn_rx.source_port = "8112";
+	conn_rx.type = CONN_TYPE_UDP;
+	ret = conn_init(&conn_rx);
+	if (ret < 0)
+		goto test_conn_send_many_exit;
+
+	conn_tx.source_addr = "127.0.0.1";
+	conn_tx.type = CONN_TYPE_UDP;
+	ret = conn_init(&conn_tx);
+	if (ret < 0)
+		goto test_conn_send_many_exit;
+
+	ret = conn_listen(&conn_rx);
+	if (ret < 0)
+		goto test_conn_send_many_exit;
+
+	ret = conn_listen(&conn_tx);
+	if (ret < 0)
+		goto test_conn_send_many_exit;
+
+	while (sent < 3) {
+		ret = conn_send_many(&conn_tx, &dgrams[sent], 3 - sent);
+		if (ret <= 0) {
+			fprintf(stderr,
+				"Error: Failed to send datagrams (%d): %s\n",
+				-ret, strerror(-ret));
+			ret = ret < 0 ? ret : -EINVAL;
+			goto test_conn_send_many_exit;
+		}
+
+		sent += ret;
+	}
+
+	for (i = 0; i < 3; i++) {
+		ret = conn_recv_any(&conn_rx, buff, sizeof(buff), NULL, NULL);
+		if (ret < 0)
+			goto test_conn_send_many_exit;
+
+		if (ret != (int)i + 1 || memcmp(buff, payload, ret) != 0) {
+			fprintf(stderr, "Error: Datagram was corrupted\n");
+			ret = -EINVAL;
+			goto test_conn_send_many_exit;
+		}
+	}
+
+	ret = 0;
+
+test_conn_send_many_exit:
+	conn_free(&conn_rx);
+	conn_free(&conn_tx);
+
+	return ret;
+}
+
+static int test_conn_sendv(void)
+{
+	struct conn_handle conn_accepted;
+	struct conn_handle conn_listener;
+	struct conn_handle conn_tx;
+	struct conn_iovec iov[100];
+	uint8_t payload[100];
+	uint8_t buff[5050];
+	size_t offset = 0;
+	unsigned int i;
+	unsigned int j;
+	int ret;
+
+	memset(&conn_accepted, 0x0, sizeof(conn_accepted));
+	memset(&conn_listener, 0x0, sizeof(conn_listener));
+	memset(&conn_tx, 0x0, sizeof(conn_tx));
+
+	/* More buffers than can be sent in a single system call */
+	for (i = 0; i < 100; i++) {
+		payload[i] = (uint8_t)i;
+		iov[i].buff = payload;
+		iov[i].len = i + 1;
+	}
+
+	conn_listener.source_addr = "127.0.0.1";
+	conn_listener.source_port = "8113";
+	conn_listener.type = CONN_TYPE_TCP;
+	ret = conn_init(&conn_listener);
+	if (ret < 0)
+		goto test_conn_sendv_exit;
+
+	conn_accepted.type = CONN_TYPE_TCP;
+	ret = conn_init(&conn_accepted);
+	if (ret < 0)
+		goto test_conn_sendv_exit;
+
+	conn_tx.type = CONN_TYPE_TCP;
+	ret = conn_init(&conn_tx);
+	if (ret < 0)
+		goto test_conn_sendv_exit;
+
+	ret = conn_listen(&conn_listener);
+	if (ret < 0)
+		goto test_conn_sendv_exit;
+
+	ret = conn_connect(&conn_tx, "127.0.0.1", "8113");
+	if (ret < 0)
+		goto test_conn_sendv_exit;
+
+	ret = conn_accept(&conn_listener, &conn_accepted);
+	if (ret < 0)
+		goto test_conn_sendv_exit;
+
+	ret = conn_sendv(&conn_tx, iov, 100);
+	if (ret < 0) {
+		fprintf(stderr, "Error: Failed to send buffers (%d): %s\n",
+			-ret, strerror(-ret));
+		goto test_conn_sendv_exit;
+	}
+
+	ret = conn_recv(&conn_accepted, buff, sizeof(buff));
+	if (ret < 0)
+		goto test_conn_sendv_exit;
+
+	for (i = 0; i < 100; i++) {
+		for (j = 0; j <= i; j++, offset++) {
+			if (buff[offset] != payload[j]) {
+				fprintf(stderr, "Error: Data was corrupted\n");
+				ret = -EINVAL;
+				goto test_conn_sendv_exit;
+			}
+		}
+	}
+
+	ret = 0;
+
+test_conn_sendv_exit:
+	conn_free(&conn_tx);
+	conn_free(&conn_accepted);
+	conn_free(&conn_listener);
+
+	return ret;
+}
+
+static int test_conn_splice(void)
+{
+	struct conn_handle conn_accepted;
+	struct conn_handle conn_listener;
+	struct conn_handle conn_tx;
+	struct conn_pipe cp = { -1, -1 };
+	struct conn_iovec iov;
+	uint8_t payload[3000];
+	uint8_t buff[sizeof(payload) + 4];
+	size_t len = 0;
+	unsigned int i;
+	int ret;
+
+	memset(&conn_accepted, 0x0, sizeof(conn_accepted));
+	memset(&conn_listener, 0x0, sizeof(conn_listener));
+	memset(&conn_tx, 0x0, sizeof(conn_tx));
+
+	for (i = 0; i < sizeof(payload); i++)
+		payload[i] = (uint8_t)i;
+
+	iov.buff = (const uint8_t *)"HDR:";
+	iov.len = 4;
+
+	ret = conn_pipe_init(&cp);
+	if (ret == -ENOSYS) {
+		/* Not supported on this platform */
+		return 0;
+	} else if (ret < 0) {
+		fprintf(stderr, "Error: Failed to create pipe (%d): %s\n",
+			-ret, strerror(-ret));
+		return ret;
+	}
+
+	conn_listener.source_addr = "127.0.0.1";
+	conn_listener.source_port = "8114";
+	conn_listener.type = CONN_TYPE_TCP;
+	ret = conn_init(&conn_listener);
+	if (ret < 0)
+		goto test_conn_splice_exit;
+
+	conn_accepted.type = CONN_TYPE_TCP;
+	ret = conn_init(&conn_accepted);
+	if (ret < 0)
+		goto test_conn_splice_exit;
+
+	conn_tx.type = CONN_TYPE_TCP;
+	ret = conn_init(&conn_tx);
+	if (ret < 0)
+		goto test_conn_splice_exit;
+
+	ret = conn_listen(&conn_listener);
+	if (ret < 0)
+		goto test_conn_splice_exit;
+
+	ret = conn_connect(&conn_tx, "127.0.0.1", "8114");
+	if (ret < 0)
+		goto test_conn_splice_exit;
+
+	ret = conn_accept(&conn_listener, &conn_accepted);
+	if (ret < 0)
+		goto test_conn_splice_exit;
+
+	ret = conn_send(&conn_tx, payload, sizeof(payload));
+	if (ret < 0)
+		goto test_conn_splice_exit;
+
+	while (len < sizeof(payload)) {
+		ret = conn_splice_recv(&conn_accepted, &cp,
+				       sizeof(payload) - len);
+		if (ret < 0) {
+			fprintf(stderr, "Error: Failed to splice data in (%d): %s\n",
+				-ret, strerror(-ret));
+			goto test_conn_splice_exit;
+		}
+
+		len += ret;
+	}
+
+	/* Send it back with a header in front of it */
+	ret = conn_splice_send(&conn_accepted, &iov, 1, &cp, len);
+	if (ret < 0) {
+		fprintf(stderr, "Error: Failed to splice data out (%d): %s\n",
+			-ret, strerror(-ret));
+		goto test_conn_splice_exit;
+	}
+
+	ret = conn_recv(&conn_tx, buff, sizeof(buff));
+	if (ret < 0)
+		goto test_conn_splice_exit;
+
+	if (memcmp(buff, iov.buff, iov.len) != 0 ||
+	    memcmp(buff + iov.len, payload, sizeof(payload)) != 0) {
+		fprintf(stderr, "Error: Data was corrupted\n");
+		ret = -EINVAL;
+		goto test_conn_splice_exit;
+	}
+
+	ret = 0;
+
+test_conn_splice_exit:
+	conn_free(&conn_tx);
+	conn_free(&conn_accepted);
+	conn_free(&conn_listener);
+
+	conn_pipe_free(&cp);
+
+	return ret;
+}
+
 static int test_conn_timeout(void)
 {
 	int ret;
@@ -244,3 +968,219 @@ test_conn_blocking_exit:
 
 	return ret;
 }
+
+static int test_conn_zerocopy(void)
+{
+	struct conn_handle conn_accepted;
+	struct conn_handle conn_listener;
+	struct conn_handle conn_tx;
+	struct conn_zerocopy_stats stats;
+	struct conn_iovec iov[2];
+	static uint8_t payload[65536];
+	static uint8_t buff[sizeof(payload) + 32];
+	unsigned int i;
+	int ret;
+
+	memset(&conn_accepted, 0x0, sizeof(conn_accepted));
+	memset(&conn_listener, 0x0, sizeof(conn_listener));
+	memset(&conn_tx, 0x0, sizeof(conn_tx));
+
+	for (i = 0; i < sizeof(payload); i++)
+		payload[i] = (uint8_t)i;
+
+	/* Small sends are still copied */
+	iov[0].buff = payload;
+	iov[0].len = 16;
+	iov[1].buff = payload;
+	iov[1].len = sizeof(payload);
+
+	conn_listener.source_addr = "127.0.0.1";
+	conn_listener.source_port = "8115";
+	conn_listener.type = CONN_TYPE_TCP;
+	ret = conn_init(&conn_listener);
+	if (ret < 0)
+		goto test_conn_zerocopy_exit;
+
+	conn_accepted.type = CONN_TYPE_TCP;
+	ret = conn_init(&conn_accepted);
+	if (ret < 0)
+		goto test_conn_zerocopy_exit;
+
+	conn_tx.type = CONN_TYPE_TCP;
+	ret = conn_init(&conn_tx);
+	if (ret < 0)
+		goto test_conn_zerocopy_exit;
+
+	ret = conn_listen(&conn_listener);
+	if (ret < 0)
+		goto test_conn_zerocopy_exit;
+
+	ret = conn_connect(&conn_tx, "127.0.0.1", "8115");
+	if (ret < 0)
+		goto test_conn_zerocopy_exit;
+
+	ret = conn_accept(&conn_listener, &conn_accepted);
+	if (ret < 0)
+		goto test_conn_zerocopy_exit;
+
+	ret = conn_set_zerocopy(&conn_accepted, 1024);
+	if (ret == -ENOSYS || ret == -ENOPROTOOPT) {
+		/* Not supported on this platform */
+		ret = 0;
+		goto test_conn_zerocopy_exit;
+	} else if (ret < 0) {
+		fprintf(stderr, "Error: Failed to enable zero-copy (%d): %s\n",
+			-ret, strerror(-ret));
+		goto test_conn_zerocopy_exit;
+	}
+
+	ret = conn_sendv(&conn_accepted, iov, 1);
+	if (ret < 0)
+		goto test_conn_zerocopy_exit;
+
+	ret = conn_sendv(&conn_accepted, iov, 2);
+	if (ret < 0)
+		goto test_conn_zerocopy_exit;
+
+	ret = conn_recv(&conn_tx, buff, sizeof(buff));
+	if (ret < 0)
+		goto test_conn_zerocopy_exit;
+
+	if (memcmp(buff, payload, 16) != 0 ||
+	    memcmp(buff + 16, payload, 16) != 0 ||
+	    memcmp(buff + 32, payload, sizeof(payload) - 16) != 0) {
+		fprintf(stderr, "Error: Data was corrupted\n");
+		ret = -EINVAL;
+		goto test_conn_zerocopy_exit;
+	}
+
+	/* Now that the data was received, the kernel should be done with it */
+	for (i = 0; i < 10; i++) {
+		ret = conn_zerocopy_reap(&conn_accepted, 1000);
+		if (ret <= 0)
+			break;
+	}
+
+	if (ret != 0) {
+		fprintf(stderr, "Error: Sends are still pending (%d)\n", ret);
+		ret = -EINVAL;
+		goto test_conn_zerocopy_exit;
+	}
+
+	conn_get_zerocopy_stats(&conn_accepted, &stats);
+	if (stats.sends == 0 || stats.completed != stats.sends ||
+	    stats.bytes != sizeof(payload) + 16) {
+		fprintf(stderr, "Error: Invalid zero-copy statistics\n");
+		ret = -EINVAL;
+		goto test_conn_zerocopy_exit;
+	}
+
+	ret = 0;
+
+test_conn_zerocopy_exit:
+	conn_free(&conn_tx);
+	conn_free(&conn_accepted);
+	conn_free(&conn_listener);
+
+	return ret;
+}
+
+#ifdef HAVE_IO_URING
+static int test_conn_uring_recv(void)
+{
+	struct conn_handle conn_rx;
+	struct conn_handle conn_tx;
+	struct conn_uring_handle cu;
+	static const uint8_t loopback[4] = { 127, 0, 0, 1 };
+	static const uint8_t payload[] = "OpenELP";
+	uint8_t buff[64];
+	uint32_t addr = 0;
+	int ret;
+	int i;
+
+	memset(&conn_rx, 0x0, sizeof(conn_rx));
+	memset(&conn_tx, 0x0, sizeof(conn_tx));
+	memset(&cu, 0x0, sizeof(cu));
+
+	ret = conn_uring_init(&cu);
+	if (ret < 0) {
+		fprintf(stderr, "Skipping io_uring test (%d): %s\n",
+			-ret, strerror(-ret));
+		return 0;
+	}
+
+	conn_rx.source_addr = "127.0.0.1";
+	conn_rx.source_port = "8110";
+	conn_rx.type = CONN_TYPE_UDP;
+	ret = conn_init(&conn_rx);
+	if (ret < 0)
+		goto test_conn_uring_recv_exit;
+
+	conn_tx.source_addr = "127.0.0.1";
+	conn_tx.type = CONN_TYPE_UDP;
+	ret = conn_init(&conn_tx);
+	if (ret < 0)
+		goto test_conn_uring_recv_exit;
+
+	ret = conn_listen(&conn_rx);
+	if (ret < 0)
+		goto test_conn_uring_recv_exit;
+
+	ret = conn_listen(&conn_tx);
+	if (ret < 0)
+		goto test_conn_uring_recv_exit;
+
+	ret = conn_uring_attach(&cu, &conn_rx);
+	if (ret < 0)
+		goto test_conn_uring_recv_exit;
+
+	ret = conn_uring_submit(&cu);
+	if (ret < 0)
+		goto test_conn_uring_recv_exit;
+
+	ret = conn_send_to(&conn_tx, payload, sizeof(payload),
+			   *(const uint32_t *)loopback, 8110);
+	if (ret < 0)
+		goto test_conn_uring_recv_exit;
+
+	/* Completions arrive asynchronously */
+	for (i = 0; i < 100 && !conn_uring_readable(&conn_rx); i++) {
+		usleep(10000);
+		conn_uring_reap(&cu);
+	}
+
+	ret = conn_recv_any(&conn_rx, buff, sizeof(buff), &addr, NULL);
+	if (ret < 0) {
+		fprintf(stderr,
+			"Error: Failed to receive datagram through io_uring (%d): %s\n",
+			-ret, strerror(-ret));
+		goto test_conn_uring_recv_exit;
+	}
+
+	if (ret != sizeof(payload) || memcmp(buff, payload, ret) != 0 ||
+	    addr != *(const uint32_t *)loopback) {
+		fprintf(stderr, "Error: Datagram was corrupted\n");
+		ret = -EINVAL;
+		goto test_conn_uring_recv_exit;
+	}
+
+	ret = conn_recv_any(&conn_rx, buff, sizeof(buff), NULL, NULL);
+	if (ret != -EAGAIN) {
+		fprintf(stderr,
+			"Error: Invalid return with no datagrams pending (%d)\n",
+			ret);
+		ret = -EINVAL;
+		goto test_conn_uring_recv_exit;
+	}
+
+	ret = 0;
+
+test_conn_uring_recv_exit:
+	conn_uring_detach(&conn_rx);
+	conn_free(&conn_rx);
+	conn_free(&conn_tx);
+	conn_uring_free(&cu);
+
+	return ret;
+}
+#endif
@@ -73,6 +73,15 @@ struct processor_context
  */
 static void proxy_processor(struct worker_handle *wh);
 
+#ifdef HAVE_EPOLL
+/*!
+ * @brief Worker function for running the proxy server's event loop
+ *
+ * @param[in,out] wh The worker context
+ */
+static void proxy_processor_loop(struct worker_handle *wh);
+#endif
+
 /*!
  * @brief Test basic proxy lifecycle and functions
  *
@@ -82,6 +91,19 @@ static void proxy_processor(struct worker_handle *wh);
  */
 static int test_proxy_e2e(void);
 
+#ifdef HAVE_EPOLL
+/*!
+ * @brief Test proxy lifecycle and forwarding using the event loop
+ *
+ * @param[in] event_loop Event loop mode, should be one of ::PROXY_EVENT_LOOP
+ *
+ * @returns 0 on success, negative ERRNO value on failure
+ *
+ * @test Test proxy lifecycle and forwarding using the event loop
+ */
+static int test_proxy_e2e_event_loop(enum PROXY_EVENT_LOOP event_loop);
+#endif
+
 /*!
  * @brief Main entry point for authorization tests
  *
@@ -94,6 +116,10 @@ int main(void)
 	int ret = 0;
 
 	ret |= test_proxy_e2e();
+#ifdef HAVE_EPOLL
+	ret |= test_proxy_e2e_event_loop(PROXY_EVENT_LOOP_SINGLE);
+	ret |= test_proxy_e2e_event_loop(PROXY_EVENT_LOOP_SHARDED);
+#endif
 
 	return ret;
 }
@@ -105,6 +131,17 @@ static void proxy_processor(struct worker_handle *wh)
 	ctx->ret = proxy_process(ctx->ph);
 }
 
+#ifdef HAVE_EPOLL
+static void proxy_processor_loop(struct worker_handle *wh)
+{
+	struct processor_context *ctx = wh->func_ctx;
+
+	do {
+		ctx->ret = proxy_process(ctx->ph);
+	} while (ctx->ret == 0);
+}
+#endif
+
 static int test_proxy_e2e(void)
 {
 	struct proxy_client_handle client = { 0 };
@@ -219,3 +256,140 @@ test_proxy_authorize_exit:
 
 	return ret;
 }
+
+#ifdef HAVE_EPOLL
+static int test_proxy_e2e_event_loop(enum PROXY_EVENT_LOOP event_loop)
+{
+	struct proxy_client_handle client = { 0 };
+	struct proxy_client_handle client2 = { 0 };
+	struct proxy_handle proxy = { 0 };
+	struct worker_handle worker = { 0 };
+	struct processor_context ctx = { 0 };
+	static const uint8_t loopback[4] = { 127, 0, 0, 1 };
+	static const uint8_t payload[] = "OpenELP";
+	uint8_t buff[64];
+	struct proxy_msg msg;
+	int ret;
+
+	/* Initialize */
+
+	ctx.ph = &proxy;
+	ctx.ret = 0;
+	worker.func_ptr = proxy_processor_loop;
+	worker.func_ctx = &ctx;
+	ret = worker_init(&worker);
+	if (ret < 0)
+		goto test_proxy_e2e_event_loop_exit;
+
+	ret = proxy_init(&proxy);
+	if (ret < 0)
+		goto test_proxy_e2e_event_loop_exit;
+
+	client.callsign = "KM0H";
+	client.host_addr = "127.0.0.1";
+	client.host_port = "8100";
+	client.password = "PUBLIC";
+	ret = proxy_client_init(&client);
+	if (ret < 0)
+		goto test_proxy_e2e_event_loop_exit;
+
+	client2.callsign = "KM0H";
+	client2.host_addr = "127.0.0.1";
+	client2.host_port = "8100";
+	client2.password = "PUBLIC";
+	ret = proxy_client_init(&client2);
+	if (ret < 0)
+		goto test_proxy_e2e_event_loop_exit;
+
+	/* Start the proxy server */
+
+	proxy_log_level(&proxy, LOG_LEVEL_WARN);
+
+	proxy.conf.bind_addr = strdup("127.0.0.1");
+	proxy.conf.bind_addr_ext = strdup("127.0.0.1");
+	proxy.conf.calls_allowed = strdup("^KM0H$");
+	proxy.conf.event_loop = event_loop;
+	proxy.conf.event_loop_threads = 2;
+	proxy.conf.password = strdup("PUBLIC");
+	proxy.conf.port = 8100;
+	ret = proxy_open(&proxy);
+	if (ret < 0)
+		goto test_proxy_e2e_event_loop_exit;
+
+	ret = proxy_start(&proxy);
+	if (ret < 0)
+		goto test_proxy_e2e_event_loop_exit;
+
+	ret = worker_start(&worker);
+	if (ret < 0)
+		goto test_proxy_e2e_event_loop_exit;
+
+	ret = worker_wake(&worker);
+	if (ret < 0)
+		goto test_proxy_e2e_event_loop_exit;
+
+	/* Try to connect and authorize */
+
+	ret = proxy_client_connect(&client);
+	if (ret < 0) {
+		fprintf(stderr, "Failed to connect to the client (%d): %s\n",
+			-ret, strerror(-ret));
+		goto test_proxy_e2e_event_loop_exit;
+	}
+
+	/* Send a datagram to the proxy's own data port and expect it back */
+
+	msg.type = PROXY_MSG_TYPE_UDP_DATA;
+	memcpy(&msg.address, loopback, sizeof(loopback));
+	msg.size = sizeof(payload);
+	ret = proxy_client_send(&client, &msg, payload);
+	if (ret < 0)
+		goto test_proxy_e2e_event_loop_exit;
+
+	ret = proxy_client_recv(&client, &msg, buff, sizeof(buff));
+	if (ret < 0) {
+		fprintf(stderr, "Failed to receive forwarded data (%d): %s\n",
+			-ret, strerror(-ret));
+		goto test_proxy_e2e_event_loop_exit;
+	}
+
+	if (msg.type != PROXY_MSG_TYPE_UDP_DATA || msg.size != sizeof(payload) ||
+	    memcmp(buff, payload, sizeof(payload)) != 0) {
+		fprintf(stderr, "Forwarded data mismatch\n");
+		ret = -EINVAL;
+		goto test_proxy_e2e_event_loop_exit;
+	}
+
+	/* Attempt another connection */
+
+	ret = proxy_client_connect(&client2);
+	if (ret != -EPIPE) {
+		fprintf(stderr, "Invalid busy signal (%d): %s\n",
+			-ret, strerror(-ret));
+		goto test_proxy_e2e_event_loop_exit;
+	}
+
+	/* The event loop should exit once the remaining client is dropped */
+
+	proxy_shutdown(&proxy);
+	proxy_drop(&proxy);
+
+	ret = worker_wait_idle(&worker);
+	if (ret < 0)
+		goto test_proxy_e2e_event_loop_exit;
+
+	if (ctx.ret != -EINTR) {
+		fprintf(stderr, "Event loop exited unexpectedly (%d): %s\n",
+			-ctx.ret, strerror(-ctx.ret));
+		ret = ctx.ret < 0 ? ctx.ret : -EINVAL;
+	}
+
+test_proxy_e2e_event_loop_exit:
+	proxy_client_free(&client2);
+	proxy_client_free(&client);
+	proxy_free(&proxy);
+	worker_free(&worker);
+
+	return ret;
+}
+#endif
@@ -0,0 +1,490 @@
+/*!
+ * @file test_msg_queue.c
+ *
+ * @copyright
+ * Copyright &copy; 2026, Scott K Logan
+ *
+ * @copyright
+ * All rights reserved.
+ *
+ * @copyright
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * @copyright
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * @copyright
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * @copyright
+ * EchoLink&reg; is a registered trademark of Synergenics, LLC
+ *
+ * @author Scott K Logan &lt;logans@cottsay.net&gt;
+ *
+ * @brief Tests related to bounded multi-producer message queues
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "msg_queue.h"
+#include "thread.h"
+
+/*! Number of threads which add messages concurrently */
+#define TEST_PRODUCERS 4
+
+/*! Number of messages added by each producing thread */
+#define TEST_MESSAGES 2000
+
+/*!
+ * @brief Contextual data for a thread which adds messages to a queue
+ */
+struct msg_queue_producer {
+	/*! The queue to add messages to */
+	struct msg_queue_handle *mq;
+
+	/*! The thread which adds the messages */
+	struct thread_handle thread;
+
+	/*! Identifies the messages added by this thread */
+	uint32_t id;
+};
+
+/*!
+ * @brief Thread function which adds TEST_MESSAGES messages to a queue
+ *
+ * @param[in,out] ctx The thread context
+ *
+ * @returns Always returns NULL
+ */
+static void *msg_queue_producer_func(void *ctx);
+
+/*!
+ * @brief Basic test of adding and removing messages from a single thread
+ *
+ * @returns 0 on success, negative ERRNO value on failure
+ *
+ * @test Basic test of adding and removing messages from a single thread
+ */
+static int test_msg_queue_basic(void);
+
+/*!
+ * @brief Test of several threads adding messages concurrently
+ *
+ * @returns 0 on success, negative ERRNO value on failure
+ *
+ * @test Test of several threads adding messages concurrently
+ */
+static int test_msg_queue_concurrent(void);
+
+/*!
+ * @brief Test of replacing the oldest message in a full queue
+ *
+ * @returns 0 on success, negative ERRNO value on failure
+ *
+ * @test Test of replacing the oldest message in a full queue
+ */
+static int test_msg_queue_replace(void);
+
+static void *msg_queue_producer_func(void *ctx)
+{
+	struct thread_handle *th = ctx;
+	struct msg_queue_producer *producer = th->func_ctx;
+	struct conn_iovec iov[2];
+	uint32_t seq;
+
+	iov[0].buff = (const uint8_t *)&producer->id;
+	iov[0].len = sizeof(producer->id);
+	iov[1].buff = (const uint8_t *)&seq;
+	iov[1].len = sizeof(seq);
+
+	for (seq = 0; seq < TEST_MESSAGES; seq++) {
+		while (msg_queue_push(producer->mq, iov, 2) == -ENOSPC)
+			;
+	}
+
+	return NULL;
+}
+
+/*!
+ * @brief Main entry point for message queue tests
+ *
+ * @returns 0 on success, non-zero value on failure
+ */
+int main(void);
+
+int main(void)
+{
+	int ret = 0;
+
+	ret |= test_msg_queue_basic();
+	ret |= test_msg_queue_concurrent();
+	ret |= test_msg_queue_replace();
+
+	return ret;
+}
+
+static int test_msg_queue_basic(void)
+{
+	struct buff_pool_handle pool;
+	struct buff_pool_stats pool_stats;
+	struct msg_queue_handle mq;
+	struct msg_queue_stats stats;
+	struct conn_iovec iov[5];
+	static const uint8_t payload[] = "OpenELP";
+	uint8_t big[17] = { 0 };
+	unsigned int count;
+	unsigned int i;
+	int ret;
+
+	memset(&pool, 0x0, sizeof(pool));
+	memset(&mq, 0x0, sizeof(mq));
+
+	pool.buff_len = 16;
+	ret = buff_pool_init(&pool);
+	if (ret < 0)
+		return ret;
+
+	mq.capacity = 4;
+	mq.msg_len = 16;
+	mq.pool = &pool;
+	ret = msg_queue_init(&mq);
+	if (ret < 0)
+		goto test_msg_queue_basic_exit;
+
+	for (i = 0; i < 4; i++) {
+		iov[0].buff = payload;
+		iov[0].len = i + 1;
+
+		ret = msg_queue_push(&mq, iov, 1);
+		if (ret < 0) {
+			fprintf(stderr, "Error: Failed to add message (%d): %s\n",
+				-ret, strerror(-ret));
+			goto test_msg_queue_basic_exit;
+		}
+	}
+
+	ret = msg_queue_push(&mq, iov, 1);
+	if (ret != -ENOSPC) {
+		fprintf(stderr, "Error: Invalid return with a full queue (%d)\n",
+			ret);
+		ret = -EINVAL;
+		goto test_msg_queue_basic_exit;
+	}
+
+	count = msg_queue_peek(&mq, 0, iov, 5);
+	if (count != 4) {
+		fprintf(stderr, "Error: Expected 4 messages but got %u\n", count);
+		ret = -EINVAL;
+		goto test_msg_queue_basic_exit;
+	}
+
+	for (i = 0; i < count; i++) {
+		if (iov[i].len != i + 1 ||
+		    memcmp(iov[i].buff, payload, iov[i].len) != 0) {
+			fprintf(stderr, "Error: Message %u was corrupted\n", i);
+			ret = -EINVAL;
+			goto test_msg_queue_basic_exit;
+		}
+	}
+
+	count = msg_queue_peek(&mq, 3, iov, 5);
+	if (count != 1 || iov[0].len != 4) {
+		fprintf(stderr, "Error: Failed to pass over the oldest messages\n");
+		ret = -EINVAL;
+		goto test_msg_queue_basic_exit;
+	}
+
+	msg_queue_get_stats(&mq, &stats);
+	if (stats.depth != 4 || stats.depth_max != 4 || stats.bytes != 10 ||
+	    stats.bytes_max != 10) {
+		fprintf(stderr, "Error: Invalid statistics for a full queue\n");
+		ret = -EINVAL;
+		goto test_msg_queue_basic_exit;
+	}
+
+	buff_pool_get_stats(&pool, &pool_stats);
+	if (pool_stats.in_use != 4) {
+		fprintf(stderr, "Error: Expected 4 buffers in use but got %u\n",
+			pool_stats.in_use);
+		ret = -EINVAL;
+		goto test_msg_queue_basic_exit;
+	}
+
+	msg_queue_pop(&mq, 3);
+
+	buff_pool_get_stats(&pool, &pool_stats);
+	if (pool_stats.in_use != 1) {
+		fprintf(stderr, "Error: Buffers were not released on removal\n");
+		ret = -EINVAL;
+		goto test_msg_queue_basic_exit;
+	}
+
+	msg_queue_get_stats(&mq, &stats);
+	if (stats.depth != 1 || stats.depth_max != 4 || stats.bytes != 4 ||
+	    stats.bytes_max != 10) {
+		fprintf(stderr, "Error: Invalid statistics after removal\n");
+		ret = -EINVAL;
+		goto test_msg_queue_basic_exit;
+	}
+
+	msg_queue_reset_stats(&mq);
+
+	msg_queue_get_stats(&mq, &stats);
+	if (stats.depth_max != 1 || stats.bytes_max != 4) {
+		fprintf(stderr, "Error: Invalid statistics after reset\n");
+		ret = -EINVAL;
+		goto test_msg_queue_basic_exit;
+	}
+
+	iov[0].buff = big;
+	iov[0].len = sizeof(big);
+	ret = msg_queue_push(&mq, iov, 1);
+	if (ret != -EMSGSIZE) {
+		fprintf(stderr,
+			"Error: Invalid return with an oversized message (%d)\n",
+			ret);
+		ret = -EINVAL;
+		goto test_msg_queue_basic_exit;
+	}
+
+	ret = 0;
+
+test_msg_queue_basic_exit:
+	msg_queue_free(&mq);
+
+	buff_pool_get_stats(&pool, &pool_stats);
+	if (ret == 0 && pool_stats.in_use != 0) {
+		fprintf(stderr, "Error: Queued buffers were not released\n");
+		ret = -EINVAL;
+	}
+
+	buff_pool_free(&pool);
+
+	return ret;
+}
+
+static int test_msg_queue_concurrent(void)
+{
+	struct buff_pool_handle pool;
+	struct msg_queue_handle mq;
+	struct msg_queue_producer producers[TEST_PRODUCERS];
+	uint32_t expected[TEST_PRODUCERS] = { 0 };
+	struct conn_iovec iov[16];
+	uint32_t received = 0;
+	uint32_t msg[2];
+	unsigned int count;
+	unsigned int i;
+	int ret;
+
+	memset(&pool, 0x0, sizeof(pool));
+	memset(&mq, 0x0, sizeof(mq));
+	memset(producers, 0x0, sizeof(producers));
+
+	pool.buff_len = sizeof(msg);
+	ret = buff_pool_init(&pool);
+	if (ret < 0)
+		return ret;
+
+	mq.capacity = 64;
+	mq.msg_len = sizeof(msg);
+	mq.pool = &pool;
+	ret = msg_queue_init(&mq);
+	if (ret < 0) {
+		buff_pool_free(&pool);
+		return ret;
+	}
+
+	for (i = 0; i < TEST_PRODUCERS; i++) {
+		producers[i].mq = &mq;
+		producers[i].id = i;
+		producers[i].thread.func_ctx = &producers[i];
+		producers[i].thread.func_ptr = msg_queue_producer_func;
+		ret = thread_init(&producers[i].thread);
+		if (ret < 0)
+			goto test_msg_queue_concurrent_exit;
+	}
+
+	for (i = 0; i < TEST_PRODUCERS; i++) {
+		ret = thread_start(&producers[i].thread);
+		if (ret < 0)
+			goto test_msg_queue_concurrent_exit;
+	}
+
+	/* Messages from each thread must arrive intact and in order */
+	while (received < TEST_PRODUCERS * TEST_MESSAGES) {
+		count = msg_queue_peek(&mq, 0, iov, 16);
+
+		for (i = 0; i < count; i++) {
+			memcpy(msg, iov[i].buff, sizeof(msg));
+
+			if (iov[i].len != sizeof(msg) || msg[0] >= TEST_PRODUCERS ||
+			    msg[1] != expected[msg[0]]) {
+				fprintf(stderr,
+					"Error: Message %u was corrupted or out of order\n",
+					received + i);
+				ret = -EINVAL;
+				goto test_msg_queue_concurrent_exit;
+			}
+
+			expected[msg[0]]++;
+		}
+
+		msg_queue_pop(&mq, count);
+		received += count;
+	}
+
+	ret = 0;
+
+test_msg_queue_concurrent_exit:
+	for (i = 0; i < TEST_PRODUCERS; i++) {
+		thread_join(&producers[i].thread);
+		thread_free(&producers[i].thread);
+	}
+
+	msg_queue_free(&mq);
+	buff_pool_free(&pool);
+
+	return ret;
+}
+
+static int test_msg_queue_replace(void)
+{
+	struct buff_pool_handle pool;
+	struct buff_pool_stats pool_stats;
+	struct msg_queue_handle mq;
+	struct msg_queue_stats stats;
+	struct conn_iovec iov[5];
+	static const uint8_t payload[] = "OpenELP";
+	static const unsigned int expected[] = { 1, 3, 4, 5 };
+	uint8_t *buff = NULL;
+	unsigned int count;
+	unsigned int i;
+	int ret;
+
+	memset(&pool, 0x0, sizeof(pool));
+	memset(&mq, 0x0, sizeof(mq));
+
+	pool.buff_len = 16;
+	ret = buff_pool_init(&pool);
+	if (ret < 0)
+		return ret;
+
+	mq.capacity = 4;
+	mq.msg_len = 16;
+	mq.pool = &pool;
+	ret = msg_queue_init(&mq);
+	if (ret < 0)
+		goto test_msg_queue_replace_exit;
+
+	for (i = 0; i < 4; i++) {
+		iov[0].buff = payload;
+		iov[0].len = i + 1;
+
+		ret = msg_queue_push(&mq, iov, 1);
+		if (ret < 0) {
+			fprintf(stderr, "Error: Failed to add message (%d): %s\n",
+				-ret, strerror(-ret));
+			goto test_msg_queue_replace_exit;
+		}
+	}
+
+	buff = buff_pool_borrow(&pool);
+	if (buff == NULL) {
+		ret = -ENOMEM;
+		goto test_msg_queue_replace_exit;
+	}
+
+	memcpy(buff, payload, 5);
+
+	/* The oldest message is kept, so the second one is discarded */
+	ret = msg_queue_replace(&mq, 1, buff, 5);
+	if (ret != 2) {
+		fprintf(stderr, "Error: Invalid return from a replacement (%d)\n",
+			ret);
+		ret = -EINVAL;
+		goto test_msg_queue_replace_exit;
+	}
+
+	count = msg_queue_peek(&mq, 0, iov, 5);
+	if (count != 4) {
+		fprintf(stderr, "Error: Expected 4 messages but got %u\n", count);
+		ret = -EINVAL;
+		goto test_msg_queue_replace_exit;
+	}
+
+	for (i = 0; i < count; i++) {
+		if (iov[i].len != expected[i] ||
+		    memcmp(iov[i].buff, payload, iov[i].len) != 0) {
+			fprintf(stderr, "Error: Message %u is out of order\n", i);
+			ret = -EINVAL;
+			goto test_msg_queue_replace_exit;
+		}
+	}
+
+	msg_queue_get_stats(&mq, &stats);
+	if (stats.depth != 4 || stats.bytes != 13 || stats.bytes_max != 13) {
+		fprintf(stderr, "Error: Invalid statistics after a replacement\n");
+		ret = -EINVAL;
+		goto test_msg_queue_replace_exit;
+	}
+
+	ret = msg_queue_replace(&mq, 4, buff, 5);
+	if (ret != -ENOSPC) {
+		fprintf(stderr,
+			"Error: Replaced a message which must be kept (%d)\n",
+			ret);
+		ret = -EINVAL;
+		goto test_msg_queue_replace_exit;
+	}
+
+	buff_pool_release(&pool, buff);
+	buff = NULL;
+
+	buff_pool_get_stats(&pool, &pool_stats);
+	if (pool_stats.in_use != 4) {
+		fprintf(stderr, "Error: Expected 4 buffers in use but got %u\n",
+			pool_stats.in_use);
+		ret = -EINVAL;
+		goto test_msg_queue_replace_exit;
+	}
+
+	ret = 0;
+
+test_msg_queue_replace_exit:
+	if (buff != NULL)
+		buff_pool_release(&pool, buff);
+
+	msg_queue_free(&mq);
+
+	buff_pool_get_stats(&pool, &pool_stats);
+	if (ret == 0 && pool_stats.in_use != 0) {
+		fprintf(stderr, "Error: Queued buffers were not released\n");
+		ret = -EINVAL;
+	}
+
+	buff_pool_free(&pool);
+
+	return ret;
+}
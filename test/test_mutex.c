@@ -0,0 +1,795 @@
+/*!
+ * @file test_mutex.c
+ *
+ * @copyright
+ * Copyright &copy; 2026, Scott K Logan
+ *
+ * @copyright
+ * All rights reserved.
+ *
+ * @copyright
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * @copyright
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * @copyright
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * @copyright
+ * EchoLink&reg; is a registered trademark of Synergenics, LLC
+ *
+ * @author Scott K Logan &lt;logans@cottsay.net&gt;
+ *
+ * @brief Tests and benchmark of the mutex and condition variable primitives
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#  include <windows.h>
+#else
+#  include <pthread.h>
+#  include <time.h>
+#endif
+
+#include "mutex.h"
+#include "thread.h"
+
+/*! Maximum number of threads contending for a lock */
+#define TEST_THREADS_MAX 64
+
+/*!
+ * @brief Lock operations exercised by the contention workers
+ */
+struct lock_ops {
+	/*! Name of the implementation, used when reporting */
+	const char *name;
+
+	/*! Acquires the exclusive lock */
+	int (*lock)(void *lock);
+
+	/*! Acquires a shared lock */
+	int (*lock_shared)(void *lock);
+
+	/*! Releases the exclusive lock */
+	int (*unlock)(void *lock);
+
+	/*! Releases a shared lock */
+	int (*unlock_shared)(void *lock);
+};
+
+/*!
+ * @brief Data shared by the contention workers
+ */
+struct lock_data {
+	/*! Operations on lock_data::lock */
+	const struct lock_ops *ops;
+
+	/*! Lock protecting lock_data::a and lock_data::b */
+	void *lock;
+
+	/*! Incremented by each exclusive holder */
+	unsigned long a;
+
+	/*! Copy of lock_data::a, which a shared holder must never see differ */
+	unsigned long b;
+};
+
+/*!
+ * @brief Contextual data for a thread which contends for a lock
+ */
+struct lock_worker {
+	/*! Data shared with the other workers */
+	struct lock_data *data;
+
+	/*! The thread which contends for the lock */
+	struct thread_handle thread;
+
+	/*! Number of times to acquire the lock */
+	unsigned long iterations;
+
+	/*! One in this many acquisitions is exclusive, or none if zero */
+	unsigned long writer_every;
+
+	/*! Number of inconsistencies observed while holding a shared lock */
+	unsigned long torn;
+
+	/*! Number of times the lock could not be acquired */
+	unsigned long errors;
+};
+
+/*!
+ * @brief Context of a thread which waits on a condition variable
+ */
+struct condvar_waiter {
+	/*! Condition variable to wait on */
+	struct condvar_handle *condvar;
+
+	/*! Mutex protecting condvar_waiter::state */
+	struct mutex_handle *mutex;
+
+	/*! Set to 1 by the waker, and to 2 by the waiter once it was awoken */
+	int state;
+};
+
+#ifndef _WIN32
+/*!
+ * @brief Shared lock emulated with a POSIX mutex, a reader counter and a
+ *        condition variable, as ::mutex_handle used to be on POSIX systems
+ */
+struct legacy_mutex {
+	/*! Broadcast when the last shared holder leaves */
+	pthread_cond_t cond;
+
+	/*! Held for the duration of the exclusive lock */
+	pthread_mutex_t lock;
+
+	/*! Number of holders of the shared lock */
+	unsigned int readers;
+};
+#endif
+
+/*!
+ * @brief Measures contention for a lock and prints the result
+ *
+ * @param[in] ops Operations on the lock
+ * @param[in] lock Lock to contend for
+ * @param[in] threads Number of contending threads
+ * @param[in] iterations Number of acquisitions made by each thread
+ * @param[in] writer_every One in this many acquisitions is exclusive
+ *
+ * @returns 0 on success, negative ERRNO value on failure
+ */
+static int bench_lock(const struct lock_ops *ops, void *lock,
+		      unsigned long threads, unsigned long iterations,
+		      unsigned long writer_every);
+
+/*!
+ * @brief Gets a monotonic timestamp
+ *
+ * @returns Timestamp in microseconds
+ */
+static unsigned long bench_time(void);
+
+/*!
+ * @brief Thread function which waits until condvar_waiter::state is set
+ *
+ * @param[in,out] ctx The thread context
+ *
+ * @returns Always returns NULL
+ */
+static void *condvar_waiter_func(void *ctx);
+
+#ifndef _WIN32
+/*!
+ * @brief Acquires the exclusive lock on a ::legacy_mutex
+ *
+ * @param[in,out] lock Target ::legacy_mutex
+ *
+ * @returns 0 on success, negative ERRNO value on failure
+ */
+static int legacy_lock(void *lock);
+
+/*!
+ * @brief Acquires a shared lock on a ::legacy_mutex
+ *
+ * @param[in,out] lock Target ::legacy_mutex
+ *
+ * @returns 0 on success, negative ERRNO value on failure
+ */
+static int legacy_lock_shared(void *lock);
+
+/*!
+ * @brief Releases the exclusive lock on a ::legacy_mutex
+ *
+ * @param[in,out] lock Target ::legacy_mutex
+ *
+ * @returns 0 on success, negative ERRNO value on failure
+ */
+static int legacy_unlock(void *lock);
+
+/*!
+ * @brief Releases a shared lock on a ::legacy_mutex
+ *
+ * @param[in,out] lock Target ::legacy_mutex
+ *
+ * @returns 0 on success, negative ERRNO value on failure
+ */
+static int legacy_unlock_shared(void *lock);
+#endif
+
+/*!
+ * @brief Thread function which contends for a lock
+ *
+ * @param[in,out] ctx The thread context
+ *
+ * @returns Always returns NULL
+ */
+static void *lock_worker_func(void *ctx);
+
+/*!
+ * @brief Runs threads contending for a lock and waits for them to finish
+ *
+ * @param[in,out] data Data shared by the workers
+ * @param[out] workers Workers to run
+ * @param[in] threads Number of workers
+ * @param[in] iterations Number of acquisitions made by each worker
+ * @param[in] writer_every One in this many acquisitions is exclusive
+ *
+ * @returns 0 on success, negative ERRNO value on failure
+ */
+static int lock_workers_run(struct lock_data *data,
+			    struct lock_worker *workers, unsigned long threads,
+			    unsigned long iterations,
+			    unsigned long writer_every);
+
+/*!
+ * @brief Acquires the exclusive lock on a ::mutex_handle
+ *
+ * @param[in,out] lock Target ::mutex_handle
+ *
+ * @returns 0 on success, negative ERRNO value on failure
+ */
+static int mutex_ops_lock(void *lock);
+
+/*!
+ * @brief Acquires a shared lock on a ::mutex_handle
+ *
+ * @param[in,out] lock Target ::mutex_handle
+ *
+ * @returns 0 on success, negative ERRNO value on failure
+ */
+static int mutex_ops_lock_shared(void *lock);
+
+/*!
+ * @brief Releases the exclusive lock on a ::mutex_handle
+ *
+ * @param[in,out] lock Target ::mutex_handle
+ *
+ * @returns 0 on success, negative ERRNO value on failure
+ */
+static int mutex_ops_unlock(void *lock);
+
+/*!
+ * @brief Releases a shared lock on a ::mutex_handle
+ *
+ * @param[in,out] lock Target ::mutex_handle
+ *
+ * @returns 0 on success, negative ERRNO value on failure
+ */
+static int mutex_ops_unlock_shared(void *lock);
+
+/*!
+ * @brief Thread function which acquires and releases a shared lock
+ *
+ * @param[in,out] ctx The thread context
+ *
+ * @returns Always returns NULL
+ */
+static void *shared_locker_func(void *ctx);
+
+/*!
+ * @brief Test a condition variable wait which times out
+ *
+ * @returns 0 on success, negative ERRNO value on failure
+ *
+ * @test Test a condition variable wait which times out
+ */
+static int test_condvar_wait_time(void);
+
+/*!
+ * @brief Test waking a thread blocked on a condition variable
+ *
+ * @returns 0 on success, negative ERRNO value on failure
+ *
+ * @test Test waking a thread blocked on a condition variable
+ */
+static int test_condvar_wake(void);
+
+/*!
+ * @brief Test that shared and exclusive holders never overlap under contention
+ *
+ * @returns 0 on success, negative ERRNO value on failure
+ *
+ * @test Test that shared and exclusive holders never overlap under contention
+ */
+static int test_mutex_contention(void);
+
+/*!
+ * @brief Test that a shared lock can be held by two threads at once
+ *
+ * @returns 0 on success, negative ERRNO value on failure
+ *
+ * @test Test that a shared lock can be held by two threads at once
+ */
+static int test_mutex_shared(void);
+
+/*!
+ * @brief Main entry point for mutex tests
+ *
+ * @param[in] argc Number of arguments in argv
+ * @param[in] argv Optional number of threads, acquisitions per thread and
+ *                 ratio of shared to exclusive acquisitions, which runs the
+ *                 contention benchmark instead of the tests
+ *
+ * @returns 0 on success, non-zero value on failure
+ */
+int main(int argc, char *argv[]);
+
+/*! Operations on a ::mutex_handle */
+static const struct lock_ops mutex_ops = {
+	"mutex_handle",
+	mutex_ops_lock,
+	mutex_ops_lock_shared,
+	mutex_ops_unlock,
+	mutex_ops_unlock_shared,
+};
+
+#ifndef _WIN32
+/*! Operations on a ::legacy_mutex */
+static const struct lock_ops legacy_ops = {
+	"legacy",
+	legacy_lock,
+	legacy_lock_shared,
+	legacy_unlock,
+	legacy_unlock_shared,
+};
+#endif
+
+int main(int argc, char *argv[])
+{
+	struct mutex_handle mutex = { 0 };
+	unsigned long threads = 4;
+	unsigned long iterations = 1000000;
+	unsigned long writer_every = 100;
+#ifndef _WIN32
+	struct legacy_mutex legacy;
+#endif
+	int ret = 0;
+
+	if (argc <= 1) {
+		ret |= test_condvar_wait_time();
+		ret |= test_condvar_wake();
+		ret |= test_mutex_contention();
+		ret |= test_mutex_shared();
+
+		return ret;
+	}
+
+	threads = strtoul(argv[1], NULL, 10);
+	if (argc > 2)
+		iterations = strtoul(argv[2], NULL, 10);
+	if (argc > 3)
+		writer_every = strtoul(argv[3], NULL, 10);
+
+	if (argc > 4 || threads < 1 || threads > TEST_THREADS_MAX ||
+	    iterations < 1) {
+		fprintf(stderr,
+			"Usage: %s [THREADS [ITERATIONS [WRITER_EVERY]]]\n",
+			argv[0]);
+		return 1;
+	}
+
+	ret = mutex_init(&mutex);
+	if (ret < 0)
+		return 1;
+
+	ret = bench_lock(&mutex_ops, &mutex, threads, iterations,
+			 writer_every);
+
+	mutex_free(&mutex);
+
+#ifndef _WIN32
+	if (ret == 0) {
+		memset(&legacy, 0x0, sizeof(legacy));
+		pthread_mutex_init(&legacy.lock, NULL);
+		pthread_cond_init(&legacy.cond, NULL);
+
+		ret = bench_lock(&legacy_ops, &legacy, threads, iterations,
+				 writer_every);
+
+		pthread_cond_destroy(&legacy.cond);
+		pthread_mutex_destroy(&legacy.lock);
+	}
+
+#endif
+	return ret == 0 ? 0 : 1;
+}
+
+static int bench_lock(const struct lock_ops *ops, void *lock,
+		      unsigned long threads, unsigned long iterations,
+		      unsigned long writer_every)
+{
+	struct lock_worker workers[TEST_THREADS_MAX];
+	struct lock_data data;
+	unsigned long elapsed;
+	unsigned long start;
+	int ret;
+
+	memset(&data, 0x0, sizeof(data));
+	data.ops = ops;
+	data.lock = lock;
+
+	start = bench_time();
+
+	ret = lock_workers_run(&data, workers, threads, iterations,
+			       writer_every);
+	if (ret < 0)
+		return ret;
+
+	elapsed = bench_time() - start;
+
+	printf("%s: %lu threads acquired the lock %lu times each, one in %lu exclusively, in %lu us (%lu ns each)\n",
+	       ops->name, threads, iterations, writer_every, elapsed,
+	       (unsigned long)((double)elapsed * 1000.0 /
+			       ((double)threads * (double)iterations)));
+
+	return 0;
+}
+
+static unsigned long bench_time(void)
+{
+#ifdef _WIN32
+	return GetTickCount() * 1000UL;
+#else
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	return (unsigned long)now.tv_sec * 1000000 + now.tv_nsec / 1000;
+#endif
+}
+
+static void *condvar_waiter_func(void *ctx)
+{
+	struct thread_handle *th = ctx;
+	struct condvar_waiter *waiter = th->func_ctx;
+
+	mutex_lock(waiter->mutex);
+
+	while (waiter->state == 0)
+		condvar_wait(waiter->condvar, waiter->mutex);
+
+	waiter->state = 2;
+
+	mutex_unlock(waiter->mutex);
+
+	return NULL;
+}
+
+#ifndef _WIN32
+static int legacy_lock(void *lock)
+{
+	struct legacy_mutex *lm = lock;
+	int ret;
+
+	ret = pthread_mutex_lock(&lm->lock);
+	if (ret != 0)
+		return -ret;
+
+	while (lm->readers > 0) {
+		ret = pthread_cond_wait(&lm->cond, &lm->lock);
+		if (ret != 0) {
+			pthread_mutex_unlock(&lm->lock);
+			return -ret;
+		}
+	}
+
+	return 0;
+}
+
+static int legacy_lock_shared(void *lock)
+{
+	struct legacy_mutex *lm = lock;
+	int ret;
+
+	ret = pthread_mutex_lock(&lm->lock);
+	if (ret != 0)
+		return -ret;
+
+	lm->readers++;
+
+	return -pthread_mutex_unlock(&lm->lock);
+}
+
+static int legacy_unlock(void *lock)
+{
+	struct legacy_mutex *lm = lock;
+
+	return -pthread_mutex_unlock(&lm->lock);
+}
+
+static int legacy_unlock_shared(void *lock)
+{
+	struct legacy_mutex *lm = lock;
+	int ret;
+
+	ret = pthread_mutex_lock(&lm->lock);
+	if (ret != 0)
+		return -ret;
+
+	if (--(lm->readers) == 0)
+		pthread_cond_broadcast(&lm->cond);
+
+	return -pthread_mutex_unlock(&lm->lock);
+}
+#endif
+
+static void *lock_worker_func(void *ctx)
+{
+	struct thread_handle *th = ctx;
+	struct lock_worker *worker = th->func_ctx;
+	struct lock_data *data = worker->data;
+	unsigned long i;
+
+	for (i = 0; i < worker->iterations; i++) {
+		if (worker->writer_every != 0 && i % worker->writer_every == 0) {
+			if (data->ops->lock(data->lock) < 0) {
+				worker->errors++;
+				continue;
+			}
+
+			data->a++;
+			data->b = data->a;
+
+			data->ops->unlock(data->lock);
+		} else {
+			if (data->ops->lock_shared(data->lock) < 0) {
+				worker->errors++;
+				continue;
+			}
+
+			if (data->a != data->b)
+				worker->torn++;
+
+			data->ops->unlock_shared(data->lock);
+		}
+	}
+
+	return NULL;
+}
+
+static int lock_workers_run(struct lock_data *data,
+			    struct lock_worker *workers, unsigned long threads,
+			    unsigned long iterations,
+			    unsigned long writer_every)
+{
+	unsigned long i;
+	int ret = 0;
+
+	memset(workers, 0x0, sizeof(*workers) * threads);
+
+	for (i = 0; i < threads; i++) {
+		workers[i].data = data;
+		workers[i].iterations = iterations;
+		workers[i].writer_every = writer_every;
+		workers[i].thread.func_ctx = &workers[i];
+		workers[i].thread.func_ptr = lock_worker_func;
+		ret = thread_init(&workers[i].thread);
+		if (ret < 0)
+			goto lock_workers_run_exit;
+	}
+
+	for (i = 0; i < threads; i++) {
+		ret = thread_start(&workers[i].thread);
+		if (ret < 0)
+			goto lock_workers_run_exit;
+	}
+
+lock_workers_run_exit:
+	for (i = 0; i < threads; i++) {
+		thread_join(&workers[i].thread);
+		thread_free(&workers[i].thread);
+
+		if (workers[i].errors != 0) {
+			fprintf(stderr,
+				"Error: Thread %lu failed to acquire the lock %lu times\n",
+				i, workers[i].errors);
+			ret = -EINVAL;
+		}
+
+		if (workers[i].torn != 0) {
+			fprintf(stderr,
+				"Error: Thread %lu saw %lu writes in progress\n",
+				i, workers[i].torn);
+			ret = -EINVAL;
+		}
+	}
+
+	return ret;
+}
+
+static int mutex_ops_lock(void *lock)
+{
+	return mutex_lock(lock);
+}
+
+static int mutex_ops_lock_shared(void *lock)
+{
+	return mutex_lock_shared(lock);
+}
+
+static int mutex_ops_unlock(void *lock)
+{
+	return mutex_unlock(lock);
+}
+
+static int mutex_ops_unlock_shared(void *lock)
+{
+	return mutex_unlock_shared(lock);
+}
+
+static void *shared_locker_func(void *ctx)
+{
+	struct thread_handle *th = ctx;
+	struct mutex_handle *mutex = th->func_ctx;
+
+	mutex_lock_shared(mutex);
+	mutex_unlock_shared(mutex);
+
+	return NULL;
+}
+
+static int test_condvar_wait_time(void)
+{
+	struct condvar_handle condvar = { 0 };
+	struct mutex_handle mutex = { 0 };
+	int ret;
+
+	ret = mutex_init(&mutex);
+	if (ret < 0)
+		return ret;
+
+	ret = condvar_init(&condvar);
+	if (ret < 0)
+		goto test_condvar_wait_time_exit;
+
+	mutex_lock(&mutex);
+	ret = condvar_wait_time(&condvar, &mutex, 10);
+	mutex_unlock(&mutex);
+
+	if (ret != 1) {
+		fprintf(stderr, "Error: Wait did not time out (%d)\n", ret);
+		ret = -EINVAL;
+	} else {
+		ret = 0;
+	}
+
+test_condvar_wait_time_exit:
+	condvar_free(&condvar);
+	mutex_free(&mutex);
+
+	return ret;
+}
+
+static int test_condvar_wake(void)
+{
+	struct condvar_handle condvar = { 0 };
+	struct mutex_handle mutex = { 0 };
+	struct thread_handle thread = { 0 };
+	struct condvar_waiter waiter;
+	int ret;
+
+	waiter.condvar = &condvar;
+	waiter.mutex = &mutex;
+	waiter.state = 0;
+
+	ret = mutex_init(&mutex);
+	if (ret < 0)
+		return ret;
+
+	ret = condvar_init(&condvar);
+	if (ret < 0)
+		goto test_condvar_wake_exit;
+
+	thread.func_ctx = &waiter;
+	thread.func_ptr = condvar_waiter_func;
+	ret = thread_init(&thread);
+	if (ret < 0)
+		goto test_condvar_wake_exit;
+
+	ret = thread_start(&thread);
+	if (ret < 0)
+		goto test_condvar_wake_exit;
+
+	mutex_lock(&mutex);
+	waiter.state = 1;
+	condvar_wake_one(&condvar);
+	mutex_unlock(&mutex);
+
+	thread_join(&thread);
+
+	if (waiter.state != 2) {
+		fprintf(stderr, "Error: Waiter was not awoken\n");
+		ret = -EINVAL;
+	}
+
+test_condvar_wake_exit:
+	thread_free(&thread);
+	condvar_free(&condvar);
+	mutex_free(&mutex);
+
+	return ret;
+}
+
+static int test_mutex_contention(void)
+{
+	struct lock_worker workers[4];
+	struct mutex_handle mutex = { 0 };
+	struct lock_data data;
+	int ret;
+
+	ret = mutex_init(&mutex);
+	if (ret < 0)
+		return ret;
+
+	memset(&data, 0x0, sizeof(data));
+	data.ops = &mutex_ops;
+	data.lock = &mutex;
+
+	ret = lock_workers_run(&data, workers, 4, 20000, 8);
+	if (ret == 0 && data.a != 4 * 20000 / 8) {
+		fprintf(stderr, "Error: Exclusive holders overlapped\n");
+		ret = -EINVAL;
+	}
+
+	mutex_free(&mutex);
+
+	return ret;
+}
+
+static int test_mutex_shared(void)
+{
+	struct mutex_handle mutex = { 0 };
+	struct thread_handle thread = { 0 };
+	int ret;
+
+	ret = mutex_init(&mutex);
+	if (ret < 0)
+		return ret;
+
+	thread.func_ctx = &mutex;
+	thread.func_ptr = shared_locker_func;
+	ret = thread_init(&thread);
+	if (ret < 0)
+		goto test_mutex_shared_exit;
+
+	/* The thread can only finish if it can share the lock with us */
+	mutex_lock_shared(&mutex);
+
+	ret = thread_start(&thread);
+	if (ret == 0)
+		thread_join(&thread);
+
+	mutex_unlock_shared(&mutex);
+
+test_mutex_shared_exit:
+	thread_free(&thread);
+	mutex_free(&mutex);
+
+	return ret;
+}
@@ -0,0 +1,503 @@
+/*!
+ * @file test_registration.c
+ *
+ * @copyright
+ * Copyright &copy; 2026, Scott K Logan
+ *
+ * @copyright
+ * All rights reserved.
+ *
+ * @copyright
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * @copyright
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * @copyright
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * @copyright
+ * EchoLink&reg; is a registered trademark of Synergenics, LLC
+ *
+ * @author Scott K Logan &lt;logans@cottsay.net&gt;
+ *
+ * @brief Tests of the registration service against an emulated registrar
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+
+#ifdef _WIN32
+#  include <windows.h>
+#else
+#  include <unistd.h>
+#endif
+
+#include "conf.h"
+#include "emu.h"
+#include "registration.h"
+
+/*! Address the emulated registrar listens on */
+#define TEST_REGISTRAR_ADDR "127.0.0.1"
+
+/*! Port the emulated registrar listens on */
+#define TEST_REGISTRAR_PORT "8190"
+
+/*! Number of updates sent before the service is stopped */
+#define TEST_UPDATES 4
+
+/*!
+ * @brief Sends several updates to an emulated registrar and stops the service
+ *
+ * @param[in] chunked Non-zero for the registrar to send chunked responses
+ * @param[in] requests_per_conn Number of requests the registrar answers on
+ *                              each connection, or 0 for no limit
+ * @param[in] connections Number of connections the registrar should see
+ *
+ * @returns 0 on success, negative ERRNO value on failure
+ */
+static int registration_run(uint8_t chunked, uint32_t requests_per_conn,
+			    uint32_t connections);
+
+/*!
+ * @brief Sleeps the calling thread
+ *
+ * @param[in] msec Time to sleep in milliseconds
+ */
+static void registration_sleep(unsigned long msec);
+
+/*!
+ * @brief Waits for the registrar to answer a number of requests
+ *
+ * @param[in,out] rh Target registrar instance
+ * @param[in] requests Number of requests to wait for
+ * @param[out] stats Statistics of the registrar once they were answered
+ *
+ * @returns 0 on success, negative ERRNO value on failure
+ */
+static int registration_wait(struct emu_registrar_handle *rh,
+			     uint32_t requests,
+			     struct emu_registrar_stats *stats);
+
+/*!
+ * @brief Test that updates are read in full from chunked responses
+ *
+ * @returns 0 on success, negative ERRNO value on failure
+ *
+ * @test Test that updates are read in full from chunked responses
+ */
+static int test_registration_chunked(void);
+
+/*!
+ * @brief Test that rapid updates are sent together and unchanged updates are
+ *        not sent at all
+ *
+ * @returns 0 on success, negative ERRNO value on failure
+ *
+ * @test Test that rapid updates are sent together and unchanged updates are
+ *       not sent at all
+ */
+static int test_registration_coalesce(void);
+
+/*!
+ * @brief Test that every update is sent on the same connection
+ *
+ * @returns 0 on success, negative ERRNO value on failure
+ *
+ * @test Test that every update is sent on the same connection
+ */
+static int test_registration_keep_alive(void);
+
+/*!
+ * @brief Test that an update which changes nothing doesn't delay the periodic
+ *        report
+ *
+ * @returns 0 on success, negative ERRNO value on failure
+ *
+ * @test Test that an update which changes nothing doesn't delay the periodic
+ *       report
+ */
+static int test_registration_heartbeat(void);
+
+/*!
+ * @brief Test that updates are still delivered when the registrar closes
+ *        idle connections
+ *
+ * @returns 0 on success, negative ERRNO value on failure
+ *
+ * @test Test that updates are still delivered when the registrar closes idle
+ *       connections
+ */
+static int test_registration_reconnect(void);
+
+/*!
+ * @brief Main entry point for registration tests
+ *
+ * @returns 0 on success, non-zero value on failure
+ */
+int main(void);
+
+int main(void)
+{
+	int ret = 0;
+
+	ret |= test_registration_chunked();
+	ret |= test_registration_coalesce();
+	ret |= test_registration_heartbeat();
+	ret |= test_registration_keep_alive();
+	ret |= test_registration_reconnect();
+
+	return ret;
+}
+
+static int registration_run(uint8_t chunked, uint32_t requests_per_conn,
+			    uint32_t connections)
+{
+	struct emu_registrar_handle rh;
+	struct emu_registrar_stats stats;
+	struct registration_service_handle rs;
+	struct proxy_conf conf;
+	char expected[32];
+	uint32_t i;
+	int ret;
+
+	memset(&rh, 0x0, sizeof(rh));
+	memset(&rs, 0x0, sizeof(rs));
+	memset(&conf, 0x0, sizeof(conf));
+
+	rh.addr = TEST_REGISTRAR_ADDR;
+	rh.port = TEST_REGISTRAR_PORT;
+	rh.chunked = chunked;
+	rh.requests_per_conn = requests_per_conn;
+
+	rs.host = TEST_REGISTRAR_ADDR;
+	rs.port = TEST_REGISTRAR_PORT;
+
+	ret = conf_init(&conf);
+	if (ret < 0)
+		return ret;
+
+	conf.password = "PUBLIC";
+	conf.reg_name = "EMU-PROXY";
+	conf.reg_comment = "Emulated";
+	conf.reg_interval = 0;
+
+	ret = emu_registrar_init(&rh);
+	if (ret < 0)
+		return ret;
+
+	ret = registration_service_init(&rs);
+	if (ret < 0)
+		goto registration_run_exit;
+
+	ret = emu_registrar_start(&rh);
+	if (ret < 0) {
+		fprintf(stderr,
+			"Error: Failed to start the registrar (%d): %s\n",
+			-ret, strerror(-ret));
+		goto registration_run_exit;
+	}
+
+	ret = registration_service_start(&rs, &conf);
+	if (ret < 0)
+		goto registration_run_exit;
+
+	for (i = 1; i <= TEST_UPDATES; i++) {
+		registration_service_update(&rs, i % 2, 2);
+
+		ret = registration_wait(&rh, i, &stats);
+		if (ret < 0)
+			goto registration_run_exit;
+
+		sprintf(expected, "[%lu/2]", (unsigned long)(i % 2));
+		if (strstr(stats.last_body, expected) == NULL) {
+			fprintf(stderr, "Error: Unexpected update '%s'\n",
+				stats.last_body);
+			ret = -EINVAL;
+			goto registration_run_exit;
+		}
+	}
+
+	/* Stopping sends one last update synchronously */
+	ret = registration_service_stop(&rs);
+	if (ret < 0)
+		goto registration_run_exit;
+
+	emu_registrar_get_stats(&rh, &stats);
+	if (stats.requests != TEST_UPDATES + 1 ||
+	    strstr(stats.last_body, "status=Off") == NULL) {
+		fprintf(stderr,
+			"Error: Final update was not sent (%u requests, last '%s')\n",
+			stats.requests, stats.last_body);
+		ret = -EINVAL;
+	} else if (stats.connections != connections) {
+		fprintf(stderr,
+			"Error: Registrar saw %u connections instead of %u\n",
+			stats.connections, connections);
+		ret = -EINVAL;
+	}
+
+registration_run_exit:
+	registration_service_free(&rs);
+	emu_registrar_free(&rh);
+
+	return ret;
+}
+
+static void registration_sleep(unsigned long msec)
+{
+#ifdef _WIN32
+	Sleep(msec);
+#else
+	usleep(msec * 1000);
+#endif
+}
+
+static int registration_wait(struct emu_registrar_handle *rh,
+			     uint32_t requests,
+			     struct emu_registrar_stats *stats)
+{
+	int i;
+
+	for (i = 0; i < 500; i++) {
+		emu_registrar_get_stats(rh, stats);
+		if (stats->requests >= requests)
+			return 0;
+
+		registration_sleep(10);
+	}
+
+	fprintf(stderr, "Error: Registrar answered %u of %u requests\n",
+		stats->requests, requests);
+
+	return -ETIMEDOUT;
+}
+
+static int test_registration_chunked(void)
+{
+	return registration_run(1, 0, 1);
+}
+
+static int test_registration_coalesce(void)
+{
+	struct emu_registrar_handle rh;
+	struct emu_registrar_stats stats;
+	struct registration_service_handle rs;
+	struct registration_service_stats rs_stats;
+	struct proxy_conf conf;
+	int ret;
+
+	memset(&rh, 0x0, sizeof(rh));
+	memset(&rs, 0x0, sizeof(rs));
+	memset(&conf, 0x0, sizeof(conf));
+
+	rh.addr = TEST_REGISTRAR_ADDR;
+	rh.port = TEST_REGISTRAR_PORT;
+
+	rs.host = TEST_REGISTRAR_ADDR;
+	rs.port = TEST_REGISTRAR_PORT;
+
+	ret = conf_init(&conf);
+	if (ret < 0)
+		return ret;
+
+	conf.password = "PUBLIC";
+	conf.reg_name = "EMU-PROXY";
+	conf.reg_comment = "Emulated";
+	conf.reg_interval = 1;
+
+	ret = emu_registrar_init(&rh);
+	if (ret < 0)
+		return ret;
+
+	ret = registration_service_init(&rs);
+	if (ret < 0)
+		goto test_registration_coalesce_exit;
+
+	ret = emu_registrar_start(&rh);
+	if (ret < 0)
+		goto test_registration_coalesce_exit;
+
+	ret = registration_service_start(&rs, &conf);
+	if (ret < 0)
+		goto test_registration_coalesce_exit;
+
+	/* The first update is never held back */
+	registration_service_update(&rs, 0, 2);
+	ret = registration_wait(&rh, 1, &stats);
+	if (ret < 0)
+		goto test_registration_coalesce_exit;
+
+	/* Three changes and a repeat within the interval */
+	registration_service_update(&rs, 1, 2);
+	registration_service_update(&rs, 0, 2);
+	registration_service_update(&rs, 1, 2);
+	registration_service_update(&rs, 1, 2);
+
+	emu_registrar_get_stats(&rh, &stats);
+	if (stats.requests != 1) {
+		fprintf(stderr, "Error: Update was not held back\n");
+		ret = -EINVAL;
+		goto test_registration_coalesce_exit;
+	}
+
+	ret = registration_wait(&rh, 2, &stats);
+	if (ret < 0)
+		goto test_registration_coalesce_exit;
+
+	if (strstr(stats.last_body, "[1/2]") == NULL) {
+		fprintf(stderr, "Error: Unexpected update '%s'\n",
+			stats.last_body);
+		ret = -EINVAL;
+		goto test_registration_coalesce_exit;
+	}
+
+	/* Nothing has changed since the last report */
+	registration_service_update(&rs, 1, 2);
+
+	ret = registration_service_stop(&rs);
+	if (ret < 0)
+		goto test_registration_coalesce_exit;
+
+	emu_registrar_get_stats(&rh, &stats);
+	registration_service_get_stats(&rs, &rs_stats);
+	if (stats.requests != 3 || rs_stats.sent != 3 ||
+	    rs_stats.suppressed != 4 || rs_stats.failed != 0) {
+		fprintf(stderr,
+			"Error: Registrar saw %u requests, %u sent, %u suppressed and %u failed\n",
+			stats.requests, rs_stats.sent, rs_stats.suppressed,
+			rs_stats.failed);
+		ret = -EINVAL;
+	}
+
+test_registration_coalesce_exit:
+	registration_service_free(&rs);
+	emu_registrar_free(&rh);
+
+	return ret;
+}
+
+static int test_registration_heartbeat(void)
+{
+	struct emu_registrar_handle rh;
+	struct emu_registrar_stats stats;
+	struct registration_service_handle rs;
+	struct registration_service_stats rs_stats;
+	struct proxy_conf conf;
+	int i;
+	int ret;
+
+	memset(&rh, 0x0, sizeof(rh));
+	memset(&rs, 0x0, sizeof(rs));
+	memset(&conf, 0x0, sizeof(conf));
+
+	rh.addr = TEST_REGISTRAR_ADDR;
+	rh.port = TEST_REGISTRAR_PORT;
+
+	rs.host = TEST_REGISTRAR_ADDR;
+	rs.port = TEST_REGISTRAR_PORT;
+	rs.heartbeat = 1500;
+
+	ret = conf_init(&conf);
+	if (ret < 0)
+		return ret;
+
+	conf.password = "PUBLIC";
+	conf.reg_name = "EMU-PROXY";
+	conf.reg_comment = "Emulated";
+	conf.reg_interval = 1;
+
+	ret = emu_registrar_init(&rh);
+	if (ret < 0)
+		return ret;
+
+	ret = registration_service_init(&rs);
+	if (ret < 0)
+		goto test_registration_heartbeat_exit;
+
+	ret = emu_registrar_start(&rh);
+	if (ret < 0)
+		goto test_registration_heartbeat_exit;
+
+	ret = registration_service_start(&rs, &conf);
+	if (ret < 0)
+		goto test_registration_heartbeat_exit;
+
+	registration_service_update(&rs, 0, 2);
+	ret = registration_wait(&rh, 1, &stats);
+	if (ret < 0)
+		goto test_registration_heartbeat_exit;
+
+	/* Changed and changed back within the interval, so nothing is sent */
+	registration_sleep(200);
+	registration_service_update(&rs, 1, 2);
+	registration_service_update(&rs, 0, 2);
+
+	/* The periodic report is due 1500 ms after the first one */
+	for (i = 0; i < 180; i++) {
+		emu_registrar_get_stats(&rh, &stats);
+		if (stats.requests >= 2)
+			break;
+
+		registration_sleep(10);
+	}
+
+	if (stats.requests != 2) {
+		fprintf(stderr, "Error: Periodic report was delayed\n");
+		ret = -ETIMEDOUT;
+		goto test_registration_heartbeat_exit;
+	}
+
+	ret = registration_service_stop(&rs);
+	if (ret < 0)
+		goto test_registration_heartbeat_exit;
+
+	emu_registrar_get_stats(&rh, &stats);
+	registration_service_get_stats(&rs, &rs_stats);
+	if (stats.requests != 3 || rs_stats.sent != 3 ||
+	    rs_stats.suppressed != 2 || rs_stats.failed != 0) {
+		fprintf(stderr,
+			"Error: Registrar saw %u requests, %u sent, %u suppressed and %u failed\n",
+			stats.requests, rs_stats.sent, rs_stats.suppressed,
+			rs_stats.failed);
+		ret = -EINVAL;
+	}
+
+test_registration_heartbeat_exit:
+	registration_service_free(&rs);
+	emu_registrar_free(&rh);
+
+	return ret;
+}
+
+static int test_registration_keep_alive(void)
+{
+	return registration_run(0, 0, 1);
+}
+
+static int test_registration_reconnect(void)
+{
+	/* Five requests, two at a time */
+	return registration_run(0, 2, 3);
+}
@@ -0,0 +1,799 @@
+/*!
+ * @file test_session.c
+ *
+ * @copyright
+ * Copyright &copy; 2026, Scott K Logan
+ *
+ * @copyright
+ * All rights reserved.
+ *
+ * @copyright
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * @copyright
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * @copyright
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * @copyright
+ * EchoLink&reg; is a registered trademark of Synergenics, LLC
+ *
+ * @author Scott K Logan &lt;logans@cottsay.net&gt;
+ *
+ * @brief Full client sessions through the proxy against emulated stations
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#  include <windows.h>
+#  define strdup _strdup
+#else
+#  include <time.h>
+#  include <unistd.h>
+#endif
+
+#include "emu.h"
+#include "openelp/openelp.h"
+#include "proxy_client.h"
+#include "worker.h"
+
+/*! Maximum number of emulated stations, each of which needs its own loopback
+ *  alias */
+#define SESSION_STATIONS_MAX 64
+
+/*! Last octet of the loopback alias of the emulated directory server */
+#define SESSION_DIRECTORY_HOST 2
+
+/*! Last octet of the loopback alias of the first emulated station */
+#define SESSION_STATION_HOST 3
+
+/*! Synchronization source identifier of the client */
+#define SESSION_SSRC 0x4B4D3048
+
+/*! Milliseconds to wait for a message before declaring it lost */
+#define SESSION_TIMEOUT 5000
+
+/*! Context for ::proxy_processor */
+struct processor_context
+{
+	/*! Handle to the proxy instance to process messages for */
+	struct proxy_handle *ph;
+
+	/*! Return value from the most recent processing run */
+	int ret;
+};
+
+/*!
+ * @brief Parameters of the sessions to run through the proxy
+ */
+struct session_params {
+	/*! Number of emulated stations to talk to at once */
+	unsigned long stations;
+
+	/*! Number of RTP packets each station sends */
+	unsigned long packets;
+
+	/*! Milliseconds between the RTP packets sent by each station */
+	unsigned long interval;
+
+	/*! Number of entries in the directory server's station list */
+	unsigned long directory_stations;
+
+	/*! Non-zero to print how long each session took */
+	int report;
+};
+
+/*!
+ * @brief Measurements taken during a session
+ */
+struct session_result {
+	/*! Milliseconds spent fetching the station list */
+	unsigned long elapsed_directory;
+
+	/*! Milliseconds spent receiving the transmissions from the stations */
+	unsigned long elapsed_stations;
+
+	/*! Number of RTP packets from the stations which never arrived */
+	unsigned long lost;
+
+	/*! Number of RTP packets sent back to the stations which never arrived */
+	unsigned long lost_back;
+};
+
+/*!
+ * @brief Summary of a response to a directory server request
+ */
+struct session_response {
+	/*! Number of bytes in the response */
+	size_t len;
+
+	/*! Number of newlines in the response */
+	size_t lines;
+
+	/*! First bytes of the response */
+	char head[4];
+
+	/*! Last bytes of the response */
+	char tail[3];
+};
+
+/*!
+ * @brief Worker function for processing proxy server messages
+ *
+ * @param[in,out] wh The worker context
+ */
+static void proxy_processor(struct worker_handle *wh);
+
+#ifdef HAVE_EPOLL
+/*!
+ * @brief Worker function for running the proxy server's event loop
+ *
+ * @param[in,out] wh The worker context
+ */
+static void proxy_processor_loop(struct worker_handle *wh);
+#endif
+
+/*!
+ * @brief Logs in to the emulated directory server and fetches the station list
+ *
+ * @param[in,out] client Connected client
+ * @param[in] params Parameters of the session
+ * @param[out] result Measurements to populate
+ *
+ * @returns 0 on success, negative ERRNO value on failure
+ */
+static int session_directory(struct proxy_client_handle *client,
+			     const struct session_params *params,
+			     struct session_result *result);
+
+/*!
+ * @brief Gets the address of a loopback alias
+ *
+ * @param[in] host Last octet of the address
+ *
+ * @returns 32-bit IPv4 address, in network byte order
+ */
+static uint32_t session_loopback_addr(unsigned long host);
+
+/*!
+ * @brief Makes a request to the emulated directory server
+ *
+ * @param[in,out] client Connected client
+ * @param[in] req Request to send
+ * @param[in] req_len Number of bytes in req
+ * @param[out] resp Summary of the response
+ *
+ * @returns 0 on success, negative ERRNO value on failure
+ */
+static int session_request(struct proxy_client_handle *client,
+			   const char *req, size_t req_len,
+			   struct session_response *resp);
+
+/*!
+ * @brief Sends a message with the given payload to the proxy
+ *
+ * @param[in,out] client Connected client
+ * @param[in] type Type of the message, should be one of ::PROXY_MSG_TYPE
+ * @param[in] addr Remote address the message is for
+ * @param[in] buff Payload of the message
+ * @param[in] len Number of bytes in buff
+ *
+ * @returns 0 on success, negative ERRNO value on failure
+ */
+static int session_send(struct proxy_client_handle *client, uint8_t type,
+			uint32_t addr, const uint8_t *buff, size_t len);
+
+/*!
+ * @brief Blocks the calling thread
+ *
+ * @param[in] msec Number of milliseconds to block for
+ */
+static void session_sleep(unsigned long msec);
+
+/*!
+ * @brief Talks to all of the emulated stations at once until they say goodbye
+ *
+ * @param[in,out] client Connected client
+ * @param[in,out] stations Emulated stations
+ * @param[in] params Parameters of the session
+ * @param[out] result Measurements to populate
+ *
+ * @returns 0 on success, negative ERRNO value on failure
+ *
+ * Lost packets are only considered a failure if session_params::report is
+ * zero, since sending as fast as possible is expected to overrun the socket
+ * buffers.
+ */
+static int session_stations(struct proxy_client_handle *client,
+			    struct emu_station_handle *stations,
+			    const struct session_params *params,
+			    struct session_result *result);
+
+/*!
+ * @brief Gets a monotonic time stamp
+ *
+ * @returns Time stamp in milliseconds
+ */
+static unsigned long session_time(void);
+
+/*!
+ * @brief Test full client sessions through the proxy
+ *
+ * @param[in] event_loop Event loop mode, should be one of ::PROXY_EVENT_LOOP
+ * @param[in] params Parameters of the session
+ *
+ * @returns 0 on success, negative ERRNO value on failure
+ *
+ * @test Test full client sessions through the proxy
+ */
+static int test_session(enum PROXY_EVENT_LOOP event_loop,
+			const struct session_params *params);
+
+/*!
+ * @brief Main entry point for full session tests
+ *
+ * @param[in] argc Number of arguments in argv
+ * @param[in] argv Optional number of stations, packets per station, interval
+ *                 between packets and directory entries, which also enables
+ *                 reporting how long each session took
+ *
+ * @returns 0 on success, non-zero value on failure
+ */
+int main(int argc, char *argv[]);
+
+int main(int argc, char *argv[])
+{
+	struct session_params params;
+	int ret = 0;
+
+	params.stations = 2;
+	params.packets = 25;
+	params.interval = EMU_RTP_INTERVAL;
+	params.directory_stations = 1000;
+	params.report = argc > 1;
+
+	if (argc > 1)
+		params.stations = strtoul(argv[1], NULL, 10);
+	if (argc > 2)
+		params.packets = strtoul(argv[2], NULL, 10);
+	if (argc > 3)
+		params.interval = strtoul(argv[3], NULL, 10);
+	if (argc > 4)
+		params.directory_stations = strtoul(argv[4], NULL, 10);
+
+	if (argc > 5 || params.stations < 1 ||
+	    params.stations > SESSION_STATIONS_MAX ||
+	    params.packets < 1 || params.packets > 0xFFFF) {
+		fprintf(stderr,
+			"Usage: %s [STATIONS [PACKETS [INTERVAL [DIRECTORY_STATIONS]]]]\n",
+			argv[0]);
+		return 1;
+	}
+
+	ret |= test_session(PROXY_EVENT_LOOP_OFF, &params);
+#ifdef HAVE_EPOLL
+	ret |= test_session(PROXY_EVENT_LOOP_SINGLE, &params);
+	ret |= test_session(PROXY_EVENT_LOOP_SHARDED, &params);
+#endif
+
+	return ret;
+}
+
+static void proxy_processor(struct worker_handle *wh)
+{
+	struct processor_context *ctx = wh->func_ctx;
+
+	ctx->ret = proxy_process(ctx->ph);
+}
+
+#ifdef HAVE_EPOLL
+static void proxy_processor_loop(struct worker_handle *wh)
+{
+	struct processor_context *ctx = wh->func_ctx;
+
+	do {
+		ctx->ret = proxy_process(ctx->ph);
+	} while (ctx->ret == 0);
+}
+#endif
+
+static int session_directory(struct proxy_client_handle *client,
+			     const struct session_params *params,
+			     struct session_result *result)
+{
+	static const char login[] =
+		"lKM0H\xac\xacPUBLIC\rONLINE3.40(00:00)\rOpenELP\r";
+	struct session_response resp;
+	unsigned long start;
+	int ret;
+
+	ret = session_request(client, login, sizeof(login) - 1, &resp);
+	if (ret < 0)
+		return ret;
+
+	if (resp.len != 2 || memcmp(resp.head, "OK", 2) != 0) {
+		fprintf(stderr, "Error: Directory server login failed\n");
+		return -EINVAL;
+	}
+
+	start = session_time();
+
+	ret = session_request(client, "s", 1, &resp);
+	if (ret < 0)
+		return ret;
+
+	result->elapsed_directory = session_time() - start;
+
+	if (resp.len < 7 || memcmp(resp.head, "@@@\n", 4) != 0 ||
+	    memcmp(resp.tail, "+++", 3) != 0 ||
+	    resp.lines != 2 + 4 * params->directory_stations) {
+		fprintf(stderr, "Error: Station list was corrupted\n");
+		return -EINVAL;
+	}
+
+	return 0;
+}
+
+static uint32_t session_loopback_addr(unsigned long host)
+{
+	uint8_t addr[4] = { 127, 0, 0, 0 };
+	uint32_t ret;
+
+	addr[3] = (uint8_t)host;
+
+	memcpy(&ret, addr, sizeof(ret));
+
+	return ret;
+}
+
+static int session_request(struct proxy_client_handle *client,
+			   const char *req, size_t req_len,
+			   struct session_response *resp)
+{
+	uint8_t buff[4096];
+	struct proxy_msg msg;
+	int32_t status;
+	size_t i;
+	int ret;
+
+	memset(resp, 0x0, sizeof(*resp));
+
+	ret = session_send(client, PROXY_MSG_TYPE_TCP_OPEN,
+			   session_loopback_addr(SESSION_DIRECTORY_HOST),
+			   NULL, 0);
+	if (ret < 0)
+		return ret;
+
+	ret = proxy_client_recv(client, &msg, buff, sizeof(buff));
+	if (ret < 0)
+		return ret;
+
+	memcpy(&status, buff, sizeof(status));
+	if (msg.type != PROXY_MSG_TYPE_TCP_STATUS ||
+	    msg.size != sizeof(status) || status != 0) {
+		fprintf(stderr,
+			"Error: Failed to connect to the directory server\n");
+		return -ECONNREFUSED;
+	}
+
+	ret = session_send(client, PROXY_MSG_TYPE_TCP_DATA, 0,
+			   (const uint8_t *)req, req_len);
+	if (ret < 0)
+		return ret;
+
+	/* The directory server closes the connection after each response */
+	while (1) {
+		ret = proxy_client_recv(client, &msg, buff, sizeof(buff));
+		if (ret < 0)
+			return ret;
+
+		if (msg.type == PROXY_MSG_TYPE_TCP_CLOSE)
+			return 0;
+
+		if (msg.type != PROXY_MSG_TYPE_TCP_DATA) {
+			fprintf(stderr,
+				"Error: Unexpected message type %u from the directory server\n",
+				(unsigned int)msg.type);
+			return -EINVAL;
+		}
+
+		for (i = 0; i < msg.size; i++, resp->len++) {
+			if (resp->len < sizeof(resp->head))
+				resp->head[resp->len] = (char)buff[i];
+
+			memmove(resp->tail, &resp->tail[1],
+				sizeof(resp->tail) - 1);
+			resp->tail[sizeof(resp->tail) - 1] = (char)buff[i];
+
+			if (buff[i] == '\n')
+				resp->lines++;
+		}
+	}
+}
+
+static int session_send(struct proxy_client_handle *client, uint8_t type,
+			uint32_t addr, const uint8_t *buff, size_t len)
+{
+	struct proxy_msg msg;
+
+	msg.type = type;
+	msg.address = addr;
+	msg.size = (uint32_t)len;
+
+	return proxy_client_send(client, &msg, buff);
+}
+
+static void session_sleep(unsigned long msec)
+{
+#ifdef _WIN32
+	Sleep(msec);
+#else
+	usleep(msec * 1000);
+#endif
+}
+
+static int session_stations(struct proxy_client_handle *client,
+			    struct emu_station_handle *stations,
+			    const struct session_params *params,
+			    struct session_result *result)
+{
+	unsigned long next_seq[SESSION_STATIONS_MAX] = { 0 };
+	unsigned long sent[SESSION_STATIONS_MAX] = { 0 };
+	uint8_t buff[4096];
+	uint8_t rtcp[EMU_RTCP_LEN_MAX];
+	uint8_t rtp[EMU_RTP_LEN];
+	struct emu_station_stats stats;
+	struct proxy_msg msg;
+	unsigned long byes = 0;
+	unsigned long rx = 0;
+	unsigned long start;
+	unsigned long last;
+	unsigned long idx;
+	unsigned long i;
+	uint32_t addr;
+	uint16_t seq;
+	size_t len;
+	int ret;
+
+	result->lost = 0;
+	result->lost_back = 0;
+
+	/* Introduce ourselves, and each station will start transmitting */
+	len = emu_rtcp_sdes(rtcp, SESSION_SSRC, "KM0H");
+	for (i = 0; i < params->stations; i++) {
+		addr = session_loopback_addr(SESSION_STATION_HOST + i);
+		ret = session_send(client, PROXY_MSG_TYPE_UDP_CONTROL, addr,
+				   rtcp, len);
+		if (ret < 0)
+			return ret;
+	}
+
+	start = session_time();
+	last = start;
+
+	/* Goodbyes are forwarded separately and may overtake the audio */
+	while (byes < params->stations ||
+	       rx + result->lost < params->stations * params->packets) {
+		ret = proxy_client_recv(client, &msg, buff, sizeof(buff));
+		if ((ret == -EAGAIN || ret == -ETIMEDOUT) &&
+		    byes == params->stations)
+			break;
+
+		if (ret < 0) {
+			fprintf(stderr,
+				"Error: Failed to receive from the stations after %lu packets and %lu goodbyes (%d): %s\n",
+				rx, byes, -ret, strerror(-ret));
+			return ret;
+		}
+
+		last = session_time();
+
+		for (idx = 0; idx < params->stations; idx++) {
+			addr = session_loopback_addr(SESSION_STATION_HOST + idx);
+			if (msg.address == addr)
+				break;
+		}
+
+		if (idx >= params->stations) {
+			fprintf(stderr,
+				"Error: Received message type %u from an unknown address\n",
+				(unsigned int)msg.type);
+			return -EINVAL;
+		}
+
+		switch (msg.type) {
+		case PROXY_MSG_TYPE_UDP_DATA:
+			ret = emu_rtp_parse(buff, msg.size, &seq);
+			if (ret < 0) {
+				fprintf(stderr,
+					"Error: Audio from station #%lu was corrupted\n",
+					idx);
+				return ret;
+			} else if (seq < next_seq[idx]) {
+				fprintf(stderr,
+					"Error: Audio packet #%u from station #%lu arrived out of order\n",
+					(unsigned int)seq, idx);
+				return -EINVAL;
+			}
+
+			result->lost += seq - next_seq[idx];
+			next_seq[idx] = seq + 1;
+			rx++;
+
+			/* Talk back to the station */
+			emu_rtp(rtp, SESSION_SSRC, seq);
+			ret = session_send(client, PROXY_MSG_TYPE_UDP_DATA,
+					   msg.address, rtp, sizeof(rtp));
+			if (ret < 0)
+				return ret;
+
+			sent[idx]++;
+
+			break;
+		case PROXY_MSG_TYPE_UDP_CONTROL:
+			if (emu_rtcp_parse(buff, msg.size) == EMU_RTCP_TYPE_BYE)
+				byes++;
+
+			break;
+		default:
+			fprintf(stderr,
+				"Error: Unexpected message type %u from station #%lu\n",
+				(unsigned int)msg.type, idx);
+			return -EINVAL;
+		}
+	}
+
+	result->elapsed_stations = last - start;
+
+	/* Packets at the end of a transmission are noticed last */
+	for (i = 0; i < params->stations; i++)
+		result->lost += params->packets - next_seq[i];
+
+	len = emu_rtcp_bye(rtcp, SESSION_SSRC);
+	for (i = 0; i < params->stations; i++) {
+		addr = session_loopback_addr(SESSION_STATION_HOST + i);
+		ret = session_send(client, PROXY_MSG_TYPE_UDP_CONTROL, addr,
+				   rtcp, len);
+		if (ret < 0)
+			return ret;
+	}
+
+	/* Wait for the stations to receive everything we sent them */
+	for (i = 0; i < params->stations; i++) {
+		start = session_time();
+
+		do {
+			emu_station_get_stats(&stations[i], &stats);
+			if (stats.rx_packets >= sent[i] && stats.byes > 0)
+				break;
+
+			session_sleep(10);
+		} while (session_time() - start < SESSION_TIMEOUT);
+
+		if (stats.byes != 1) {
+			fprintf(stderr,
+				"Error: Station #%lu received %lu goodbyes\n",
+				i, (unsigned long)stats.byes);
+			return -EINVAL;
+		}
+
+		result->lost_back += sent[i] - stats.rx_packets;
+	}
+
+	if (!params->report && (result->lost > 0 || result->lost_back > 0)) {
+		fprintf(stderr,
+			"Error: %lu packets from and %lu packets to the stations were lost\n",
+			result->lost, result->lost_back);
+		return -EINVAL;
+	}
+
+	return 0;
+}
+
+static unsigned long session_time(void)
+{
+#ifdef _WIN32
+	return GetTickCount();
+#else
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	return (unsigned long)now.tv_sec * 1000 + now.tv_nsec / 1000000;
+#endif
+}
+
+static int test_session(enum PROXY_EVENT_LOOP event_loop,
+			const struct session_params *params)
+{
+	static const char * const mode_names[] = {
+		"Threaded",
+		"Event loop",
+		"Sharded event loop",
+	};
+	struct emu_directory_handle directory = { 0 };
+	struct emu_station_handle stations[SESSION_STATIONS_MAX];
+	char directory_addr[16];
+	char station_addrs[SESSION_STATIONS_MAX][16];
+	char station_calls[SESSION_STATIONS_MAX][16];
+	struct proxy_client_handle client = { 0 };
+	struct proxy_handle proxy = { 0 };
+	struct worker_handle worker = { 0 };
+	struct processor_context ctx = { 0 };
+	struct session_result result = { 0 };
+	unsigned long i;
+	int ret;
+
+	memset(stations, 0x0, sizeof(stations));
+
+	/* Start the emulators */
+
+	sprintf(directory_addr, "127.0.0.%d", SESSION_DIRECTORY_HOST);
+
+	directory.addr = directory_addr;
+	directory.num_stations = params->directory_stations;
+	ret = emu_directory_init(&directory);
+	if (ret < 0)
+		goto test_session_exit;
+
+	ret = emu_directory_start(&directory);
+	if (ret == -EADDRNOTAVAIL) {
+		fprintf(stderr,
+			"Skipping full session test: loopback alias %s is not available\n",
+			directory_addr);
+		ret = 0;
+		goto test_session_exit;
+	} else if (ret < 0) {
+		fprintf(stderr,
+			"Error: Failed to start the directory server (%d): %s\n",
+			-ret, strerror(-ret));
+		goto test_session_exit;
+	}
+
+	for (i = 0; i < params->stations; i++) {
+		sprintf(station_addrs[i], "127.0.0.%lu",
+			SESSION_STATION_HOST + i);
+		sprintf(station_calls[i], "EMU%lu", i);
+
+		stations[i].addr = station_addrs[i];
+		stations[i].callsign = station_calls[i];
+		stations[i].packets = (uint32_t)params->packets;
+		stations[i].interval = (uint32_t)params->interval;
+		ret = emu_station_init(&stations[i]);
+		if (ret < 0)
+			goto test_session_exit;
+
+		ret = emu_station_start(&stations[i]);
+		if (ret < 0) {
+			fprintf(stderr,
+				"Error: Failed to start station at %s (%d): %s\n",
+				station_addrs[i], -ret, strerror(-ret));
+			goto test_session_exit;
+		}
+	}
+
+	/* Start the proxy server */
+
+	ctx.ph = &proxy;
+	ctx.ret = 0;
+#ifdef HAVE_EPOLL
+	worker.func_ptr = event_loop == PROXY_EVENT_LOOP_OFF ?
+			  proxy_processor : proxy_processor_loop;
+#else
+	worker.func_ptr = proxy_processor;
+#endif
+	worker.func_ctx = &ctx;
+	ret = worker_init(&worker);
+	if (ret < 0)
+		goto test_session_exit;
+
+	ret = proxy_init(&proxy);
+	if (ret < 0)
+		goto test_session_exit;
+
+	proxy_log_level(&proxy, LOG_LEVEL_WARN);
+
+	proxy.conf.bind_addr = strdup("127.0.0.1");
+	proxy.conf.bind_addr_ext = strdup("127.0.0.1");
+	proxy.conf.event_loop = event_loop;
+	proxy.conf.event_loop_threads = 2;
+	proxy.conf.password = strdup("PUBLIC");
+	proxy.conf.port = 8120;
+	ret = proxy_open(&proxy);
+	if (ret < 0)
+		goto test_session_exit;
+
+	ret = proxy_start(&proxy);
+	if (ret < 0)
+		goto test_session_exit;
+
+	ret = worker_start(&worker);
+	if (ret < 0)
+		goto test_session_exit;
+
+	ret = worker_wake(&worker);
+	if (ret < 0)
+		goto test_session_exit_late;
+
+	/* Connect and run the session */
+
+	client.callsign = "KM0H";
+	client.host_addr = "127.0.0.1";
+	client.host_port = "8120";
+	client.password = "PUBLIC";
+	ret = proxy_client_init(&client);
+	if (ret < 0)
+		goto test_session_exit_late;
+
+	ret = proxy_client_connect(&client);
+	if (ret < 0) {
+		fprintf(stderr, "Error: Failed to connect to the proxy (%d): %s\n",
+			-ret, strerror(-ret));
+		goto test_session_exit_late;
+	}
+
+	ret = proxy_client_set_timeout(&client, SESSION_TIMEOUT);
+	if (ret < 0)
+		goto test_session_exit_late;
+
+	ret = session_directory(&client, params, &result);
+	if (ret < 0)
+		goto test_session_exit_late;
+
+	ret = session_stations(&client, stations, params, &result);
+	if (ret < 0)
+		goto test_session_exit_late;
+
+	if (params->report) {
+		printf("%s: %lu station list entries in %lu ms\n",
+		       mode_names[event_loop], params->directory_stations,
+		       result.elapsed_directory);
+		printf("%s: %lu stations sent %lu packets each in %lu ms, losing %lu from and %lu to the stations\n",
+		       mode_names[event_loop], params->stations,
+		       params->packets, result.elapsed_stations, result.lost,
+		       result.lost_back);
+	}
+
+test_session_exit_late:
+	proxy_client_disconnect(&client);
+	proxy_shutdown(&proxy);
+	proxy_drop(&proxy);
+	worker_wait_idle(&worker);
+
+test_session_exit:
+	proxy_client_free(&client);
+	proxy_free(&proxy);
+	worker_free(&worker);
+
+	for (i = 0; i < params->stations; i++)
+		emu_station_free(&stations[i]);
+
+	emu_directory_free(&directory);
+
+	return ret;
+}
@@ -0,0 +1,557 @@
+/*!
+ * @file test_worker.c
+ *
+ * @copyright
+ * Copyright &copy; 2026, Scott K Logan
+ *
+ * @copyright
+ * All rights reserved.
+ *
+ * @copyright
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * @copyright
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * @copyright
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * @copyright
+ * EchoLink&reg; is a registered trademark of Synergenics, LLC
+ *
+ * @author Scott K Logan &lt;logans@cottsay.net&gt;
+ *
+ * @brief Tests and benchmark of the worker state machine
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#  include <windows.h>
+#else
+#  include <time.h>
+#  include <unistd.h>
+#endif
+
+#include "atomic.h"
+#include "worker.h"
+
+/*!
+ * @brief Shared state of a worker under test
+ */
+struct worker_data {
+	/*! Number of times the work function was called */
+	uint32_t runs;
+
+	/*! Timestamp taken by the work function when it last began */
+	unsigned long run_time;
+
+	/*! While non-zero, the work function spins instead of returning */
+	uint32_t spin;
+
+	/*! Non-zero once the work function has begun spinning */
+	uint32_t spinning;
+};
+
+/*!
+ * @brief Measures the latency from waking an idle worker to its work
+ *        beginning and the cost of waking a worker which is already busy
+ *
+ * @param[in] iterations Number of wakes to measure
+ *
+ * @returns 0 on success, negative ERRNO value on failure
+ */
+static int bench_wake(unsigned long iterations);
+
+/*!
+ * @brief Gets a monotonic timestamp
+ *
+ * @returns Timestamp in nanoseconds
+ */
+static unsigned long bench_time(void);
+
+/*!
+ * @brief Sleeps the calling thread
+ *
+ * @param[in] msec Time to sleep in milliseconds
+ */
+static void test_sleep(unsigned long msec);
+
+/*!
+ * @brief Test that a worker whose thread exited after being idle runs its
+ *        work when it is woken again
+ *
+ * @returns 0 on success, negative ERRNO value on failure
+ *
+ * @test Test that a worker whose thread exited after being idle runs its
+ *       work when it is woken again
+ */
+static int test_worker_idle_timeout(void);
+
+/*!
+ * @brief Test that a worker which is told to stop still performs work which
+ *        was signaled before
+ *
+ * @returns 0 on success, negative ERRNO value on failure
+ *
+ * @test Test that a worker which is told to stop still performs work which
+ *       was signaled before
+ */
+static int test_worker_join(void);
+
+/*!
+ * @brief Test that a worker with a periodic wake runs without being woken
+ *
+ * @returns 0 on success, negative ERRNO value on failure
+ *
+ * @test Test that a worker with a periodic wake runs without being woken
+ */
+static int test_worker_periodic(void);
+
+/*!
+ * @brief Test that waking a worker which is stopped fails
+ *
+ * @returns 0 on success, negative ERRNO value on failure
+ *
+ * @test Test that waking a worker which is stopped fails
+ */
+static int test_worker_stopped(void);
+
+/*!
+ * @brief Test that waking a busy worker runs its work again once it is done
+ *
+ * @returns 0 on success, negative ERRNO value on failure
+ *
+ * @test Test that waking a busy worker runs its work again once it is done
+ */
+static int test_worker_wake_busy(void);
+
+/*!
+ * @brief Test that waking an idle worker runs its work
+ *
+ * @returns 0 on success, negative ERRNO value on failure
+ *
+ * @test Test that waking an idle worker runs its work
+ */
+static int test_worker_wake_idle(void);
+
+/*!
+ * @brief Work function which counts its calls
+ *
+ * @param[in,out] wh Worker instance which is doing the work
+ */
+static void worker_data_func(struct worker_handle *wh);
+
+/*!
+ * @brief Initializes and starts a worker which calls ::worker_data_func
+ *
+ * @param[in,out] wh Worker instance to initialize
+ * @param[in,out] data Data shared with the work function
+ * @param[in] periodic_wake Maximum idle time in milliseconds, or 0 for none
+ * @param[in] idle_timeout Idle time in milliseconds after which the thread
+ *                         exits, or 0 for none
+ *
+ * @returns 0 on success, negative ERRNO value on failure
+ */
+static int worker_data_start(struct worker_handle *wh,
+			     struct worker_data *data, uint32_t periodic_wake,
+			     uint32_t idle_timeout);
+
+/*!
+ * @brief Main entry point for worker tests
+ *
+ * @param[in] argc Number of arguments in argv
+ * @param[in] argv Optional number of wakes, which runs the wake latency
+ *                 benchmark instead of the tests
+ *
+ * @returns 0 on success, non-zero value on failure
+ */
+int main(int argc, char *argv[]);
+
+int main(int argc, char *argv[])
+{
+	unsigned long iterations;
+	int ret = 0;
+
+	if (argc <= 1) {
+		ret |= test_worker_idle_timeout();
+		ret |= test_worker_join();
+		ret |= test_worker_periodic();
+		ret |= test_worker_stopped();
+		ret |= test_worker_wake_busy();
+		ret |= test_worker_wake_idle();
+
+		return ret;
+	}
+
+	iterations = strtoul(argv[1], NULL, 10);
+	if (argc > 2 || iterations < 1) {
+		fprintf(stderr, "Usage: %s [ITERATIONS]\n", argv[0]);
+		return 1;
+	}
+
+	return bench_wake(iterations) == 0 ? 0 : 1;
+}
+
+static int bench_wake(unsigned long iterations)
+{
+	struct worker_handle wh;
+	struct worker_data data;
+	unsigned long latency = 0;
+	unsigned long elapsed;
+	unsigned long start;
+	unsigned long i;
+	int ret;
+
+	ret = worker_data_start(&wh, &data, 0, 0);
+	if (ret < 0)
+		return ret;
+
+	/* Wake a worker which is parked, and time until its work begins */
+	for (i = 0; i < iterations; i++) {
+		ret = worker_wait_idle(&wh);
+		if (ret < 0)
+			goto bench_wake_exit;
+
+		start = bench_time();
+
+		ret = worker_wake(&wh);
+		if (ret < 0)
+			goto bench_wake_exit;
+
+		ret = worker_wait_idle(&wh);
+		if (ret < 0)
+			goto bench_wake_exit;
+
+		latency += data.run_time - start;
+
+		/* Give the worker time to park again */
+		test_sleep(1);
+	}
+
+	printf("Woke an idle worker %lu times, with %lu ns from wake to work on average\n",
+	       iterations, latency / iterations);
+
+	/* Wake a worker which is busy, which only needs to leave a signal */
+	atomic_store_u32(&data.spin, 1);
+
+	ret = worker_wake(&wh);
+	if (ret < 0)
+		goto bench_wake_exit;
+
+	while (atomic_load_u32(&data.spinning) == 0)
+		test_sleep(0);
+
+	start = bench_time();
+
+	for (i = 0; i < iterations; i++) {
+		ret = worker_wake(&wh);
+		if (ret < 0)
+			break;
+	}
+
+	elapsed = bench_time() - start;
+
+	atomic_store_u32(&data.spin, 0);
+
+	if (ret < 0)
+		goto bench_wake_exit;
+
+	printf("Woke a busy worker %lu times, in %lu ns each on average\n",
+	       iterations, elapsed / iterations);
+
+bench_wake_exit:
+	worker_free(&wh);
+
+	return ret;
+}
+
+static unsigned long bench_time(void)
+{
+#ifdef _WIN32
+	return GetTickCount() * 1000000UL;
+#else
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	return (unsigned long)now.tv_sec * 1000000000UL + now.tv_nsec;
+#endif
+}
+
+static void test_sleep(unsigned long msec)
+{
+#ifdef _WIN32
+	Sleep(msec);
+#else
+	usleep(msec * 1000);
+#endif
+}
+
+static int test_worker_idle_timeout(void)
+{
+	struct worker_handle wh;
+	struct worker_data data;
+	int i;
+	int ret;
+
+	ret = worker_data_start(&wh, &data, 0, 5);
+	if (ret < 0)
+		return ret;
+
+	for (i = 0; i < 3 && ret == 0; i++) {
+		ret = worker_wake(&wh);
+		if (ret == 0)
+			ret = worker_wait_idle(&wh);
+
+		/* Long enough for the thread to exit */
+		test_sleep(50);
+
+		if (ret == 0 && !worker_is_idle(&wh)) {
+			fprintf(stderr, "Error: Dormant worker is not idle\n");
+			ret = -EINVAL;
+		}
+	}
+
+	if (ret == 0 && atomic_load_u32(&data.runs) != 3) {
+		fprintf(stderr, "Error: Work ran %u times instead of 3\n",
+			atomic_load_u32(&data.runs));
+		ret = -EINVAL;
+	}
+
+	if (ret == 0)
+		ret = worker_join(&wh);
+
+	if (ret == 0 && worker_wake(&wh) != -EINVAL) {
+		fprintf(stderr, "Error: Woke a worker which was stopped\n");
+		ret = -EINVAL;
+	}
+
+	worker_free(&wh);
+
+	return ret;
+}
+
+static int test_worker_join(void)
+{
+	struct worker_handle wh;
+	struct worker_data data;
+	int ret;
+
+	ret = worker_data_start(&wh, &data, 0, 0);
+	if (ret < 0)
+		return ret;
+
+	ret = worker_wake(&wh);
+	if (ret == 0)
+		ret = worker_join(&wh);
+
+	if (ret == 0 && atomic_load_u32(&data.runs) != 1) {
+		fprintf(stderr, "Error: Signaled work was not performed\n");
+		ret = -EINVAL;
+	}
+
+	if (ret == 0 && worker_wait_idle(&wh) != -EINVAL) {
+		fprintf(stderr, "Error: Stopped worker became idle\n");
+		ret = -EINVAL;
+	}
+
+	worker_free(&wh);
+
+	return ret;
+}
+
+static int test_worker_periodic(void)
+{
+	struct worker_handle wh;
+	struct worker_data data;
+	int i;
+	int ret;
+
+	ret = worker_data_start(&wh, &data, 5, 0);
+	if (ret < 0)
+		return ret;
+
+	for (i = 0; i < 200 && atomic_load_u32(&data.runs) < 3; i++)
+		test_sleep(10);
+
+	if (atomic_load_u32(&data.runs) < 3) {
+		fprintf(stderr, "Error: Periodic work ran %u times\n",
+			atomic_load_u32(&data.runs));
+		ret = -EINVAL;
+	}
+
+	worker_free(&wh);
+
+	return ret;
+}
+
+static int test_worker_stopped(void)
+{
+	struct worker_handle wh;
+	struct worker_data data;
+	int ret;
+
+	memset(&wh, 0x0, sizeof(wh));
+	memset(&data, 0x0, sizeof(data));
+	wh.func_ptr = worker_data_func;
+	wh.func_ctx = &data;
+
+	ret = worker_init(&wh);
+	if (ret < 0)
+		return ret;
+
+	if (worker_wake(&wh) != -EINVAL) {
+		fprintf(stderr, "Error: Woke a worker which was never started\n");
+		ret = -EINVAL;
+	} else if (worker_is_idle(&wh)) {
+		fprintf(stderr, "Error: Worker which was never started is idle\n");
+		ret = -EINVAL;
+	}
+
+	worker_free(&wh);
+
+	return ret;
+}
+
+static int test_worker_wake_busy(void)
+{
+	struct worker_handle wh;
+	struct worker_data data;
+	int ret;
+
+	ret = worker_data_start(&wh, &data, 0, 0);
+	if (ret < 0)
+		return ret;
+
+	atomic_store_u32(&data.spin, 1);
+
+	ret = worker_wake(&wh);
+	if (ret < 0)
+		goto test_worker_wake_busy_exit;
+
+	while (atomic_load_u32(&data.spinning) == 0)
+		test_sleep(1);
+
+	/* Several wakes while busy collapse into one more run */
+	ret = worker_wake(&wh);
+	if (ret == 0)
+		ret = worker_wake(&wh);
+
+	atomic_store_u32(&data.spin, 0);
+
+	if (ret == 0)
+		ret = worker_wait_idle(&wh);
+
+	if (ret == 0 && atomic_load_u32(&data.runs) != 2) {
+		fprintf(stderr, "Error: Work ran %u times instead of 2\n",
+			atomic_load_u32(&data.runs));
+		ret = -EINVAL;
+	}
+
+test_worker_wake_busy_exit:
+	worker_free(&wh);
+
+	return ret;
+}
+
+static int test_worker_wake_idle(void)
+{
+	struct worker_handle wh;
+	struct worker_data data;
+	int i;
+	int ret;
+
+	ret = worker_data_start(&wh, &data, 0, 0);
+	if (ret < 0)
+		return ret;
+
+	for (i = 0; i < 100; i++) {
+		ret = worker_wait_idle(&wh);
+		if (ret == 0)
+			ret = worker_wake(&wh);
+		if (ret == 0)
+			ret = worker_wait_idle(&wh);
+		if (ret < 0)
+			break;
+
+		if (!worker_is_idle(&wh)) {
+			fprintf(stderr, "Error: Worker is not idle\n");
+			ret = -EINVAL;
+			break;
+		}
+	}
+
+	if (ret == 0 && atomic_load_u32(&data.runs) != 100) {
+		fprintf(stderr, "Error: Work ran %u times instead of 100\n",
+			atomic_load_u32(&data.runs));
+		ret = -EINVAL;
+	}
+
+	worker_free(&wh);
+
+	return ret;
+}
+
+static void worker_data_func(struct worker_handle *wh)
+{
+	struct worker_data *data = wh->func_ctx;
+
+	data->run_time = bench_time();
+
+	atomic_add_u32(&data->runs, 1);
+
+	if (atomic_load_u32(&data->spin) != 0) {
+		atomic_store_u32(&data->spinning, 1);
+
+		while (atomic_load_u32(&data->spin) != 0)
+			;
+	}
+}
+
+static int worker_data_start(struct worker_handle *wh,
+			     struct worker_data *data, uint32_t periodic_wake,
+			     uint32_t idle_timeout)
+{
+	int ret;
+
+	memset(wh, 0x0, sizeof(*wh));
+	memset(data, 0x0, sizeof(*data));
+	wh->func_ptr = worker_data_func;
+	wh->func_ctx = data;
+	wh->periodic_wake = periodic_wake;
+	wh->idle_timeout = idle_timeout;
+
+	ret = worker_init(wh);
+	if (ret < 0)
+		return ret;
+
+	ret = worker_start(wh);
+	if (ret < 0)
+		worker_free(wh);
+
+	return ret;
+}